@@ -112,6 +112,9 @@ static struct
 /* Rom. */
 static GBC_Rom _rom;
 
+/* Màquina. */
+static GBC_Machine *_gbc;
+
 /* Tracer. */
 static struct
 {
@@ -133,9 +136,6 @@ static struct
   
 } _screen;
 
-/* Paleta de colors. */
-static uint32_t _palette[32768];
-
 /* RAM externa. */
 static struct
 {
@@ -216,28 +216,6 @@ init_GL (void)
 } /* end init_GL */
 
 
-static void
-init_palette (void)
-{
-  
-  uint32_t color;
-  double frac;
-  int i;
-  
-  
-  frac= 255.0/31.0;
-  color= 0;
-  for ( i= 0; i < 32768; ++i )
-    {
-      ((uint8_t *) &color)[0]= (uint8_t) ((i&0x1F)*frac+0.5);
-      ((uint8_t *) &color)[1]= (uint8_t) (((i>>5)&0x1F)*frac+0.5);
-      ((uint8_t *) &color)[2]= (uint8_t) (((i>>10)&0x1F)*frac+0.5);
-      _palette[i]= color;
-    }
-  
-} /* end init_palette */
-
-
 static void
 screen_update (void)
 {
@@ -437,16 +415,21 @@ get_external_ram (
 
 static void
 update_screen (
-               const int  fb[23040],
-               void      *udata
+               const void             *fb,
+               const GBC_FrameChanges *changes,
+               void                   *udata
                )
 {
   
-  int i;
+  int y;
   
   
-  for ( i= 0; i < 23040; ++i )
-    _screen.data[i]= _palette[fb[i]];
+  if ( changes->identical ) return;
+  for ( y= 0; y < HEIGHT; ++y )
+    if ( GBC_FRAME_LINE_DIRTY ( changes, y ) )
+      memcpy ( &(_screen.data[y*WIDTH]),
+               ((const uint32_t *) fb) + y*WIDTH,
+               WIDTH*sizeof(uint32_t) );
   screen_update ();
   
 } /* end update_screen */
@@ -706,6 +689,7 @@ GBC_close (
   SDL_Quit ();
   if ( _rom.banks != NULL ) GBC_rom_free ( _rom );
   if ( _eram.ram != NULL ) free ( _eram.ram );
+  GBC_machine_free ( _gbc );
   _initialized= FALSE;
   Py_XDECREF ( _tracer.obj );
   
@@ -724,7 +708,7 @@ GBC_get_bank1 (
   CHECK_INITIALIZED;
   CHECK_ROM;
   
-  return PyLong_FromLong ( GBC_mapper_get_bank1 () );
+  return PyLong_FromLong ( GBC_mapper_get_bank1 ( _gbc ) );
   
 } /* end GBC_get_bank1 */
 
@@ -746,7 +730,7 @@ GBC_get_cpal (
   CHECK_INITIALIZED;
   CHECK_ROM;
   
-  GBC_lcd_get_cpal ( bg, ob );
+  GBC_lcd_get_cpal ( _gbc, bg, ob );
   dict= PyDict_New ();
   if ( dict == NULL ) return NULL;
   
@@ -807,7 +791,7 @@ GBC_get_vram (
   CHECK_INITIALIZED;
   CHECK_ROM;
   
-  vram= GBC_lcd_get_vram ();
+  vram= GBC_lcd_get_vram ( _gbc );
   ret= PyTuple_New ( 2 );
   if ( ret == NULL ) goto error;
   aux= PyBytes_FromStringAndSize ( (const char *) vram, 8192 );
@@ -1044,7 +1028,6 @@ GBC_init_module (
       return NULL;
     }
   init_GL ();
-  init_palette ();
   screen_clear ();
   SDL_WM_SetCaption ( "GBC", "GBC" );
   if ( (err= init_audio ()) != NULL )
@@ -1054,6 +1037,15 @@ GBC_init_module (
       return NULL; 
     }
   
+  /* Màquina. */
+  _gbc= GBC_machine_new ();
+  if ( _gbc == NULL )
+    {
+      close_audio ();
+      SDL_Quit ();
+      return PyErr_NoMemory ();
+    }
+  
   /* ROM */
   _rom.banks= NULL;
   
@@ -1079,7 +1071,7 @@ GBC_is_bios_mapped (
   
   CHECK_INITIALIZED;
   
-  return PyBool_FromLong ( GBC_mem_is_bios_mapped () );
+  return PyBool_FromLong ( GBC_mem_is_bios_mapped ( _gbc ) );
   
 } /* end GBC_is_bios_mapped */
 
@@ -1099,7 +1091,7 @@ GBC_loop_module (
   
   for ( n= 0; n < NBUFF; ++n ) _audio.buffers[n].full= 0;
   SDL_PauseAudio ( 0 );
-  GBC_loop ();
+  GBC_loop ( _gbc );
   SDL_PauseAudio ( 1 );
   
   Py_RETURN_NONE;
@@ -1129,7 +1121,8 @@ GBC_set_rom (
       check_buttons,
       play_sound,
       update_rumble,
-      &trace_callbacks
+      &trace_callbacks,
+      GBC_FB_RGBA8888
     };
   
   PyObject *bytes;
@@ -1160,7 +1153,8 @@ GBC_set_rom (
   /* Inicialitza el simulador. */
   screen_clear ();
   _control= 0;
-  err= GBC_init ( _bios.active?_bios.data:NULL, &_rom, &frontend, NULL );
+  err= GBC_init ( _gbc, _bios.active?_bios.data:NULL,
+        	  &_rom, &frontend, NULL );
   if ( err != GBC_NOERROR )
     {
       switch ( err )
@@ -1236,7 +1230,7 @@ GBC_trace_module (
   CHECK_ROM;
   
   SDL_PauseAudio ( 0 );
-  cc= GBC_trace ();
+  cc= GBC_trace ( _gbc );
   SDL_PauseAudio ( 1 );
   if ( PyErr_Occurred () != NULL ) return NULL;
   
@@ -1245,6 +1239,102 @@ GBC_trace_module (
 } /* end GBC_trace_module */
 
 
+static PyObject *
+GBC_view_map (
+              PyObject *self,
+              PyObject *args
+              )
+{
+  
+  static GBCu8 img[GBC_LCD_VIEW_MAP_WIDTH*GBC_LCD_VIEW_MAP_HEIGHT*4];
+  
+  int map;
+  
+  
+  CHECK_INITIALIZED;
+  CHECK_ROM;
+  if ( !PyArg_ParseTuple ( args, "i", &map ) )
+    return NULL;
+  if ( GBC_lcd_view_map ( _gbc, map, img,
+        		  GBC_LCD_VIEW_MAP_WIDTH*4 ) != 0 )
+    {
+      PyErr_SetString ( GBCError, "Invalid tile map" );
+      return NULL;
+    }
+  
+  return PyBytes_FromStringAndSize ( (const char *) img, sizeof(img) );
+  
+} /* end GBC_view_map */
+
+
+static PyObject *
+GBC_view_oam (
+              PyObject *self,
+              PyObject *args
+              )
+{
+  
+  static GBCu8 img[GBC_LCD_VIEW_OAM_WIDTH*GBC_LCD_VIEW_OAM_HEIGHT*4];
+  
+  
+  CHECK_INITIALIZED;
+  CHECK_ROM;
+  GBC_lcd_view_oam ( _gbc, img, GBC_LCD_VIEW_OAM_WIDTH*4 );
+  
+  return PyBytes_FromStringAndSize ( (const char *) img, sizeof(img) );
+  
+} /* end GBC_view_oam */
+
+
+static PyObject *
+GBC_view_palettes (
+        	   PyObject *self,
+        	   PyObject *args
+        	   )
+{
+  
+  static GBCu8
+    img[GBC_LCD_VIEW_PALETTES_WIDTH*GBC_LCD_VIEW_PALETTES_HEIGHT*4];
+  
+  
+  CHECK_INITIALIZED;
+  CHECK_ROM;
+  GBC_lcd_view_palettes ( _gbc, img, GBC_LCD_VIEW_PALETTES_WIDTH*4 );
+  
+  return PyBytes_FromStringAndSize ( (const char *) img, sizeof(img) );
+  
+} /* end GBC_view_palettes */
+
+
+static PyObject *
+GBC_view_tiles (
+        	PyObject *self,
+        	PyObject *args
+        	)
+{
+  
+  static GBCu8 img[GBC_LCD_VIEW_TILES_WIDTH*GBC_LCD_VIEW_TILES_HEIGHT*4];
+  
+  int bank, pal;
+  
+  
+  CHECK_INITIALIZED;
+  CHECK_ROM;
+  pal= -1;
+  if ( !PyArg_ParseTuple ( args, "i|i", &bank, &pal ) )
+    return NULL;
+  if ( GBC_lcd_view_tiles ( _gbc, bank, pal, img,
+        		    GBC_LCD_VIEW_TILES_WIDTH*4 ) != 0 )
+    {
+      PyErr_SetString ( GBCError, "Invalid bank or palette" );
+      return NULL;
+    }
+  
+  return PyBytes_FromStringAndSize ( (const char *) img, sizeof(img) );
+  
+} /* end GBC_view_tiles */
+
+
 
 
 /************************/
@@ -1290,6 +1380,17 @@ static PyMethodDef GBCMethods[]=
       "is passed as arguments" },
     { "trace", GBC_trace_module, METH_VARARGS,
       "Executes the next instruction or interruption in trace mode" },
+    { "view_map", GBC_view_map, METH_VARARGS,
+      "Render the tile map (0 or 1) into 256x256 RGBA bytes" },
+    { "view_oam", GBC_view_oam, METH_VARARGS,
+      "Render the 40 sprites into 64x80 RGBA bytes (8x5 cells of 8x16)" },
+    { "view_palettes", GBC_view_palettes, METH_VARARGS,
+      "Render the 8 BG and 8 OBJ palettes into 64x64 RGBA bytes"
+      " (one palette per row, 8x8 swatches)" },
+    { "view_tiles", GBC_view_tiles, METH_VARARGS,
+      "Render the 384 tiles of a VRAM bank into 128x192 RGBA bytes."
+      " Optionally a color palette ([0,7] BG, [8,15] OBJ) can be"
+      " specified" },
     { NULL, NULL, 0, NULL }
   };
 
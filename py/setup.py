@@ -5,15 +5,17 @@ module= Extension ( 'GBC',
                                '../src/apu.c',
                                '../src/cpu.c',
                                '../src/cpu_dis.c',
+                               '../src/cpu_trace.c',
                                '../src/joypad.c',
                                '../src/lcd.c',
+                               '../src/lcd_simd.c',
                                '../src/main.c',
                                '../src/mem.c',
                                '../src/rom.c',
                                '../src/mapper.c',
                                '../src/timers.c' ],
-                    depends= [ '../src/GBC.h' ],
-                    libraries= [ 'SDL', 'GL' ],
+                    depends= [ '../src/GBC.h', '../src/machine.h' ],
+                    libraries= [ 'SDL', 'GL', 'm' ],
                     include_dirs= [ '../src' ])
 
 setup ( name= 'GBC',
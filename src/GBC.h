@@ -51,6 +51,14 @@ typedef unsigned char GBCu8;
 typedef signed short GBCs16;
 typedef unsigned short GBCu16;
 typedef unsigned int GBCu32;
+typedef unsigned long long GBCu64;
+
+/* Màquina. Conté tot l'estat d'un simulador. Totes les funcions que
+ * depenen de l'estat reben com a primer argument la màquina sobre la
+ * que treballen, de manera que es poden tindre diverses màquines
+ * independents en el mateix procés. Es crea amb 'GBC_machine_new'.
+ */
+typedef struct GBC_Machine GBC_Machine;
 
 /* Funció per a metre avísos. */
 typedef void 
@@ -67,7 +75,10 @@ typedef enum
     GBC_WRONGLOGO,       /* La ROM no ha passat el test del logotip. */
     GBC_WRONGCHKS,       /* La ROM no ha passat el test del checksum. */
     GBC_WRONGRAMSIZE,    /* La grandària de la RAM no està suportada. */
-    GBC_WRONGROMSIZE     /* La grandària de la ROM no està suportada. */
+    GBC_WRONGROMSIZE,    /* La grandària de la ROM no està suportada. */
+    GBC_ENOMEM,          /* No s'ha pogut reservar memòria. */
+    GBC_ETIMEOUT         /* S'ha superat el límit de cicles sense
+        		    completar els frames demanats. */
   } GBC_Error;
 
 
@@ -270,16 +281,22 @@ typedef void (GBC_MapperChanged) (
         			  );
 
 /* Procesa cicles de la UCP. */
-extern void
-(*GBC_mapper_clock) (const int cc);
+void
+GBC_mapper_clock (
+        	  GBC_Machine *m,
+        	  const int    cc
+        	  );
 
 /* Torna el número de banc mapejat en el banc 1. */
-extern int
-(*GBC_mapper_get_bank1) (void);
+int
+GBC_mapper_get_bank1 (
+        	      GBC_Machine *m
+        	      );
 
 /* Inicialitza el mapper. */
 GBC_Error
 GBC_mapper_init (
+        	 GBC_Machine        *m,
         	 const GBC_Rom      *rom,
         	 const GBC_Bool      check_rom,
         	 GBC_GetExternalRAM *get_external_ram,
@@ -290,49 +307,57 @@ GBC_mapper_init (
 
 /* Com init, però sense fixar altra vegada els callback i la rom. */
 GBC_Error
-GBC_mapper_init_state (void);
+GBC_mapper_init_state (
+                       GBC_Machine *m
+                       );
 
 /* Llig un byte de la ROM. L'adreça ha d'estar en el rang
  * [0000-7FFF].
  */
-extern GBCu8
-(*GBC_mapper_read) (
-        	    const GBCu16 addr    /* Adreça. */
-        	    );
+GBCu8
+GBC_mapper_read (
+        	 GBC_Machine  *m,
+        	 const GBCu16  addr    /* Adreça. */
+        	 );
 
 /* Llig un byte de la RAM. L'adreça ha d'estar en el rang
  * [0000-1FFF].
  */
-extern GBCu8
-(*GBC_mapper_read_ram) (
-        		const GBCu16 addr    /* Adreça. */
-        		);
+GBCu8
+GBC_mapper_read_ram (
+        	     GBC_Machine  *m,
+        	     const GBCu16  addr    /* Adreça. */
+        	     );
 
 /* Escriu un byte en la ROM. L'adreça ha d'estar en el rang
  * [0000-7FFF].
  */
-extern void
-(*GBC_mapper_write) (
-        	     const GBCu16 addr,    /* Adreça. */
-        	     const GBCu8  data     /* Dades. */
-        	     );
+void
+GBC_mapper_write (
+        	  GBC_Machine  *m,
+        	  const GBCu16  addr,    /* Adreça. */
+        	  const GBCu8   data     /* Dades. */
+        	  );
 
 /* Escriu un byte en la RAM. L'adreça ha d'estar en el rang
  * [0000-1FFF].
  */
-extern void
-(*GBC_mapper_write_ram) (
-        		 const GBCu16 addr,    /* Adreça. */
-        		 const GBCu8  data     /* Dades. */
-        		 );
+void
+GBC_mapper_write_ram (
+        	      GBC_Machine  *m,
+        	      const GBCu16  addr,    /* Adreça. */
+        	      const GBCu8   data     /* Dades. */
+        	      );
 
 int
 GBC_mapper_save_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       );
 
 int
 GBC_mapper_load_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       );
 
@@ -370,47 +395,137 @@ typedef void (GBC_MemAccess) (
 /* Inicialitza el mapa de memòria. Per defecte en mode CGB. */
 void
 GBC_mem_init (
+              GBC_Machine    *m,
               const GBCu8     bios[0x900],    /* Pot ser NULL, els
         					 valors [0x100,0x1FF]
         					 no s'utilitzen. */
+              GBC_Warning    *warning,        /* Pot ser NULL. */
               GBC_MemAccess  *mem_access,     /* Pot ser NULL. */
               void           *udata
               );
 
 /* Com init, però sense fixar altra vegada els callback i la bios. */
 void
-GBC_mem_init_state (void);
+GBC_mem_init_state (
+                    GBC_Machine *m
+                    );
+
+/* Torna el banc mapejat en ADDR si el codi d'eixa adreça es pot
+ * guardar en la cache de blocs de la UCP (ROM, WRAM i HRAM), -1 en
+ * cas contrari.
+ */
+int
+GBC_mem_get_code_bank (
+        	       GBC_Machine  *m,
+        	       const GBCu16  addr
+        	       );
+
+/* Copia en READS i WRITES el nombre de lectures i escriptures en
+ * cada port d'E/S no implementat (0xFF00+i) des de 'GBC_init'. El
+ * primer accés a cada port s'avisa amb 'GBC_Warning'.
+ */
+void
+GBC_mem_get_io_unmapped (
+        		 GBC_Machine *m,
+        		 GBCu32       reads[128],
+        		 GBCu32       writes[128]
+        		 );
 
 /* Indica si la BIOS està mapejada o no. */
 GBC_Bool
-GBC_mem_is_bios_mapped (void);
+GBC_mem_is_bios_mapped (
+                        GBC_Machine *m
+                        );
+
+/* Marca NBYTES bytes de RAM a partir de ADDR (banc BANK) com a codi
+ * d'un bloc de la UCP. Cada byte compta quants blocs el contenen
+ * (amb 255 es queda fix). Escriure en un byte marcat invalida els
+ * blocs.
+ */
+void
+GBC_mem_mark_code (
+        	   GBC_Machine  *m,
+        	   const GBCu16  addr,
+        	   const int     bank,
+        	   const int     nbytes
+        	   );
+
+/* Desfà 'GBC_mem_mark_code' quan un bloc s'invalida o es
+ * reemplaça. Els comptadors a 0 o a 255 no canvien.
+ */
+void
+GBC_mem_unmark_code (
+        	     GBC_Machine  *m,
+        	     const GBCu16  addr,
+        	     const int     bank,
+        	     const int     nbytes
+        	     );
+
+/* Indica els bancs de ROM mapejats en 0x0000 i 0x4000. El mapper
+ * l'ha de cridar cada vegada que canvia de banc.
+ */
+void
+GBC_mem_map_rom (
+        	 GBC_Machine *m,
+        	 const GBCu8 *rom0,
+        	 const GBCu8 *rom1
+        	 );
+
+/* Indica el banc de VRAM seleccionat. */
+void
+GBC_mem_map_vram (
+        	  GBC_Machine *m,
+        	  const GBCu8 *vram
+        	  );
 
 /* Llig un byte de l'adreça especificada. */
 GBCu8
 GBC_mem_read (
+              GBC_Machine *m,
               const GBCu16 addr    /* Adreça. */
               );
 
+/* Com 'GBC_mem_read' però sense cridar mai al callback de traça. És
+ * el que utilitza la UCP fora de 'GBC_trace'.
+ */
+GBCu8
+GBC_mem_read_plain (
+        	    GBC_Machine  *m,
+        	    const GBCu16  addr
+        	    );
+
 /* Activa/Desactiva el mode traça en el mòdul de memòria. */
 void
 GBC_mem_set_mode_trace (
+        		GBC_Machine   *m,
         		const GBC_Bool val
         		);
 
 /* Escriu un byte en l'adreça especificada. */
 void
 GBC_mem_write (
+               GBC_Machine *m,
                const GBCu16 addr,    /* Adreça. */
                const GBCu8  data     /* Dades. */
                );
 
+/* Com 'GBC_mem_write' però sense cridar mai al callback de traça. */
+void
+GBC_mem_write_plain (
+        	     GBC_Machine  *m,
+        	     const GBCu16  addr,
+        	     const GBCu8   data
+        	     );
+
 int
 GBC_mem_save_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    );
 
 int
 GBC_mem_load_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    );
 
@@ -613,6 +728,7 @@ typedef struct
 /* Descodifica la instrucció de l'adreça indicada. */
 GBCu16
 GBC_cpu_decode (
+        	GBC_Machine *m,
         	GBCu16    addr,
         	GBC_Inst *inst
         	);
@@ -622,97 +738,263 @@ GBC_cpu_decode (
  */
 GBCu16
 GBC_cpu_decode_next_step (
+        		  GBC_Machine *m,
         		  GBC_Step *step
         		  );
 
 /* Inicialitza el mòdul. */
 void
 GBC_cpu_init (
+              GBC_Machine *m,
               GBC_Warning *warning,     /* Funció per als avisos. */
               void        *udata        /* Dades de l'usuari. */
               );
 
 /* Com init, però sense fixar altra vegada els callback. */
 void
-GBC_cpu_init_state (void);
+GBC_cpu_init_state (
+                    GBC_Machine *m
+                    );
 
 /* Fica la UCP en l'estat després de la seqüència d'encés. */
 void
-GBC_cpu_power_up (void);
+GBC_cpu_power_up (
+                  GBC_Machine *m
+                  );
 
 /* Torna el contingut del registre IE. IE és el registre que habilitat
  * i deshabilita interrupcions.
  */
 GBCu8
-GBC_cpu_read_IE (void);
+GBC_cpu_read_IE (
+                 GBC_Machine *m
+                 );
 
 /* Torna el contingut del registre IF. IF és el registre amb les
  * peticions d'interrupció.
  */
 GBCu8
-GBC_cpu_read_IF (void);
+GBC_cpu_read_IF (
+                 GBC_Machine *m
+                 );
 
 /* Petició d'interrupció V-Blank. */
 void
-GBC_cpu_request_vblank_int (void);
+GBC_cpu_request_vblank_int (
+                            GBC_Machine *m
+                            );
 
 /* Petició d'interrupció LCD STAT. */
 void
-GBC_cpu_request_lcdstat_int (void);
+GBC_cpu_request_lcdstat_int (
+                             GBC_Machine *m
+                             );
 
 /* Petició d'interrupció Timer. */
 void
-GBC_cpu_request_timer_int (void);
+GBC_cpu_request_timer_int (
+                           GBC_Machine *m
+                           );
 
 /* Petició d'interrupció Serial. */
 void
-GBC_cpu_request_serial_int (void);
+GBC_cpu_request_serial_int (
+                            GBC_Machine *m
+                            );
 
 /* Petició d'interrupció Joypad. */
 void
-GBC_cpu_request_joypad_int (void);
+GBC_cpu_request_joypad_int (
+                            GBC_Machine *m
+                            );
 
 /* Executa la següent instrucció o interrupció. Torna el número de
  * cicles.
  */
 int
-GBC_cpu_run (void);
+GBC_cpu_run (
+             GBC_Machine *m
+             );
+
+/* Com 'GBC_cpu_run' però amb la variant de la UCP compilada en
+ * 'cpu_trace.c', on tots els accessos a memòria passen per
+ * 'GBC_mem_read' i 'GBC_mem_write' i per tant pel callback de traça.
+ */
+int
+GBC_cpu_run_trace (
+        	   GBC_Machine *m
+        	   );
+
+/* Executa instruccions i interrupcions fins consumir almenys BUDGET
+ * cicles de UCP o fins que es cride a 'GBC_cpu_stop_run'. Sempre
+ * executa almenys una instrucció. Torna els cicles consumits.
+ */
+int
+GBC_cpu_run_cycles (
+        	    GBC_Machine *m,
+        	    const int    budget
+        	    );
+
+/* Torna els cicles consumits per 'GBC_cpu_run_cycles' abans de la
+ * instrucció que s'està executant.
+ */
+int
+GBC_cpu_get_run_cycles (
+        		GBC_Machine *m
+        		);
+
+/* Indica si la UCP està parada per HALT esperant una interrupció. */
+GBC_Bool
+GBC_cpu_is_halted (
+        	   GBC_Machine *m
+        	   );
+
+/* Fa que 'GBC_cpu_run_cycles' torne en acabar la instrucció actual. */
+void
+GBC_cpu_stop_run (
+        	  GBC_Machine *m
+        	  );
+
+/* Invalida els blocs descodificats que contenen l'adreça ADDR del
+ * banc BANK. La crida el mòdul de memòria quan s'escriu en codi.
+ */
+void
+GBC_cpu_code_written (
+        	      GBC_Machine  *m,
+        	      const GBCu16  addr,
+        	      const int     bank
+        	      );
+
+/* Modes del compilador dinàmic. Sols els blocs de la ROM que
+ * s'executen sovint es tradueixen a codi x86-64; el codi de la RAM
+ * (que pot modificar-se a si mateix) sempre l'executa l'intèrpret.
+ */
+typedef enum
+  {
+    GBC_JIT_OFF= 0,    /* Sols intèrpret. */
+    GBC_JIT_ON,        /* Executa els blocs traduïts en codi natiu. */
+    GBC_JIT_SHADOW     /* Tradueix els mateixos blocs que GBC_JIT_ON
+        		  però els executa amb l'intèrpret. Serveix de
+        		  referència per a comparar els dos modes. */
+  } GBC_JitMode;
+
+/* Registres de la UCP. F està en el format intern. */
+typedef struct
+{
+
+  GBCu16   PC;
+  GBCu16   SP;
+  GBCu8    A, F, B, C, D, E, H, L;
+  GBCu8    IE, IF;
+  GBC_Bool IME;
+  int      cc;           /* Cicles consumits en el lot actual. */
+
+} GBC_CPURegs;
+
+/* Tipus de la funció que es crida després d'executar cada bloc que
+ * s'executa (o s'executaria) en codi natiu. BANK és el banc de la ROM
+ * del bloc que comença en ADDR.
+ */
+typedef void (GBC_JitBlockHook) (
+        			 const GBCu16       addr,
+        			 const int          bank,
+        			 const GBC_CPURegs *regs,
+        			 void              *udata
+        			 );
+
+/* Indica si el compilador dinàmic està disponible en aquesta
+ * compilació (x86-64 amb 'mmap').
+ */
+GBC_Bool
+GBC_cpu_jit_available (void);
+
+/* Canvia el mode del compilador dinàmic. Torna 0 si tot ha anat bé o
+ * -1 si no està disponible, no s'ha pogut reservar memòria o el
+ * sistema no permet fer-la executable. GBC_JIT_OFF allibera la
+ * memòria.
+ */
+int
+GBC_cpu_set_jit (
+        	 GBC_Machine       *m,
+        	 const GBC_JitMode  mode
+        	 );
+
+/* Fixa una funció (o NULL) per a observar els blocs traduïts. */
+void
+GBC_cpu_set_jit_hook (
+        	      GBC_Machine      *m,
+        	      GBC_JitBlockHook *hook,
+        	      void             *udata
+        	      );
+
+/* Copia en REGS l'estat dels registres. */
+void
+GBC_cpu_get_regs (
+        	  GBC_Machine *m,
+        	  GBC_CPURegs *regs
+        	  );
+
+/* Activa/Desactiva el bot dels bucles d'espera (per defecte activat).
+ * Un bucle d'espera és un bloc curt que sols llig LY, STAT, IF, DIV o
+ * TIMA, comprova el valor i torna a començar. Mentre el valor no pot
+ * canviar les voltes es boten avançant el temps. Sols té efecte amb
+ * la memòria cau de blocs.
+ */
+void
+GBC_cpu_set_idle_skip (
+        	       GBC_Machine    *m,
+        	       const GBC_Bool  enabled
+        	       );
+
+/* Torna el nombre total de cicles botats en bucles d'espera. */
+GBCu64
+GBC_cpu_get_idle_skipped (
+        		  GBC_Machine *m
+        		  );
 
 /* Actica/Desactiva el mode CGB. */
 void
 GBC_cpu_set_cgb_mode (
+        	      GBC_Machine   *m,
         	      const GBC_Bool enabled
         	      );
 
 /* Prepara la UCP per a modificar la velocitat. */
 void
 GBC_cpu_speed_prepare (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       );
 
 /* Consulta la velocitat i si està llesta per a ser modificada. */
 GBCu8
-GBC_cpu_speed_query (void);
+GBC_cpu_speed_query (
+                     GBC_Machine *m
+                     );
 
 /* Escriu el registre IE. */
 void
 GBC_cpu_write_IE (
+        	  GBC_Machine *m,
         	  GBCu8 data    /* Dades */
         	  );
 
 /* Escriu el registre IF. */
 void
 GBC_cpu_write_IF (
+        	  GBC_Machine *m,
         	  GBCu8 data    /* Dades */
         	  );
 
 int
 GBC_cpu_save_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    );
 
 int
 GBC_cpu_load_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    );
 
@@ -725,60 +1007,98 @@ GBC_cpu_load_state (
 /* Procesa cicles de la UCP (rellotge). */
 void
 GBC_timers_clock (
+        	  GBC_Machine *m,
         	  const int cc
         	  );
 
 /* Torna el valor del divisor. */
 GBCu8
-GBC_timers_divider_read (void);
+GBC_timers_divider_read (
+                         GBC_Machine *m
+                         );
 
 /* Escriu en el registre del divisor. */
 void
 GBC_timers_divider_write (
+        		  GBC_Machine *m,
         		  GBCu8 data
         		  );
 
 /* Inicialitza el mòdul. */
 void
-GBC_timers_init (void);
+GBC_timers_init (
+                 GBC_Machine *m
+                 );
+
+/* Torna els cicles de UCP que falten per al pròxim desbordament del
+ * temporitzador, o -1 si està desactivat.
+ */
+int
+GBC_timers_next_event (
+        	       GBC_Machine *m
+        	       );
+
+/* Per al registre DIV (0xFF04) o TIMA (0xFF05) torna en SINCE els
+ * cicles de UCP que fa que no canvia i en UNTIL els que falten perquè
+ * canvie. Si el temporitzador està desactivat TIMA no canvia mai i
+ * els dos valors són INT_MAX.
+ */
+void
+GBC_timers_get_stable (
+        	       GBC_Machine  *m,
+        	       const GBCu16  addr,
+        	       int          *since,
+        	       int          *until
+        	       );
 
 /* Llig el contingut del control del temporitzador. */
 GBCu8
-GBC_timers_timer_control_read (void);
+GBC_timers_timer_control_read (
+                               GBC_Machine *m
+                               );
 
 /* Control del temporitzador. */
 void
 GBC_timers_timer_control_write (
+        			GBC_Machine *m,
         			GBCu8 data
         			);
 
 /* Llig el comptador del temporitzador. */
 GBCu8
-GBC_timers_timer_counter_read (void);
+GBC_timers_timer_counter_read (
+                               GBC_Machine *m
+                               );
 
 /* Escriu en el comptador del temporitzador. */
 void
 GBC_timers_timer_counter_write (
+        			GBC_Machine *m,
         			GBCu8 data
         			);
 
 /* Llig el mòdul del temporitzador. */
 GBCu8
-GBC_timers_timer_modulo_read (void);
+GBC_timers_timer_modulo_read (
+                              GBC_Machine *m
+                              );
 
 /* Escriu en el mòdul del temporitzador. */
 void
 GBC_timers_timer_modulo_write (
+        		       GBC_Machine *m,
         		       GBCu8 data
         		       );
 
 int
 GBC_timers_save_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       );
 
 int
 GBC_timers_load_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       );
 
@@ -813,38 +1133,47 @@ typedef int (GBC_CheckButtons) (
 /* Inicialitza el mòdul. */
 void
 GBC_joypad_init (
+        	 GBC_Machine      *m,
         	 GBC_CheckButtons *check_buttons,
                  void             *udata
         	 );
 
 /* Com init, però sense fixar altra vegada els callback. */
 void
-GBC_joypad_init_state (void);
+GBC_joypad_init_state (
+                       GBC_Machine *m
+                       );
 
 /* Indica al mòdul que una tecla s'ha apretat. */
 void
 GBC_joypad_key_pressed (
+        		GBC_Machine *m,
         		GBC_Bool button_pressed,
         		GBC_Bool direction_pressed
         		);
 
 /* Llig l'estat actual del mando. */
 GBCu8
-GBC_joypad_read (void);
+GBC_joypad_read (
+                 GBC_Machine *m
+                 );
 
 /* Escriu en el registre del mando. */
 void
 GBC_joypad_write (
+        	  GBC_Machine *m,
         	  GBCu8 data
         	  );
 
 int
 GBC_joypad_save_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       );
 
 int
 GBC_joypad_load_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       );
 
@@ -854,88 +1183,203 @@ GBC_joypad_load_state (
 /*******/
 /* Mòdul que implementa la pantalla de la GameBoy Color. */
 
+/* Formats de la imatge que es passa al 'frontend'. Els formats de 16
+ * i 32 bits són valors empaquetats en l'ordre de bytes de la màquina,
+ * excepte GBC_FB_RGBA8888 i GBC_FB_BGRA8888 que indiquen l'ordre dels
+ * bytes en memòria.
+ */
+typedef enum
+  {
+    GBC_FB_CGB15= 0,    /* Un 'int' per píxel entre [0,32767] amb
+        		   format BBBBBGGGGGRRRRR. */
+    GBC_FB_RGBA8888,    /* 4 bytes per píxel: R, G, B i A (255). */
+    GBC_FB_BGRA8888,    /* 4 bytes per píxel: B, G, R i A (255). */
+    GBC_FB_RGB565,      /* 'GBCu16' RRRRRGGGGGGBBBBB. */
+    GBC_FB_XRGB1555,    /* 'GBCu16' 0RRRRRGGGGGBBBBB. */
+    GBC_FB_INDEXED8     /* 1 byte per píxel amb l'entrada de la
+        		   paleta: [0,31] fons (paleta*4+color),
+        		   [32,63] sprites, 64 blanc (LCD desactivat) i
+        		   65 negre (LCD parat). Els colors es
+        		   consulten amb 'GBC_lcd_get_cpal'. */
+  } GBC_FBFormat;
+
+/* Línies de la imatge que han canviat respecte a l'últim frame
+ * passat al 'frontend'.
+ */
+typedef struct
+{
+
+  GBC_Bool identical;    /* Cap línia ha canviat. */
+  GBCu32   dirty[5];     /* El bit Y%32 de dirty[Y/32] indica si la
+        		    línia Y ha canviat. */
+
+} GBC_FrameChanges;
+
+/* Indica si la línia Y ha canviat. */
+#define GBC_FRAME_LINE_DIRTY(CHANGES,Y)        			\
+  ((((CHANGES)->dirty[(Y)>>5])>>((Y)&0x1F))&0x1)
+
 /* Tipus de la funció que actualitza la pantalla real. FB és el buffer
- * amb una imatge de 160x144, on cada valor és un sencer entre
- * [0,32767] amb format BBBBBGGGGGRRRRR.
+ * amb una imatge de 160x144 en el format indicat en 'GBC_lcd_init'.
+ * CHANGES indica les línies que han canviat des de l'última crida.
  */
 typedef void (GBC_UpdateScreen) (
-        			 const int  fb[23040 /*160x144*/],
-        			 void      *udata
+        			 const void             *fb,
+        			 const GBC_FrameChanges *changes,
+        			 void                   *udata
         			 );
 
+/* Jocs de funcions vectorials del renderitzat. */
+typedef enum
+  {
+    GBC_LCD_SIMD_AUTO= 0,    /* El millor que suporte la UCP. */
+    GBC_LCD_SIMD_SCALAR,     /* Sense instruccions vectorials. */
+    GBC_LCD_SIMD_SSE2,
+    GBC_LCD_SIMD_AVX2
+  } GBC_LCDSimd;
+
+/* Funcions del renderitzat que tenen versió vectorial. Totes les
+ * versions produeixen el mateix resultat.
+ */
+typedef struct
+{
+
+  GBC_LCDSimd  id;
+  const char  *name;
+  
+  /* Expandeix els plans de bits d'un tile (8 files de 2 bytes) en
+   * PIX, un índex de color per píxel, i en PIX_FLIP la mateixa
+   * imatge amb volteig horitzontal.
+   */
+  void (*expand) (
+        	  const GBCu8 planes[16],
+        	  GBCu8       pix[64],
+        	  GBCu8       pix_flip[64]
+        	  );
+  
+  /* Converteix 8 índexs de color en colors de la paleta PAL. */
+  void (*gather) (
+        	  int         dst[8],
+        	  const GBCu8 pix[8],
+        	  const int   pal[4]
+        	  );
+  
+  /* Combina una línia del fons amb la dels sprites (-1 indica
+   * transparent) segons les prioritats.
+   */
+  void (*blend) (
+        	 int               dst[160],
+        	 const int         bg[160],
+        	 const int         obj[160],
+        	 const signed char prio_bg[160],
+        	 const signed char prio_obj[160],
+        	 const GBC_Bool    obj_has_prio
+        	 );
+
+} GBC_LCDKernels;
+
 /* Processa cicles de UCP. A vegades aquest dispositiu para el
  * processador, per eixe motiu torna els cicles extra que s'ha
  * processat mentre el processador estava parat.
  */
 int
 GBC_lcd_clock (
+               GBC_Machine *m,
                const int cc    /* Cicles a processar. */
                );
 
 /* Torna el contingut del registre de control. */
 GBCu8
-GBC_lcd_control_read (void);
+GBC_lcd_control_read (
+                      GBC_Machine *m
+                      );
 
 /* Escriu en el registre de control. */
 void
 GBC_lcd_control_write (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       );
 
 /* Fixa l'índex de la paleta (color) del fons. */
 void
 GBC_lcd_cpal_bg_index (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       );
 
 /* Fixa l'índex de la paleta (color) dels sprites. */
 void
 GBC_lcd_cpal_ob_index (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       );
 
 /* Llig dades de la paleta (color) del fons. */
 GBCu8
-GBC_lcd_cpal_bg_read_data (void);
+GBC_lcd_cpal_bg_read_data (
+                           GBC_Machine *m
+                           );
 
 /* Llig dades de la paleta (color) dels sprites. */
 GBCu8
-GBC_lcd_cpal_ob_read_data (void);
+GBC_lcd_cpal_ob_read_data (
+                           GBC_Machine *m
+                           );
 
 /* Fixa dades en la paleta (color) del fons. */
 void
 GBC_lcd_cpal_bg_write_data (
+        		    GBC_Machine *m,
         		    const GBCu8 data
         		    );
 
 /* Fixa dades en la paleta (color) dels sprites. */
 void
 GBC_lcd_cpal_ob_write_data (
+        		    GBC_Machine *m,
         		    const GBCu8 data
         		    );
 
 /* Torna les paletes de color actuals. */
 void
 GBC_lcd_get_cpal (
+        	  GBC_Machine *m,
         	  int bg[8][4],    /* Guarda la paleta del fons. */
         	  int ob[8][4]     /* Guarda la paleta dels sprites. */
         	  );
 
+/* Torna el joc de funcions vectorials indicat, o NULL si la UCP o
+ * aquesta compilació no el suporten. GBC_LCD_SIMD_AUTO sempre torna
+ * un joc.
+ */
+const GBC_LCDKernels *
+GBC_lcd_get_kernels (
+        	     const GBC_LCDSimd simd
+        	     );
+
 /* Torna un punter a la memòria de vídeo. La grandària és 8192*2. */
 const GBCu8 *
-GBC_lcd_get_vram (void);
+GBC_lcd_get_vram (
+                  GBC_Machine *m
+                  );
 
 /* Torna el banc de memòria de vídeo actual. Sols funciona en mode
  * CGB.
  */
 GBCu8
-GBC_lcd_get_vram_bank (void);
+GBC_lcd_get_vram_bank (
+                       GBC_Machine *m
+                       );
 
 /* Inicialitza el mòdul. */
 void
 GBC_lcd_init (
+              GBC_Machine      *m,
               GBC_UpdateScreen *update_screen,    /* Per a actualitzar
         					     la pantalla. */
+              GBC_FBFormat      format,           /* Format de la
+        					     imatge. */
               GBC_Warning      *warning,          /* Per a mostrar
         					     avisos. */
               void             *udata             /* Dades de
@@ -944,58 +1388,97 @@ GBC_lcd_init (
 
 /* Com init, però sense fixar altra vegada els callback. */
 void
-GBC_lcd_init_state (void);
+GBC_lcd_init_state (
+                    GBC_Machine *m
+                    );
 
 /* Inicialitza la paleta de colors a la paleta gris per al mode
  * DMG.
  */
 void
-GBC_lcd_init_gray_pal (void);
+GBC_lcd_init_gray_pal (
+                       GBC_Machine *m
+                       );
+
+/* Per al registre LY (0xFF44) o STAT (0xFF41) torna en SINCE els
+ * cicles del LCD que fa que no canvia i en UNTIL els que falten perquè
+ * canvie. Amb el LCD apagat els dos valors són INT_MAX.
+ */
+void
+GBC_lcd_get_stable (
+        	    GBC_Machine  *m,
+        	    const GBCu16  addr,
+        	    int          *since,
+        	    int          *until
+        	    );
 
 /* Torna el contingut del registre LY. */
 GBCu8
-GBC_lcd_ly_read (void);
+GBC_lcd_ly_read (
+                 GBC_Machine *m
+                 );
 
 /* Torna el contingut del registre LYC. */
 GBCu8
-GBC_lcd_lyc_read (void);
+GBC_lcd_lyc_read (
+                  GBC_Machine *m
+                  );
 
 /* Escriu en el registre LYC. */
 void
 GBC_lcd_lyc_write (
+        	   GBC_Machine *m,
         	   const GBCu8 data
         	   );
 
 /* Torna la paleta (monocroma) del fons. */
 GBCu8
-GBC_lcd_mpal_bg_get (void);
+GBC_lcd_mpal_bg_get (
+                     GBC_Machine *m
+                     );
 
 /* Fixa la paleta (monocroma) del fons. */
 void
 GBC_lcd_mpal_bg_set (
+        	     GBC_Machine *m,
         	     const GBCu8 data
         	     );
 
 /* Torna la paleta (monocroma) dels sprites 0. */
 GBCu8
-GBC_lcd_mpal_ob0_get (void);
+GBC_lcd_mpal_ob0_get (
+                      GBC_Machine *m
+                      );
 
 /* Fixa la paleta (monocroma) dels sprites 0. */
 void
 GBC_lcd_mpal_ob0_set (
+        	      GBC_Machine *m,
         	      const GBCu8 data
         	      );
 
 /* Torna la paleta (monocroma) dels sprites 1. */
 GBCu8
-GBC_lcd_mpal_ob1_get (void);
+GBC_lcd_mpal_ob1_get (
+                      GBC_Machine *m
+                      );
 
 /* Fixa la paleta (monocroma) dels sprites 1. */
 void
 GBC_lcd_mpal_ob1_set (
+        	      GBC_Machine *m,
         	      const GBCu8 data
         	      );
 
+/* Torna els cicles que falten per a que el dispositiu necessite
+ * processar-los (VBlank, interrupcions de STAT activades o bloc de
+ * HDMA). Abans d'eixe moment 'GBC_lcd_clock' sols acumula cicles.
+ */
+int
+GBC_lcd_next_event (
+        	    GBC_Machine *m
+        	    );
+
 /* Inicialitza la transferència DMA a la OAM. Teòricament sols es pot
  * accedir a la HRAM mentre esta operació s'està executant i tarda
  * aproximadament 160 (80 double) microsegons, però assumiré que el
@@ -1004,6 +1487,7 @@ GBC_lcd_mpal_ob1_set (
  */
 void
 GBC_lcd_oam_dma (
+        	 GBC_Machine *m,
         	 const GBCu8 data
         	 );
 
@@ -1012,6 +1496,7 @@ GBC_lcd_oam_dma (
  */
 GBCu8
 GBC_lcd_oam_read (
+        	  GBC_Machine *m,
         	  const GBCu16 addr
         	  );
 
@@ -1020,6 +1505,7 @@ GBC_lcd_oam_read (
  */
 void
 GBC_lcd_oam_write (
+        	   GBC_Machine *m,
         	   const GBCu16 addr,
         	   const GBCu8  data
         	   );
@@ -1029,26 +1515,33 @@ GBC_lcd_oam_write (
  */
 void
 GBC_lcd_pal_lock (
+        	  GBC_Machine *m,
         	  const GBCu8 data
         	  );
 
 /* Torna el contingut del registre SCX. */
 GBCu8
-GBC_lcd_scx_read (void);
+GBC_lcd_scx_read (
+                  GBC_Machine *m
+                  );
 
 /* Escriu en el registre SCX. */
 void
 GBC_lcd_scx_write (
+        	   GBC_Machine *m,
         	   const GBCu8 data
         	   );
 
 /* Torna el contingut del registre SCY. */
 GBCu8
-GBC_lcd_scy_read (void);
+GBC_lcd_scy_read (
+                  GBC_Machine *m
+                  );
 
 /* Escriu en el registre SCY. */
 void
 GBC_lcd_scy_write (
+        	   GBC_Machine *m,
         	   const GBCu8 data
         	   );
 
@@ -1057,6 +1550,7 @@ GBC_lcd_scy_write (
  */
 void
 GBC_lcd_select_vram_bank (
+        		  GBC_Machine *m,
         		  const GBCu8 data
         		  );
 
@@ -1066,16 +1560,183 @@ GBC_lcd_select_vram_bank (
  */
 void
 GBC_lcd_set_cgb_mode (
+        	      GBC_Machine   *m,
         	      const GBC_Bool enabled
         	      );
 
+/* Perfils de correcció de color. */
+typedef enum
+  {
+    GBC_LCD_COLOR_RAW= 0,    /* Sense correcció. */
+    GBC_LCD_COLOR_CGB,       /* Pantalla de la GameBoy Color. */
+    GBC_LCD_COLOR_GBA,       /* Pantalla de la GameBoy Advance. */
+    GBC_LCD_COLOR_CUSTOM     /* Matriu de l'usuari. */
+  } GBC_LCDColorProfile;
+
+/* Fixa la correcció de color que s'aplica a la imatge (per defecte
+ * GBC_LCD_COLOR_RAW). En canviar de perfil es calcula una taula amb
+ * el color corregit de cada un dels 32768 colors, que s'aplica quan
+ * s'escriuen les paletes, de manera que renderitzar no costa res
+ * més. Amb GBC_LCD_COLOR_CUSTOM cada component de l'eixida és
+ * MATRIX[c][0]*R + MATRIX[c][1]*G + MATRIX[c][2]*B (components entre
+ * 0 i 1); en la resta de perfils MATRIX s'ignora. No afecta a
+ * GBC_FB_INDEXED8 ni a 'GBC_lcd_get_cpal'. Torna 0 si tot ha anat bé
+ * i -1 si no s'ha pogut reservar memòria o falta la matriu.
+ */
+int
+GBC_lcd_set_color_profile (
+        		   GBC_Machine               *m,
+        		   const GBC_LCDColorProfile  profile,
+        		   const double               matrix[3][3]
+        		   );
+
+/* Anell de buffers per a la imatge. En compte de cridar a
+ * 'update_screen', el simulador renderitza cada frame en un buffer
+ * lliure de l'anell i el publica en una cua sense bloquejos d'un
+ * productor i un consumidor. Un altre fil obté els frames amb
+ * 'GBC_lcd_ring_acquire' i els torna amb 'GBC_lcd_ring_release',
+ * sense copiar-los.
+ */
+
+/* Què fer quan comença un frame i no hi ha cap buffer lliure. */
+typedef enum
+  {
+    GBC_FB_RING_DROP= 0,    /* No es renderitza el frame. */
+    GBC_FB_RING_WAIT        /* S'espera a que s'allibere un buffer. */
+  } GBC_FBRingPolicy;
+
+/* Un frame de l'anell. */
+typedef struct
+{
+
+  const void       *fb;         /* Imatge en el format del mòdul. */
+  GBC_FrameChanges  changes;    /* Canvis respecte al frame publicat
+        			   anterior. */
+  GBCu64            number;     /* Número de frame publicat. */
+  int               slot;       /* Buffer (per a l'alliberament). */
+
+} GBC_FBRingFrame;
+
+/* Activa l'anell amb N buffers, o el desactiva amb N igual a 0. S'ha
+ * de cridar des del fil del simulador i quan el consumidor no té cap
+ * frame. El frame en curs no es publica. Torna 0 si tot ha anat bé o
+ * -1 si no s'ha pogut reservar memòria.
+ */
+int
+GBC_lcd_set_ring (
+        	  GBC_Machine            *m,
+        	  const int               n,
+        	  const GBC_FBRingPolicy  policy
+        	  );
+
+/* Obté el frame publicat més antic. Si no n'hi ha cap torna GBC_FALSE
+ * o, si WAIT és cert, espera a que se'n publique un. Sols un fil pot
+ * consumir frames.
+ */
+GBC_Bool
+GBC_lcd_ring_acquire (
+        	      GBC_Machine     *m,
+        	      GBC_FBRingFrame *frame,
+        	      const GBC_Bool   wait
+        	      );
+
+/* Torna a l'anell el buffer d'un frame obtés amb
+ * 'GBC_lcd_ring_acquire'.
+ */
+void
+GBC_lcd_ring_release (
+        	      GBC_Machine           *m,
+        	      const GBC_FBRingFrame *frame
+        	      );
+
+/* Torna el nombre de frames que no s'han renderitzat per no tindre
+ * cap buffer lliure (GBC_FB_RING_DROP).
+ */
+GBCu64
+GBC_lcd_ring_get_dropped (
+        		  GBC_Machine *m
+        		  );
+
+/* Activa/Desactiva el renderitzat diferit. En mode diferit els
+ * accessos als registres del LCD, la VRAM i l'OAM sols registren les
+ * escriptures que afecten a línies encara no renderitzades, i el frame
+ * sencer es renderitza d'una vegada en arribar al V-Blank tornant a
+ * aplicar el registre línia a línia. El resultat és el mateix que en
+ * el mode normal. Per defecte està desactivat.
+ */
+void
+GBC_lcd_set_deferred (
+        	      GBC_Machine    *m,
+        	      const GBC_Bool  enabled
+        	      );
+
+/* Modes de renderitzat. */
+typedef enum
+  {
+    GBC_LCD_RENDER_INLINE=0,     /* En el fil de la simulació. */
+    GBC_LCD_RENDER_THREAD,       /* En un fil a part. */
+    GBC_LCD_RENDER_THREAD_CHECK  /* En un fil a part i en línia,
+        			    comparant els resultats. */
+  } GBC_LCDRenderMode;
+
+/* Canvia el mode de renderitzat. Amb GBC_LCD_RENDER_THREAD el fil de
+ * la simulació sols registra les escriptures que afecten al
+ * renderitzat i un altre fil renderitza el frame N mentre se simula
+ * el N+1, per tant 'update_screen' rep cada frame amb un frame de
+ * retard (sempre des del fil de la simulació). La imatge és la mateixa
+ * que en línia; GBC_LCD_RENDER_THREAD_CHECK ho comprova renderitzant
+ * també en línia. No es pot utilitzar amb l'anell de buffers. Torna 0
+ * si tot ha anat bé.
+ */
+int
+GBC_lcd_set_render_mode (
+        		 GBC_Machine             *m,
+        		 const GBC_LCDRenderMode  mode
+        		 );
+
+/* Torna el nombre de frames del fil de renderitzat diferents dels
+ * renderitzats en línia (GBC_LCD_RENDER_THREAD_CHECK).
+ */
+GBCu64
+GBC_lcd_get_render_mismatches (
+        		       GBC_Machine *m
+        		       );
+
+/* Valor de N en 'GBC_lcd_set_frameskip' per a no renderitzar res. */
+#define GBC_LCD_NO_VIDEO (-1)
+
+/* Renderitza sols un de cada N+1 frames. En els frames botats la
+ * temporització del LCD (LY, STAT, interrupcions i HDMA) és la
+ * mateixa, però no es dibuixa res ni es crida a 'update_screen'. Amb
+ * N negatiu (GBC_LCD_NO_VIDEO) no es renderitza cap frame. Per
+ * defecte N és 0.
+ */
+void
+GBC_lcd_set_frameskip (
+        	       GBC_Machine *m,
+        	       const int    n
+        	       );
+
+/* Canvia el joc de funcions vectorials del renderitzat. Per defecte
+ * s'utilitza GBC_LCD_SIMD_AUTO. Torna 0 si tot ha anat bé o -1 si no
+ * està suportat.
+ */
+int
+GBC_lcd_set_simd (
+        	  GBC_Machine       *m,
+        	  const GBC_LCDSimd  simd
+        	  );
+
 /* Torna el contingut del registre d'estat. */
 GBCu8
-GBC_lcd_status_read (void);
+GBC_lcd_status_read (
+                     GBC_Machine *m
+                     );
 
 /* Escriu en el registre d'estat. */
 void
 GBC_lcd_status_write (
+        	      GBC_Machine *m,
         	      const GBCu8 data
         	      );
 
@@ -1084,18 +1745,85 @@ GBC_lcd_status_write (
  */
 void
 GBC_lcd_stop (
+              GBC_Machine   *m,
               const GBC_Bool state
               );
 
+/* Visors de la VRAM per a depurar. Dibuixen l'estat actual de la
+ * VRAM, l'OAM i les paletes en imatges GBC_FB_RGBA8888 de l'usuari
+ * (PITCH és la grandària en bytes d'una fila), amb la correcció de
+ * color de 'GBC_lcd_set_color_profile'. No es poden cridar mentre
+ * s'està executant la simulació.
+ */
+#define GBC_LCD_VIEW_TILES_WIDTH 128
+#define GBC_LCD_VIEW_TILES_HEIGHT 192
+#define GBC_LCD_VIEW_MAP_WIDTH 256
+#define GBC_LCD_VIEW_MAP_HEIGHT 256
+#define GBC_LCD_VIEW_OAM_WIDTH 64
+#define GBC_LCD_VIEW_OAM_HEIGHT 80
+#define GBC_LCD_VIEW_PALETTES_WIDTH 64
+#define GBC_LCD_VIEW_PALETTES_HEIGHT 64
+
+/* Dibuixa el mapa de tiles MAP (0 -> 9800, 1 -> 9C00) amb el mode
+ * d'adreçament dels tiles actual i, en mode CGB, els atributs del
+ * banc 1 (banc, paleta i volteig). Torna -1 si MAP no és vàlid.
+ */
+int
+GBC_lcd_view_map (
+        	  GBC_Machine *m,
+        	  const int    map,
+        	  GBCu8       *dst,
+        	  const int    pitch
+        	  );
+
+/* Dibuixa els 40 sprites de l'OAM en una graella de 8x5 cel·les de
+ * 8x16 píxels amb els seus tiles, paletes i volteigs. El color 0 i la
+ * meitat de baix de les cel·les amb sprites de 8x8 són transparents
+ * (tots els bytes a 0).
+ */
+void
+GBC_lcd_view_oam (
+        	  GBC_Machine *m,
+        	  GBCu8       *dst,
+        	  const int    pitch
+        	  );
+
+/* Dibuixa les 8 paletes de fons (meitat esquerra) i les 8 paletes
+ * d'sprites (meitat dreta), una per fila, amb un quadrat de 8x8
+ * píxels per color.
+ */
+void
+GBC_lcd_view_palettes (
+        	       GBC_Machine *m,
+        	       GBCu8       *dst,
+        	       const int    pitch
+        	       );
+
+/* Dibuixa els 384 tiles del banc BANK de la VRAM en una graella de 16
+ * tiles per fila. PAL indica la paleta de color ([0,7] fons, [8,15]
+ * sprites) o, si és negatiu, escala de grisos. Torna -1 si BANK o PAL
+ * no són vàlids.
+ */
+int
+GBC_lcd_view_tiles (
+        	    GBC_Machine *m,
+        	    const int    bank,
+        	    const int    pal,
+        	    GBCu8       *dst,
+        	    const int    pitch
+        	    );
+
 /* Fixa la part alta de l'adreça destí per al DMA. */
 void
 GBC_lcd_vram_dma_dst_high (
+        		   GBC_Machine *m,
         		   const GBCu8 data
         		   );
 
 /* Fixa la part baixa de l'adreça destí per al DMA. */
 void
 GBC_lcd_vram_dma_dst_low (
+        		  GBC_Machine *m,
         		  const GBCu8 data
         		  );
 
@@ -1107,30 +1835,36 @@ GBC_lcd_vram_dma_dst_low (
  */
 void
 GBC_lcd_vram_dma_init (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       );
 
 /* Fixa la part alta de l'adreça origen per al DMA. */
 void
 GBC_lcd_vram_dma_src_high (
+        		   GBC_Machine *m,
         		   const GBCu8 data
         		   );
 
 /* Fixa la part baixa de l'adreça origen per al DMA. */
 void
 GBC_lcd_vram_dma_src_low (
+        		  GBC_Machine *m,
         		  const GBCu8 data
         		  );
 
 /* Torna l'estat del DMA. */
 GBCu8
-GBC_lcd_vram_dma_status (void);
+GBC_lcd_vram_dma_status (
+                         GBC_Machine *m
+                         );
 
 /* LLig de l'adreça indicada. L'adreça ha d'estar en el rang
  * [0000-1FFF].
  */
 GBCu8
 GBC_lcd_vram_read (
+        	   GBC_Machine *m,
         	   const GBCu16 addr
         	   );
 
@@ -1139,37 +1873,46 @@ GBC_lcd_vram_read (
  */
 void
 GBC_lcd_vram_write (
+        	    GBC_Machine *m,
         	    const GBCu16 addr,
         	    const GBCu8  data
         	    );
 
 /* Torna el contingut del registre WX. */
 GBCu8
-GBC_lcd_wx_read (void);
+GBC_lcd_wx_read (
+                 GBC_Machine *m
+                 );
 
 /* Escriu en el registre WX. */
 void
 GBC_lcd_wx_write (
+        	  GBC_Machine *m,
         	  const GBCu8 data
         	  );
 
 /* Torna el contingut del registre WY. */
 GBCu8
-GBC_lcd_wy_read (void);
+GBC_lcd_wy_read (
+                 GBC_Machine *m
+                 );
 
 /* Escriu en el registre WY. */
 void
 GBC_lcd_wy_write (
+        	  GBC_Machine *m,
         	  const GBCu8 data
         	  );
 
 int
 GBC_lcd_save_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    );
 
 int
 GBC_lcd_load_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    );
 
@@ -1202,6 +1945,7 @@ typedef void (GBC_PlaySound) (
  */
 void
 GBC_apu_ch1_freq_hi (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     );
 
@@ -1210,40 +1954,52 @@ GBC_apu_ch1_freq_hi (
  */
 void
 GBC_apu_ch1_freq_lo (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     );
 
 /* Torna l'estat del 'length counter' del canal 1. */
 GBCu8
-GBC_apu_ch1_get_lc_status (void);
+GBC_apu_ch1_get_lc_status (
+                           GBC_Machine *m
+                           );
 
 /* Torna 'Wave pattern duty' del canal 1. */
 GBCu8
-GBC_apu_ch1_get_wave_pattern_duty (void);
+GBC_apu_ch1_get_wave_pattern_duty (
+                                   GBC_Machine *m
+                                   );
 
 /* Fixa el 'wave pattern duty' i la longitut del canal 1. */
 void
 GBC_apu_ch1_set_length_wave_pattern_dutty (
+        				   GBC_Machine *m,
         				   GBCu8 data
         				   );
 
 /* Llig el contingut del registre de sweep del canal 1. */
 GBCu8
-GBC_apu_ch1_sweep_read (void);
+GBC_apu_ch1_sweep_read (
+                        GBC_Machine *m
+                        );
 
 /* Escriu en el registre de sweep del canal 1. */
 void
 GBC_apu_ch1_sweep_write (
+        		 GBC_Machine *m,
         		 GBCu8 data
         		 );
 
 /* Llig el contingut del registre de volum del canal 1. */
 GBCu8
-GBC_apu_ch1_volume_envelope_read (void);
+GBC_apu_ch1_volume_envelope_read (
+                                  GBC_Machine *m
+                                  );
 
 /* Escriu en el registre de volum del canal 1. */
 void
 GBC_apu_ch1_volume_envelope_write (
+        			   GBC_Machine *m,
         			   GBCu8 data
         			   );
 
@@ -1252,6 +2008,7 @@ GBC_apu_ch1_volume_envelope_write (
  */
 void
 GBC_apu_ch2_freq_hi (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     );
 
@@ -1260,30 +2017,39 @@ GBC_apu_ch2_freq_hi (
  */
 void
 GBC_apu_ch2_freq_lo (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     );
 
 /* Torna l'estat del 'length counter' del canal 2. */
 GBCu8
-GBC_apu_ch2_get_lc_status (void);
+GBC_apu_ch2_get_lc_status (
+                           GBC_Machine *m
+                           );
 
 /* Torna 'Wave pattern duty' del canal 2. */
 GBCu8
-GBC_apu_ch2_get_wave_pattern_duty (void);
+GBC_apu_ch2_get_wave_pattern_duty (
+                                   GBC_Machine *m
+                                   );
 
 /* Fixa el 'wave pattern duty' i la longitut del canal 2. */
 void
 GBC_apu_ch2_set_length_wave_pattern_dutty (
+        				   GBC_Machine *m,
         				   GBCu8 data
         				   );
 
 /* Llig el contingut del registre de volum del canal 2. */
 GBCu8
-GBC_apu_ch2_volume_envelope_read (void);
+GBC_apu_ch2_volume_envelope_read (
+                                  GBC_Machine *m
+                                  );
 
 /* Escriu en el registre de volum del canal 2. */
 void
 GBC_apu_ch2_volume_envelope_write (
+        			   GBC_Machine *m,
         			   GBCu8 data
         			   );
 
@@ -1292,6 +2058,7 @@ GBC_apu_ch2_volume_envelope_write (
  */
 void
 GBC_apu_ch3_freq_hi (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     );
 
@@ -1300,32 +2067,40 @@ GBC_apu_ch3_freq_hi (
  */
 void
 GBC_apu_ch3_freq_lo (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     );
 
 /* Torna l'estat del 'length counter' del canal 3. */
 GBCu8
-GBC_apu_ch3_get_lc_status (void);
+GBC_apu_ch3_get_lc_status (
+                           GBC_Machine *m
+                           );
 
 /* Llig el volum del canal 3. */
 GBCu8
-GBC_apu_ch3_output_level_read (void);
+GBC_apu_ch3_output_level_read (
+                               GBC_Machine *m
+                               );
 
 /* Escriu el volum del canal 3. */
 void
 GBC_apu_ch3_output_level_write (
+        			GBC_Machine *m,
         			GBCu8 data
         			);
 
 /* Llig de la memòria interna del canal 3. */
 GBCu8
 GBC_apu_ch3_ram_read (
+        	      GBC_Machine *m,
         	      int pos
         	      );
 
 /* Escriu en la memòria interna del canal 3. */
 void
 GBC_apu_ch3_ram_write (
+        	       GBC_Machine *m,
         	       GBCu8 data,
         	       int   pos
         	       );
@@ -1333,89 +2108,120 @@ GBC_apu_ch3_ram_write (
 /* Fixa la longitut del canal 3. */
 void
 GBC_apu_ch3_set_length (
+        		GBC_Machine *m,
         		GBCu8 data
         		);
 
 /* Indica si el canal 3 està actiu o no. */
 GBCu8
-GBC_apu_ch3_sound_on_off_read (void);
+GBC_apu_ch3_sound_on_off_read (
+                               GBC_Machine *m
+                               );
 
 /* Canvia el Master Channel Control Switch del canal 3. */
 void
 GBC_apu_ch3_sound_on_off_write (
+        			GBC_Machine *m,
         			GBCu8 data
         			);
 
 /* Torna l'estat del 'length counter' del canal 4. */
 GBCu8
-GBC_apu_ch4_get_lc_status (void);
+GBC_apu_ch4_get_lc_status (
+                           GBC_Machine *m
+                           );
 
 /* Inicialitza el canal 4. */
 void
 GBC_apu_ch4_init (
+        	  GBC_Machine *m,
         	  GBCu8 data
         	  );
 
 /* Llig el contingut del polynomial counter del canal 4. */
 GBCu8
-GBC_apu_ch4_polynomial_counter_read (void);
+GBC_apu_ch4_polynomial_counter_read (
+                                     GBC_Machine *m
+                                     );
 
 /* Escriu en el contingut del polynomial counter del canal 4. */
 void
 GBC_apu_ch4_polynomial_counter_write (
+        			      GBC_Machine *m,
         			      GBCu8 data
         			      );
 
 /* Fixa la longitut del canal 4. */
 void
 GBC_apu_ch4_set_length (
+        		GBC_Machine *m,
         		GBCu8 data
         		);
 
 /* Llig el contingut del registre de volum del canal 4. */
 GBCu8
-GBC_apu_ch4_volume_envelope_read (void);
+GBC_apu_ch4_volume_envelope_read (
+                                  GBC_Machine *m
+                                  );
 
 /* Escriu en el registre de volum del canal 4. */
 void
 GBC_apu_ch4_volume_envelope_write (
+        			   GBC_Machine *m,
         			   GBCu8 data
         			   );
 
 /* Alimenta el dispositiu amb cicles de rellotge de la UCP. */
 void
 GBC_apu_clock (
+               GBC_Machine *m,
                const int cc
                );
 
 /* Torna l'estat. */
 GBCu8
-GBC_apu_get_status (void);
+GBC_apu_get_status (
+                    GBC_Machine *m
+                    );
 
 /* Inicialitza el mòdul. */
 void
 GBC_apu_init (
+              GBC_Machine   *m,
               GBC_PlaySound *play_sound,
               void          *udata
               );
 
 /* Com init, però sense fixar altra vegada els callback. */
 void
-GBC_apu_init_state (void);
+GBC_apu_init_state (
+                    GBC_Machine *m
+                    );
+
+/* Torna els cicles que falten per a omplir el búfer de so. */
+int
+GBC_apu_next_event (
+                    GBC_Machine *m
+                    );
 
 /* Fixa els valors després del procés d'encès. Aquesta funció s'ha de
  * cridar després de 'GBC_apu_init'.
  */
 void
-GBC_apu_power_up (void);
+GBC_apu_power_up (
+                  GBC_Machine *m
+                  );
 
 /* Llig el contingut del registre de selecció de canals. */
 GBCu8
-GBC_apu_select_out_read (void);
+GBC_apu_select_out_read (
+                         GBC_Machine *m
+                         );
 
 /* Escriu en el registre de selecció de canals. */
 void
 GBC_apu_select_out_write (
+        		  GBC_Machine *m,
         		  GBCu8 data
         		  );
 
@@ -1425,32 +2231,39 @@ GBC_apu_select_out_write (
  */
 void
 GBC_apu_stop (
+              GBC_Machine   *m,
               const GBC_Bool state
               );
 
 /* Encen o apaga el dispositiu de so. */
 void
 GBC_apu_turn_on (
+        	 GBC_Machine *m,
         	 GBCu8 data
         	 );
 
 /* Llig el contingut del registre de Vin. */
 GBCu8
-GBC_apu_vin_read (void);
+GBC_apu_vin_read (
+                  GBC_Machine *m
+                  );
 
 /* Escriu en el registre de Vin. */
 void
 GBC_apu_vin_write (
+        	   GBC_Machine *m,
         	   GBCu8 data
         	   );
 
 int
 GBC_apu_save_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    );
 
 int
 GBC_apu_load_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    );
 
@@ -1534,18 +2347,56 @@ typedef struct
         					    es van a gastar
         					    les funcions per a
         					    fer una traça. */
+  GBC_FBFormat              fb_format;           /* Format de la
+        					    imatge que rep
+        					    'update_screen'. */
   
 } GBC_Frontend;
 
+/* Força que el planificador recalcule els events en acabar la
+ * instrucció actual. S'ha de cridar quan una escriptura pot canviar
+ * el moment del pròxim event.
+ */
+void
+GBC_main_resched (
+                  GBC_Machine *m
+                  );
+
 /* Canvia la velocitat. */
 void
-GBC_main_switch_speed (void);
+GBC_main_switch_speed (
+                       GBC_Machine *m
+                       );
+
+/* Posa al dia tots els dispositius fins al principi de la instrucció
+ * actual. La UCP executa instruccions sense actualitzar la resta de
+ * dispositius fins al pròxim event, per tant s'ha de cridar abans de
+ * qualsevol accés que depenga de l'estat d'un dispositiu.
+ */
+void
+GBC_main_sync (
+               GBC_Machine *m
+               );
+
+/* Posa al dia els dispositius i torna en SINCE els cicles de UCP que
+ * fa que no canvia el registre ADDR (LY, STAT, IF, DIV o TIMA) i en
+ * UNTIL els que falten com a mínim perquè canvie. IF sols canvia en
+ * els events i per a ell es torna INT_MAX.
+ */
+void
+GBC_main_get_stable (
+        	     GBC_Machine  *m,
+        	     const GBCu16  addr,
+        	     int          *since,
+        	     int          *until
+        	     );
 
 /* Inicialitza la llibreria, s'ha de cridar cada vegada que s'inserte
  * una nova rom. Torna GBC_NOERROR si tot ha anat bé.
  */
 GBC_Error
 GBC_init (
+          GBC_Machine        *m,
           const GBCu8         bios[0x900],    /* BIOS. Pot ser
         					 NULL. Els valors
         					 [0x100-0x1FF] no
@@ -1559,15 +2410,17 @@ GBC_init (
          );
 
 /* Executa un cicle de la GameBoy Color. Aquesta funció executa una
- * iteració de 'GBC_loop' i torna els cicles de UCP emprats. Si
- * CHECKSIGNALS en el frontend no és NULL aleshores cada cert temps al
- * cridar a GBC_iter es fa una comprovació de CHECKSIGNALS.  La funció
+ * iteració de 'GBC_loop' (totes les instruccions fins al pròxim
+ * event) i torna els cicles de UCP emprats. Si CHECKSIGNALS en el
+ * frontend no és NULL aleshores cada cert temps al cridar a
+ * GBC_iter es fa una comprovació de CHECKSIGNALS.  La funció
  * CHECKSIGNALS del frontend es crida amb una freqüència suficient per
  * a que el frontend tracte els seus events. La senyal stop de
  * CHECKSIGNALS és llegit en STOP si es crida a CHECKSIGNALS.
  */
 int
 GBC_iter (
+          GBC_Machine *m,
           GBC_Bool *stop
           );
 
@@ -1576,6 +2429,7 @@ GBC_iter (
  */
 void
 GBC_key_pressed (
+        	 GBC_Machine *m,
         	 GBC_Bool button_pressed,
         	 GBC_Bool direction_pressed
         	 );
@@ -1588,6 +2442,7 @@ GBC_key_pressed (
  */
 int
 GBC_load_state (
+        	GBC_Machine *m,
         	FILE *f
         	);
 
@@ -1598,25 +2453,212 @@ GBC_load_state (
  * freqüència suficient per a que el frontend tracte els seus events.
  */
 void
-GBC_loop (void);
+GBC_loop (
+          GBC_Machine *m
+          );
+
+/* Allibera una màquina creada amb 'GBC_machine_new'. */
+void
+GBC_machine_free (
+        	  GBC_Machine *m
+        	  );
+
+/* Crea una nova màquina. Torna NULL si no hi ha memòria
+ * suficient. Abans de gastar-la s'ha d'inicialitzar amb 'GBC_init'.
+ */
+GBC_Machine *
+GBC_machine_new (void);
 
 /* Escriu en 'f' l'estat de la màquina. Torna 0 si tot ha anat bé, -1
  * en cas contrari.
  */
 int
 GBC_save_state (
+        	GBC_Machine *m,
         	FILE *f
         	);
 
 /* Para a 'GBC_loop'. */
 void
-GBC_stop (void);
+GBC_stop (
+          GBC_Machine *m
+          );
 
 /* Executa els següent pas de UCP en mode traça. Tots aquelles
  * funcions de 'callback' que no són nul·les es cridaran si és el
  * cas. Torna el clocks de rellotge executats en l'últim pas.
  */
 int
-GBC_trace (void);
+GBC_trace (
+           GBC_Machine *m
+           );
+
+
+
+/*********/
+/* BATCH */
+/*********/
+/* Mòdul per a executar molts treballs sense interfície en paral·lel
+ * (ROMs de regressió, simulacions de bots...). Cada treball s'executa
+ * en la seua pròpia 'GBC_Machine' dins d'un conjunt fix de fils. Cada
+ * fil té la seua cua de treballs i quan es queda sense en roba als
+ * altres, de manera que els treballs llargs no deixen fils parats.
+ */
+
+/* Cicles de UCP per frame que pot gastar un treball abans d'aturar-lo
+ * (un frame són 70224 cicles, el doble en doble velocitat).
+ */
+#define GBC_BATCH_FRAME_CC (4*70224)
+
+/* Entrada d'un guió d'entrada. A partir del frame FRAME (comptant des
+ * de 0) els botons apretats són BUTTONS (combinació de 'GBC_Button'
+ * amb l'operador OR).
+ */
+typedef struct
+{
+  
+  int frame;
+  int buttons;
+  
+} GBC_BatchInput;
+
+/* Treball. Els camps d'entrada els ha d'omplir l'usuari, els
+ * d'eixida els omple 'GBC_batch_run'.
+ */
+typedef struct
+{
+  
+  /* Entrada. */
+  const GBC_Rom        *rom;           /* ROM. Es pot compartir entre
+        				  treballs. */
+  const GBCu8          *bios;          /* BIOS. Pot ser NULL. */
+  int                   frames;        /* Frames a executar. */
+  const GBC_BatchInput *input;         /* Guió d'entrada ordenat per
+        				  frame. Pot ser NULL. */
+  int                   ninput;        /* Número d'entrades en
+        				  INPUT. */
+  
+  /* Eixida. */
+  GBC_Error             err;           /* Error. Si no és GBC_NOERROR
+        				  ni GBC_ETIMEOUT la resta de
+        				  camps d'eixida no són
+        				  vàlids. */
+  int                   frames_done;   /* Frames executats. */
+  GBCu32                fb_hash;       /* Hash (FNV-1a) de l'últim
+        				  frame. */
+  GBCu32                audio_hash;    /* Hash (FNV-1a) de totes les
+        				  mostres de so generades,
+        				  quantificades a 16 bits. */
+  double                wall_time;     /* Temps real emprat en
+        				  segons. */
+  
+} GBC_BatchJob;
+
+/* Llig un guió d'entrada en format text. Cada línia no buida té un
+ * número de frame seguit dels botons apretats a partir d'eixe frame
+ * (RIGHT, LEFT, UP, DOWN, A, B, SELECT, START) o '-' si no n'hi ha
+ * cap. Els frames han d'estar en ordre creixent. Les línies que
+ * comencen per '#' s'ignoren. Torna 0 si tot ha anat bé i -1 en cas
+ * contrari. El vector INPUT s'ha d'alliberar amb 'free'.
+ */
+int
+GBC_batch_read_input (
+        	      FILE            *f,
+        	      GBC_BatchInput **input,
+        	      int             *ninput
+        	      );
+
+/* Executa NJOBS treballs en NTHREADS fils. Si NTHREADS és menor o
+ * igual que 0 s'utilitzen tants fils com processadors. Es bloqueja
+ * fins que s'acaben tots els treballs. Un treball que no completa
+ * els seus frames en GBC_BATCH_FRAME_CC cicles per frame (per
+ * exemple perquè la ROM apaga el LCD) s'atura amb GBC_ETIMEOUT. Torna
+ * 0 si tot ha anat bé i -1 si no s'han pogut crear els fils.
+ */
+int
+GBC_batch_run (
+               GBC_BatchJob *jobs,
+               const int     njobs,
+               int           nthreads
+               );
+
+
+/*********/
+/* VIDEO */
+/*********/
+/* Funcions per a escalar i postprocessar en el 'frontend' la imatge
+ * que es passa a 'update_screen'. Treballen amb els formats de
+ * 'GBC_FBFormat' (imatges de GBC_VIDEO_WIDTH x GBC_VIDEO_HEIGHT
+ * píxels sense espai entre files) i escriuen en buffers de
+ * l'usuari. PITCH sempre és la grandària en bytes d'una fila del
+ * destí. Totes tornen 0 si tot ha anat bé i -1 si els paràmetres no
+ * són vàlids.
+ */
+
+#define GBC_VIDEO_WIDTH 160
+#define GBC_VIDEO_HEIGHT 144
+
+/* Escala SRC per un factor enter FACTOR ([1,8]) replicant els
+ * píxels. DST ha de tindre com a mínim GBC_VIDEO_HEIGHT*FACTOR files.
+ */
+int
+GBC_video_scale (
+        	 const void         *src,
+        	 const GBC_FBFormat  format,
+        	 void               *dst,
+        	 const int           pitch,
+        	 const int           factor
+        	 );
+
+/* Escala SRC amb l'algorisme Scale2x (FACTOR 2) o Scale3x (FACTOR
+ * 3). En GBC_FB_INDEXED8 es comparen els índexs.
+ */
+int
+GBC_video_scalex (
+        	  const void         *src,
+        	  const GBC_FBFormat  format,
+        	  void               *dst,
+        	  const int           pitch,
+        	  const int           factor
+        	  );
+
+/* Simula la graella del LCD en una imatge BUF escalada per FACTOR
+ * ([2,8]): enfosqueix l'última fila i l'última columna de cada píxel
+ * en LEVEL/256 ([0,256]). No es pot utilitzar amb GBC_FB_INDEXED8.
+ */
+int
+GBC_video_lcd_grid (
+        	    void               *buf,
+        	    const GBC_FBFormat  format,
+        	    const int           pitch,
+        	    const int           factor,
+        	    const int           level
+        	    );
+
+/* Simula la persistència del LCD: FRAME passa a ser la mescla de
+ * FRAME i PREV amb pes WEIGHT/256 ([0,256]) per a PREV, i PREV es
+ * sobreescriu amb el resultat. Les dues imatges tenen el mateix
+ * format, que no pot ser GBC_FB_INDEXED8. En els formats de 15/16
+ * bits el pes es redueix a 5 bits.
+ */
+int
+GBC_video_ghosting (
+        	    void               *frame,
+        	    void               *prev,
+        	    const GBC_FBFormat  format,
+        	    const int           weight
+        	    );
+
+/* Converteix una imatge GBC_FB_CGB15 en una imatge en format FORMAT
+ * aplicant la correcció de color de la pantalla de la GameBoy Color
+ * (colors menys saturats i més foscos). No es pot utilitzar amb
+ * GBC_FB_INDEXED8.
+ */
+int
+GBC_video_color_correct (
+        		 const int          *src,
+        		 void               *dst,
+        		 const GBC_FBFormat  format
+        		 );
 
 #endif /* __GBC_H__ */
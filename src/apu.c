@@ -31,6 +31,7 @@
 #include <string.h>
 
 #include "GBC.h"
+#include "machine.h"
 
 
 
@@ -92,185 +93,23 @@ static const double _volume_table[16]=
 /* ESTAT */
 /*********/
 
-/* Estat provisional pera VIN. */
-static GBCu8 _vin;
-
-/* Patrons duty amb grunalaritat 12. */
-/* MOTIU: Upon the channel INIT trigger bit being set for either
-   channel 1 or 2, the wave position's incrementing will be delayed by
-   1/12 of a full cycle. */
-static char _duty_pat[4][96];
-
-/* Canal 1. */
-static struct
-{
-  
-  GBC_Bool enabled;
-  
-  /* Programmable timer. */
-  GBCu16   pt_freq;
-  GBCu16   pt_counter;
-  
-  /* Master Channel Control Switch. */
-  GBC_Bool mccswitch;
-  
-  /* Length counter. */
-  int      lc_aux_div;    /* Divisor auxiliar. */
-  GBCu8    lc_counter;
-  GBC_Bool lc_enabled;
-  
-  /* Sweep Unit. */
-  int      sw_aux_div;    /* Dividix lc_aux_div */
-  GBC_Bool sw_enabled;
-  GBCu16   sw_freq;
-  GBCu8    sw_time;
-  GBCu8    sw_counter;
-  GBC_Bool sw_increase;
-  GBCu8    sw_shift;
-  GBC_Bool sw_neg_used;
-  
-  /* Duty Cicle. */
-  GBCu8    dc_wave_pattern;
-  int      dc_pos;
-  char     dc_out;
-  
-  /* Volumne Envelope. */
-  int      ve_aux_div;    /* Divisor auxiliar que utilitza amb sw_aux_div. */
-  GBCu8    ve_vol_reg;
-  GBCu8    ve_vol;
-  GBC_Bool ve_increase_reg;
-  GBC_Bool ve_increase;
-  GBCu8    ve_step;
-  GBCu8    ve_counter;
-  
-} _ch1;
-
-/* Canal 2. */
-static struct
-{
-  
-  GBC_Bool enabled;
-  
-  /* Programmable timer. */
-  GBCu16   pt_freq;
-  GBCu16   pt_counter;
-  
-  /* Master Channel Control Switch. */
-  GBC_Bool mccswitch;
-  
-  /* Length counter. */
-  int      lc_aux_div;    /* Divisor auxiliar. */
-  GBCu8    lc_counter;
-  GBC_Bool lc_enabled;
-  
-  /* Duty Cicle. */
-  GBCu8    dc_wave_pattern;
-  int      dc_pos;
-  char     dc_out;
-  
-  /* Volumne Envelope. */
-  int      ve_aux_div;    /* Divisor auxiliar que utilitza amb lc_aux_div. */
-  GBCu8    ve_vol_reg;
-  GBCu8    ve_vol;
-  GBC_Bool ve_increase_reg;
-  GBC_Bool ve_increase;
-  GBCu8    ve_step;
-  GBCu8    ve_counter;
-  
-} _ch2;
-
-/* Canal 3. */
-static struct
-{
-  
-  GBC_Bool enabled;
-  
-  /* Programmable timer. */
-  GBCu16   pt_freq;
-  GBCu16   pt_counter;
-  
-  /* Master Channel Control Switch. */
-  GBC_Bool mccswitch;
-  
-  /* Length counter. */
-  int      lc_aux_div;    /* Divisor auxiliar. */
-  GBCu16   lc_counter;
-  GBC_Bool lc_enabled;
-  
-  /* Wave Pattern RAM. */
-  char     ram[32];
-  
-  /* Wave Pattern Playback / Shifter Unit. */
-  int      su_pos;
-  int      su_val;
-  
-} _ch3;
-
-/* Canal 4. */
-static struct
-{
-  
-  GBC_Bool enabled;
-  
-  /* Configurable timer. */
-  GBCu16   ct_3bcounter;   /* 2*524288 / (2*r) / 2^(s+1) */
-  int      ct_16bcounter;
-  GBCu8    ct_ratio;
-  GBCu8    ct_scfreq;
-  
-  /* Master Channel Control Switch. */
-  GBC_Bool mccswitch;
-  
-  /* Length counter. */
-  int      lc_aux_div;    /* Divisor auxiliar. */
-  GBCu8    lc_counter;
-  GBC_Bool lc_enabled;
-  
-  /* Volumne Envelope. */
-  int      ve_aux_div;    /* Divisor auxiliar que utilitza amb lc_aux_div. */
-  GBCu8    ve_vol_reg;
-  GBCu8    ve_vol;
-  GBC_Bool ve_increase_reg;
-  GBC_Bool ve_increase;
-  GBCu8    ve_step;
-  GBCu8    ve_counter;
-  
-  /* PseudoRandom Number Generator. */
-  GBCu16   pr_prng;
-  char     pr_out;
-  GBC_Bool pr_mode15b;
-  
-} _ch4;
-
-/* Indica que el so està activat o no. */
-static GBC_Bool _sound_on;
-static GBC_Bool _stop;
-
-/* Buffers per a cada canal. Açò es abans de convertir al valor
-   real. */
-static GBCu8 _buffer[4][GBC_APU_BUFFER_SIZE];
-
-/* Comptadors i cicles per processar. */
-static struct
-{
-  
-  int pos;          /* Següent sample a generar, on 0 és el primer. */
-  int cc;           /* Cicles de UCP acumulats. */
-  int cctoFrame;    /* Cicles que falten per a plenar el buffer. */
-  
-} _timing;
-
-/* Buffers d'eixida. */
-static double _left[GBC_APU_BUFFER_SIZE];
-static double _right[GBC_APU_BUFFER_SIZE];
-
-/* Màscares dels canals. */
-static int _left_mask;
-static int _right_mask;
-
-/* Callback. */
-static GBC_PlaySound *_play_sound;
-static void *_udata;
+/* L'estat està en 'GBC_Machine' (veure 'machine.h'). */
+#define _vin (m->apu.vin)
+#define _duty_pat (m->apu.duty_pat)
+#define _ch1 (m->apu.ch1)
+#define _ch2 (m->apu.ch2)
+#define _ch3 (m->apu.ch3)
+#define _ch4 (m->apu.ch4)
+#define _sound_on (m->apu.sound_on)
+#define _stop (m->apu.stop)
+#define _buffer (m->apu.buffer)
+#define _timing (m->apu.timing)
+#define _left (m->apu.left)
+#define _right (m->apu.right)
+#define _left_mask (m->apu.left_mask)
+#define _right_mask (m->apu.right_mask)
+#define _play_sound (m->apu.play_sound)
+#define _udata (m->apu.udata)
 
 
 
@@ -282,6 +121,7 @@ static void *_udata;
 /* Hi ha un cas en el que pot parar el canal. */
 static void
 calc_sweep (
+            GBC_Machine *m,
             const bool update
             )
 {
@@ -324,6 +164,7 @@ render_off (
 
 static void
 render_ch1 (
+            GBC_Machine *m,
             GBCu8     buffer[GBC_APU_BUFFER_SIZE],
             const int begin,
             const int end
@@ -361,8 +202,8 @@ render_ch1 (
                       if ( _ch1.sw_counter == 0 ) _ch1.sw_counter= 8;
         	      if ( _ch1.sw_time != 0 && _ch1.sw_enabled )
         		{
-        		  calc_sweep ( true );
-                          calc_sweep ( false );
+        		  calc_sweep ( m, true );
+                          calc_sweep ( m, false );
         		  // Açò és sols perquè en prepare_sweep es
         		  // pot desactivar el canal.
         		  if ( !_ch1.enabled ) vol= 0x0;
@@ -414,6 +255,7 @@ render_ch1 (
 
 static void
 render_ch2 (
+            GBC_Machine *m,
             GBCu8     buffer[GBC_APU_BUFFER_SIZE],
             const int begin,
             const int end
@@ -483,6 +325,7 @@ render_ch2 (
 
 static void
 render_ch3 (
+            GBC_Machine *m,
             GBCu8     buffer[GBC_APU_BUFFER_SIZE],
             const int begin,
             const int end
@@ -534,6 +377,7 @@ render_ch3 (
 
 static void
 render_ch4 (
+            GBC_Machine *m,
             GBCu8     buffer[GBC_APU_BUFFER_SIZE],
             const int begin,
             const int end
@@ -605,6 +449,7 @@ render_ch4 (
 
 static void
 join_channels (
+               GBC_Machine *m,
                int     mask,
                double *channel,
                double  master_vol
@@ -629,6 +474,7 @@ join_channels (
 
 static void
 run (
+     GBC_Machine *m,
      const int begin,
      const int end
      )
@@ -639,10 +485,10 @@ run (
   
   if ( _sound_on && !_stop )
     {
-      render_ch1 ( _buffer[0], begin, end );
-      render_ch2 ( _buffer[1], begin, end );
-      render_ch3 ( _buffer[2], begin, end );
-      render_ch4 ( _buffer[3], begin, end );
+      render_ch1 ( m, _buffer[0], begin, end );
+      render_ch2 ( m, _buffer[1], begin, end );
+      render_ch3 ( m, _buffer[2], begin, end );
+      render_ch4 ( m, _buffer[3], begin, end );
     }
   else
     {
@@ -656,8 +502,8 @@ run (
     {
       master_vol_l= ((_vin>>4)&0x7)/7.0;
       master_vol_r= (_vin&0x7)/7.0;
-      join_channels ( _left_mask, _left, master_vol_l );
-      join_channels ( _right_mask, _right, master_vol_r );
+      join_channels ( m, _left_mask, _left, master_vol_l );
+      join_channels ( m, _right_mask, _right, master_vol_r );
       _play_sound ( _left, _right, _udata );
     }
   
@@ -665,7 +511,9 @@ run (
 
 
 static void
-clock (void)
+update_clock (
+       GBC_Machine *m
+       )
 {
   
   int npos;
@@ -680,20 +528,22 @@ clock (void)
   _timing.cctoFrame+= _timing.cc;
   while ( npos >= GBC_APU_BUFFER_SIZE )
     {
-      run ( _timing.pos, GBC_APU_BUFFER_SIZE );
+      run ( m, _timing.pos, GBC_APU_BUFFER_SIZE );
       npos-= GBC_APU_BUFFER_SIZE;
       _timing.pos= 0;
     }
-  run ( _timing.pos, npos );
+  run ( m, _timing.pos, npos );
   _timing.pos= npos;
   if ( _timing.cctoFrame <= 0 )
     _timing.cctoFrame= (GBC_APU_BUFFER_SIZE-_timing.pos)*4;
   
-} /* end clock */
+} /* end update_clock */
 
 
 static void
-init_duty_pat (void)
+init_duty_pat (
+               GBC_Machine *m
+               )
 {
   
   int i, j, k, p;
@@ -719,6 +569,7 @@ init_duty_pat (void)
 
 void
 GBC_apu_ch1_freq_hi (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     )
 {
@@ -727,7 +578,7 @@ GBC_apu_ch1_freq_hi (
   
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   /* NOTA: L'ordre és important. */
   _ch1.pt_freq&= 0x0FF;
@@ -749,7 +600,7 @@ GBC_apu_ch1_freq_hi (
       _ch1.sw_enabled= _ch1.sw_time != 0 || _ch1.sw_shift != 0;
       _ch1.sw_counter= _ch1.sw_time;
       if ( _ch1.sw_counter == 0 ) _ch1.sw_counter= 8;
-      if ( _ch1.sw_shift != 0 ) calc_sweep ( true );
+      if ( _ch1.sw_shift != 0 ) calc_sweep ( m, true );
       _ch1.dc_pos= 96-8; /* 1/12*8 steps de delay. */
       _ch1.dc_out= _duty_pat[_ch1.dc_wave_pattern][_ch1.dc_pos];
       _ch1.ve_counter= _ch1.ve_step;
@@ -762,12 +613,13 @@ GBC_apu_ch1_freq_hi (
 
 void
 GBC_apu_ch1_freq_lo (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     )
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch1.pt_freq&= 0x700;
   _ch1.pt_freq|= data;
@@ -776,13 +628,15 @@ GBC_apu_ch1_freq_lo (
 
 
 GBCu8
-GBC_apu_ch1_get_lc_status (void)
+GBC_apu_ch1_get_lc_status (
+                           GBC_Machine *m
+                           )
 {
 
   GBCu8 ret;
 
   
-  clock ();
+  update_clock ( m );
   
   ret= 0xBF | (_ch1.lc_enabled ? 0x40 : 0x00);
   
@@ -792,7 +646,9 @@ GBC_apu_ch1_get_lc_status (void)
 
 
 GBCu8
-GBC_apu_ch1_get_wave_pattern_duty (void)
+GBC_apu_ch1_get_wave_pattern_duty (
+                                   GBC_Machine *m
+                                   )
 {
 
   GBCu8 ret;
@@ -809,12 +665,13 @@ GBC_apu_ch1_get_wave_pattern_duty (void)
 
 void
 GBC_apu_ch1_set_length_wave_pattern_dutty (
+        				   GBC_Machine *m,
         				   GBCu8 data
         				   )
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch1.dc_wave_pattern= data>>6;
   _ch1.dc_out= _duty_pat[_ch1.dc_wave_pattern][_ch1.dc_pos];
@@ -824,7 +681,9 @@ GBC_apu_ch1_set_length_wave_pattern_dutty (
 
 
 GBCu8
-GBC_apu_ch1_sweep_read (void)
+GBC_apu_ch1_sweep_read (
+                        GBC_Machine *m
+                        )
 {
 
   GBCu8 ret;
@@ -842,6 +701,7 @@ GBC_apu_ch1_sweep_read (void)
 
 void
 GBC_apu_ch1_sweep_write (
+        		 GBC_Machine *m,
         		 GBCu8 data
         		 )
 {
@@ -850,7 +710,7 @@ GBC_apu_ch1_sweep_write (
   
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch1.sw_time= (data>>4)&0x7;
   old_increase= _ch1.sw_increase;
@@ -864,7 +724,9 @@ GBC_apu_ch1_sweep_write (
 
 
 GBCu8
-GBC_apu_ch1_volume_envelope_read (void)
+GBC_apu_ch1_volume_envelope_read (
+                                  GBC_Machine *m
+                                  )
 {
 
   GBCu8 ret;
@@ -881,12 +743,13 @@ GBC_apu_ch1_volume_envelope_read (void)
 
 void
 GBC_apu_ch1_volume_envelope_write (
+        			   GBC_Machine *m,
         			   GBCu8 data
         			   )
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch1.ve_vol_reg= data>>4;
   _ch1.mccswitch= ((data&0xF8)!=0);
@@ -901,6 +764,7 @@ GBC_apu_ch1_volume_envelope_write (
 
 void
 GBC_apu_ch2_freq_hi (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     )
 {
@@ -909,7 +773,7 @@ GBC_apu_ch2_freq_hi (
   
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   /* NOTA: L'ordre és important. */
   _ch2.pt_freq&= 0x0FF;
@@ -939,12 +803,13 @@ GBC_apu_ch2_freq_hi (
 
 void
 GBC_apu_ch2_freq_lo (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     )
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch2.pt_freq&= 0x700;
   _ch2.pt_freq|= data;
@@ -953,10 +818,12 @@ GBC_apu_ch2_freq_lo (
 
 
 GBCu8
-GBC_apu_ch2_get_lc_status (void)
+GBC_apu_ch2_get_lc_status (
+                           GBC_Machine *m
+                           )
 {
   
-  clock ();
+  update_clock ( m );
   
   return 0xBF | (_ch2.lc_enabled ? 0x40 : 0x00);
   
@@ -964,7 +831,9 @@ GBC_apu_ch2_get_lc_status (void)
 
 
 GBCu8
-GBC_apu_ch2_get_wave_pattern_duty (void)
+GBC_apu_ch2_get_wave_pattern_duty (
+                                   GBC_Machine *m
+                                   )
 {
   
   /* Estos valors no es poden modificar durant l'execució, per tant no
@@ -977,12 +846,13 @@ GBC_apu_ch2_get_wave_pattern_duty (void)
 
 void
 GBC_apu_ch2_set_length_wave_pattern_dutty (
+        				   GBC_Machine *m,
         				   GBCu8 data
         				   )
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch2.dc_wave_pattern= data>>6;
   _ch2.dc_out= _duty_pat[_ch2.dc_wave_pattern][_ch2.dc_pos];
@@ -992,7 +862,9 @@ GBC_apu_ch2_set_length_wave_pattern_dutty (
 
 
 GBCu8
-GBC_apu_ch2_volume_envelope_read (void)
+GBC_apu_ch2_volume_envelope_read (
+                                  GBC_Machine *m
+                                  )
 {
   
   /* Estos valors no es modifiquen en el renderitzat i per tant no
@@ -1004,12 +876,13 @@ GBC_apu_ch2_volume_envelope_read (void)
 
 void
 GBC_apu_ch2_volume_envelope_write (
+        			   GBC_Machine *m,
         			   GBCu8 data
         			   )
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch2.ve_vol_reg= data>>4;
   _ch2.mccswitch= ((data&0xF8)!=0);
@@ -1024,6 +897,7 @@ GBC_apu_ch2_volume_envelope_write (
 
 void
 GBC_apu_ch3_freq_hi (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     )
 {
@@ -1032,7 +906,7 @@ GBC_apu_ch3_freq_hi (
   
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   /* NOTA: L'ordre és important. */
   _ch3.pt_freq&= 0x0FF;
@@ -1058,12 +932,13 @@ GBC_apu_ch3_freq_hi (
 
 void
 GBC_apu_ch3_freq_lo (
+        	     GBC_Machine *m,
         	     GBCu8 data
         	     )
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch3.pt_freq&= 0x700;
   _ch3.pt_freq|= data;
@@ -1072,10 +947,12 @@ GBC_apu_ch3_freq_lo (
 
 
 GBCu8
-GBC_apu_ch3_get_lc_status (void)
+GBC_apu_ch3_get_lc_status (
+                           GBC_Machine *m
+                           )
 {
   
-  clock ();
+  update_clock ( m );
   
   return 0xBF | (_ch3.lc_enabled ? 0x40 : 0x00);
   
@@ -1083,7 +960,9 @@ GBC_apu_ch3_get_lc_status (void)
 
 
 GBCu8
-GBC_apu_ch3_output_level_read (void)
+GBC_apu_ch3_output_level_read (
+                               GBC_Machine *m
+                               )
 {
   
   switch ( _ch3.su_val )
@@ -1100,12 +979,13 @@ GBC_apu_ch3_output_level_read (void)
 
 void
 GBC_apu_ch3_output_level_write (
+        			GBC_Machine *m,
         			GBCu8 data
         			)
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   switch ( (data>>5)&0x3 )
     {
@@ -1120,6 +1000,7 @@ GBC_apu_ch3_output_level_write (
 
 GBCu8
 GBC_apu_ch3_ram_read (
+        	      GBC_Machine *m,
         	      int pos
         	      )
 {
@@ -1127,7 +1008,7 @@ GBC_apu_ch3_ram_read (
   int aux;
   
   
-  clock ();
+  update_clock ( m );
   
   aux= _ch3.enabled ? (_ch3.su_pos&0xFE) : pos<<1;
   
@@ -1138,6 +1019,7 @@ GBC_apu_ch3_ram_read (
 
 void
 GBC_apu_ch3_ram_write (
+        	       GBC_Machine *m,
         	       GBCu8 data,
         	       int   pos
         	       )
@@ -1147,7 +1029,7 @@ GBC_apu_ch3_ram_write (
   
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   aux= _ch3.enabled ? (_ch3.su_pos&0xFE) : pos<<1;
   _ch3.ram[aux]= data>>4;
@@ -1158,12 +1040,13 @@ GBC_apu_ch3_ram_write (
 
 void
 GBC_apu_ch3_set_length (
+        		GBC_Machine *m,
         		GBCu8 data
         		)
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch3.lc_counter= 256 - (GBCu16) data;
   
@@ -1171,7 +1054,9 @@ GBC_apu_ch3_set_length (
 
 
 GBCu8
-GBC_apu_ch3_sound_on_off_read (void)
+GBC_apu_ch3_sound_on_off_read (
+                               GBC_Machine *m
+                               )
 {
   return _ch3.mccswitch ? 0xFF : 0x7F;
 } /* end GBC_apu_ch3_sound_on_off_read */
@@ -1179,12 +1064,13 @@ GBC_apu_ch3_sound_on_off_read (void)
 
 void
 GBC_apu_ch3_sound_on_off_write (
+        			GBC_Machine *m,
         			GBCu8 data
         			)
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
 
   _ch3.mccswitch= ((data&0x80)!=0);
   if ( !_ch3.mccswitch ) _ch3.enabled= GBC_FALSE;
@@ -1193,10 +1079,12 @@ GBC_apu_ch3_sound_on_off_write (
 
 
 GBCu8
-GBC_apu_ch4_get_lc_status (void)
+GBC_apu_ch4_get_lc_status (
+                           GBC_Machine *m
+                           )
 {
   
-  clock ();
+  update_clock ( m );
   
   return 0xBF | (_ch4.lc_enabled ? 0x40 : 0x00);
   
@@ -1205,6 +1093,7 @@ GBC_apu_ch4_get_lc_status (void)
 
 void
 GBC_apu_ch4_init (
+        	  GBC_Machine *m,
         	  GBCu8 data
         	  )
 {
@@ -1213,7 +1102,7 @@ GBC_apu_ch4_init (
   
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   /* NOTA: L'ordre és important. */
   /* Counter/consecutive selection. */
@@ -1241,7 +1130,9 @@ GBC_apu_ch4_init (
 
 
 GBCu8
-GBC_apu_ch4_polynomial_counter_read (void)
+GBC_apu_ch4_polynomial_counter_read (
+                                     GBC_Machine *m
+                                     )
 {
   return (_ch4.ct_scfreq<<4) | (_ch4.pr_mode15b?0x00:0x08) | _ch4.ct_ratio;
 } /* end GBC_apu_ch4_polynomial_counter_read */
@@ -1249,12 +1140,13 @@ GBC_apu_ch4_polynomial_counter_read (void)
 
 void
 GBC_apu_ch4_polynomial_counter_write (
+        			      GBC_Machine *m,
         			      GBCu8 data
         			      )
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch4.ct_scfreq= data>>4;
   _ch4.pr_mode15b= ((data&0x08)==0);
@@ -1265,12 +1157,13 @@ GBC_apu_ch4_polynomial_counter_write (
 
 void
 GBC_apu_ch4_set_length (
+        		GBC_Machine *m,
         		GBCu8 data
         		)
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch4.lc_counter= 64 - (data&0x3F);
   
@@ -1278,7 +1171,9 @@ GBC_apu_ch4_set_length (
 
 
 GBCu8
-GBC_apu_ch4_volume_envelope_read (void)
+GBC_apu_ch4_volume_envelope_read (
+                                  GBC_Machine *m
+                                  )
 {
   
   /* Estos valors no es modifiquen en el renderitzat i per tant no
@@ -1290,12 +1185,13 @@ GBC_apu_ch4_volume_envelope_read (void)
 
 void
 GBC_apu_ch4_volume_envelope_write (
+        			   GBC_Machine *m,
         			   GBCu8 data
         			   )
 {
   
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   
   _ch4.ve_vol_reg= data>>4;
   _ch4.mccswitch= ((data&0xF8)!=0);
@@ -1310,21 +1206,24 @@ GBC_apu_ch4_volume_envelope_write (
 
 void
 GBC_apu_clock (
+               GBC_Machine *m,
                const int cc
                )
 {
   
   if ( (_timing.cc+= cc) >= _timing.cctoFrame )
-    clock ();
+    update_clock ( m );
   
 } /* end GBC_apu_clock */
 
 
 GBCu8
-GBC_apu_get_status (void)
+GBC_apu_get_status (
+                    GBC_Machine *m
+                    )
 {
   
-  clock ();
+  update_clock ( m );
   
   return
     0x70 |
@@ -1339,21 +1238,24 @@ GBC_apu_get_status (void)
 
 void
 GBC_apu_init (
+              GBC_Machine   *m,
               GBC_PlaySound *play_sound,
               void          *udata
               )
 {
   
-  init_duty_pat ();
+  init_duty_pat ( m );
   _play_sound= play_sound;
   _udata= udata;
-  GBC_apu_init_state ();
+  GBC_apu_init_state ( m );
   
 } /* end GBC_apu_init */
 
 
 void
-GBC_apu_init_state (void)
+GBC_apu_init_state (
+                    GBC_Machine *m
+                    )
 {
   
   int i;
@@ -1465,8 +1367,19 @@ GBC_apu_init_state (void)
 } /* end GBC_apu_init_state */
 
 
+int
+GBC_apu_next_event (
+                    GBC_Machine *m
+                    )
+{
+  return _timing.cctoFrame - _timing.cc;
+} /* end GBC_apu_next_event */
+
+
 void
-GBC_apu_power_up (void)
+GBC_apu_power_up (
+                  GBC_Machine *m
+                  )
 {
   
   /* Canal 1. */
@@ -1514,7 +1427,9 @@ GBC_apu_power_up (void)
 
 
 GBCu8
-GBC_apu_select_out_read (void)
+GBC_apu_select_out_read (
+                         GBC_Machine *m
+                         )
 {
   return (_left_mask<<4) | _right_mask;
 } /* end GBC_apu_select_out_read */
@@ -1522,13 +1437,14 @@ GBC_apu_select_out_read (void)
 
 void
 GBC_apu_select_out_write (
+        		  GBC_Machine *m,
         		  GBCu8 data
         		  )
 {
   
   /* SO1 -> right; SO2 -> left. */
   if ( !_sound_on ) return;
-  clock ();
+  update_clock ( m );
   _left_mask= data>>4;
   _right_mask= data&0xF;
   
@@ -1537,11 +1453,12 @@ GBC_apu_select_out_write (
 
 void
 GBC_apu_stop (
+              GBC_Machine   *m,
               const GBC_Bool state
               )
 {
   
-  clock ();
+  update_clock ( m );
   _stop= state;
   
 } /* end GBC_apu_stop */
@@ -1549,6 +1466,7 @@ GBC_apu_stop (
 
 void
 GBC_apu_turn_on (
+        	 GBC_Machine *m,
         	 GBCu8 data
         	 )
 {
@@ -1556,7 +1474,7 @@ GBC_apu_turn_on (
   GBC_Bool old;
   
   
-  clock ();
+  update_clock ( m );
   
   old= _sound_on;
   _sound_on= (data&0x80)!=0;
@@ -1640,7 +1558,9 @@ GBC_apu_turn_on (
 
 
 GBCu8
-GBC_apu_vin_read (void)
+GBC_apu_vin_read (
+                  GBC_Machine *m
+                  )
 {
   return _vin;
 } /* end GBC_apu_vin_read */
@@ -1648,6 +1568,7 @@ GBC_apu_vin_read (void)
 
 void
 GBC_apu_vin_write (
+        	   GBC_Machine *m,
         	   GBCu8 data
         	   )
 {
@@ -1660,6 +1581,7 @@ GBC_apu_vin_write (
 
 int
 GBC_apu_save_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    )
 {
@@ -1685,6 +1607,7 @@ GBC_apu_save_state (
 
 int
 GBC_apu_load_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    )
 {
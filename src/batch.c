@@ -0,0 +1,558 @@
+/*
+ * Copyright 2011-2013,2015,2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  batch.c - Execució en paral·lel de treballs sense interfície.
+ *
+ *  NOTA: Aquest és l'únic mòdul que depén de POSIX (fils i
+ *  rellotge monòton).
+ *  NOTA: Tots els treballs es reparteixen al principi entre les cues
+ *  dels fils. Cada fil trau treballs del final de la seua cua i, quan
+ *  està buida, en roba del principi de les cues dels altres fils. Com
+ *  no es creen treballs nous, un fil acaba quan totes les cues estan
+ *  buides.
+ *
+ */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "GBC.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+
+#define FNV_BYTE(HASH,BYTE)        			\
+  (HASH)= ((HASH)^((GBCu8) (BYTE)))*FNV_PRIME
+
+#define DIRECTIONS (GBC_RIGHT|GBC_LEFT|GBC_UP|GBC_DOWN)
+#define BUTTONS (GBC_BUTTON_A|GBC_BUTTON_B|GBC_SELECT|GBC_START)
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+/* Cua de treballs d'un fil. */
+typedef struct
+{
+
+  pthread_mutex_t  lock;
+  int             *v;       /* Índexs dels treballs. */
+  int              head;    /* Primer treball (per a robar). */
+  int              tail;    /* Un més que l'últim treball (per al
+        		       propietari). */
+
+} queue_t;
+
+/* Conjunt de fils. */
+typedef struct
+{
+
+  GBC_BatchJob *jobs;
+  queue_t      *queues;
+  int           nqueues;
+
+} pool_t;
+
+/* Argument de cada fil. */
+typedef struct
+{
+
+  pool_t *pool;
+  int     id;
+
+} worker_t;
+
+/* Estat d'un treball en execució. És el 'udata' del frontend. */
+typedef struct
+{
+
+  GBC_BatchJob *job;
+  int           frames;     /* Frames completats. */
+  int           buttons;    /* Botons apretats actualment. */
+  int           next;       /* Següent entrada del guió. */
+  GBCu8        *eram;       /* RAM externa. */
+  GBCu32        fb_hash;
+  GBCu32        audio_hash;
+
+} run_t;
+
+
+/* Noms dels botons en els guions. */
+static const struct
+{
+
+  const char *name;
+  int         button;
+
+} BUTTON_NAMES[]=
+  {
+    { "RIGHT", GBC_RIGHT },
+    { "LEFT", GBC_LEFT },
+    { "UP", GBC_UP },
+    { "DOWN", GBC_DOWN },
+    { "A", GBC_BUTTON_A },
+    { "B", GBC_BUTTON_B },
+    { "SELECT", GBC_SELECT },
+    { "START", GBC_START },
+    { NULL, 0 }
+  };
+
+
+
+
+/************/
+/* FRONTEND */
+/************/
+
+static void
+warning (
+         void       *udata,
+         const char *format,
+         ...
+         )
+{
+} /* end warning */
+
+
+static GBCu8 *
+get_external_ram (
+        	  const size_t  nbytes,
+        	  void         *udata
+        	  )
+{
+
+  run_t *run;
+
+
+  run= (run_t *) udata;
+  if ( run->eram != NULL ) free ( run->eram );
+  run->eram= (GBCu8 *) calloc ( nbytes, 1 );
+
+  return run->eram;
+
+} /* end get_external_ram */
+
+
+static void
+update_screen (
+               const void             *fb,
+               const GBC_FrameChanges *changes,
+               void                   *udata
+               )
+{
+
+  run_t *run;
+  GBCu32 hash;
+  const int *pix;
+  int i;
+
+
+  pix= (const int *) fb;
+  run= (run_t *) udata;
+  if ( ++run->frames == run->job->frames )
+    {
+      hash= FNV_OFFSET;
+      for ( i= 0; i < 23040; ++i )
+        {
+          FNV_BYTE ( hash, pix[i] );
+          FNV_BYTE ( hash, pix[i]>>8 );
+        }
+      run->fb_hash= hash;
+    }
+
+} /* end update_screen */
+
+
+static int
+check_buttons (
+               void *udata
+               )
+{
+  return ((run_t *) udata)->buttons;
+} /* end check_buttons */
+
+
+static void
+play_sound (
+            const double  left[GBC_APU_BUFFER_SIZE],
+            const double  right[GBC_APU_BUFFER_SIZE],
+            void         *udata
+            )
+{
+
+  run_t *run;
+  GBCu32 hash;
+  GBCu16 l, r;
+  int i;
+
+
+  run= (run_t *) udata;
+  hash= run->audio_hash;
+  for ( i= 0; i < GBC_APU_BUFFER_SIZE; ++i )
+    {
+      l= (GBCu16) ((int) (left[i]*32767.0));
+      r= (GBCu16) ((int) (right[i]*32767.0));
+      FNV_BYTE ( hash, l );
+      FNV_BYTE ( hash, l>>8 );
+      FNV_BYTE ( hash, r );
+      FNV_BYTE ( hash, r>>8 );
+    }
+  run->audio_hash= hash;
+
+} /* end play_sound */
+
+
+static void
+update_rumble (
+               const int  level,
+               void      *udata
+               )
+{
+} /* end update_rumble */
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static double
+get_time (void)
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+} /* end get_time */
+
+
+/* Aplica les entrades del guió fins al frame actual. */
+static void
+update_input (
+              GBC_Machine *m,
+              run_t       *run
+              )
+{
+
+  const GBC_BatchJob *job;
+  int old, pressed;
+
+
+  job= run->job;
+  old= run->buttons;
+  while ( run->next < job->ninput &&
+          job->input[run->next].frame <= run->frames )
+    run->buttons= job->input[run->next++].buttons;
+  pressed= run->buttons&(~old);
+  if ( pressed )
+    GBC_key_pressed ( m, (pressed&BUTTONS)!=0, (pressed&DIRECTIONS)!=0 );
+
+} /* end update_input */
+
+
+static void
+run_job (
+         GBC_BatchJob *job
+         )
+{
+
+  static const GBC_Frontend frontend=
+    {
+      warning,
+      get_external_ram,
+      update_screen,
+      NULL,
+      check_buttons,
+      play_sound,
+      update_rumble,
+      NULL,
+      GBC_FB_CGB15
+    };
+
+  GBC_Machine *m;
+  run_t run;
+  GBC_Bool stop;
+  int frames;
+  GBCu64 cc, max_cc;
+  double t0;
+
+
+  t0= get_time ();
+  job->frames_done= 0;
+  job->fb_hash= job->audio_hash= 0;
+  m= GBC_machine_new ();
+  if ( m == NULL )
+    {
+      job->err= GBC_ENOMEM;
+      job->wall_time= get_time () - t0;
+      return;
+    }
+  run.job= job;
+  run.frames= 0;
+  run.buttons= 0;
+  run.next= 0;
+  run.eram= NULL;
+  run.fb_hash= FNV_OFFSET;
+  run.audio_hash= FNV_OFFSET;
+  job->err= GBC_init ( m, job->bios, job->rom, &frontend, &run );
+  if ( job->err == GBC_NOERROR )
+    {
+      stop= GBC_FALSE;
+      update_input ( m, &run );
+      cc= 0;
+      max_cc= ((GBCu64) job->frames)*GBC_BATCH_FRAME_CC;
+      while ( run.frames < job->frames && !stop && cc < max_cc )
+        {
+          frames= run.frames;
+          cc+= (GBCu64) GBC_iter ( m, &stop );
+          if ( frames != run.frames ) update_input ( m, &run );
+        }
+      if ( run.frames < job->frames ) job->err= GBC_ETIMEOUT;
+      job->frames_done= run.frames;
+      job->fb_hash= run.fb_hash;
+      job->audio_hash= run.audio_hash;
+    }
+  GBC_machine_free ( m );
+  if ( run.eram != NULL ) free ( run.eram );
+  job->wall_time= get_time () - t0;
+
+} /* end run_job */
+
+
+/* Torna el següent treball per al fil ID o -1 si no en queden. */
+static int
+next_job (
+          pool_t    *pool,
+          const int  id
+          )
+{
+
+  queue_t *q;
+  int i, ret;
+
+
+  /* Cua pròpia. */
+  q= &(pool->queues[id]);
+  pthread_mutex_lock ( &(q->lock) );
+  ret= q->head < q->tail ? q->v[--q->tail] : -1;
+  pthread_mutex_unlock ( &(q->lock) );
+
+  /* Roba. */
+  for ( i= 1; ret == -1 && i < pool->nqueues; ++i )
+    {
+      q= &(pool->queues[(id+i)%pool->nqueues]);
+      pthread_mutex_lock ( &(q->lock) );
+      if ( q->head < q->tail ) ret= q->v[q->head++];
+      pthread_mutex_unlock ( &(q->lock) );
+    }
+
+  return ret;
+
+} /* end next_job */
+
+
+static void *
+worker (
+        void *arg
+        )
+{
+
+  worker_t *w;
+  int job;
+
+
+  w= (worker_t *) arg;
+  while ( (job= next_job ( w->pool, w->id )) != -1 )
+    run_job ( &(w->pool->jobs[job]) );
+
+  return NULL;
+
+} /* end worker */
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+int
+GBC_batch_read_input (
+        	      FILE            *f,
+        	      GBC_BatchInput **input,
+        	      int             *ninput
+        	      )
+{
+
+  char line[256], *p, *tok;
+  GBC_BatchInput *v, *aux;
+  int n, size, frame, buttons, i;
+
+
+  v= NULL; n= size= 0;
+  while ( fgets ( line, sizeof(line), f ) != NULL )
+    {
+
+      /* Frame. */
+      for ( p= line; isspace ( (unsigned char) *p ); ++p );
+      if ( *p == '\0' || *p == '#' ) continue;
+      frame= (int) strtol ( p, &p, 10 );
+      if ( frame < 0 || (n > 0 && frame < v[n-1].frame) ) goto error;
+
+      /* Botons. */
+      buttons= 0;
+      for ( tok= strtok ( p, " \t\r\n" ); tok != NULL;
+            tok= strtok ( NULL, " \t\r\n" ) )
+        {
+          if ( tok[0] == '#' ) break;
+          if ( !strcmp ( tok, "-" ) ) continue;
+          for ( i= 0; BUTTON_NAMES[i].name != NULL &&
+        	  strcmp ( tok, BUTTON_NAMES[i].name ); ++i );
+          if ( BUTTON_NAMES[i].name == NULL ) goto error;
+          buttons|= BUTTON_NAMES[i].button;
+        }
+
+      /* Afegeix. */
+      if ( n == size )
+        {
+          size= size ? size*2 : 16;
+          aux= (GBC_BatchInput *) realloc ( v, sizeof(GBC_BatchInput)*size );
+          if ( aux == NULL ) goto error;
+          v= aux;
+        }
+      v[n].frame= frame;
+      v[n].buttons= buttons;
+      ++n;
+
+    }
+  if ( ferror ( f ) ) goto error;
+  *input= v;
+  *ninput= n;
+
+  return 0;
+
+ error:
+  if ( v != NULL ) free ( v );
+  return -1;
+
+} /* end GBC_batch_read_input */
+
+
+int
+GBC_batch_run (
+               GBC_BatchJob *jobs,
+               const int     njobs,
+               int           nthreads
+               )
+{
+
+  pool_t pool;
+  worker_t *workers;
+  pthread_t *threads;
+  int i, nstarted, ret;
+
+
+  if ( njobs <= 0 ) return 0;
+  if ( nthreads <= 0 )
+    {
+      nthreads= (int) sysconf ( _SC_NPROCESSORS_ONLN );
+      if ( nthreads <= 0 ) nthreads= 1;
+    }
+  if ( nthreads > njobs ) nthreads= njobs;
+
+  /* Reserva i reparteix els treballs. */
+  ret= -1;
+  pool.jobs= jobs;
+  pool.nqueues= nthreads;
+  pool.queues= (queue_t *) calloc ( nthreads, sizeof(queue_t) );
+  workers= (worker_t *) malloc ( sizeof(worker_t)*nthreads );
+  threads= (pthread_t *) malloc ( sizeof(pthread_t)*nthreads );
+  if ( pool.queues == NULL || workers == NULL || threads == NULL )
+    goto end;
+  for ( i= 0; i < nthreads; ++i )
+    {
+      pool.queues[i].v= (int *) malloc ( sizeof(int)*(njobs/nthreads+1) );
+      if ( pool.queues[i].v == NULL ) goto end;
+      pthread_mutex_init ( &(pool.queues[i].lock), NULL );
+      pool.queues[i].head= pool.queues[i].tail= 0;
+    }
+  /* En ordre invers perquè cada fil comence pel primer treball que li
+     toca. */
+  for ( i= njobs-1; i >= 0; --i )
+    {
+      queue_t *q= &(pool.queues[i%nthreads]);
+      q->v[q->tail++]= i;
+    }
+
+  /* Executa. El fil actual fa de fil 0. */
+  for ( nstarted= 1; nstarted < nthreads; ++nstarted )
+    {
+      workers[nstarted].pool= &pool;
+      workers[nstarted].id= nstarted;
+      if ( pthread_create ( &threads[nstarted], NULL,
+        		    worker, &workers[nstarted] ) != 0 )
+        break;
+    }
+  workers[0].pool= &pool;
+  workers[0].id= 0;
+  worker ( &workers[0] );
+  for ( i= 1; i < nstarted; ++i )
+    pthread_join ( threads[i], NULL );
+  ret= 0;
+
+ end:
+  if ( pool.queues != NULL )
+    {
+      for ( i= 0; i < nthreads; ++i )
+        if ( pool.queues[i].v != NULL )
+          {
+            pthread_mutex_destroy ( &(pool.queues[i].lock) );
+            free ( pool.queues[i].v );
+          }
+      free ( pool.queues );
+    }
+  if ( workers != NULL ) free ( workers );
+  if ( threads != NULL ) free ( threads );
+
+  return ret;
+
+} /* end GBC_batch_run */
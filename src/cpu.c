@@ -38,7 +38,23 @@
  */
 
 
+/* El compilador dinàmic genera codi x86-64 en memòria reservada amb
+ * 'mmap'. La memòria mai és escrivible i executable a la vegada: les
+ * pàgines on s'escriu un bloc es canvien amb 'mprotect'. Es
+ * desactiva definint GBC_CPU_NO_JIT. */
+#if defined(__x86_64__) && defined(__unix__) && !defined(GBC_CPU_NO_JIT)
+#define CPU_JIT
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stddef.h>
+#ifdef CPU_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "GBC.h"
+#include "machine.h"
 
 
 
@@ -54,6 +70,33 @@
   if ( fread ( &(VAR), sizeof(VAR), 1, f ) != 1 ) return -1
 
 
+/* Nucli d'execució. Amb GCC/Clang 'GBC_cpu_run_cycles' utilitza per
+ * defecte un nucli amb 'computed goto' (etiquetes com a valors). Si es
+ * defineix GBC_CPU_NO_THREADED s'utilitza sempre la taula de funcions,
+ * que és C estàndard. */
+#if defined(__GNUC__) && !defined(GBC_CPU_NO_THREADED)
+#define CPU_THREADED
+#endif
+
+/* Cache de blocs bàsics descodificats. Es desactiva definint
+ * GBC_CPU_NO_BLOCKS. */
+#ifndef GBC_CPU_NO_BLOCKS
+#define CPU_BLOCKS
+#endif
+
+/* La variant amb traça (veure 'cpu_trace.c') sols executa
+ * instruccions soltes amb la taula de funcions. */
+#ifdef CPU_TRACE
+#undef CPU_THREADED
+#undef CPU_BLOCKS
+#endif
+
+/* El compilador dinàmic tradueix blocs de la cache. */
+#if defined(CPU_JIT) && !defined(CPU_BLOCKS)
+#undef CPU_JIT
+#endif
+
+
 #define VBINT 0x01
 #define LSINT 0x02
 #define TIINT 0x04
@@ -70,10 +113,21 @@
 #define CFLAG 0x01
 
 
+/* Llig el següent byte de la instrucció actual. Dins d'un bloc els
+   operands ja estan descodificats. */
+#ifdef CPU_BLOCKS
+#define FETCH        							\
+  (_blocks.ops!=NULL ?        						\
+   (++_regs.PC,*(_blocks.ops++)) : mem_read ( m, _regs.PC++ ))
+#else
+#define FETCH mem_read ( m, _regs.PC++ )
+#endif
+
+
 #define R16(HI,LO) ((((GBCu16) _regs.HI)<<8)|_regs.LO)
 #define GET_NN(ADDR)        				\
-  ADDR= GBC_mem_read ( _regs.PC++ );        		\
-  ADDR|= ((GBCu16) GBC_mem_read ( _regs.PC++ ))<<8
+  ADDR= FETCH;                                          \
+  ADDR|= ((GBCu16) FETCH)<<8
 #define RESET_FLAGS(MASK) _regs.F&= ((MASK)^0xff)
 #define INCR16(HI,LO) if ( ++_regs.LO == 0x00 ) ++_regs.HI
 #define DECR16(HI,LO) if ( --_regs.LO == 0xff ) --_regs.HI
@@ -180,44 +234,44 @@
   RESET_FLAGS ( ZFLAG|HFLAG|NFLAG|CFLAG );        		\
   (VAR)= ((VAR)<<4) | ((VAR)>>4);        			\
   _regs.F|= ((VAR)?0x00:ZFLAG)
-#define BRANCH _regs.PC+= ((GBCs8) GBC_mem_read ( _regs.PC ))+1
+#define BRANCH _regs.PC+= ((GBCs8) mem_read ( m, _regs.PC ))+1
 #define PUSH_PC        					\
-  GBC_mem_write ( --_regs.SP, (GBCu8) (_regs.PC>>8) );        \
-  GBC_mem_write ( --_regs.SP, (GBCu8) (_regs.PC&0xff) )
+  mem_write ( m, --_regs.SP, (GBCu8) (_regs.PC>>8) );        \
+  mem_write ( m, --_regs.SP, (GBCu8) (_regs.PC&0xff) )
 
 
 #define LD_R_R return 4
 #define LD_R1_R2(R1,R2) _regs.R1= _regs.R2; return 4
 #define LD_R_A(R) _regs.R= (GBCu8) _regs.A; return 4
-#define LD_R_N(R) _regs.R= GBC_mem_read ( _regs.PC++ ); return 8
-#define LD_R_pHL_AUX(R) _regs.R= GBC_mem_read ( R16 ( H, L ) )
+#define LD_R_N(R) _regs.R= FETCH; return 8
+#define LD_R_pHL_AUX(R) _regs.R= mem_read ( m, R16 ( H, L ) )
 #define LD_R_pHL(R) LD_R_pHL_AUX(R); return 8
-#define LD_pHL_R_AUX(R) GBC_mem_write ( R16 ( H, L ), (GBCu8) _regs.R )
+#define LD_pHL_R_AUX(R) mem_write ( m, R16 ( H, L ), (GBCu8) _regs.R )
 #define LD_pHL_R(R) LD_pHL_R_AUX(R); return 8
-#define LD_A_pR16(HI,LO) _regs.A= GBC_mem_read ( R16 ( HI, LO ) ); return 8
+#define LD_A_pR16(HI,LO) _regs.A= mem_read ( m, R16 ( HI, LO ) ); return 8
 #define LD_pR16_A(HI,LO)        				\
-  GBC_mem_write ( R16 ( HI, LO ), (GBCu8) _regs.A ); return 8
+  mem_write ( m, R16 ( HI, LO ), (GBCu8) _regs.A ); return 8
 
 #define LD_DD_NN(HI,LO)        		 \
-  _regs.LO= GBC_mem_read ( _regs.PC++ ); \
-  _regs.HI= GBC_mem_read ( _regs.PC++ ); \
+  _regs.LO= FETCH;                       \
+  _regs.HI= FETCH;                       \
   return 12
 #define LD_RU16_NN_NORET(RU16)        				\
-  _regs.RU16= GBC_mem_read ( _regs.PC++ );        		\
-  _regs.RU16|= ((GBCu16) GBC_mem_read ( _regs.PC++ ))<<8
+  _regs.RU16= FETCH;                                            \
+  _regs.RU16|= ((GBCu16) FETCH)<<8
 #define LD_pNN_RU16(RU16)        		     \
   GBCu16 addr;        				     \
   GET_NN ( addr );        			     \
-  GBC_mem_write ( addr, (GBCu8) (_regs.RU16&0xff) ); \
-  GBC_mem_write ( addr+1, (GBCu8) (_regs.RU16>>8) ); \
+  mem_write ( m, addr, (GBCu8) (_regs.RU16&0xff) ); \
+  mem_write ( m, addr+1, (GBCu8) (_regs.RU16>>8) ); \
   return 20
 #define PUSH_QQ(HI,LO)        			     \
-  GBC_mem_write ( --_regs.SP, (GBCu8) _regs.HI);     \
-  GBC_mem_write ( --_regs.SP, _regs.LO );             \
+  mem_write ( m, --_regs.SP, (GBCu8) _regs.HI);     \
+  mem_write ( m, --_regs.SP, _regs.LO );             \
   return 16
 #define POP_QQ_NORET(HI,LO)        	 \
-  _regs.LO= GBC_mem_read ( _regs.SP++ ); \
-  _regs.HI= GBC_mem_read ( _regs.SP++ )
+  _regs.LO= mem_read ( m, _regs.SP++ ); \
+  _regs.HI= mem_read ( m, _regs.SP++ )
 #define POP_QQ(HI,LO)        		 \
   POP_QQ_NORET ( HI, LO );        	 \
   return 12
@@ -233,12 +287,12 @@
   return 4
 #define OPVAR_A_N(OP)        			\
   GBCu8 aux, val;        			\
-  val= GBC_mem_read ( _regs.PC++ );        	\
+  val= FETCH;                                   \
   OP ## _A_VAL ( val, aux );        		\
   return 8
 #define OPVAR_A_pHL(OP)        			\
   GBCu8 aux, val;        			\
-  val= GBC_mem_read ( R16 ( H, L ) );        	\
+  val= mem_read ( m, R16 ( H, L ) );        	\
   OP ## _A_VAL ( val, aux );        		\
   return 8
 #define OP_A_R(R,OP)        			\
@@ -246,12 +300,12 @@
   return 4
 #define OP_A_N(OP)        			\
   GBCu8 val;        				\
-  val= GBC_mem_read ( _regs.PC++ );        	\
+  val= FETCH;                                   \
   OP ## _A_VAL ( val );        			\
   return 8
 #define OP_A_pHL(OP)        			\
   GBCu8 val;        				\
-  val= GBC_mem_read ( R16 ( H, L ) );        	\
+  val= mem_read ( m, R16 ( H, L ) );        	\
   OP ## _A_VAL ( val );        			\
   return 8
 #define CP_A_R(R)        			\
@@ -261,13 +315,13 @@
 #define CP_A_N        				\
   GBCu8 val;        				\
   GBCu16 aux;        				\
-  val= GBC_mem_read ( _regs.PC++ );        	\
+  val= FETCH;                                   \
   CP_A_VAL ( val, aux );        		\
   return 8
 #define CP_A_pHL        			\
   GBCu8 val;        				\
   GBCu16 aux;        				\
-  val= GBC_mem_read ( R16 ( H, L ) );        	\
+  val= mem_read ( m, R16 ( H, L ) );        	\
   CP_A_VAL ( val, aux );        		\
   return 8
 #define INCDEC_R(R,OP)        			\
@@ -284,9 +338,9 @@
   GBCu8 val, aux;        			\
   GBCu16 addr;        				\
   addr= R16 ( H, L );        			\
-  val= GBC_mem_read ( addr );        		\
+  val= mem_read ( m, addr );        		\
   OP ## _VARU8 ( val, aux );        		\
-  GBC_mem_write ( addr, val );        		\
+  mem_write ( m, addr, val );        		\
   return 12
 
 
@@ -311,7 +365,7 @@
 #define SPdd_DEFAUX32()        						\
   GBCu32 aux;        							\
   GBCu16 b;        							\
-  b= ((GBCu16) ((GBCs16) ((GBCs8) GBC_mem_read ( _regs.PC++ ))));        \
+  b= ((GBCu16) ((GBCs16) ((GBCs8) FETCH)));                             \
   aux= _regs.SP+b;        						\
   RESET_FLAGS ( HFLAG|CFLAG|ZFLAG|NFLAG );        			\
   _regs.F|=        							\
@@ -333,9 +387,9 @@
   GBCu16 addr;        		 \
   GBCu8 aux, var;        	 \
   addr= R16 ( H, L );        	 \
-  var= GBC_mem_read ( addr );    \
+  var= mem_read ( m, addr );    \
   OP ## _VARU8 ( aux, var );         \
-  GBC_mem_write ( addr, var );   \
+  mem_write ( m, addr, var );   \
   return 16
 #define SHI_R(OP,R)        	 \
   OP ## _VARU8 ( _regs.R );         \
@@ -350,9 +404,9 @@
   GBCu16 addr;        		 \
   GBCu8 var;        		 \
   addr= R16 ( H, L );        	 \
-  var= GBC_mem_read ( addr );    \
+  var= mem_read ( m, addr );    \
   OP ## _VARU8 ( var );        	 \
-  GBC_mem_write ( addr, var );   \
+  mem_write ( m, addr, var );   \
   return 16
 #define SWAP_R(R)        	 \
   SWAP_VARU8 ( _regs.R );         \
@@ -367,9 +421,9 @@
   GBCu16 addr;        	     \
   GBCu8 var;        	     \
   addr= R16 ( H, L );             \
-  var= GBC_mem_read ( addr );    \
+  var= mem_read ( m, addr );    \
   SWAP_VARU8 ( var );        \
-  GBC_mem_write ( addr, var );   \
+  mem_write ( m, addr, var );   \
   return 16
 
 #define BIT_VARU8_NORET(VAR,MASK)        	\
@@ -380,20 +434,20 @@
   return 8
 #define BIT_pHL(MASK)        	      \
   GBCu8 val;        		      \
-  val= GBC_mem_read ( R16 ( H, L ) ); \
+  val= mem_read ( m, R16 ( H, L ) ); \
   BIT_VARU8_NORET ( val, MASK );      \
   return 12
 #define SET_R(R,MASK) _regs.R|= (MASK); return 8
 #define SET_pHL(MASK)        			  \
   GBCu16 addr;        				  \
   addr= R16 ( H, L );        			  \
-  GBC_mem_write ( addr, GBC_mem_read ( addr ) | (MASK) ); \
+  mem_write ( m, addr, mem_read ( m, addr ) | (MASK) ); \
   return 16
 #define RES_R(R,MASK) _regs.R&= (MASK); return 8
 #define RES_pHL(MASK)        			  \
   GBCu16 addr;        				  \
   addr= R16 ( H, L );        			  \
-  GBC_mem_write ( addr, GBC_mem_read ( addr ) & (MASK) ); \
+  mem_write ( m, addr, mem_read ( m, addr ) & (MASK) ); \
   return 16
 
 
@@ -422,8 +476,8 @@
   if ( (COND) ) { CALL_NORET ( aux ); return 24; } \
   else { _regs.PC+= 2; return 12; }
 #define RET_NORET        				\
-  _regs.PC= GBC_mem_read ( _regs.SP++ );        		\
-  _regs.PC|= ((GBCu16) GBC_mem_read ( _regs.SP++ ))<<8
+  _regs.PC= mem_read ( m, _regs.SP++ );        		\
+  _regs.PC|= ((GBCu16) mem_read ( m, _regs.SP++ ))<<8
 #define RET_COND(COND)        			\
   if ( (COND) ) { RET_NORET; return 20; }        \
   else return 8
@@ -436,50 +490,74 @@
 /* ESTAT */
 /*********/
 
-/* L'acumulador tenen més bits dels que neecessita. */
-static struct
+/* L'estat està en 'GBC_Machine' (veure 'machine.h'). */
+#define _regs (m->cpu.regs)
+#define _opcode (m->cpu.opcode)
+#define _opcode2 (m->cpu.opcode2)
+#define _warning (m->cpu.warning)
+#define _udata (m->cpu.udata)
+#define _cgb_mode (m->cpu.cgb_mode)
+#define _speed (m->cpu.speed)
+#define _run (m->cpu.run)
+#define _blocks (m->cpu.blocks)
+#define _jit (m->cpu.jit)
+#define _idle (m->cpu.idle)
+#define _rpage (m->mem.rpage)
+#define _wpage (m->mem.wpage)
+#define _cpage (m->mem.cpage)
+
+
+
+
+/*******************/
+/* ACCÉS A MEMÒRIA */
+/*******************/
+
+/* En la variant amb traça tots els accessos passen per
+   'GBC_mem_read' i 'GBC_mem_write', que criden al callback. */
+#ifdef CPU_TRACE
+#define mem_read GBC_mem_read
+#define mem_write GBC_mem_write
+#else
+
+/* Les regions mapejades en la taula de pàgines de 'mem.c' s'accedixen
+   directament, la resta amb 'GBC_mem_read_plain' i
+   'GBC_mem_write_plain'. */
+static GBCu8
+mem_read (
+          GBC_Machine  *m,
+          const GBCu16  addr
+          )
 {
   
-  GBCu16 SP;
-  GBCu16 PC;
-  GBCu16 A;
-  GBCu8  F, F2;
-  GBCu8  B;
-  GBCu8  C;
-  GBCu8  D;
-  GBCu8  E;
-  GBCu8  H;
-  GBCu8  L;
-  GBCu8  IE, IF, IAUX;
-  GBC_Bool IME;
-  GBC_Bool halted;
-  GBC_Bool unhalted;
+  const GBCu8 *p;
   
-} _regs;
-
-
-/* Opcode de la instrucció que s'està executant. */
-static GBCu8 _opcode;
-static GBCu8 _opcode2;
-
-
-/* Informació de l'usuari. */
-static GBC_Warning *_warning;
-static void *_udata;
-
-
-/* Mode. */
-static int _cgb_mode;
+  
+  p= _rpage[addr>>8];
+  
+  return p!=NULL ? p[addr&0xFF] : GBC_mem_read_plain ( m, addr );
+  
+} /* end mem_read */
 
 
-/* Velocitat. */
-static struct
+static void
+mem_write (
+           GBC_Machine  *m,
+           const GBCu16  addr,
+           const GBCu8   data
+           )
 {
   
-  GBCu8    current;
-  GBC_Bool prepare;
+  GBCu8 *p;
+  
+  
+  p= _wpage[addr>>8];
+  if ( p != NULL && !_cpage[addr>>8][addr&0xFF] ) p[addr&0xFF]= data;
+  else GBC_mem_write_plain ( m, addr, data );
   
-} _speed;
+} /* end mem_write */
+
+#endif /* CPU_TRACE */
 
 
 
@@ -489,7 +567,9 @@ static struct
 /****************/
 
 static int
-unk (void)
+unk (
+     GBC_Machine *m
+     )
 {
   _warning ( _udata, "l'opcode '0x%02x' és desconegut", _opcode );
   return 0;
@@ -498,133 +578,133 @@ unk (void)
 
 /* 8-BIT LOAD GROUP */
 
-static int ld_B_B (void) { LD_R_R; }
-static int ld_B_C (void) { LD_R1_R2 ( B, C ); }
-static int ld_B_D (void) { LD_R1_R2 ( B, D ); }
-static int ld_B_E (void) { LD_R1_R2 ( B, E ); }
-static int ld_B_H (void) { LD_R1_R2 ( B, H ); }
-static int ld_B_L (void) { LD_R1_R2 ( B, L ); }
-static int ld_B_A (void) { LD_R_A ( B ); }
-static int ld_C_B (void) { LD_R1_R2 ( C, B ); }
-static int ld_C_C (void) { LD_R_R; }
-static int ld_C_D (void) { LD_R1_R2 ( C, D ); }
-static int ld_C_E (void) { LD_R1_R2 ( C, E ); }
-static int ld_C_H (void) { LD_R1_R2 ( C, H ); }
-static int ld_C_L (void) { LD_R1_R2 ( C, L ); }
-static int ld_C_A (void) { LD_R_A ( C ); }
-static int ld_D_B (void) { LD_R1_R2 ( D, B ); }
-static int ld_D_C (void) { LD_R1_R2 ( D, C ); }
-static int ld_D_D (void) { LD_R_R; }
-static int ld_D_E (void) { LD_R1_R2 ( D, E ); }
-static int ld_D_H (void) { LD_R1_R2 ( D, H ); }
-static int ld_D_L (void) { LD_R1_R2 ( D, L ); }
-static int ld_D_A (void) { LD_R_A ( D ); }
-static int ld_E_B (void) { LD_R1_R2 ( E, B ); }
-static int ld_E_C (void) { LD_R1_R2 ( E, C ); }
-static int ld_E_D (void) { LD_R1_R2 ( E, D ); }
-static int ld_E_E (void) { LD_R_R; }
-static int ld_E_H (void) { LD_R1_R2 ( E, H ); }
-static int ld_E_L (void) { LD_R1_R2 ( E, L ); }
-static int ld_E_A (void) { LD_R_A ( E ); }
-static int ld_H_B (void) { LD_R1_R2 ( H, B ); }
-static int ld_H_C (void) { LD_R1_R2 ( H, C ); }
-static int ld_H_D (void) { LD_R1_R2 ( H, D ); }
-static int ld_H_E (void) { LD_R1_R2 ( H, E ); }
-static int ld_H_H (void) { LD_R_R; }
-static int ld_H_L (void) { LD_R1_R2 ( H, L ); }
-static int ld_H_A (void) { LD_R_A ( H ); }
-static int ld_L_B (void) { LD_R1_R2 ( L, B ); }
-static int ld_L_C (void) { LD_R1_R2 ( L, C ); }
-static int ld_L_D (void) { LD_R1_R2 ( L, D ); }
-static int ld_L_E (void) { LD_R1_R2 ( L, E ); }
-static int ld_L_H (void) { LD_R1_R2 ( L, H ); }
-static int ld_L_L (void) { LD_R_R; }
-static int ld_L_A (void) { LD_R_A ( L ); }
-static int ld_A_B (void) { LD_R1_R2 ( A, B ); }
-static int ld_A_C (void) { LD_R1_R2 ( A, C ); }
-static int ld_A_D (void) { LD_R1_R2 ( A, D ); }
-static int ld_A_E (void) { LD_R1_R2 ( A, E ); }
-static int ld_A_H (void) { LD_R1_R2 ( A, H ); }
-static int ld_A_L (void) { LD_R1_R2 ( A, L ); }
-static int ld_A_A (void) { LD_R_R; }
-static int ld_B_n (void) { LD_R_N ( B ); }
-static int ld_C_n (void) { LD_R_N ( C ); }
-static int ld_D_n (void) { LD_R_N ( D ); }
-static int ld_E_n (void) { LD_R_N ( E ); }
-static int ld_H_n (void) { LD_R_N ( H ); }
-static int ld_L_n (void) { LD_R_N ( L ); }
-static int ld_A_n (void) { LD_R_N ( A ); }
-static int ld_B_pHL (void) { LD_R_pHL ( B ); }
-static int ld_C_pHL (void) { LD_R_pHL ( C ); }
-static int ld_D_pHL (void) { LD_R_pHL ( D ); }
-static int ld_E_pHL (void) { LD_R_pHL ( E ); }
-static int ld_H_pHL (void) { LD_R_pHL ( H ); }
-static int ld_L_pHL (void) { LD_R_pHL ( L ); }
-static int ld_A_pHL (void) { LD_R_pHL ( A ); }
-static int ld_pHL_B (void) { LD_pHL_R ( B ); }
-static int ld_pHL_C (void) { LD_pHL_R ( C ); }
-static int ld_pHL_D (void) { LD_pHL_R ( D ); }
-static int ld_pHL_E (void) { LD_pHL_R ( E ); }
-static int ld_pHL_H (void) { LD_pHL_R ( H ); }
-static int ld_pHL_L (void) { LD_pHL_R ( L ); }
-static int ld_pHL_A (void) { LD_pHL_R ( A ); }
-static int ld_pHL_n (void)
-{
-  GBC_mem_write ( R16 ( H, L ), GBC_mem_read ( _regs.PC++ ) );
+static int ld_B_B (GBC_Machine *m) { LD_R_R; }
+static int ld_B_C (GBC_Machine *m) { LD_R1_R2 ( B, C ); }
+static int ld_B_D (GBC_Machine *m) { LD_R1_R2 ( B, D ); }
+static int ld_B_E (GBC_Machine *m) { LD_R1_R2 ( B, E ); }
+static int ld_B_H (GBC_Machine *m) { LD_R1_R2 ( B, H ); }
+static int ld_B_L (GBC_Machine *m) { LD_R1_R2 ( B, L ); }
+static int ld_B_A (GBC_Machine *m) { LD_R_A ( B ); }
+static int ld_C_B (GBC_Machine *m) { LD_R1_R2 ( C, B ); }
+static int ld_C_C (GBC_Machine *m) { LD_R_R; }
+static int ld_C_D (GBC_Machine *m) { LD_R1_R2 ( C, D ); }
+static int ld_C_E (GBC_Machine *m) { LD_R1_R2 ( C, E ); }
+static int ld_C_H (GBC_Machine *m) { LD_R1_R2 ( C, H ); }
+static int ld_C_L (GBC_Machine *m) { LD_R1_R2 ( C, L ); }
+static int ld_C_A (GBC_Machine *m) { LD_R_A ( C ); }
+static int ld_D_B (GBC_Machine *m) { LD_R1_R2 ( D, B ); }
+static int ld_D_C (GBC_Machine *m) { LD_R1_R2 ( D, C ); }
+static int ld_D_D (GBC_Machine *m) { LD_R_R; }
+static int ld_D_E (GBC_Machine *m) { LD_R1_R2 ( D, E ); }
+static int ld_D_H (GBC_Machine *m) { LD_R1_R2 ( D, H ); }
+static int ld_D_L (GBC_Machine *m) { LD_R1_R2 ( D, L ); }
+static int ld_D_A (GBC_Machine *m) { LD_R_A ( D ); }
+static int ld_E_B (GBC_Machine *m) { LD_R1_R2 ( E, B ); }
+static int ld_E_C (GBC_Machine *m) { LD_R1_R2 ( E, C ); }
+static int ld_E_D (GBC_Machine *m) { LD_R1_R2 ( E, D ); }
+static int ld_E_E (GBC_Machine *m) { LD_R_R; }
+static int ld_E_H (GBC_Machine *m) { LD_R1_R2 ( E, H ); }
+static int ld_E_L (GBC_Machine *m) { LD_R1_R2 ( E, L ); }
+static int ld_E_A (GBC_Machine *m) { LD_R_A ( E ); }
+static int ld_H_B (GBC_Machine *m) { LD_R1_R2 ( H, B ); }
+static int ld_H_C (GBC_Machine *m) { LD_R1_R2 ( H, C ); }
+static int ld_H_D (GBC_Machine *m) { LD_R1_R2 ( H, D ); }
+static int ld_H_E (GBC_Machine *m) { LD_R1_R2 ( H, E ); }
+static int ld_H_H (GBC_Machine *m) { LD_R_R; }
+static int ld_H_L (GBC_Machine *m) { LD_R1_R2 ( H, L ); }
+static int ld_H_A (GBC_Machine *m) { LD_R_A ( H ); }
+static int ld_L_B (GBC_Machine *m) { LD_R1_R2 ( L, B ); }
+static int ld_L_C (GBC_Machine *m) { LD_R1_R2 ( L, C ); }
+static int ld_L_D (GBC_Machine *m) { LD_R1_R2 ( L, D ); }
+static int ld_L_E (GBC_Machine *m) { LD_R1_R2 ( L, E ); }
+static int ld_L_H (GBC_Machine *m) { LD_R1_R2 ( L, H ); }
+static int ld_L_L (GBC_Machine *m) { LD_R_R; }
+static int ld_L_A (GBC_Machine *m) { LD_R_A ( L ); }
+static int ld_A_B (GBC_Machine *m) { LD_R1_R2 ( A, B ); }
+static int ld_A_C (GBC_Machine *m) { LD_R1_R2 ( A, C ); }
+static int ld_A_D (GBC_Machine *m) { LD_R1_R2 ( A, D ); }
+static int ld_A_E (GBC_Machine *m) { LD_R1_R2 ( A, E ); }
+static int ld_A_H (GBC_Machine *m) { LD_R1_R2 ( A, H ); }
+static int ld_A_L (GBC_Machine *m) { LD_R1_R2 ( A, L ); }
+static int ld_A_A (GBC_Machine *m) { LD_R_R; }
+static int ld_B_n (GBC_Machine *m) { LD_R_N ( B ); }
+static int ld_C_n (GBC_Machine *m) { LD_R_N ( C ); }
+static int ld_D_n (GBC_Machine *m) { LD_R_N ( D ); }
+static int ld_E_n (GBC_Machine *m) { LD_R_N ( E ); }
+static int ld_H_n (GBC_Machine *m) { LD_R_N ( H ); }
+static int ld_L_n (GBC_Machine *m) { LD_R_N ( L ); }
+static int ld_A_n (GBC_Machine *m) { LD_R_N ( A ); }
+static int ld_B_pHL (GBC_Machine *m) { LD_R_pHL ( B ); }
+static int ld_C_pHL (GBC_Machine *m) { LD_R_pHL ( C ); }
+static int ld_D_pHL (GBC_Machine *m) { LD_R_pHL ( D ); }
+static int ld_E_pHL (GBC_Machine *m) { LD_R_pHL ( E ); }
+static int ld_H_pHL (GBC_Machine *m) { LD_R_pHL ( H ); }
+static int ld_L_pHL (GBC_Machine *m) { LD_R_pHL ( L ); }
+static int ld_A_pHL (GBC_Machine *m) { LD_R_pHL ( A ); }
+static int ld_pHL_B (GBC_Machine *m) { LD_pHL_R ( B ); }
+static int ld_pHL_C (GBC_Machine *m) { LD_pHL_R ( C ); }
+static int ld_pHL_D (GBC_Machine *m) { LD_pHL_R ( D ); }
+static int ld_pHL_E (GBC_Machine *m) { LD_pHL_R ( E ); }
+static int ld_pHL_H (GBC_Machine *m) { LD_pHL_R ( H ); }
+static int ld_pHL_L (GBC_Machine *m) { LD_pHL_R ( L ); }
+static int ld_pHL_A (GBC_Machine *m) { LD_pHL_R ( A ); }
+static int ld_pHL_n (GBC_Machine *m)
+{
+  mem_write ( m, R16 ( H, L ), FETCH );
   return 12;
 }
-static int ld_A_pBC (void) { LD_A_pR16 ( B, C ); }
-static int ld_A_pDE (void) { LD_A_pR16 ( D, E ); }
-static int ld_A_pnn (void)
+static int ld_A_pBC (GBC_Machine *m) { LD_A_pR16 ( B, C ); }
+static int ld_A_pDE (GBC_Machine *m) { LD_A_pR16 ( D, E ); }
+static int ld_A_pnn (GBC_Machine *m)
 {
   GBCu16 addr;
   GET_NN ( addr );
-  _regs.A= GBC_mem_read ( addr );
+  _regs.A= mem_read ( m, addr );
   return 16;
 }
-static int ld_pBC_A (void) { LD_pR16_A ( B, C ); }
-static int ld_pDE_A (void) { LD_pR16_A ( D, E ); }
-static int ld_pnn_A (void)
+static int ld_pBC_A (GBC_Machine *m) { LD_pR16_A ( B, C ); }
+static int ld_pDE_A (GBC_Machine *m) { LD_pR16_A ( D, E ); }
+static int ld_pnn_A (GBC_Machine *m)
 {
   GBCu16 addr;
   GET_NN ( addr );
-  GBC_mem_write ( addr, (GBCu8) _regs.A );
+  mem_write ( m, addr, (GBCu8) _regs.A );
   return 16;
 }
-static int ldi_pHL_A (void) { LD_pHL_R_AUX ( A ); INCR16 ( H, L ); return 8; }
-static int ldi_A_pHL (void) { LD_R_pHL_AUX ( A ); INCR16 ( H, L ); return 8; }
-static int ldd_pHL_A (void) { LD_pHL_R_AUX ( A ); DECR16 ( H, L ); return 8; }
-static int ldd_A_pHL (void) { LD_R_pHL_AUX ( A ); DECR16 ( H, L ); return 8; }
-static int ld_A_pFF00n (void) {
-  _regs.A= GBC_mem_read ( 0xFF00 | GBC_mem_read ( _regs.PC++ ) );
+static int ldi_pHL_A (GBC_Machine *m) { LD_pHL_R_AUX ( A ); INCR16 ( H, L ); return 8; }
+static int ldi_A_pHL (GBC_Machine *m) { LD_R_pHL_AUX ( A ); INCR16 ( H, L ); return 8; }
+static int ldd_pHL_A (GBC_Machine *m) { LD_pHL_R_AUX ( A ); DECR16 ( H, L ); return 8; }
+static int ldd_A_pHL (GBC_Machine *m) { LD_R_pHL_AUX ( A ); DECR16 ( H, L ); return 8; }
+static int ld_A_pFF00n (GBC_Machine *m) {
+  _regs.A= mem_read ( m, 0xFF00 | FETCH );
   return 12;
 }
-static int ld_pFF00n_A (void) {
-  GBC_mem_write ( 0xFF00 | GBC_mem_read ( _regs.PC++ ), (GBCu8) _regs.A );
+static int ld_pFF00n_A (GBC_Machine *m) {
+  mem_write ( m, 0xFF00 | FETCH, (GBCu8) _regs.A );
   return 12;
 }
-static int ld_A_pFF00C (void) {
-  _regs.A= GBC_mem_read ( 0xFF00 | _regs.C );
+static int ld_A_pFF00C (GBC_Machine *m) {
+  _regs.A= mem_read ( m, 0xFF00 | _regs.C );
   return 8;
 }
-static int ld_pFF00C_A (void) {
-  GBC_mem_write ( 0xFF00 | _regs.C, (GBCu8) _regs.A );
+static int ld_pFF00C_A (GBC_Machine *m) {
+  mem_write ( m, 0xFF00 | _regs.C, (GBCu8) _regs.A );
   return 8;
 }
 
 
 /* 16-BIT LOAD GROUP */
 
-static int ld_BC_nn (void) { LD_DD_NN ( B, C ); }
-static int ld_DE_nn (void) { LD_DD_NN ( D, E ); }
-static int ld_HL_nn (void) { LD_DD_NN ( H, L ); }
-static int ld_SP_nn (void) { LD_RU16_NN_NORET ( SP ); return 12; }
-static int ld_pnn_SP (void) { LD_pNN_RU16 ( SP ); }
-static int ld_SP_HL (void) { _regs.SP= R16 ( H, L ); return 8; }
-static int push_BC (void) { PUSH_QQ ( B, C ); }
-static int push_DE (void) { PUSH_QQ ( D, E ); }
-static int push_HL (void) { PUSH_QQ ( H, L ); }
-static int push_AF (void) {
+static int ld_BC_nn (GBC_Machine *m) { LD_DD_NN ( B, C ); }
+static int ld_DE_nn (GBC_Machine *m) { LD_DD_NN ( D, E ); }
+static int ld_HL_nn (GBC_Machine *m) { LD_DD_NN ( H, L ); }
+static int ld_SP_nn (GBC_Machine *m) { LD_RU16_NN_NORET ( SP ); return 12; }
+static int ld_pnn_SP (GBC_Machine *m) { LD_pNN_RU16 ( SP ); }
+static int ld_SP_HL (GBC_Machine *m) { _regs.SP= R16 ( H, L ); return 8; }
+static int push_BC (GBC_Machine *m) { PUSH_QQ ( B, C ); }
+static int push_DE (GBC_Machine *m) { PUSH_QQ ( D, E ); }
+static int push_HL (GBC_Machine *m) { PUSH_QQ ( H, L ); }
+static int push_AF (GBC_Machine *m) {
   _regs.F2=
     ((_regs.F&ZFLAG)?0x80:0x00) |
     ((_regs.F&NFLAG)?0x40:0x00) |
@@ -632,10 +712,10 @@ static int push_AF (void) {
     ((_regs.F&CFLAG)?0x10:0x00);
   PUSH_QQ ( A, F2 );
 }
-static int pop_BC (void) { POP_QQ ( B, C ); }
-static int pop_DE (void) { POP_QQ ( D, E ); }
-static int pop_HL (void) { POP_QQ ( H, L ); }
-static int pop_AF (void) {
+static int pop_BC (GBC_Machine *m) { POP_QQ ( B, C ); }
+static int pop_DE (GBC_Machine *m) { POP_QQ ( D, E ); }
+static int pop_HL (GBC_Machine *m) { POP_QQ ( H, L ); }
+static int pop_AF (GBC_Machine *m) {
   POP_QQ_NORET ( A, F2 );
   _regs.F=
     ((_regs.F2&0x80)?ZFLAG:0x00) |
@@ -648,99 +728,99 @@ static int pop_AF (void) {
 
 /* 8-BIT ARITHMETIC GROUP */
 
-static int add_A_B (void) { OPVAR_A_R ( B, ADD ); }
-static int add_A_C (void) { OPVAR_A_R ( C, ADD ); }
-static int add_A_D (void) { OPVAR_A_R ( D, ADD ); }
-static int add_A_E (void) { OPVAR_A_R ( E, ADD ); }
-static int add_A_H (void) { OPVAR_A_R ( H, ADD ); }
-static int add_A_L (void) { OPVAR_A_R ( L, ADD ); }
-static int add_A_A (void) { OPVAR_A_A ( ADD ); }
-static int add_A_n (void) { OPVAR_A_N ( ADD ); }
-static int add_A_pHL (void) { OPVAR_A_pHL ( ADD ); }
-static int adc_A_B (void) { OPVAR_A_R ( B, ADC ); }
-static int adc_A_C (void) { OPVAR_A_R ( C, ADC ); }
-static int adc_A_D (void) { OPVAR_A_R ( D, ADC ); }
-static int adc_A_E (void) { OPVAR_A_R ( E, ADC ); }
-static int adc_A_H (void) { OPVAR_A_R ( H, ADC ); }
-static int adc_A_L (void) { OPVAR_A_R ( L, ADC ); }
-static int adc_A_A (void) { OPVAR_A_A ( ADC ); }
-static int adc_A_n (void) { OPVAR_A_N ( ADC ); }
-static int adc_A_pHL (void) { OPVAR_A_pHL ( ADC ); }
-static int sub_A_B (void) { OPVAR_A_R ( B, SUB ); }
-static int sub_A_C (void) { OPVAR_A_R ( C, SUB ); }
-static int sub_A_D (void) { OPVAR_A_R ( D, SUB ); }
-static int sub_A_E (void) { OPVAR_A_R ( E, SUB ); }
-static int sub_A_H (void) { OPVAR_A_R ( H, SUB ); }
-static int sub_A_L (void) { OPVAR_A_R ( L, SUB ); }
-static int sub_A_A (void) { OPVAR_A_A ( SUB ); }
-static int sub_A_n (void) { OPVAR_A_N ( SUB ); }
-static int sub_A_pHL (void) { OPVAR_A_pHL ( SUB ); }
-static int sbc_A_B (void) { OPVAR_A_R ( B, SBC ); }
-static int sbc_A_C (void) { OPVAR_A_R ( C, SBC ); }
-static int sbc_A_D (void) { OPVAR_A_R ( D, SBC ); }
-static int sbc_A_E (void) { OPVAR_A_R ( E, SBC ); }
-static int sbc_A_H (void) { OPVAR_A_R ( H, SBC ); }
-static int sbc_A_L (void) { OPVAR_A_R ( L, SBC ); }
-static int sbc_A_A (void) { OPVAR_A_A ( SBC ); }
-static int sbc_A_n (void) { OPVAR_A_N ( SBC ); }
-static int sbc_A_pHL (void) { OPVAR_A_pHL ( SBC ); }
-static int and_A_B (void) { OP_A_R ( B, AND ); }
-static int and_A_C (void) { OP_A_R ( C, AND ); }
-static int and_A_D (void) { OP_A_R ( D, AND ); }
-static int and_A_E (void) { OP_A_R ( E, AND ); }
-static int and_A_H (void) { OP_A_R ( H, AND ); }
-static int and_A_L (void) { OP_A_R ( L, AND ); }
-static int and_A_A (void) { OP_A_R ( A, AND ); }
-static int and_A_n (void) { OP_A_N ( AND ); }
-static int and_A_pHL (void) { OP_A_pHL ( AND ); }
-static int or_A_B (void) { OP_A_R ( B, OR ); }
-static int or_A_C (void) { OP_A_R ( C, OR ); }
-static int or_A_D (void) { OP_A_R ( D, OR ); }
-static int or_A_E (void) { OP_A_R ( E, OR ); }
-static int or_A_H (void) { OP_A_R ( H, OR ); }
-static int or_A_L (void) { OP_A_R ( L, OR ); }
-static int or_A_A (void) { OP_A_R ( A, OR ); }
-static int or_A_n (void) { OP_A_N ( OR ); }
-static int or_A_pHL (void) { OP_A_pHL ( OR ); }
-static int xor_A_B (void) { OP_A_R ( B, XOR ); }
-static int xor_A_C (void) { OP_A_R ( C, XOR ); }
-static int xor_A_D (void) { OP_A_R ( D, XOR ); }
-static int xor_A_E (void) { OP_A_R ( E, XOR ); }
-static int xor_A_H (void) { OP_A_R ( H, XOR ); }
-static int xor_A_L (void) { OP_A_R ( L, XOR ); }
-static int xor_A_A (void) { OP_A_R ( A, XOR ); }
-static int xor_A_n (void) { OP_A_N ( XOR ); }
-static int xor_A_pHL (void) { OP_A_pHL ( XOR ); }
-static int cp_A_B (void) { CP_A_R ( B ); }
-static int cp_A_C (void) { CP_A_R ( C ); }
-static int cp_A_D (void) { CP_A_R ( D ); }
-static int cp_A_E (void) { CP_A_R ( E ); }
-static int cp_A_H (void) { CP_A_R ( H ); }
-static int cp_A_L (void) { CP_A_R ( L ); }
-static int cp_A_A (void) { CP_A_R ( A ); }
-static int cp_A_n (void) { CP_A_N; }
-static int cp_A_pHL (void) { CP_A_pHL; }
-static int inc_B (void) { INCDEC_R ( B, INC ); }
-static int inc_C (void) { INCDEC_R ( C, INC ); }
-static int inc_D (void) { INCDEC_R ( D, INC ); }
-static int inc_E (void) { INCDEC_R ( E, INC ); }
-static int inc_H (void) { INCDEC_R ( H, INC ); }
-static int inc_L (void) { INCDEC_R ( L, INC ); }
-static int inc_A (void) { INCDEC_A ( INC ); }
-static int inc_pHL (void) { INCDEC_pHL ( INC ); }
-static int dec_B (void) { INCDEC_R ( B, DEC ); }
-static int dec_C (void) { INCDEC_R ( C, DEC ); }
-static int dec_D (void) { INCDEC_R ( D, DEC ); }
-static int dec_E (void) { INCDEC_R ( E, DEC ); }
-static int dec_H (void) { INCDEC_R ( H, DEC ); }
-static int dec_L (void) { INCDEC_R ( L, DEC ); }
-static int dec_A (void) { INCDEC_A ( DEC ); }
-static int dec_pHL (void) { INCDEC_pHL ( DEC ); }
+static int add_A_B (GBC_Machine *m) { OPVAR_A_R ( B, ADD ); }
+static int add_A_C (GBC_Machine *m) { OPVAR_A_R ( C, ADD ); }
+static int add_A_D (GBC_Machine *m) { OPVAR_A_R ( D, ADD ); }
+static int add_A_E (GBC_Machine *m) { OPVAR_A_R ( E, ADD ); }
+static int add_A_H (GBC_Machine *m) { OPVAR_A_R ( H, ADD ); }
+static int add_A_L (GBC_Machine *m) { OPVAR_A_R ( L, ADD ); }
+static int add_A_A (GBC_Machine *m) { OPVAR_A_A ( ADD ); }
+static int add_A_n (GBC_Machine *m) { OPVAR_A_N ( ADD ); }
+static int add_A_pHL (GBC_Machine *m) { OPVAR_A_pHL ( ADD ); }
+static int adc_A_B (GBC_Machine *m) { OPVAR_A_R ( B, ADC ); }
+static int adc_A_C (GBC_Machine *m) { OPVAR_A_R ( C, ADC ); }
+static int adc_A_D (GBC_Machine *m) { OPVAR_A_R ( D, ADC ); }
+static int adc_A_E (GBC_Machine *m) { OPVAR_A_R ( E, ADC ); }
+static int adc_A_H (GBC_Machine *m) { OPVAR_A_R ( H, ADC ); }
+static int adc_A_L (GBC_Machine *m) { OPVAR_A_R ( L, ADC ); }
+static int adc_A_A (GBC_Machine *m) { OPVAR_A_A ( ADC ); }
+static int adc_A_n (GBC_Machine *m) { OPVAR_A_N ( ADC ); }
+static int adc_A_pHL (GBC_Machine *m) { OPVAR_A_pHL ( ADC ); }
+static int sub_A_B (GBC_Machine *m) { OPVAR_A_R ( B, SUB ); }
+static int sub_A_C (GBC_Machine *m) { OPVAR_A_R ( C, SUB ); }
+static int sub_A_D (GBC_Machine *m) { OPVAR_A_R ( D, SUB ); }
+static int sub_A_E (GBC_Machine *m) { OPVAR_A_R ( E, SUB ); }
+static int sub_A_H (GBC_Machine *m) { OPVAR_A_R ( H, SUB ); }
+static int sub_A_L (GBC_Machine *m) { OPVAR_A_R ( L, SUB ); }
+static int sub_A_A (GBC_Machine *m) { OPVAR_A_A ( SUB ); }
+static int sub_A_n (GBC_Machine *m) { OPVAR_A_N ( SUB ); }
+static int sub_A_pHL (GBC_Machine *m) { OPVAR_A_pHL ( SUB ); }
+static int sbc_A_B (GBC_Machine *m) { OPVAR_A_R ( B, SBC ); }
+static int sbc_A_C (GBC_Machine *m) { OPVAR_A_R ( C, SBC ); }
+static int sbc_A_D (GBC_Machine *m) { OPVAR_A_R ( D, SBC ); }
+static int sbc_A_E (GBC_Machine *m) { OPVAR_A_R ( E, SBC ); }
+static int sbc_A_H (GBC_Machine *m) { OPVAR_A_R ( H, SBC ); }
+static int sbc_A_L (GBC_Machine *m) { OPVAR_A_R ( L, SBC ); }
+static int sbc_A_A (GBC_Machine *m) { OPVAR_A_A ( SBC ); }
+static int sbc_A_n (GBC_Machine *m) { OPVAR_A_N ( SBC ); }
+static int sbc_A_pHL (GBC_Machine *m) { OPVAR_A_pHL ( SBC ); }
+static int and_A_B (GBC_Machine *m) { OP_A_R ( B, AND ); }
+static int and_A_C (GBC_Machine *m) { OP_A_R ( C, AND ); }
+static int and_A_D (GBC_Machine *m) { OP_A_R ( D, AND ); }
+static int and_A_E (GBC_Machine *m) { OP_A_R ( E, AND ); }
+static int and_A_H (GBC_Machine *m) { OP_A_R ( H, AND ); }
+static int and_A_L (GBC_Machine *m) { OP_A_R ( L, AND ); }
+static int and_A_A (GBC_Machine *m) { OP_A_R ( A, AND ); }
+static int and_A_n (GBC_Machine *m) { OP_A_N ( AND ); }
+static int and_A_pHL (GBC_Machine *m) { OP_A_pHL ( AND ); }
+static int or_A_B (GBC_Machine *m) { OP_A_R ( B, OR ); }
+static int or_A_C (GBC_Machine *m) { OP_A_R ( C, OR ); }
+static int or_A_D (GBC_Machine *m) { OP_A_R ( D, OR ); }
+static int or_A_E (GBC_Machine *m) { OP_A_R ( E, OR ); }
+static int or_A_H (GBC_Machine *m) { OP_A_R ( H, OR ); }
+static int or_A_L (GBC_Machine *m) { OP_A_R ( L, OR ); }
+static int or_A_A (GBC_Machine *m) { OP_A_R ( A, OR ); }
+static int or_A_n (GBC_Machine *m) { OP_A_N ( OR ); }
+static int or_A_pHL (GBC_Machine *m) { OP_A_pHL ( OR ); }
+static int xor_A_B (GBC_Machine *m) { OP_A_R ( B, XOR ); }
+static int xor_A_C (GBC_Machine *m) { OP_A_R ( C, XOR ); }
+static int xor_A_D (GBC_Machine *m) { OP_A_R ( D, XOR ); }
+static int xor_A_E (GBC_Machine *m) { OP_A_R ( E, XOR ); }
+static int xor_A_H (GBC_Machine *m) { OP_A_R ( H, XOR ); }
+static int xor_A_L (GBC_Machine *m) { OP_A_R ( L, XOR ); }
+static int xor_A_A (GBC_Machine *m) { OP_A_R ( A, XOR ); }
+static int xor_A_n (GBC_Machine *m) { OP_A_N ( XOR ); }
+static int xor_A_pHL (GBC_Machine *m) { OP_A_pHL ( XOR ); }
+static int cp_A_B (GBC_Machine *m) { CP_A_R ( B ); }
+static int cp_A_C (GBC_Machine *m) { CP_A_R ( C ); }
+static int cp_A_D (GBC_Machine *m) { CP_A_R ( D ); }
+static int cp_A_E (GBC_Machine *m) { CP_A_R ( E ); }
+static int cp_A_H (GBC_Machine *m) { CP_A_R ( H ); }
+static int cp_A_L (GBC_Machine *m) { CP_A_R ( L ); }
+static int cp_A_A (GBC_Machine *m) { CP_A_R ( A ); }
+static int cp_A_n (GBC_Machine *m) { CP_A_N; }
+static int cp_A_pHL (GBC_Machine *m) { CP_A_pHL; }
+static int inc_B (GBC_Machine *m) { INCDEC_R ( B, INC ); }
+static int inc_C (GBC_Machine *m) { INCDEC_R ( C, INC ); }
+static int inc_D (GBC_Machine *m) { INCDEC_R ( D, INC ); }
+static int inc_E (GBC_Machine *m) { INCDEC_R ( E, INC ); }
+static int inc_H (GBC_Machine *m) { INCDEC_R ( H, INC ); }
+static int inc_L (GBC_Machine *m) { INCDEC_R ( L, INC ); }
+static int inc_A (GBC_Machine *m) { INCDEC_A ( INC ); }
+static int inc_pHL (GBC_Machine *m) { INCDEC_pHL ( INC ); }
+static int dec_B (GBC_Machine *m) { INCDEC_R ( B, DEC ); }
+static int dec_C (GBC_Machine *m) { INCDEC_R ( C, DEC ); }
+static int dec_D (GBC_Machine *m) { INCDEC_R ( D, DEC ); }
+static int dec_E (GBC_Machine *m) { INCDEC_R ( E, DEC ); }
+static int dec_H (GBC_Machine *m) { INCDEC_R ( H, DEC ); }
+static int dec_L (GBC_Machine *m) { INCDEC_R ( L, DEC ); }
+static int dec_A (GBC_Machine *m) { INCDEC_A ( DEC ); }
+static int dec_pHL (GBC_Machine *m) { INCDEC_pHL ( DEC ); }
 
 
 /* GENERAL-PURPOSE ARITHMETIC AND CPU CONTROL GROUPS */
 
-static int daa (void)
+static int daa (GBC_Machine *m)
 {
   GBCu8 aux, cflag;
   if ( _regs.F&NFLAG ) /* SUB SBC DEC NEG */
@@ -775,57 +855,63 @@ static int daa (void)
   _regs.F|= ((_regs.A&= 0xff)?0:ZFLAG) | cflag;
   return 4;
 }
-static int cpl (void)
+static int cpl (GBC_Machine *m)
 {
   _regs.A= (GBCu8) (~_regs.A);
   _regs.F|= HFLAG|NFLAG;
   return 4;
 }
-static int ccf (void) {
+static int ccf (GBC_Machine *m) {
   RESET_FLAGS ( NFLAG|HFLAG );
   _regs.F^= CFLAG;
   return 4;
 }
-static int scf (void)
+static int scf (GBC_Machine *m)
 {
   RESET_FLAGS ( HFLAG|NFLAG );
   _regs.F|= CFLAG;
   return 4;
 }
-static int nop (void) { return 4; }
-static int halt (void)
+static int nop (GBC_Machine *m) { return 4; }
+static int halt (GBC_Machine *m)
 {
+  int cc;
   if ( _regs.halted && _regs.unhalted )
     {
       _regs.halted= GBC_FALSE;
       _regs.unhalted= GBC_FALSE;
+      return 4;
     }
-  else
+  if ( !_regs.halted )
     {
-      if ( !_regs.halted )
-        {
-          _regs.halted= GBC_TRUE;
-          _regs.unhalted= GBC_FALSE;
-        }
-      --_regs.PC;
+      _regs.halted= GBC_TRUE;
+      _regs.unhalted= GBC_FALSE;
     }
-  return 4;
+  --_regs.PC;
+  /* Sols una interrupció pot despertar la UCP, i les interrupcions es
+     demanen en sincronitzar, que no es fa fins acabar el lot. Per
+     tant es consumeix de colp la resta del lot, en passos de 4
+     cicles com si s'executara HALT una i altra vegada. */
+  cc= _run.budget - _run.cc;
+  return cc > 4 ? (cc+3)&~3 : 4;
 }
-static int stop (void)
+static int stop (GBC_Machine *m)
 {
+  GBC_main_sync ( m );
+  GBC_main_resched ( m );
   if ( _speed.prepare )
     {
       _speed.prepare= GBC_FALSE;
       _speed.current^= 0x80;
-      GBC_main_switch_speed ();
+      GBC_main_switch_speed ( m );
       return 0;
     }
   if ( _regs.halted && _regs.unhalted )
     {
       _regs.halted= GBC_FALSE;
       _regs.unhalted= GBC_FALSE;
-      GBC_lcd_stop ( GBC_FALSE );
-      GBC_apu_stop ( GBC_FALSE );
+      GBC_lcd_stop ( m, GBC_FALSE );
+      GBC_apu_stop ( m, GBC_FALSE );
     }
   else
     {
@@ -833,38 +919,38 @@ static int stop (void)
         {
           _regs.halted= GBC_TRUE;
           _regs.unhalted= GBC_FALSE;
-          GBC_lcd_stop ( GBC_TRUE );
-          GBC_apu_stop ( GBC_TRUE );
+          GBC_lcd_stop ( m, GBC_TRUE );
+          GBC_apu_stop ( m, GBC_TRUE );
         }
       --_regs.PC;
     }
   return 0; /* Realment medix 2 bytes, però es pot emular com un NOP,
                per tant el nop següent té el cost de l'actual. */
 }
-static int di (void) { _regs.IME= GBC_FALSE; return 4; }
-static int ei (void) { _regs.IME= GBC_TRUE; return 4; }
+static int di (GBC_Machine *m) { _regs.IME= GBC_FALSE; return 4; }
+static int ei (GBC_Machine *m) { _regs.IME= GBC_TRUE; return 4; }
 
 
 /* 16-BIT ARITHMETIC GROUP */
 
-static int add_HL_BC (void) { OP_HL_SS_NORET ( ADD, B, C ); return 8; }
-static int add_HL_DE (void) { OP_HL_SS_NORET ( ADD, D, E ); return 8; }
-static int add_HL_HL (void) { OP_HL_SS_NORET ( ADD, H, L ); return 8; }
-static int add_HL_SP (void) { OP_HL_RU16_NORET ( ADD, SP ); return 8; }
-static int inc_BC (void) { INCDEC_SS ( INC, B, C ); }
-static int inc_DE (void) { INCDEC_SS ( INC, D, E ); }
-static int inc_HL (void) { INCDEC_SS ( INC, H, L ); }
-static int inc_SP (void) { ++_regs.SP; return 8; }
-static int dec_BC (void) { INCDEC_SS ( DEC, B, C ); }
-static int dec_DE (void) { INCDEC_SS ( DEC, D, E ); }
-static int dec_HL (void) { INCDEC_SS ( DEC, H, L ); }
-static int dec_SP (void) { --_regs.SP; return 8; }
-static int add_SP_dd (void) {
+static int add_HL_BC (GBC_Machine *m) { OP_HL_SS_NORET ( ADD, B, C ); return 8; }
+static int add_HL_DE (GBC_Machine *m) { OP_HL_SS_NORET ( ADD, D, E ); return 8; }
+static int add_HL_HL (GBC_Machine *m) { OP_HL_SS_NORET ( ADD, H, L ); return 8; }
+static int add_HL_SP (GBC_Machine *m) { OP_HL_RU16_NORET ( ADD, SP ); return 8; }
+static int inc_BC (GBC_Machine *m) { INCDEC_SS ( INC, B, C ); }
+static int inc_DE (GBC_Machine *m) { INCDEC_SS ( INC, D, E ); }
+static int inc_HL (GBC_Machine *m) { INCDEC_SS ( INC, H, L ); }
+static int inc_SP (GBC_Machine *m) { ++_regs.SP; return 8; }
+static int dec_BC (GBC_Machine *m) { INCDEC_SS ( DEC, B, C ); }
+static int dec_DE (GBC_Machine *m) { INCDEC_SS ( DEC, D, E ); }
+static int dec_HL (GBC_Machine *m) { INCDEC_SS ( DEC, H, L ); }
+static int dec_SP (GBC_Machine *m) { --_regs.SP; return 8; }
+static int add_SP_dd (GBC_Machine *m) {
   SPdd_DEFAUX32();
   _regs.SP= aux&0xFFFF;
   return 16;
 }
-static int ld_HL_SPdd (void) {
+static int ld_HL_SPdd (GBC_Machine *m) {
   SPdd_DEFAUX32();
   _regs.H= (GBCu8) ((aux>>8)&0xFF);
   _regs.L= (GBCu8) (aux&0xFF);
@@ -874,7 +960,7 @@ static int ld_HL_SPdd (void) {
 
 /* ROTATE AND SHIFT GROUP */
 
-static int rlca (void)
+static int rlca (GBC_Machine *m)
 {
   GBCu8 aux;
   aux= _regs.A>>7;
@@ -882,7 +968,7 @@ static int rlca (void)
   _regs.A= ((_regs.A<<1)|aux)&0xff;
   return 4;
 }
-static int rla (void)
+static int rla (GBC_Machine *m)
 {
   _regs.A<<= 1;
   _regs.A|= _regs.F&CFLAG;
@@ -890,7 +976,7 @@ static int rla (void)
   _regs.A&= 0xff;
   return 4;
 }
-static int rrca (void)
+static int rrca (GBC_Machine *m)
 {
   GBCu8 aux;
   aux= _regs.A&0x1;
@@ -898,7 +984,7 @@ static int rrca (void)
   _regs.A= (_regs.A>>1)|(aux<<7);
   return 4;
 }
-static int rra (void)
+static int rra (GBC_Machine *m)
 {
   GBCu8 aux;
   aux= _regs.A&0x1;
@@ -906,307 +992,307 @@ static int rra (void)
   _regs.F= aux;
   return 4;
 }
-static int rlc_B (void) { ROT_R ( RLC, B ); }
-static int rlc_C (void) { ROT_R ( RLC, C ); }
-static int rlc_D (void) { ROT_R ( RLC, D ); }
-static int rlc_E (void) { ROT_R ( RLC, E ); }
-static int rlc_H (void) { ROT_R ( RLC, H ); }
-static int rlc_L (void) { ROT_R ( RLC, L ); }
-static int rlc_A (void) { ROT_A ( RLC ); }
-static int rlc_pHL (void) { ROT_pHL ( RLC ); }
-static int rl_B (void) { ROT_R ( RL, B ); }
-static int rl_C (void) { ROT_R ( RL, C ); }
-static int rl_D (void) { ROT_R ( RL, D ); }
-static int rl_E (void) { ROT_R ( RL, E ); }
-static int rl_H (void) { ROT_R ( RL, H ); }
-static int rl_L (void) { ROT_R ( RL, L ); }
-static int rl_A (void) { ROT_A ( RL ); }
-static int rl_pHL (void) { ROT_pHL ( RL ); }
-static int rrc_B (void) { ROT_R ( RRC, B ); }
-static int rrc_C (void) { ROT_R ( RRC, C ); }
-static int rrc_D (void) { ROT_R ( RRC, D ); }
-static int rrc_E (void) { ROT_R ( RRC, E ); }
-static int rrc_H (void) { ROT_R ( RRC, H ); }
-static int rrc_L (void) { ROT_R ( RRC, L ); }
-static int rrc_A (void) { ROT_A ( RRC ); }
-static int rrc_pHL (void) { ROT_pHL ( RRC ); }
-static int rr_B (void) { ROT_R ( RR, B ); }
-static int rr_C (void) { ROT_R ( RR, C ); }
-static int rr_D (void) { ROT_R ( RR, D ); }
-static int rr_E (void) { ROT_R ( RR, E ); }
-static int rr_H (void) { ROT_R ( RR, H ); }
-static int rr_L (void) { ROT_R ( RR, L ); }
-static int rr_A (void) { ROT_A ( RR ); }
-static int rr_pHL (void) { ROT_pHL ( RR ); }
-static int sla_B (void) { SHI_R ( SLA, B ); }
-static int sla_C (void) { SHI_R ( SLA, C ); }
-static int sla_D (void) { SHI_R ( SLA, D ); }
-static int sla_E (void) { SHI_R ( SLA, E ); }
-static int sla_H (void) { SHI_R ( SLA, H ); }
-static int sla_L (void) { SHI_R ( SLA, L ); }
-static int sla_A (void) { SHI_A ( SLA ); }
-static int sla_pHL (void) { SHI_pHL ( SLA ); }
-static int sra_B (void) { SHI_R ( SRA, B ); }
-static int sra_C (void) { SHI_R ( SRA, C ); }
-static int sra_D (void) { SHI_R ( SRA, D ); }
-static int sra_E (void) { SHI_R ( SRA, E ); }
-static int sra_H (void) { SHI_R ( SRA, H ); }
-static int sra_L (void) { SHI_R ( SRA, L ); }
-static int sra_A (void) { SHI_A ( SRA ); }
-static int sra_pHL (void) { SHI_pHL ( SRA ); }
-static int srl_B (void) { SHI_R ( SRL, B ); }
-static int srl_C (void) { SHI_R ( SRL, C ); }
-static int srl_D (void) { SHI_R ( SRL, D ); }
-static int srl_E (void) { SHI_R ( SRL, E ); }
-static int srl_H (void) { SHI_R ( SRL, H ); }
-static int srl_L (void) { SHI_R ( SRL, L ); }
-static int srl_A (void) { SHI_A ( SRL ); }
-static int srl_pHL (void) { SHI_pHL ( SRL ); }
-static int swap_B (void) { SWAP_R ( B ); }
-static int swap_C (void) { SWAP_R ( C ); }
-static int swap_D (void) { SWAP_R ( D ); }
-static int swap_E (void) { SWAP_R ( E ); }
-static int swap_H (void) { SWAP_R ( H ); }
-static int swap_L (void) { SWAP_R ( L ); }
-static int swap_A (void) { SWAP_A (); }
-static int swap_pHL (void) { SWAP_pHL (); }
+static int rlc_B (GBC_Machine *m) { ROT_R ( RLC, B ); }
+static int rlc_C (GBC_Machine *m) { ROT_R ( RLC, C ); }
+static int rlc_D (GBC_Machine *m) { ROT_R ( RLC, D ); }
+static int rlc_E (GBC_Machine *m) { ROT_R ( RLC, E ); }
+static int rlc_H (GBC_Machine *m) { ROT_R ( RLC, H ); }
+static int rlc_L (GBC_Machine *m) { ROT_R ( RLC, L ); }
+static int rlc_A (GBC_Machine *m) { ROT_A ( RLC ); }
+static int rlc_pHL (GBC_Machine *m) { ROT_pHL ( RLC ); }
+static int rl_B (GBC_Machine *m) { ROT_R ( RL, B ); }
+static int rl_C (GBC_Machine *m) { ROT_R ( RL, C ); }
+static int rl_D (GBC_Machine *m) { ROT_R ( RL, D ); }
+static int rl_E (GBC_Machine *m) { ROT_R ( RL, E ); }
+static int rl_H (GBC_Machine *m) { ROT_R ( RL, H ); }
+static int rl_L (GBC_Machine *m) { ROT_R ( RL, L ); }
+static int rl_A (GBC_Machine *m) { ROT_A ( RL ); }
+static int rl_pHL (GBC_Machine *m) { ROT_pHL ( RL ); }
+static int rrc_B (GBC_Machine *m) { ROT_R ( RRC, B ); }
+static int rrc_C (GBC_Machine *m) { ROT_R ( RRC, C ); }
+static int rrc_D (GBC_Machine *m) { ROT_R ( RRC, D ); }
+static int rrc_E (GBC_Machine *m) { ROT_R ( RRC, E ); }
+static int rrc_H (GBC_Machine *m) { ROT_R ( RRC, H ); }
+static int rrc_L (GBC_Machine *m) { ROT_R ( RRC, L ); }
+static int rrc_A (GBC_Machine *m) { ROT_A ( RRC ); }
+static int rrc_pHL (GBC_Machine *m) { ROT_pHL ( RRC ); }
+static int rr_B (GBC_Machine *m) { ROT_R ( RR, B ); }
+static int rr_C (GBC_Machine *m) { ROT_R ( RR, C ); }
+static int rr_D (GBC_Machine *m) { ROT_R ( RR, D ); }
+static int rr_E (GBC_Machine *m) { ROT_R ( RR, E ); }
+static int rr_H (GBC_Machine *m) { ROT_R ( RR, H ); }
+static int rr_L (GBC_Machine *m) { ROT_R ( RR, L ); }
+static int rr_A (GBC_Machine *m) { ROT_A ( RR ); }
+static int rr_pHL (GBC_Machine *m) { ROT_pHL ( RR ); }
+static int sla_B (GBC_Machine *m) { SHI_R ( SLA, B ); }
+static int sla_C (GBC_Machine *m) { SHI_R ( SLA, C ); }
+static int sla_D (GBC_Machine *m) { SHI_R ( SLA, D ); }
+static int sla_E (GBC_Machine *m) { SHI_R ( SLA, E ); }
+static int sla_H (GBC_Machine *m) { SHI_R ( SLA, H ); }
+static int sla_L (GBC_Machine *m) { SHI_R ( SLA, L ); }
+static int sla_A (GBC_Machine *m) { SHI_A ( SLA ); }
+static int sla_pHL (GBC_Machine *m) { SHI_pHL ( SLA ); }
+static int sra_B (GBC_Machine *m) { SHI_R ( SRA, B ); }
+static int sra_C (GBC_Machine *m) { SHI_R ( SRA, C ); }
+static int sra_D (GBC_Machine *m) { SHI_R ( SRA, D ); }
+static int sra_E (GBC_Machine *m) { SHI_R ( SRA, E ); }
+static int sra_H (GBC_Machine *m) { SHI_R ( SRA, H ); }
+static int sra_L (GBC_Machine *m) { SHI_R ( SRA, L ); }
+static int sra_A (GBC_Machine *m) { SHI_A ( SRA ); }
+static int sra_pHL (GBC_Machine *m) { SHI_pHL ( SRA ); }
+static int srl_B (GBC_Machine *m) { SHI_R ( SRL, B ); }
+static int srl_C (GBC_Machine *m) { SHI_R ( SRL, C ); }
+static int srl_D (GBC_Machine *m) { SHI_R ( SRL, D ); }
+static int srl_E (GBC_Machine *m) { SHI_R ( SRL, E ); }
+static int srl_H (GBC_Machine *m) { SHI_R ( SRL, H ); }
+static int srl_L (GBC_Machine *m) { SHI_R ( SRL, L ); }
+static int srl_A (GBC_Machine *m) { SHI_A ( SRL ); }
+static int srl_pHL (GBC_Machine *m) { SHI_pHL ( SRL ); }
+static int swap_B (GBC_Machine *m) { SWAP_R ( B ); }
+static int swap_C (GBC_Machine *m) { SWAP_R ( C ); }
+static int swap_D (GBC_Machine *m) { SWAP_R ( D ); }
+static int swap_E (GBC_Machine *m) { SWAP_R ( E ); }
+static int swap_H (GBC_Machine *m) { SWAP_R ( H ); }
+static int swap_L (GBC_Machine *m) { SWAP_R ( L ); }
+static int swap_A (GBC_Machine *m) { SWAP_A (); }
+static int swap_pHL (GBC_Machine *m) { SWAP_pHL (); }
 
 
 /* BIT SET, RESET, AND TEST GROUP */
 
-static int bit_0_B (void) { BIT_R ( B, 0x01 ); }
-static int bit_0_C (void) { BIT_R ( C, 0x01 ); }
-static int bit_0_D (void) { BIT_R ( D, 0x01 ); }
-static int bit_0_E (void) { BIT_R ( E, 0x01 ); }
-static int bit_0_H (void) { BIT_R ( H, 0x01 ); }
-static int bit_0_L (void) { BIT_R ( L, 0x01 ); }
-static int bit_0_A (void) { BIT_R ( A, 0x01 ); }
-static int bit_1_B (void) { BIT_R ( B, 0x02 ); }
-static int bit_1_C (void) { BIT_R ( C, 0x02 ); }
-static int bit_1_D (void) { BIT_R ( D, 0x02 ); }
-static int bit_1_E (void) { BIT_R ( E, 0x02 ); }
-static int bit_1_H (void) { BIT_R ( H, 0x02 ); }
-static int bit_1_L (void) { BIT_R ( L, 0x02 ); }
-static int bit_1_A (void) { BIT_R ( A, 0x02 ); }
-static int bit_2_B (void) { BIT_R ( B, 0x04 ); }
-static int bit_2_C (void) { BIT_R ( C, 0x04 ); }
-static int bit_2_D (void) { BIT_R ( D, 0x04 ); }
-static int bit_2_E (void) { BIT_R ( E, 0x04 ); }
-static int bit_2_H (void) { BIT_R ( H, 0x04 ); }
-static int bit_2_L (void) { BIT_R ( L, 0x04 ); }
-static int bit_2_A (void) { BIT_R ( A, 0x04 ); }
-static int bit_3_B (void) { BIT_R ( B, 0x08 ); }
-static int bit_3_C (void) { BIT_R ( C, 0x08 ); }
-static int bit_3_D (void) { BIT_R ( D, 0x08 ); }
-static int bit_3_E (void) { BIT_R ( E, 0x08 ); }
-static int bit_3_H (void) { BIT_R ( H, 0x08 ); }
-static int bit_3_L (void) { BIT_R ( L, 0x08 ); }
-static int bit_3_A (void) { BIT_R ( A, 0x08 ); }
-static int bit_4_B (void) { BIT_R ( B, 0x10 ); }
-static int bit_4_C (void) { BIT_R ( C, 0x10 ); }
-static int bit_4_D (void) { BIT_R ( D, 0x10 ); }
-static int bit_4_E (void) { BIT_R ( E, 0x10 ); }
-static int bit_4_H (void) { BIT_R ( H, 0x10 ); }
-static int bit_4_L (void) { BIT_R ( L, 0x10 ); }
-static int bit_4_A (void) { BIT_R ( A, 0x10 ); }
-static int bit_5_B (void) { BIT_R ( B, 0x20 ); }
-static int bit_5_C (void) { BIT_R ( C, 0x20 ); }
-static int bit_5_D (void) { BIT_R ( D, 0x20 ); }
-static int bit_5_E (void) { BIT_R ( E, 0x20 ); }
-static int bit_5_H (void) { BIT_R ( H, 0x20 ); }
-static int bit_5_L (void) { BIT_R ( L, 0x20 ); }
-static int bit_5_A (void) { BIT_R ( A, 0x20 ); }
-static int bit_6_B (void) { BIT_R ( B, 0x40 ); }
-static int bit_6_C (void) { BIT_R ( C, 0x40 ); }
-static int bit_6_D (void) { BIT_R ( D, 0x40 ); }
-static int bit_6_E (void) { BIT_R ( E, 0x40 ); }
-static int bit_6_H (void) { BIT_R ( H, 0x40 ); }
-static int bit_6_L (void) { BIT_R ( L, 0x40 ); }
-static int bit_6_A (void) { BIT_R ( A, 0x40 ); }
-static int bit_7_B (void) { BIT_R ( B, 0x80 ); }
-static int bit_7_C (void) { BIT_R ( C, 0x80 ); }
-static int bit_7_D (void) { BIT_R ( D, 0x80 ); }
-static int bit_7_E (void) { BIT_R ( E, 0x80 ); }
-static int bit_7_H (void) { BIT_R ( H, 0x80 ); }
-static int bit_7_L (void) { BIT_R ( L, 0x80 ); }
-static int bit_7_A (void) { BIT_R ( A, 0x80 ); }
-static int bit_0_pHL (void) { BIT_pHL ( 0x01 ); }
-static int bit_1_pHL (void) { BIT_pHL ( 0x02 ); }
-static int bit_2_pHL (void) { BIT_pHL ( 0x04 ); }
-static int bit_3_pHL (void) { BIT_pHL ( 0x08 ); }
-static int bit_4_pHL (void) { BIT_pHL ( 0x10 ); }
-static int bit_5_pHL (void) { BIT_pHL ( 0x20 ); }
-static int bit_6_pHL (void) { BIT_pHL ( 0x40 ); }
-static int bit_7_pHL (void) { BIT_pHL ( 0x80 ); }
-static int set_0_B (void) { SET_R ( B, 0x01 ); }
-static int set_0_C (void) { SET_R ( C, 0x01 ); }
-static int set_0_D (void) { SET_R ( D, 0x01 ); }
-static int set_0_E (void) { SET_R ( E, 0x01 ); }
-static int set_0_H (void) { SET_R ( H, 0x01 ); }
-static int set_0_L (void) { SET_R ( L, 0x01 ); }
-static int set_0_A (void) { SET_R ( A, 0x01 ); }
-static int set_1_B (void) { SET_R ( B, 0x02 ); }
-static int set_1_C (void) { SET_R ( C, 0x02 ); }
-static int set_1_D (void) { SET_R ( D, 0x02 ); }
-static int set_1_E (void) { SET_R ( E, 0x02 ); }
-static int set_1_H (void) { SET_R ( H, 0x02 ); }
-static int set_1_L (void) { SET_R ( L, 0x02 ); }
-static int set_1_A (void) { SET_R ( A, 0x02 ); }
-static int set_2_B (void) { SET_R ( B, 0x04 ); }
-static int set_2_C (void) { SET_R ( C, 0x04 ); }
-static int set_2_D (void) { SET_R ( D, 0x04 ); }
-static int set_2_E (void) { SET_R ( E, 0x04 ); }
-static int set_2_H (void) { SET_R ( H, 0x04 ); }
-static int set_2_L (void) { SET_R ( L, 0x04 ); }
-static int set_2_A (void) { SET_R ( A, 0x04 ); }
-static int set_3_B (void) { SET_R ( B, 0x08 ); }
-static int set_3_C (void) { SET_R ( C, 0x08 ); }
-static int set_3_D (void) { SET_R ( D, 0x08 ); }
-static int set_3_E (void) { SET_R ( E, 0x08 ); }
-static int set_3_H (void) { SET_R ( H, 0x08 ); }
-static int set_3_L (void) { SET_R ( L, 0x08 ); }
-static int set_3_A (void) { SET_R ( A, 0x08 ); }
-static int set_4_B (void) { SET_R ( B, 0x10 ); }
-static int set_4_C (void) { SET_R ( C, 0x10 ); }
-static int set_4_D (void) { SET_R ( D, 0x10 ); }
-static int set_4_E (void) { SET_R ( E, 0x10 ); }
-static int set_4_H (void) { SET_R ( H, 0x10 ); }
-static int set_4_L (void) { SET_R ( L, 0x10 ); }
-static int set_4_A (void) { SET_R ( A, 0x10 ); }
-static int set_5_B (void) { SET_R ( B, 0x20 ); }
-static int set_5_C (void) { SET_R ( C, 0x20 ); }
-static int set_5_D (void) { SET_R ( D, 0x20 ); }
-static int set_5_E (void) { SET_R ( E, 0x20 ); }
-static int set_5_H (void) { SET_R ( H, 0x20 ); }
-static int set_5_L (void) { SET_R ( L, 0x20 ); }
-static int set_5_A (void) { SET_R ( A, 0x20 ); }
-static int set_6_B (void) { SET_R ( B, 0x40 ); }
-static int set_6_C (void) { SET_R ( C, 0x40 ); }
-static int set_6_D (void) { SET_R ( D, 0x40 ); }
-static int set_6_E (void) { SET_R ( E, 0x40 ); }
-static int set_6_H (void) { SET_R ( H, 0x40 ); }
-static int set_6_L (void) { SET_R ( L, 0x40 ); }
-static int set_6_A (void) { SET_R ( A, 0x40 ); }
-static int set_7_B (void) { SET_R ( B, 0x80 ); }
-static int set_7_C (void) { SET_R ( C, 0x80 ); }
-static int set_7_D (void) { SET_R ( D, 0x80 ); }
-static int set_7_E (void) { SET_R ( E, 0x80 ); }
-static int set_7_H (void) { SET_R ( H, 0x80 ); }
-static int set_7_L (void) { SET_R ( L, 0x80 ); }
-static int set_7_A (void) { SET_R ( A, 0x80 ); }
-static int set_0_pHL (void) { SET_pHL ( 0x01 ); }
-static int set_1_pHL (void) { SET_pHL ( 0x02 ); }
-static int set_2_pHL (void) { SET_pHL ( 0x04 ); }
-static int set_3_pHL (void) { SET_pHL ( 0x08 ); }
-static int set_4_pHL (void) { SET_pHL ( 0x10 ); }
-static int set_5_pHL (void) { SET_pHL ( 0x20 ); }
-static int set_6_pHL (void) { SET_pHL ( 0x40 ); }
-static int set_7_pHL (void) { SET_pHL ( 0x80 ); }
-static int res_0_B (void) { RES_R ( B, 0xfe ); }
-static int res_0_C (void) { RES_R ( C, 0xfe ); }
-static int res_0_D (void) { RES_R ( D, 0xfe ); }
-static int res_0_E (void) { RES_R ( E, 0xfe ); }
-static int res_0_H (void) { RES_R ( H, 0xfe ); }
-static int res_0_L (void) { RES_R ( L, 0xfe ); }
-static int res_0_A (void) { RES_R ( A, 0xfe ); }
-static int res_1_B (void) { RES_R ( B, 0xfd ); }
-static int res_1_C (void) { RES_R ( C, 0xfd ); }
-static int res_1_D (void) { RES_R ( D, 0xfd ); }
-static int res_1_E (void) { RES_R ( E, 0xfd ); }
-static int res_1_H (void) { RES_R ( H, 0xfd ); }
-static int res_1_L (void) { RES_R ( L, 0xfd ); }
-static int res_1_A (void) { RES_R ( A, 0xfd ); }
-static int res_2_B (void) { RES_R ( B, 0xfb ); }
-static int res_2_C (void) { RES_R ( C, 0xfb ); }
-static int res_2_D (void) { RES_R ( D, 0xfb ); }
-static int res_2_E (void) { RES_R ( E, 0xfb ); }
-static int res_2_H (void) { RES_R ( H, 0xfb ); }
-static int res_2_L (void) { RES_R ( L, 0xfb ); }
-static int res_2_A (void) { RES_R ( A, 0xfb ); }
-static int res_3_B (void) { RES_R ( B, 0xf7 ); }
-static int res_3_C (void) { RES_R ( C, 0xf7 ); }
-static int res_3_D (void) { RES_R ( D, 0xf7 ); }
-static int res_3_E (void) { RES_R ( E, 0xf7 ); }
-static int res_3_H (void) { RES_R ( H, 0xf7 ); }
-static int res_3_L (void) { RES_R ( L, 0xf7 ); }
-static int res_3_A (void) { RES_R ( A, 0xf7 ); }
-static int res_4_B (void) { RES_R ( B, 0xef ); }
-static int res_4_C (void) { RES_R ( C, 0xef ); }
-static int res_4_D (void) { RES_R ( D, 0xef ); }
-static int res_4_E (void) { RES_R ( E, 0xef ); }
-static int res_4_H (void) { RES_R ( H, 0xef ); }
-static int res_4_L (void) { RES_R ( L, 0xef ); }
-static int res_4_A (void) { RES_R ( A, 0xef ); }
-static int res_5_B (void) { RES_R ( B, 0xdf ); }
-static int res_5_C (void) { RES_R ( C, 0xdf ); }
-static int res_5_D (void) { RES_R ( D, 0xdf ); }
-static int res_5_E (void) { RES_R ( E, 0xdf ); }
-static int res_5_H (void) { RES_R ( H, 0xdf ); }
-static int res_5_L (void) { RES_R ( L, 0xdf ); }
-static int res_5_A (void) { RES_R ( A, 0xdf ); }
-static int res_6_B (void) { RES_R ( B, 0xbf ); }
-static int res_6_C (void) { RES_R ( C, 0xbf ); }
-static int res_6_D (void) { RES_R ( D, 0xbf ); }
-static int res_6_E (void) { RES_R ( E, 0xbf ); }
-static int res_6_H (void) { RES_R ( H, 0xbf ); }
-static int res_6_L (void) { RES_R ( L, 0xbf ); }
-static int res_6_A (void) { RES_R ( A, 0xbf ); }
-static int res_7_B (void) { RES_R ( B, 0x7f ); }
-static int res_7_C (void) { RES_R ( C, 0x7f ); }
-static int res_7_D (void) { RES_R ( D, 0x7f ); }
-static int res_7_E (void) { RES_R ( E, 0x7f ); }
-static int res_7_H (void) { RES_R ( H, 0x7f ); }
-static int res_7_L (void) { RES_R ( L, 0x7f ); }
-static int res_7_A (void) { RES_R ( A, 0x7f ); }
-static int res_0_pHL (void) { RES_pHL ( 0xfe ); }
-static int res_1_pHL (void) { RES_pHL ( 0xfd ); }
-static int res_2_pHL (void) { RES_pHL ( 0xfb ); }
-static int res_3_pHL (void) { RES_pHL ( 0xf7 ); }
-static int res_4_pHL (void) { RES_pHL ( 0xef ); }
-static int res_5_pHL (void) { RES_pHL ( 0xdf ); }
-static int res_6_pHL (void) { RES_pHL ( 0xbf ); }
-static int res_7_pHL (void) { RES_pHL ( 0x7f ); }
+static int bit_0_B (GBC_Machine *m) { BIT_R ( B, 0x01 ); }
+static int bit_0_C (GBC_Machine *m) { BIT_R ( C, 0x01 ); }
+static int bit_0_D (GBC_Machine *m) { BIT_R ( D, 0x01 ); }
+static int bit_0_E (GBC_Machine *m) { BIT_R ( E, 0x01 ); }
+static int bit_0_H (GBC_Machine *m) { BIT_R ( H, 0x01 ); }
+static int bit_0_L (GBC_Machine *m) { BIT_R ( L, 0x01 ); }
+static int bit_0_A (GBC_Machine *m) { BIT_R ( A, 0x01 ); }
+static int bit_1_B (GBC_Machine *m) { BIT_R ( B, 0x02 ); }
+static int bit_1_C (GBC_Machine *m) { BIT_R ( C, 0x02 ); }
+static int bit_1_D (GBC_Machine *m) { BIT_R ( D, 0x02 ); }
+static int bit_1_E (GBC_Machine *m) { BIT_R ( E, 0x02 ); }
+static int bit_1_H (GBC_Machine *m) { BIT_R ( H, 0x02 ); }
+static int bit_1_L (GBC_Machine *m) { BIT_R ( L, 0x02 ); }
+static int bit_1_A (GBC_Machine *m) { BIT_R ( A, 0x02 ); }
+static int bit_2_B (GBC_Machine *m) { BIT_R ( B, 0x04 ); }
+static int bit_2_C (GBC_Machine *m) { BIT_R ( C, 0x04 ); }
+static int bit_2_D (GBC_Machine *m) { BIT_R ( D, 0x04 ); }
+static int bit_2_E (GBC_Machine *m) { BIT_R ( E, 0x04 ); }
+static int bit_2_H (GBC_Machine *m) { BIT_R ( H, 0x04 ); }
+static int bit_2_L (GBC_Machine *m) { BIT_R ( L, 0x04 ); }
+static int bit_2_A (GBC_Machine *m) { BIT_R ( A, 0x04 ); }
+static int bit_3_B (GBC_Machine *m) { BIT_R ( B, 0x08 ); }
+static int bit_3_C (GBC_Machine *m) { BIT_R ( C, 0x08 ); }
+static int bit_3_D (GBC_Machine *m) { BIT_R ( D, 0x08 ); }
+static int bit_3_E (GBC_Machine *m) { BIT_R ( E, 0x08 ); }
+static int bit_3_H (GBC_Machine *m) { BIT_R ( H, 0x08 ); }
+static int bit_3_L (GBC_Machine *m) { BIT_R ( L, 0x08 ); }
+static int bit_3_A (GBC_Machine *m) { BIT_R ( A, 0x08 ); }
+static int bit_4_B (GBC_Machine *m) { BIT_R ( B, 0x10 ); }
+static int bit_4_C (GBC_Machine *m) { BIT_R ( C, 0x10 ); }
+static int bit_4_D (GBC_Machine *m) { BIT_R ( D, 0x10 ); }
+static int bit_4_E (GBC_Machine *m) { BIT_R ( E, 0x10 ); }
+static int bit_4_H (GBC_Machine *m) { BIT_R ( H, 0x10 ); }
+static int bit_4_L (GBC_Machine *m) { BIT_R ( L, 0x10 ); }
+static int bit_4_A (GBC_Machine *m) { BIT_R ( A, 0x10 ); }
+static int bit_5_B (GBC_Machine *m) { BIT_R ( B, 0x20 ); }
+static int bit_5_C (GBC_Machine *m) { BIT_R ( C, 0x20 ); }
+static int bit_5_D (GBC_Machine *m) { BIT_R ( D, 0x20 ); }
+static int bit_5_E (GBC_Machine *m) { BIT_R ( E, 0x20 ); }
+static int bit_5_H (GBC_Machine *m) { BIT_R ( H, 0x20 ); }
+static int bit_5_L (GBC_Machine *m) { BIT_R ( L, 0x20 ); }
+static int bit_5_A (GBC_Machine *m) { BIT_R ( A, 0x20 ); }
+static int bit_6_B (GBC_Machine *m) { BIT_R ( B, 0x40 ); }
+static int bit_6_C (GBC_Machine *m) { BIT_R ( C, 0x40 ); }
+static int bit_6_D (GBC_Machine *m) { BIT_R ( D, 0x40 ); }
+static int bit_6_E (GBC_Machine *m) { BIT_R ( E, 0x40 ); }
+static int bit_6_H (GBC_Machine *m) { BIT_R ( H, 0x40 ); }
+static int bit_6_L (GBC_Machine *m) { BIT_R ( L, 0x40 ); }
+static int bit_6_A (GBC_Machine *m) { BIT_R ( A, 0x40 ); }
+static int bit_7_B (GBC_Machine *m) { BIT_R ( B, 0x80 ); }
+static int bit_7_C (GBC_Machine *m) { BIT_R ( C, 0x80 ); }
+static int bit_7_D (GBC_Machine *m) { BIT_R ( D, 0x80 ); }
+static int bit_7_E (GBC_Machine *m) { BIT_R ( E, 0x80 ); }
+static int bit_7_H (GBC_Machine *m) { BIT_R ( H, 0x80 ); }
+static int bit_7_L (GBC_Machine *m) { BIT_R ( L, 0x80 ); }
+static int bit_7_A (GBC_Machine *m) { BIT_R ( A, 0x80 ); }
+static int bit_0_pHL (GBC_Machine *m) { BIT_pHL ( 0x01 ); }
+static int bit_1_pHL (GBC_Machine *m) { BIT_pHL ( 0x02 ); }
+static int bit_2_pHL (GBC_Machine *m) { BIT_pHL ( 0x04 ); }
+static int bit_3_pHL (GBC_Machine *m) { BIT_pHL ( 0x08 ); }
+static int bit_4_pHL (GBC_Machine *m) { BIT_pHL ( 0x10 ); }
+static int bit_5_pHL (GBC_Machine *m) { BIT_pHL ( 0x20 ); }
+static int bit_6_pHL (GBC_Machine *m) { BIT_pHL ( 0x40 ); }
+static int bit_7_pHL (GBC_Machine *m) { BIT_pHL ( 0x80 ); }
+static int set_0_B (GBC_Machine *m) { SET_R ( B, 0x01 ); }
+static int set_0_C (GBC_Machine *m) { SET_R ( C, 0x01 ); }
+static int set_0_D (GBC_Machine *m) { SET_R ( D, 0x01 ); }
+static int set_0_E (GBC_Machine *m) { SET_R ( E, 0x01 ); }
+static int set_0_H (GBC_Machine *m) { SET_R ( H, 0x01 ); }
+static int set_0_L (GBC_Machine *m) { SET_R ( L, 0x01 ); }
+static int set_0_A (GBC_Machine *m) { SET_R ( A, 0x01 ); }
+static int set_1_B (GBC_Machine *m) { SET_R ( B, 0x02 ); }
+static int set_1_C (GBC_Machine *m) { SET_R ( C, 0x02 ); }
+static int set_1_D (GBC_Machine *m) { SET_R ( D, 0x02 ); }
+static int set_1_E (GBC_Machine *m) { SET_R ( E, 0x02 ); }
+static int set_1_H (GBC_Machine *m) { SET_R ( H, 0x02 ); }
+static int set_1_L (GBC_Machine *m) { SET_R ( L, 0x02 ); }
+static int set_1_A (GBC_Machine *m) { SET_R ( A, 0x02 ); }
+static int set_2_B (GBC_Machine *m) { SET_R ( B, 0x04 ); }
+static int set_2_C (GBC_Machine *m) { SET_R ( C, 0x04 ); }
+static int set_2_D (GBC_Machine *m) { SET_R ( D, 0x04 ); }
+static int set_2_E (GBC_Machine *m) { SET_R ( E, 0x04 ); }
+static int set_2_H (GBC_Machine *m) { SET_R ( H, 0x04 ); }
+static int set_2_L (GBC_Machine *m) { SET_R ( L, 0x04 ); }
+static int set_2_A (GBC_Machine *m) { SET_R ( A, 0x04 ); }
+static int set_3_B (GBC_Machine *m) { SET_R ( B, 0x08 ); }
+static int set_3_C (GBC_Machine *m) { SET_R ( C, 0x08 ); }
+static int set_3_D (GBC_Machine *m) { SET_R ( D, 0x08 ); }
+static int set_3_E (GBC_Machine *m) { SET_R ( E, 0x08 ); }
+static int set_3_H (GBC_Machine *m) { SET_R ( H, 0x08 ); }
+static int set_3_L (GBC_Machine *m) { SET_R ( L, 0x08 ); }
+static int set_3_A (GBC_Machine *m) { SET_R ( A, 0x08 ); }
+static int set_4_B (GBC_Machine *m) { SET_R ( B, 0x10 ); }
+static int set_4_C (GBC_Machine *m) { SET_R ( C, 0x10 ); }
+static int set_4_D (GBC_Machine *m) { SET_R ( D, 0x10 ); }
+static int set_4_E (GBC_Machine *m) { SET_R ( E, 0x10 ); }
+static int set_4_H (GBC_Machine *m) { SET_R ( H, 0x10 ); }
+static int set_4_L (GBC_Machine *m) { SET_R ( L, 0x10 ); }
+static int set_4_A (GBC_Machine *m) { SET_R ( A, 0x10 ); }
+static int set_5_B (GBC_Machine *m) { SET_R ( B, 0x20 ); }
+static int set_5_C (GBC_Machine *m) { SET_R ( C, 0x20 ); }
+static int set_5_D (GBC_Machine *m) { SET_R ( D, 0x20 ); }
+static int set_5_E (GBC_Machine *m) { SET_R ( E, 0x20 ); }
+static int set_5_H (GBC_Machine *m) { SET_R ( H, 0x20 ); }
+static int set_5_L (GBC_Machine *m) { SET_R ( L, 0x20 ); }
+static int set_5_A (GBC_Machine *m) { SET_R ( A, 0x20 ); }
+static int set_6_B (GBC_Machine *m) { SET_R ( B, 0x40 ); }
+static int set_6_C (GBC_Machine *m) { SET_R ( C, 0x40 ); }
+static int set_6_D (GBC_Machine *m) { SET_R ( D, 0x40 ); }
+static int set_6_E (GBC_Machine *m) { SET_R ( E, 0x40 ); }
+static int set_6_H (GBC_Machine *m) { SET_R ( H, 0x40 ); }
+static int set_6_L (GBC_Machine *m) { SET_R ( L, 0x40 ); }
+static int set_6_A (GBC_Machine *m) { SET_R ( A, 0x40 ); }
+static int set_7_B (GBC_Machine *m) { SET_R ( B, 0x80 ); }
+static int set_7_C (GBC_Machine *m) { SET_R ( C, 0x80 ); }
+static int set_7_D (GBC_Machine *m) { SET_R ( D, 0x80 ); }
+static int set_7_E (GBC_Machine *m) { SET_R ( E, 0x80 ); }
+static int set_7_H (GBC_Machine *m) { SET_R ( H, 0x80 ); }
+static int set_7_L (GBC_Machine *m) { SET_R ( L, 0x80 ); }
+static int set_7_A (GBC_Machine *m) { SET_R ( A, 0x80 ); }
+static int set_0_pHL (GBC_Machine *m) { SET_pHL ( 0x01 ); }
+static int set_1_pHL (GBC_Machine *m) { SET_pHL ( 0x02 ); }
+static int set_2_pHL (GBC_Machine *m) { SET_pHL ( 0x04 ); }
+static int set_3_pHL (GBC_Machine *m) { SET_pHL ( 0x08 ); }
+static int set_4_pHL (GBC_Machine *m) { SET_pHL ( 0x10 ); }
+static int set_5_pHL (GBC_Machine *m) { SET_pHL ( 0x20 ); }
+static int set_6_pHL (GBC_Machine *m) { SET_pHL ( 0x40 ); }
+static int set_7_pHL (GBC_Machine *m) { SET_pHL ( 0x80 ); }
+static int res_0_B (GBC_Machine *m) { RES_R ( B, 0xfe ); }
+static int res_0_C (GBC_Machine *m) { RES_R ( C, 0xfe ); }
+static int res_0_D (GBC_Machine *m) { RES_R ( D, 0xfe ); }
+static int res_0_E (GBC_Machine *m) { RES_R ( E, 0xfe ); }
+static int res_0_H (GBC_Machine *m) { RES_R ( H, 0xfe ); }
+static int res_0_L (GBC_Machine *m) { RES_R ( L, 0xfe ); }
+static int res_0_A (GBC_Machine *m) { RES_R ( A, 0xfe ); }
+static int res_1_B (GBC_Machine *m) { RES_R ( B, 0xfd ); }
+static int res_1_C (GBC_Machine *m) { RES_R ( C, 0xfd ); }
+static int res_1_D (GBC_Machine *m) { RES_R ( D, 0xfd ); }
+static int res_1_E (GBC_Machine *m) { RES_R ( E, 0xfd ); }
+static int res_1_H (GBC_Machine *m) { RES_R ( H, 0xfd ); }
+static int res_1_L (GBC_Machine *m) { RES_R ( L, 0xfd ); }
+static int res_1_A (GBC_Machine *m) { RES_R ( A, 0xfd ); }
+static int res_2_B (GBC_Machine *m) { RES_R ( B, 0xfb ); }
+static int res_2_C (GBC_Machine *m) { RES_R ( C, 0xfb ); }
+static int res_2_D (GBC_Machine *m) { RES_R ( D, 0xfb ); }
+static int res_2_E (GBC_Machine *m) { RES_R ( E, 0xfb ); }
+static int res_2_H (GBC_Machine *m) { RES_R ( H, 0xfb ); }
+static int res_2_L (GBC_Machine *m) { RES_R ( L, 0xfb ); }
+static int res_2_A (GBC_Machine *m) { RES_R ( A, 0xfb ); }
+static int res_3_B (GBC_Machine *m) { RES_R ( B, 0xf7 ); }
+static int res_3_C (GBC_Machine *m) { RES_R ( C, 0xf7 ); }
+static int res_3_D (GBC_Machine *m) { RES_R ( D, 0xf7 ); }
+static int res_3_E (GBC_Machine *m) { RES_R ( E, 0xf7 ); }
+static int res_3_H (GBC_Machine *m) { RES_R ( H, 0xf7 ); }
+static int res_3_L (GBC_Machine *m) { RES_R ( L, 0xf7 ); }
+static int res_3_A (GBC_Machine *m) { RES_R ( A, 0xf7 ); }
+static int res_4_B (GBC_Machine *m) { RES_R ( B, 0xef ); }
+static int res_4_C (GBC_Machine *m) { RES_R ( C, 0xef ); }
+static int res_4_D (GBC_Machine *m) { RES_R ( D, 0xef ); }
+static int res_4_E (GBC_Machine *m) { RES_R ( E, 0xef ); }
+static int res_4_H (GBC_Machine *m) { RES_R ( H, 0xef ); }
+static int res_4_L (GBC_Machine *m) { RES_R ( L, 0xef ); }
+static int res_4_A (GBC_Machine *m) { RES_R ( A, 0xef ); }
+static int res_5_B (GBC_Machine *m) { RES_R ( B, 0xdf ); }
+static int res_5_C (GBC_Machine *m) { RES_R ( C, 0xdf ); }
+static int res_5_D (GBC_Machine *m) { RES_R ( D, 0xdf ); }
+static int res_5_E (GBC_Machine *m) { RES_R ( E, 0xdf ); }
+static int res_5_H (GBC_Machine *m) { RES_R ( H, 0xdf ); }
+static int res_5_L (GBC_Machine *m) { RES_R ( L, 0xdf ); }
+static int res_5_A (GBC_Machine *m) { RES_R ( A, 0xdf ); }
+static int res_6_B (GBC_Machine *m) { RES_R ( B, 0xbf ); }
+static int res_6_C (GBC_Machine *m) { RES_R ( C, 0xbf ); }
+static int res_6_D (GBC_Machine *m) { RES_R ( D, 0xbf ); }
+static int res_6_E (GBC_Machine *m) { RES_R ( E, 0xbf ); }
+static int res_6_H (GBC_Machine *m) { RES_R ( H, 0xbf ); }
+static int res_6_L (GBC_Machine *m) { RES_R ( L, 0xbf ); }
+static int res_6_A (GBC_Machine *m) { RES_R ( A, 0xbf ); }
+static int res_7_B (GBC_Machine *m) { RES_R ( B, 0x7f ); }
+static int res_7_C (GBC_Machine *m) { RES_R ( C, 0x7f ); }
+static int res_7_D (GBC_Machine *m) { RES_R ( D, 0x7f ); }
+static int res_7_E (GBC_Machine *m) { RES_R ( E, 0x7f ); }
+static int res_7_H (GBC_Machine *m) { RES_R ( H, 0x7f ); }
+static int res_7_L (GBC_Machine *m) { RES_R ( L, 0x7f ); }
+static int res_7_A (GBC_Machine *m) { RES_R ( A, 0x7f ); }
+static int res_0_pHL (GBC_Machine *m) { RES_pHL ( 0xfe ); }
+static int res_1_pHL (GBC_Machine *m) { RES_pHL ( 0xfd ); }
+static int res_2_pHL (GBC_Machine *m) { RES_pHL ( 0xfb ); }
+static int res_3_pHL (GBC_Machine *m) { RES_pHL ( 0xf7 ); }
+static int res_4_pHL (GBC_Machine *m) { RES_pHL ( 0xef ); }
+static int res_5_pHL (GBC_Machine *m) { RES_pHL ( 0xdf ); }
+static int res_6_pHL (GBC_Machine *m) { RES_pHL ( 0xbf ); }
+static int res_7_pHL (GBC_Machine *m) { RES_pHL ( 0x7f ); }
 
 
 /* JUMP GROUP */
 
-static int jp (void) { JP (); }
-static int jp_NZ (void) { JP_COND ( !(_regs.F&ZFLAG) ); }
-static int jp_Z (void) { JP_COND ( _regs.F&ZFLAG ); }
-static int jp_NC (void) { JP_COND ( !(_regs.F&CFLAG) ); }
-static int jp_C (void) { JP_COND ( _regs.F&CFLAG ); }
-static int jr (void) { BRANCH; return 12; }
-static int jr_C (void) { JR_COND ( _regs.F&CFLAG ) }
-static int jr_NC (void) { JR_COND ( !(_regs.F&CFLAG) ) }
-static int jr_Z (void) { JR_COND ( _regs.F&ZFLAG ) }
-static int jr_NZ (void) { JR_COND ( !(_regs.F&ZFLAG) ) }
-static int jp_HL (void) { _regs.PC= R16 ( H, L ); return 4; }
+static int jp (GBC_Machine *m) { JP (); }
+static int jp_NZ (GBC_Machine *m) { JP_COND ( !(_regs.F&ZFLAG) ); }
+static int jp_Z (GBC_Machine *m) { JP_COND ( _regs.F&ZFLAG ); }
+static int jp_NC (GBC_Machine *m) { JP_COND ( !(_regs.F&CFLAG) ); }
+static int jp_C (GBC_Machine *m) { JP_COND ( _regs.F&CFLAG ); }
+static int jr (GBC_Machine *m) { BRANCH; return 12; }
+static int jr_C (GBC_Machine *m) { JR_COND ( _regs.F&CFLAG ) }
+static int jr_NC (GBC_Machine *m) { JR_COND ( !(_regs.F&CFLAG) ) }
+static int jr_Z (GBC_Machine *m) { JR_COND ( _regs.F&ZFLAG ) }
+static int jr_NZ (GBC_Machine *m) { JR_COND ( !(_regs.F&ZFLAG) ) }
+static int jp_HL (GBC_Machine *m) { _regs.PC= R16 ( H, L ); return 4; }
 
 
 /* CALL AND RETURN GROUP */
 
-static int call (void) { GBCu16 aux; CALL_NORET ( aux ); return 24; }
-static int call_NZ (void) { CALL_COND ( !(_regs.F&ZFLAG) ); }
-static int call_Z (void) { CALL_COND ( _regs.F&ZFLAG ); }
-static int call_NC (void) { CALL_COND ( !(_regs.F&CFLAG) ); }
-static int call_C (void) { CALL_COND ( _regs.F&CFLAG ); }
-static int ret (void) { RET_NORET; return 16; }
-static int ret_NZ (void) { RET_COND ( !(_regs.F&ZFLAG) ); }
-static int ret_Z (void) { RET_COND ( _regs.F&ZFLAG ); }
-static int ret_NC (void) { RET_COND ( !(_regs.F&CFLAG) ); }
-static int ret_C (void) { RET_COND ( _regs.F&CFLAG ); }
-static int reti (void) { RET_NORET; _regs.IME= GBC_TRUE; return 16; }
-static int rst_00 (void) { RST_P ( 0x00 ); }
-static int rst_08 (void) { RST_P ( 0x08 ); }
-static int rst_10 (void) { RST_P ( 0x10 ); }
-static int rst_18 (void) { RST_P ( 0x18 ); }
-static int rst_20 (void) { RST_P ( 0x20 ); }
-static int rst_28 (void) { RST_P ( 0x28 ); }
-static int rst_30 (void) { RST_P ( 0x30 ); }
-static int rst_38 (void) { RST_P ( 0x38 ); }
-
-
-static int (*const _insts_cb[256]) (void)=
+static int call (GBC_Machine *m) { GBCu16 aux; CALL_NORET ( aux ); return 24; }
+static int call_NZ (GBC_Machine *m) { CALL_COND ( !(_regs.F&ZFLAG) ); }
+static int call_Z (GBC_Machine *m) { CALL_COND ( _regs.F&ZFLAG ); }
+static int call_NC (GBC_Machine *m) { CALL_COND ( !(_regs.F&CFLAG) ); }
+static int call_C (GBC_Machine *m) { CALL_COND ( _regs.F&CFLAG ); }
+static int ret (GBC_Machine *m) { RET_NORET; return 16; }
+static int ret_NZ (GBC_Machine *m) { RET_COND ( !(_regs.F&ZFLAG) ); }
+static int ret_Z (GBC_Machine *m) { RET_COND ( _regs.F&ZFLAG ); }
+static int ret_NC (GBC_Machine *m) { RET_COND ( !(_regs.F&CFLAG) ); }
+static int ret_C (GBC_Machine *m) { RET_COND ( _regs.F&CFLAG ); }
+static int reti (GBC_Machine *m) { RET_NORET; _regs.IME= GBC_TRUE; return 16; }
+static int rst_00 (GBC_Machine *m) { RST_P ( 0x00 ); }
+static int rst_08 (GBC_Machine *m) { RST_P ( 0x08 ); }
+static int rst_10 (GBC_Machine *m) { RST_P ( 0x10 ); }
+static int rst_18 (GBC_Machine *m) { RST_P ( 0x18 ); }
+static int rst_20 (GBC_Machine *m) { RST_P ( 0x20 ); }
+static int rst_28 (GBC_Machine *m) { RST_P ( 0x28 ); }
+static int rst_30 (GBC_Machine *m) { RST_P ( 0x30 ); }
+static int rst_38 (GBC_Machine *m) { RST_P ( 0x38 ); }
+
+
+static int (*const _insts_cb[256]) (GBC_Machine *)=
 {
   /* 0x0 */ rlc_B,
   /* 0x1 */ rlc_C,
@@ -1466,14 +1552,14 @@ static int (*const _insts_cb[256]) (void)=
   /* 0xff */ set_7_A
 };
 
-static int cb (void)
+static int cb (GBC_Machine *m)
 {
-  _opcode2= GBC_mem_read ( _regs.PC++ );
-  return _insts_cb[_opcode2] ();
+  _opcode2= FETCH;
+  return _insts_cb[_opcode2] ( m );
 }
 
 
-static int (*const _insts[256]) (void)=
+static int (*const _insts[256]) (GBC_Machine *)=
 {
   /* 0x00 */ nop,
   /* 0x01 */ ld_BC_nn,
@@ -1736,7 +1822,9 @@ static int (*const _insts[256]) (void)=
 
 /* Sols es pot executar si hi ha alguna interrupció activa. */
 static int
-interruption (void)
+interruption (
+              GBC_Machine *m
+              )
 {
    
   PUSH_PC;
@@ -1773,6 +1861,1132 @@ interruption (void)
 } /* end interruption */
 
 
+#ifndef CPU_TRACE
+
+#ifdef CPU_BLOCKS
+
+/* Posició d'un bloc en la cache. */
+#define BLOCK_HASH(ADDR,BANK) (((ADDR)^((BANK)<<5))&(GBC_CPU_NBLOCKS-1))
+
+/* Indica si l'operador accedix a memòria. */
+static GBC_Bool
+is_mem_op (
+           const GBC_OpType op
+           )
+{
+  
+  switch ( op )
+    {
+    case GBC_pHL:
+    case GBC_pBC:
+    case GBC_pDE:
+    case GBC_ADDR:
+    case GBC_pB:
+    case GBC_pC:
+    case GBC_pD:
+    case GBC_pE:
+    case GBC_pH:
+    case GBC_pL:
+    case GBC_pA:
+    case GBC_pBYTE:
+    case GBC_pFF00n:
+    case GBC_pFF00C: return GBC_TRUE;
+    default: return GBC_FALSE;
+    }
+  
+} /* end is_mem_op */
+
+
+/* Indica si la instrucció pot sincronitzar els dispositius (accés a
+   memòria) o canviar IME. Després d'aquestes instruccions s'ha de
+   comprovar si cal eixir del bloc. */
+static GBC_Bool
+needs_check (
+             const GBC_InstId *id
+             )
+{
+  
+  switch ( id->name )
+    {
+    case GBC_PUSH:
+    case GBC_POP:
+    case GBC_EI:
+    case GBC_DI: return GBC_TRUE;
+    default: return is_mem_op ( id->op1 ) || is_mem_op ( id->op2 );
+    }
+  
+} /* end needs_check */
+
+
+/* Indica si la instrucció acaba un bloc: bots, crides, tornades i
+   les instruccions que tornen a executar-se mentre esperen. */
+static GBC_Bool
+ends_block (
+            const GBC_Mnemonic name
+            )
+{
+  
+  switch ( name )
+    {
+    case GBC_UNK:
+    case GBC_JP:
+    case GBC_JR:
+    case GBC_CALL:
+    case GBC_RET:
+    case GBC_RETI:
+    case GBC_RST00:
+    case GBC_RST08:
+    case GBC_RST10:
+    case GBC_RST18:
+    case GBC_RST20:
+    case GBC_RST28:
+    case GBC_RST30:
+    case GBC_RST38:
+    case GBC_HALT:
+    case GBC_STOP: return GBC_TRUE;
+    default: return GBC_FALSE;
+    }
+  
+} /* end ends_block */
+
+
+/* Els blocs no poden creuar el final de la regió on comencen perquè a
+   l'altra banda pot haver un altre banc. */
+static GBCu32
+region_end (
+            const GBCu16 addr
+            )
+{
+  
+  if ( addr < 0x4000 ) return 0x4000;
+  else if ( addr < 0x8000 ) return 0x8000;
+  else if ( addr < 0xD000 ) return 0xD000;
+  else if ( addr < 0xE000 ) return 0xE000;
+  else return 0xFFFF;
+  
+} /* end region_end */
+
+
+/* Si el bloc B que comença en ADDR és un bucle d'espera torna el
+   registre que consulta, i si no 0. Sols es reconeixen els bucles
+   que carreguen en A un dels registres LY, STAT, IF, DIV o TIMA, el
+   comproven amb instruccions que sols depenen de A i tornen a
+   l'inici. Com A es carrega al principi, cada volta deixa els
+   registres igual si el valor llegit és el mateix. */
+static GBCu16
+idle_reg (
+          const cpu_block_t *b,
+          const GBCu16       addr
+          )
+{
+  
+  const cpu_inst_t *p, *last;
+  GBCu16 reg, pc, target;
+  
+  
+  if ( b->n < 2 ) return 0;
+  
+  /* Lectura. */
+  p= &(b->v[0]);
+  if ( p->opcode == 0xF0 ) reg= 0xFF00|p->ops[0];
+  else if ( p->opcode == 0xFA && p->ops[1] == 0xFF ) reg= 0xFF00|p->ops[0];
+  else return 0;
+  if ( reg != 0xFF04 && reg != 0xFF05 && reg != 0xFF0F &&
+       reg != 0xFF41 && reg != 0xFF44 )
+    return 0;
+  
+  /* Comprovacions. */
+  pc= (GBCu16) (addr+p->nbytes);
+  last= &(b->v[b->n-1]);
+  for ( ++p; p != last; ++p )
+    {
+      switch ( p->opcode )
+        {
+        case 0xA7: /* AND A */
+        case 0xB7: /* OR A */
+        case 0xE6: /* AND n */
+        case 0xFE: /* CP n */
+          break;
+        case 0xCB: /* BIT b,A */
+          if ( (p->ops[0]&0xC7) != 0x47 ) return 0;
+          break;
+        default: return 0;
+        }
+      pc+= p->nbytes;
+    }
+  
+  /* Bot a l'inici. */
+  switch ( last->opcode )
+    {
+    case 0x18:
+    case 0x20:
+    case 0x28:
+    case 0x30:
+    case 0x38:
+      target= (GBCu16) (pc+2+(GBCs8) last->ops[0]);
+      break;
+    case 0xC2:
+    case 0xC3:
+    case 0xCA:
+    case 0xD2:
+    case 0xDA:
+      target= (GBCu16) (last->ops[0]|(((GBCu16) last->ops[1])<<8));
+      break;
+    default: return 0;
+    }
+  
+  return target == addr ? reg : 0;
+  
+} /* end idle_reg */
+
+
+/* Invalida el bloc B i, si és de RAM, desfà les marques dels seus
+   bytes. */
+static void
+release_block (
+               GBC_Machine *m,
+               cpu_block_t *b
+               )
+{
+  
+  if ( b->valid && b->addr >= 0xC000 )
+    GBC_mem_unmark_code ( m, b->addr, b->bank, b->size );
+  b->valid= GBC_FALSE;
+  
+} /* end release_block */
+
+
+/* Descodifica en B el bloc que comença en ADDR. Torna NULL si no es
+   pot descodificar cap instrucció. */
+static cpu_block_t *
+build_block (
+             GBC_Machine  *m,
+             cpu_block_t  *b,
+             const GBCu16  addr,
+             const int     bank
+             )
+{
+  
+  GBC_Inst inst;
+  cpu_inst_t *p;
+  GBCu32 pc, end;
+  GBC_Bool last;
+  
+  
+  /* Les instruccions ocupen com a molt 3 bytes, d'aquesta manera
+     'GBC_cpu_decode' mai llig fora de la regió (després de la ROM ve
+     la VRAM, i llegir-la sincronitza). */
+  end= region_end ( addr ) - 2;
+  release_block ( m, b );
+  b->n= 0;
+  last= GBC_FALSE;
+  for ( pc= addr;
+        !last && pc < end && b->n < GBC_CPU_BLOCK_SIZE;
+        pc+= inst.nbytes )
+    {
+      GBC_cpu_decode ( m, (GBCu16) pc, &inst );
+      p= &(b->v[b->n++]);
+      p->opcode= inst.bytes[0];
+      p->exec= _insts[p->opcode];
+      p->ops[0]= inst.nbytes > 1 ? inst.bytes[1] : 0x00;
+      p->ops[1]= inst.nbytes > 2 ? inst.bytes[2] : 0x00;
+      p->nbytes= inst.nbytes;
+      p->check= needs_check ( &(inst.id) );
+      last= ends_block ( inst.id.name );
+    }
+  if ( b->n == 0 ) return NULL;
+  b->valid= GBC_TRUE;
+  b->bank= bank;
+  b->addr= addr;
+  b->size= (GBCu16) (pc-addr);
+  b->cc= -1;
+  b->idle= idle_reg ( b, addr );
+  b->hits= 0;
+  b->native= NULL;
+  if ( addr >= 0xC000 ) GBC_mem_mark_code ( m, addr, bank, b->size );
+  
+  return b;
+  
+} /* end build_block */
+
+
+/* Torna el bloc que comença en PC, o NULL si el codi no es pot guardar
+   en la cache. */
+static cpu_block_t *
+get_block (
+           GBC_Machine *m
+           )
+{
+  
+  cpu_block_t *b;
+  int bank;
+  
+  
+  if ( (bank= GBC_mem_get_code_bank ( m, _regs.PC )) == -1 ) return NULL;
+  b= &(_blocks.v[BLOCK_HASH ( _regs.PC, bank )]);
+  if ( b->valid && b->addr == _regs.PC && b->bank == bank ) return b;
+  
+  return build_block ( m, b, _regs.PC, bank );
+  
+} /* end get_block */
+
+
+/* Executa el bloc B. Si totes les instruccions menys l'última caben en
+   el lot, sols es comprova si cal eixir després de les instruccions
+   que accedixen a memòria o canvien IME, que són les úniques que
+   poden demanar interrupcions, parar el lot o modificar el bloc. En
+   la primera execució es calculen els cicles del bloc. */
+static void
+run_block (
+           GBC_Machine *m,
+           cpu_block_t *b
+           )
+{
+  
+  const cpu_inst_t *p, *last;
+  int start, cc;
+  GBC_Bool fast;
+  
+  
+  start= _run.cc;
+  fast= b->cc >= 0 && start+b->cc < _run.budget;
+  last= &(b->v[b->n-1]);
+  for ( p= &(b->v[0]); ; ++p )
+    {
+      if ( p == last && b->cc < 0 ) b->cc= _run.cc - start;
+      ++_regs.PC;
+      _opcode= p->opcode;
+      _blocks.ops= &(p->ops[0]);
+      cc= p->exec ( m );
+      _run.cc+= cc;
+      if ( p == last ) break;
+      if ( (!fast || p->check) &&
+           (_run.cc >= _run.budget || (_regs.IME && _regs.IAUX) ||
+            !b->valid) )
+        break;
+    }
+  _blocks.ops= NULL;
+  
+} /* end run_block */
+
+
+/* Invalida tots els blocs. */
+static void
+flush_blocks (
+              GBC_Machine *m
+              )
+{
+  
+  int i;
+  
+  
+  for ( i= 0; i < GBC_CPU_NBLOCKS; ++i )
+    release_block ( m, &(_blocks.v[i]) );
+  _blocks.ops= NULL;
+#ifdef CPU_JIT
+  _jit.used= 0;
+#endif
+  
+} /* end flush_blocks */
+
+#endif /* CPU_BLOCKS */
+
+
+#ifdef CPU_JIT
+
+/* Execucions d'un bloc de la ROM abans de traduir-lo. */
+#define JIT_HOT 16
+
+/* Bytes màxims de la traducció d'una instrucció i d'un bloc. */
+#define JIT_INST_MAXSIZE 128
+#define JIT_BLOCK_MAXSIZE (GBC_CPU_BLOCK_SIZE*JIT_INST_MAXSIZE + 64)
+
+/* Desplaçament d'un camp de la màquina. El codi generat té la màquina
+   en RBX. */
+#define OFF(FIELD) ((GBCu32) offsetof ( GBC_Machine, FIELD ))
+
+/* Registres de 8 bits en l'ordre de la codificació de les
+   instruccions. L'índex 6 és (HL). */
+static const GBCu32 JIT_R8[8]=
+  {
+    OFF ( cpu.regs.B ), OFF ( cpu.regs.C ),
+    OFF ( cpu.regs.D ), OFF ( cpu.regs.E ),
+    OFF ( cpu.regs.H ), OFF ( cpu.regs.L ),
+    0, OFF ( cpu.regs.A )
+  };
+
+/* Opcodes x86 de 'OP AL,r/m8' per a ADD, ADC, SUB, SBC, AND, XOR, OR
+   i CP. La versió amb immediat és l'opcode més 2. */
+static const GBCu8 JIT_ALU[8]=
+  { 0x02, 0x12, 0x2A, 0x1A, 0x22, 0x32, 0x0A, 0x3A };
+
+/* Després de LAHF, AH té ZF, AF i CF en les mateixes posicions que
+   ZFLAG, HFLAG i CFLAG. Per a cada operació de l'ALU: bits de F que
+   es conserven, bits de AH que es copien i bits que es fixen. */
+static const GBCu8 JIT_ALU_FLAGS[8][3]=
+  {
+    { 0xAC, 0x51, 0x00 }, { 0xAC, 0x51, 0x00 },
+    { 0xAE, 0x51, NFLAG }, { 0xAE, 0x51, NFLAG },
+    { 0xAC, 0x40, HFLAG }, { 0xAC, 0x40, 0x00 },
+    { 0xAC, 0x40, 0x00 }, { 0xAE, 0x51, NFLAG }
+  };
+
+
+static GBCu8 *
+emit_u16 (
+          GBCu8        *p,
+          const GBCu16  val
+          )
+{
+  
+  *(p++)= (GBCu8) (val&0xff);
+  *(p++)= (GBCu8) (val>>8);
+  
+  return p;
+  
+} /* end emit_u16 */
+
+
+static GBCu8 *
+emit_u32 (
+          GBCu8        *p,
+          const GBCu32  val
+          )
+{
+  
+  p= emit_u16 ( p, (GBCu16) (val&0xffff) );
+  
+  return emit_u16 ( p, (GBCu16) (val>>16) );
+  
+} /* end emit_u32 */
+
+
+static GBCu8 *
+emit_u64 (
+          GBCu8        *p,
+          const GBCu64  val
+          )
+{
+  
+  p= emit_u32 ( p, (GBCu32) (val&0xffffffff) );
+  
+  return emit_u32 ( p, (GBCu32) (val>>32) );
+  
+} /* end emit_u64 */
+
+
+/* Instrucció OP amb un operand '[RBX+OFF]'. REG és el camp 'reg' del
+   byte ModRM (registre o extensió de l'opcode). */
+static GBCu8 *
+emit_rm (
+         GBCu8        *p,
+         const GBCu8   op,
+         const int     reg,
+         const GBCu32  off
+         )
+{
+  
+  *(p++)= op;
+  *(p++)= (GBCu8) (0x83|(reg<<3));
+  
+  return emit_u32 ( p, off );
+  
+} /* end emit_rm */
+
+
+/* mov byte [RBX+OFF],VAL */
+static GBCu8 *
+emit_set_u8 (
+             GBCu8        *p,
+             const GBCu32  off,
+             const GBCu8   val
+             )
+{
+  
+  p= emit_rm ( p, 0xC6, 0, off );
+  *(p++)= val;
+  
+  return p;
+  
+} /* end emit_set_u8 */
+
+
+/* mov word [RBX+OFF],VAL */
+static GBCu8 *
+emit_set_u16 (
+              GBCu8        *p,
+              const GBCu32  off,
+              const GBCu16  val
+              )
+{
+  
+  *(p++)= 0x66;
+  p= emit_rm ( p, 0xC7, 0, off );
+  
+  return emit_u16 ( p, val );
+  
+} /* end emit_set_u16 */
+
+
+/* add dword [RBX+OFF],CC */
+static GBCu8 *
+emit_add_cc (
+             GBCu8     *p,
+             const int  cc
+             )
+{
+  
+  if ( cc == 0 ) return p;
+  p= emit_rm ( p, 0x81, 0, OFF ( cpu.run.cc ) );
+  
+  return emit_u32 ( p, (GBCu32) cc );
+  
+} /* end emit_add_cc */
+
+
+/* F= (F&KEEP) | (AH&MASK) | SET */
+static GBCu8 *
+emit_flags (
+            GBCu8       *p,
+            const GBCu8  keep,
+            const GBCu8  mask,
+            const GBCu8  set
+            )
+{
+  
+  p= emit_rm ( p, 0x8A, 1, OFF ( cpu.regs.F ) ); /* mov cl,[F] */
+  *(p++)= 0x80; *(p++)= 0xE1; *(p++)= keep;      /* and cl,KEEP */
+  *(p++)= 0x80; *(p++)= 0xE4; *(p++)= mask;      /* and ah,MASK */
+  *(p++)= 0x08; *(p++)= 0xE1;                    /* or cl,ah */
+  if ( set != 0x00 )
+    {
+      *(p++)= 0x80; *(p++)= 0xC9; *(p++)= set;   /* or cl,SET */
+    }
+  
+  return emit_rm ( p, 0x88, 1, OFF ( cpu.regs.F ) ); /* mov [F],cl */
+  
+} /* end emit_flags */
+
+
+/* A= AL (l'acumulador té 16 bits). */
+static GBCu8 *
+emit_store_A (
+              GBCu8 *p
+              )
+{
+  
+  *(p++)= 0x0F; *(p++)= 0xB6; *(p++)= 0xC0;      /* movzx eax,al */
+  *(p++)= 0x66;
+  
+  return emit_rm ( p, 0x89, 0, OFF ( cpu.regs.A ) );
+  
+} /* end emit_store_A */
+
+
+/* Bot condicional dels blocs natius: COND és el bit de F i SET si el
+   bot es fa quan està actiu. Fixa PC i suma els cicles de cada
+   camí. */
+static GBCu8 *
+emit_branch (
+             GBCu8          *p,
+             const GBCu8     cond,
+             const GBC_Bool  set,
+             const GBCu16    taken_pc,
+             const int       taken_cc,
+             const GBCu16    next_pc,
+             const int       next_cc
+             )
+{
+  
+  GBCu8 *jcc, *jmp;
+  
+  
+  p= emit_rm ( p, 0xF6, 0, OFF ( cpu.regs.F ) ); /* test [F],COND */
+  *(p++)= cond;
+  *(p++)= set ? 0x74 : 0x75;                     /* jz/jnz no_pres */
+  jcc= p++;
+  p= emit_set_u16 ( p, OFF ( cpu.regs.PC ), taken_pc );
+  p= emit_add_cc ( p, taken_cc );
+  *(p++)= 0xEB;                                  /* jmp fi */
+  jmp= p++;
+  *jcc= (GBCu8) (p-jcc-1);
+  p= emit_set_u16 ( p, OFF ( cpu.regs.PC ), next_pc );
+  p= emit_add_cc ( p, next_cc );
+  *jmp= (GBCu8) (p-jmp-1);
+  
+  return p;
+  
+} /* end emit_branch */
+
+
+/* Tradueix directament la instrucció I que comença en PC si és una
+   de les senzilles (càrregues entre registres, ALU sense memòria,
+   increments i bots). Les instruccions que no són bots sols acumulen
+   els cicles en CC; els bots fixen PC i sumen tots els cicles
+   pendents. Torna NULL si la instrucció s'ha d'executar cridant a la
+   seua implementació. */
+static GBCu8 *
+emit_native (
+             GBCu8            *p,
+             const cpu_inst_t *i,
+             const GBCu16      pc,
+             int              *cc
+             )
+{
+  
+  GBCu8 op, r1, r2, alu;
+  GBCu16 next, nn;
+  GBC_Bool set;
+  
+  
+  op= i->opcode;
+  next= (GBCu16) (pc+i->nbytes);
+  nn= (GBCu16) (i->ops[0]|(((GBCu16) i->ops[1])<<8));
+  r1= (op>>3)&0x7;
+  r2= op&0x7;
+  
+  /* NOP. */
+  if ( op == 0x00 ) { *cc+= 4; return p; }
+  
+  /* LD r,r' */
+  if ( op >= 0x40 && op < 0x80 )
+    {
+      if ( r1 == 6 || r2 == 6 ) return NULL;
+      if ( r1 != r2 )
+        {
+          if ( r1 == 7 )
+            {
+              *(p++)= 0x0F;                      /* movzx eax,[r2] */
+              p= emit_rm ( p, 0xB6, 0, JIT_R8[r2] );
+              *(p++)= 0x66;                      /* mov [A],ax */
+              p= emit_rm ( p, 0x89, 0, OFF ( cpu.regs.A ) );
+            }
+          else
+            {
+              p= emit_rm ( p, 0x8A, 0, JIT_R8[r2] ); /* mov al,[r2] */
+              p= emit_rm ( p, 0x88, 0, JIT_R8[r1] ); /* mov [r1],al */
+            }
+        }
+      *cc+= 4;
+      return p;
+    }
+  
+  /* ALU A,r i ALU A,n */
+  if ( (op >= 0x80 && op < 0xC0 && r2 != 6) || (op&0xC7) == 0xC6 )
+    {
+      alu= r1;
+      if ( alu == 1 || alu == 3 )
+        {
+          p= emit_rm ( p, 0x8A, 1, OFF ( cpu.regs.F ) ); /* mov cl,[F] */
+          *(p++)= 0xD0; *(p++)= 0xE9;            /* shr cl,1 ; CF */
+        }
+      p= emit_rm ( p, 0x8A, 0, OFF ( cpu.regs.A ) ); /* mov al,[A] */
+      if ( op < 0xC0 ) p= emit_rm ( p, JIT_ALU[alu], 0, JIT_R8[r2] );
+      else
+        {
+          *(p++)= JIT_ALU[alu] + 2;
+          *(p++)= i->ops[0];
+        }
+      *(p++)= 0x9F;                              /* lahf */
+      p= emit_flags ( p, JIT_ALU_FLAGS[alu][0],
+        	      JIT_ALU_FLAGS[alu][1], JIT_ALU_FLAGS[alu][2] );
+      if ( alu != 7 ) p= emit_store_A ( p );
+      *cc+= op < 0xC0 ? 4 : 8;
+      return p;
+    }
+  
+  if ( op < 0x40 )
+    {
+      
+      /* INC r i DEC r */
+      if ( (r2 == 4 || r2 == 5) && r1 != 6 )
+        {
+          if ( r1 == 7 )
+            {
+              p= emit_rm ( p, 0x8A, 0, OFF ( cpu.regs.A ) );
+              *(p++)= 0xFE; *(p++)= r2 == 4 ? 0xC0 : 0xC8; /* inc/dec al */
+            }
+          else p= emit_rm ( p, 0xFE, r2 == 4 ? 0 : 1, JIT_R8[r1] );
+          *(p++)= 0x9F;                          /* lahf */
+          p= emit_flags ( p, 0xAD, 0x50, r2 == 4 ? 0x00 : NFLAG );
+          if ( r1 == 7 ) p= emit_store_A ( p );
+          *cc+= 4;
+          return p;
+        }
+      
+      /* LD r,n */
+      if ( r2 == 6 && r1 != 6 )
+        {
+          if ( r1 == 7 ) p= emit_set_u16 ( p, OFF ( cpu.regs.A ), i->ops[0] );
+          else p= emit_set_u8 ( p, JIT_R8[r1], i->ops[0] );
+          *cc+= 8;
+          return p;
+        }
+      
+      switch ( op )
+        {
+          
+          /* LD dd,nn */
+        case 0x01:
+        case 0x11:
+        case 0x21:
+          p= emit_set_u8 ( p, JIT_R8[r1+1], i->ops[0] );
+          p= emit_set_u8 ( p, JIT_R8[r1], i->ops[1] );
+          *cc+= 12;
+          return p;
+        case 0x31:
+          p= emit_set_u16 ( p, OFF ( cpu.regs.SP ), nn );
+          *cc+= 12;
+          return p;
+          
+          /* INC ss i DEC ss. El byte baix porta el carry al alt. */
+        case 0x03:
+        case 0x13:
+        case 0x23:
+          p= emit_rm ( p, 0x80, 0, JIT_R8[(r1&0x6)+1] ); /* add [lo],1 */
+          *(p++)= 0x01;
+          p= emit_rm ( p, 0x80, 2, JIT_R8[r1&0x6] );     /* adc [hi],0 */
+          *(p++)= 0x00;
+          *cc+= 8;
+          return p;
+        case 0x0B:
+        case 0x1B:
+        case 0x2B:
+          p= emit_rm ( p, 0x80, 5, JIT_R8[(r1&0x6)+1] ); /* sub [lo],1 */
+          *(p++)= 0x01;
+          p= emit_rm ( p, 0x80, 3, JIT_R8[r1&0x6] );     /* sbb [hi],0 */
+          *(p++)= 0x00;
+          *cc+= 8;
+          return p;
+        case 0x33:
+        case 0x3B:
+          *(p++)= 0x66;                          /* inc/dec word [SP] */
+          p= emit_rm ( p, 0xFF, op == 0x33 ? 0 : 1, OFF ( cpu.regs.SP ) );
+          *cc+= 8;
+          return p;
+          
+          /* JR e i JR cc,e */
+        case 0x18:
+          p= emit_set_u16 ( p, OFF ( cpu.regs.PC ),
+        		    (GBCu16) (next+(GBCs8) i->ops[0]) );
+          p= emit_add_cc ( p, *cc+12 );
+          *cc= 0;
+          return p;
+        case 0x20:
+        case 0x28:
+        case 0x30:
+        case 0x38:
+          p= emit_add_cc ( p, *cc );
+          *cc= 0;
+          set= (op&0x08)!=0;
+          return emit_branch ( p, op < 0x30 ? ZFLAG : CFLAG, set,
+        		       (GBCu16) (next+(GBCs8) i->ops[0]), 12,
+        		       next, 8 );
+        default: return NULL;
+        }
+      
+    }
+  
+  /* JP nn i JP cc,nn */
+  switch ( op )
+    {
+    case 0xC3:
+      p= emit_set_u16 ( p, OFF ( cpu.regs.PC ), nn );
+      p= emit_add_cc ( p, *cc+16 );
+      *cc= 0;
+      return p;
+    case 0xC2:
+    case 0xCA:
+    case 0xD2:
+    case 0xDA:
+      p= emit_add_cc ( p, *cc );
+      *cc= 0;
+      set= (op&0x08)!=0;
+      return emit_branch ( p, op < 0xD0 ? ZFLAG : CFLAG, set,
+        		   nn, 16, next, 12 );
+    default: return NULL;
+    }
+  
+} /* end emit_native */
+
+
+/* Executa la instrucció I que comença en PC cridant a la seua
+   implementació, igual que 'run_block'. */
+static GBCu8 *
+emit_call (
+           GBCu8            *p,
+           const cpu_inst_t *i,
+           const GBCu16      pc
+           )
+{
+  
+  p= emit_set_u16 ( p, OFF ( cpu.regs.PC ), (GBCu16) (pc+1) );
+  p= emit_set_u8 ( p, OFF ( cpu.opcode ), i->opcode );
+  *(p++)= 0x48; *(p++)= 0xB8;                    /* mov rax,&ops */
+  p= emit_u64 ( p, (GBCu64) (size_t) &(i->ops[0]) );
+  *(p++)= 0x48;                                  /* mov [ops],rax */
+  p= emit_rm ( p, 0x89, 0, OFF ( cpu.blocks.ops ) );
+  *(p++)= 0x48; *(p++)= 0x89; *(p++)= 0xDF;      /* mov rdi,rbx */
+  *(p++)= 0x48; *(p++)= 0xB8;                    /* mov rax,exec */
+  p= emit_u64 ( p, (GBCu64) (size_t) i->exec );
+  *(p++)= 0xFF; *(p++)= 0xD0;                    /* call rax */
+  
+  return emit_rm ( p, 0x01, 0, OFF ( cpu.run.cc ) ); /* add [cc],eax */
+  
+} /* end emit_call */
+
+
+/* Ix del bloc si s'ha acabat el lot o hi ha una interrupció
+   pendent. Guarda en EXITS la posició dels dos desplaçaments que cal
+   completar amb l'adreça d'eixida. */
+static GBCu8 *
+emit_check (
+            GBCu8  *p,
+            GBCu8 **exits
+            )
+{
+  
+  p= emit_rm ( p, 0x8B, 0, OFF ( cpu.run.cc ) ); /* mov eax,[cc] */
+  p= emit_rm ( p, 0x3B, 0, OFF ( cpu.run.budget ) ); /* cmp eax,[budget] */
+  *(p++)= 0x0F; *(p++)= 0x8D;                    /* jge eixida */
+  exits[0]= p; p+= 4;
+  p= emit_rm ( p, 0x83, 7, OFF ( cpu.regs.IME ) ); /* cmp [IME],0 */
+  *(p++)= 0x00;
+  *(p++)= 0x74; *(p++)= 13;                      /* je següent */
+  p= emit_rm ( p, 0x80, 7, OFF ( cpu.regs.IAUX ) ); /* cmp [IAUX],0 */
+  *(p++)= 0x00;
+  *(p++)= 0x0F; *(p++)= 0x85;                    /* jne eixida */
+  exits[1]= p; p+= 4;
+  
+  return p;
+  
+} /* end emit_check */
+
+
+/* Descarta tot el codi generat. */
+static void
+jit_flush (
+           GBC_Machine *m
+           )
+{
+  
+  int i;
+  
+  
+  for ( i= 0; i < GBC_CPU_NBLOCKS; ++i )
+    {
+      _blocks.v[i].native= NULL;
+      _blocks.v[i].hits= 0;
+    }
+  _jit.used= 0;
+  
+} /* end jit_flush */
+
+
+/* Canvia la protecció de les pàgines del codi generat que contenen
+   els bytes [P,P+N[. */
+static int
+jit_protect (
+             GBC_Machine  *m,
+             GBCu8        *p,
+             const size_t  n,
+             const int     prot
+             )
+{
+  
+  size_t begin, end;
+  
+  
+  begin= ((size_t) (p-_jit.code))&~(_jit.page-1);
+  end= ((size_t) (p-_jit.code) + n + _jit.page-1)&~(_jit.page-1);
+  if ( end > GBC_CPU_JIT_SIZE ) end= GBC_CPU_JIT_SIZE;
+  
+  return mprotect ( _jit.code + begin, end-begin, prot );
+  
+} /* end jit_protect */
+
+
+/* Tradueix el bloc B a una funció que fa el mateix que 'run_block'
+   quan totes les instruccions menys l'última caben en el lot. */
+static void
+jit_compile (
+             GBC_Machine *m,
+             cpu_block_t *b
+             )
+{
+  
+  GBCu8 *start, *p, *q, *exits[2*GBC_CPU_BLOCK_SIZE];
+  const cpu_inst_t *i, *last;
+  GBCu16 pc;
+  GBC_Bool native;
+  int cc, nexits, n;
+  
+  
+  if ( sizeof(_regs.IME) != 4 ) return;
+  if ( _jit.used + JIT_BLOCK_MAXSIZE > GBC_CPU_JIT_SIZE ) jit_flush ( m );
+  start= p= _jit.code + _jit.used;
+  if ( jit_protect ( m, start, JIT_BLOCK_MAXSIZE,
+        	     PROT_READ|PROT_WRITE ) != 0 )
+    return;
+  *(p++)= 0x53;                                  /* push rbx */
+  *(p++)= 0x48; *(p++)= 0x89; *(p++)= 0xFB;      /* mov rbx,rdi */
+  pc= b->addr;
+  cc= 0;
+  nexits= 0;
+  native= GBC_FALSE;
+  last= &(b->v[b->n-1]);
+  for ( i= &(b->v[0]); i <= last; ++i )
+    {
+      if ( (q= emit_native ( p, i, pc, &cc )) != NULL )
+        {
+          p= q;
+          native= GBC_TRUE;
+        }
+      else
+        {
+          p= emit_add_cc ( p, cc );
+          cc= 0;
+          p= emit_call ( p, i, pc );
+          if ( i != last && i->check )
+            {
+              p= emit_check ( p, &(exits[nexits]) );
+              nexits+= 2;
+            }
+          native= GBC_FALSE;
+        }
+      pc+= i->nbytes;
+    }
+  
+  /* Si l'última instrucció s'ha traduït, PC i els cicles pot ser que
+     no estiguen actualitzats. */
+  if ( native )
+    {
+      if ( cc > 0 ) p= emit_set_u16 ( p, OFF ( cpu.regs.PC ), pc );
+      p= emit_add_cc ( p, cc );
+      p= emit_set_u8 ( p, OFF ( cpu.opcode ), last->opcode );
+    }
+  
+  /* Eixida. */
+  for ( n= 0; n < nexits; ++n )
+    emit_u32 ( exits[n], (GBCu32) (p-(exits[n]+4)) );
+  *(p++)= 0x48;                                  /* mov [ops],0 */
+  p= emit_rm ( p, 0xC7, 0, OFF ( cpu.blocks.ops ) );
+  p= emit_u32 ( p, 0 );
+  *(p++)= 0x5B;                                  /* pop rbx */
+  *(p++)= 0xC3;                                  /* ret */
+  
+  _jit.used= ((p-_jit.code)+15)&~((size_t) 15);
+  /* Si no es pot tornar a fer executable, els blocs ja traduïts de
+     les mateixes pàgines tampoc es poden executar. */
+  if ( jit_protect ( m, start, JIT_BLOCK_MAXSIZE,
+        	     PROT_READ|PROT_EXEC ) != 0 )
+    {
+      jit_flush ( m );
+      return;
+    }
+  b->native= (void (*) (GBC_Machine *)) (void *) start;
+  
+} /* end jit_compile */
+
+
+/* Executa el bloc B. Els blocs de la ROM que s'executen sovint es
+   tradueixen i, si caben en el lot, s'executen en codi natiu (o amb
+   l'intèrpret en mode GBC_JIT_SHADOW). */
+static void
+jit_run_block (
+               GBC_Machine *m,
+               cpu_block_t *b
+               )
+{
+  
+  GBC_CPURegs regs;
+  
+  
+  if ( _jit.mode == GBC_JIT_OFF || b->addr >= 0x8000 || b->cc < 0 )
+    {
+      run_block ( m, b );
+      return;
+    }
+  if ( b->native == NULL && ++b->hits == JIT_HOT ) jit_compile ( m, b );
+  if ( b->native == NULL || _run.cc+b->cc >= _run.budget )
+    {
+      run_block ( m, b );
+      return;
+    }
+  if ( _jit.mode == GBC_JIT_ON ) b->native ( m );
+  else                           run_block ( m, b );
+  if ( _jit.hook != NULL )
+    {
+      GBC_cpu_get_regs ( m, &regs );
+      _jit.hook ( b->addr, b->bank, &regs, _jit.hook_udata );
+    }
+  
+} /* end jit_run_block */
+
+#elif defined(CPU_BLOCKS)
+#define jit_run_block run_block
+#endif /* CPU_JIT */
+
+
+#ifdef CPU_BLOCKS
+
+/* B és un bucle d'espera que acaba de fer una volta completa en
+   L cicles. Les voltes següents llegiran el mateix valor i deixaran
+   els registres igual mentre no canvie el registre consultat. IF
+   sols canvia en els events del planificador, és a dir, no abans del
+   final del lot; DIV i TIMA canvien cada cert nombre de cicles, i LY
+   i STAT amb la posició del LCD. Es boten les voltes que
+   s'executarien senceres abans d'eixe moment. */
+static void
+skip_idle (
+           GBC_Machine       *m,
+           const cpu_block_t *b,
+           const int          L
+           )
+{
+  
+  int n, since, until;
+  
+  
+  if ( L <= 0 || b->cc < 0 || (_regs.IME && _regs.IAUX) ) return;
+  
+  /* Voltes que començarien amb la resta del bloc dins del lot. */
+  n= _run.budget - b->cc - _run.cc;
+  if ( n <= 0 ) return;
+  n= (n+L-1)/L;
+  
+  /* La volta anterior ha d'haver llegit el valor actual i les
+     següents han d'acabar abans que canvie. */
+  GBC_main_get_stable ( m, b->idle, &since, &until );
+  if ( since < L ) return;
+  if ( until/L < n ) n= until/L;
+  if ( n <= 0 ) return;
+  
+  _run.cc+= n*L;
+  _idle.skipped+= (GBCu64) (n*L);
+  
+} /* end skip_idle */
+
+
+/* Executa el bloc B i, si és un bucle d'espera que torna a començar,
+   bota les voltes que no canvien res. */
+static void
+exec_block (
+            GBC_Machine *m,
+            cpu_block_t *b
+            )
+{
+  
+  int start;
+  
+  
+  start= _run.cc;
+  jit_run_block ( m, b );
+  if ( b->idle != 0 && _idle.enabled && _regs.PC == b->addr )
+    skip_idle ( m, b, _run.cc-start );
+  
+} /* end exec_block */
+
+#endif /* CPU_BLOCKS */
+
+
+#ifdef CPU_THREADED
+
+/* Genera X(H,L) per a tots els valors hexadecimals HL de 00 a ff. */
+#define HEX_ROW(X,H)        \
+  X(H,0) X(H,1) X(H,2) X(H,3) X(H,4) X(H,5) X(H,6) X(H,7) \
+  X(H,8) X(H,9) X(H,a) X(H,b) X(H,c) X(H,d) X(H,e) X(H,f)
+#define HEX_ALL(X)        \
+  HEX_ROW(X,0) HEX_ROW(X,1) HEX_ROW(X,2) HEX_ROW(X,3) \
+  HEX_ROW(X,4) HEX_ROW(X,5) HEX_ROW(X,6) HEX_ROW(X,7) \
+  HEX_ROW(X,8) HEX_ROW(X,9) HEX_ROW(X,a) HEX_ROW(X,b) \
+  HEX_ROW(X,c) HEX_ROW(X,d) HEX_ROW(X,e) HEX_ROW(X,f)
+
+#define OP_ADDR(H,L) &&op_ ## H ## L,
+#define CB_ADDR(H,L) &&cb_ ## H ## L,
+
+/* Comptabilitza la instrucció acabada i salta directament a la
+ * següent. Cada etiqueta té la seua còpia del salt, d'aquesta manera
+ * el predictor de salts veu quina instrucció sol seguir a quina. Amb
+ * la cache de blocs primer es busca el bloc de la següent
+ * instrucció. */
+#ifdef CPU_BLOCKS
+#define NEXT goto fetch
+#else
+#define NEXT        					\
+  _opcode= mem_read ( m, _regs.PC++ );        	\
+  goto *ops[_opcode]
+#endif
+#define DISPATCH        				\
+  total+= cc;        					\
+  _run.cc= total;        				\
+  if ( total >= _run.budget ) return total;        	\
+  if ( _regs.IME && _regs.IAUX ) goto irq;        	\
+  NEXT
+
+/* Com '_insts' i '_insts_cb' són constants, el compilador resol la
+ * crida en temps de compilació i pot expandir la instrucció dins de
+ * l'etiqueta. El prefix 0xCB no crida a 'cb', salta a 'prefix_cb'. */
+#define OP_LABEL(H,L)        				\
+  op_ ## H ## L:        				\
+  if ( 0x ## H ## L == 0xcb ) goto prefix_cb;        	\
+  cc= _insts[0x ## H ## L] ( m );        		\
+  DISPATCH;
+#define CB_LABEL(H,L)        				\
+  cb_ ## H ## L:        				\
+  cc= _insts_cb[0x ## H ## L] ( m );        		\
+  DISPATCH;
+
+/* Equivalent a 'GBC_cpu_run_cycles' amb la taula de funcions. Sols
+ * els comptadors del lot es guarden en variables locals; els
+ * registres han de continuar en 'GBC_Machine' perquè les
+ * sincronitzacions fetes en accedir a memòria poden demanar
+ * interrupcions. */
+static int
+run_cycles_threaded (
+        	     GBC_Machine *m
+        	     )
+{
+  
+  static void *const ops[256]= { HEX_ALL ( OP_ADDR ) };
+  static void *const ops_cb[256]= { HEX_ALL ( CB_ADDR ) };
+  
+#ifdef CPU_BLOCKS
+  cpu_block_t *b;
+#endif
+  int cc, total;
+  
+  
+  total= 0;
+  if ( _regs.IME && _regs.IAUX ) goto irq;
+#ifdef CPU_BLOCKS
+ fetch:
+  if ( (b= get_block ( m )) != NULL )
+    {
+      exec_block ( m, b );
+      cc= _run.cc - total;
+      DISPATCH;
+    }
+#endif
+  _opcode= mem_read ( m, _regs.PC++ );
+  goto *ops[_opcode];
+  
+  HEX_ALL ( OP_LABEL )
+  HEX_ALL ( CB_LABEL )
+  
+ prefix_cb:
+  _opcode2= mem_read ( m, _regs.PC++ );
+  goto *ops_cb[_opcode2];
+  
+ irq:
+  cc= interruption ( m );
+  DISPATCH;
+  
+} /* end run_cycles_threaded */
+
+#endif /* CPU_THREADED */
+
+
 
 
 /**********************/
@@ -1781,6 +2995,7 @@ interruption (void)
 
 GBCu16
 GBC_cpu_decode_next_step (
+        		  GBC_Machine *m,
         		  GBC_Step *step
         		  )
 {
@@ -1814,13 +3029,14 @@ GBC_cpu_decode_next_step (
         }
     }
   step->type= GBC_STEP_INST;
-  return GBC_cpu_decode ( _regs.PC, &(step->val.inst) );
+  return GBC_cpu_decode ( m, _regs.PC, &(step->val.inst) );
   
 } /* end GBC_cpu_decode_next_step */
 
 
 void
 GBC_cpu_init (
+              GBC_Machine *m,
               GBC_Warning *warning,
               void        *udata
               )
@@ -1828,13 +3044,17 @@ GBC_cpu_init (
   
   _warning= warning;
   _udata= udata;
-  GBC_cpu_init_state ();
+  _idle.enabled= GBC_TRUE;
+  _idle.skipped= 0;
+  GBC_cpu_init_state ( m );
   
 } /* end GBC_cpu_init */
 
 
 void
-GBC_cpu_init_state (void)
+GBC_cpu_init_state (
+                    GBC_Machine *m
+                    )
 {
   
   _cgb_mode= GBC_TRUE;
@@ -1860,11 +3080,17 @@ GBC_cpu_init_state (void)
   _speed.current= 0x00;
   _speed.prepare= GBC_FALSE;
   
+#ifdef CPU_BLOCKS
+  flush_blocks ( m );
+#endif
+  
 } /* end GBC_cpu_init_state */
 
 
 void
-GBC_cpu_power_up (void)
+GBC_cpu_power_up (
+                  GBC_Machine *m
+                  )
 {
   
   _regs.A= 0x11; _regs.F= 0xB0;
@@ -1878,21 +3104,27 @@ GBC_cpu_power_up (void)
 
 
 GBCu8
-GBC_cpu_read_IE (void)
+GBC_cpu_read_IE (
+                 GBC_Machine *m
+                 )
 {
   return _regs.IE;
 } /* end GBC_cpu_read_IE */
 
 
 GBCu8
-GBC_cpu_read_IF (void)
+GBC_cpu_read_IF (
+                 GBC_Machine *m
+                 )
 {
   return _regs.IF;
 } /* end GBC_cpu_read_IF */
 
 
 void
-GBC_cpu_request_vblank_int (void)
+GBC_cpu_request_vblank_int (
+                            GBC_Machine *m
+                            )
 {
   
   _regs.unhalted= GBC_TRUE;
@@ -1903,7 +3135,9 @@ GBC_cpu_request_vblank_int (void)
 
 
 void
-GBC_cpu_request_lcdstat_int (void)
+GBC_cpu_request_lcdstat_int (
+                             GBC_Machine *m
+                             )
 {
   
   _regs.unhalted= GBC_TRUE;
@@ -1914,7 +3148,9 @@ GBC_cpu_request_lcdstat_int (void)
 
 
 void
-GBC_cpu_request_timer_int (void)
+GBC_cpu_request_timer_int (
+                           GBC_Machine *m
+                           )
 {
   
   _regs.unhalted= GBC_TRUE;
@@ -1925,7 +3161,9 @@ GBC_cpu_request_timer_int (void)
 
 
 void
-GBC_cpu_request_serial_int (void)
+GBC_cpu_request_serial_int (
+                            GBC_Machine *m
+                            )
 {
   
   _regs.unhalted= GBC_TRUE;
@@ -1936,7 +3174,9 @@ GBC_cpu_request_serial_int (void)
 
 
 void
-GBC_cpu_request_joypad_int (void)
+GBC_cpu_request_joypad_int (
+                            GBC_Machine *m
+                            )
 {
   
   _regs.unhalted= GBC_TRUE;
@@ -1947,19 +3187,226 @@ GBC_cpu_request_joypad_int (void)
 
 
 int
-GBC_cpu_run (void)
+GBC_cpu_run (
+             GBC_Machine *m
+             )
 {
   
+  /* Fora dels lots HALT sols consumix 4 cicles. */
+  _run.budget= _run.cc;
   if ( _regs.IME && _regs.IAUX )
-    return interruption ();
-  _opcode= GBC_mem_read ( _regs.PC++ );
-  return _insts[_opcode] ();
+    return interruption ( m );
+  _opcode= mem_read ( m, _regs.PC++ );
+  return _insts[_opcode] ( m );
   
 } /* end GBC_cpu_run */
 
 
+int
+GBC_cpu_run_cycles (
+        	    GBC_Machine *m,
+        	    const int    budget
+        	    )
+{
+  
+#ifndef CPU_THREADED
+#ifdef CPU_BLOCKS
+  cpu_block_t *b;
+#endif
+  int cc;
+#endif
+  
+  
+  _run.budget= budget;
+  _run.cc= 0;
+#ifdef CPU_THREADED
+  return run_cycles_threaded ( m );
+#else
+  do {
+    if ( _regs.IME && _regs.IAUX )
+      cc= interruption ( m );
+#ifdef CPU_BLOCKS
+    else if ( (b= get_block ( m )) != NULL )
+      {
+        exec_block ( m, b );
+        continue;
+      }
+#endif
+    else
+      {
+        _opcode= mem_read ( m, _regs.PC++ );
+        cc= _insts[_opcode] ( m );
+      }
+    _run.cc+= cc;
+  } while ( _run.cc < _run.budget );
+  
+  return _run.cc;
+#endif
+  
+} /* end GBC_cpu_run_cycles */
+
+
+void
+GBC_cpu_code_written (
+        	      GBC_Machine  *m,
+        	      const GBCu16  addr,
+        	      const int     bank
+        	      )
+{
+  
+#ifdef CPU_BLOCKS
+  cpu_block_t *b;
+  int i;
+  
+  
+  for ( i= 0; i < GBC_CPU_NBLOCKS; ++i )
+    {
+      b= &(_blocks.v[i]);
+      if ( b->valid && b->bank == bank &&
+           addr >= b->addr && addr < b->addr+b->size )
+        release_block ( m, b );
+    }
+#endif
+  
+} /* end GBC_cpu_code_written */
+
+
+GBC_Bool
+GBC_cpu_jit_available (void)
+{
+#ifdef CPU_JIT
+  return GBC_TRUE;
+#else
+  return GBC_FALSE;
+#endif
+} /* end GBC_cpu_jit_available */
+
+
+int
+GBC_cpu_set_jit (
+        	 GBC_Machine       *m,
+        	 const GBC_JitMode  mode
+        	 )
+{
+  
+#ifdef CPU_JIT
+  void *code;
+  
+  
+  if ( mode == GBC_JIT_OFF )
+    {
+      if ( _jit.code != NULL )
+        {
+          jit_flush ( m );
+          munmap ( _jit.code, GBC_CPU_JIT_SIZE );
+          _jit.code= NULL;
+        }
+    }
+  else if ( _jit.code == NULL )
+    {
+      /* Es comprova ara que el sistema permet fer executable la
+         memòria. */
+      code= mmap ( NULL, GBC_CPU_JIT_SIZE, PROT_READ|PROT_WRITE,
+        	   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+      if ( code == MAP_FAILED ) return -1;
+      if ( mprotect ( code, GBC_CPU_JIT_SIZE, PROT_READ|PROT_EXEC ) != 0 )
+        {
+          munmap ( code, GBC_CPU_JIT_SIZE );
+          return -1;
+        }
+      _jit.code= (GBCu8 *) code;
+      _jit.page= (size_t) sysconf ( _SC_PAGESIZE );
+      jit_flush ( m );
+    }
+  _jit.mode= mode;
+  
+  return 0;
+#else
+  return mode == GBC_JIT_OFF ? 0 : -1;
+#endif
+  
+} /* end GBC_cpu_set_jit */
+
+
+void
+GBC_cpu_set_jit_hook (
+        	      GBC_Machine      *m,
+        	      GBC_JitBlockHook *hook,
+        	      void             *udata
+        	      )
+{
+  
+  _jit.hook= hook;
+  _jit.hook_udata= udata;
+  
+} /* end GBC_cpu_set_jit_hook */
+
+
+void
+GBC_cpu_get_regs (
+        	  GBC_Machine *m,
+        	  GBC_CPURegs *regs
+        	  )
+{
+  
+  regs->PC= _regs.PC;
+  regs->SP= _regs.SP;
+  regs->A= (GBCu8) _regs.A;
+  regs->F= _regs.F;
+  regs->B= _regs.B;
+  regs->C= _regs.C;
+  regs->D= _regs.D;
+  regs->E= _regs.E;
+  regs->H= _regs.H;
+  regs->L= _regs.L;
+  regs->IE= _regs.IE;
+  regs->IF= _regs.IF;
+  regs->IME= _regs.IME;
+  regs->cc= _run.cc;
+  
+} /* end GBC_cpu_get_regs */
+
+
+void
+GBC_cpu_set_idle_skip (
+        	       GBC_Machine    *m,
+        	       const GBC_Bool  enabled
+        	       )
+{
+  _idle.enabled= enabled;
+} /* end GBC_cpu_set_idle_skip */
+
+
+GBCu64
+GBC_cpu_get_idle_skipped (
+        		  GBC_Machine *m
+        		  )
+{
+  return _idle.skipped;
+} /* end GBC_cpu_get_idle_skipped */
+
+
+int
+GBC_cpu_get_run_cycles (
+        		GBC_Machine *m
+        		)
+{
+  return _run.cc;
+} /* end GBC_cpu_get_run_cycles */
+
+
+GBC_Bool
+GBC_cpu_is_halted (
+        	   GBC_Machine *m
+        	   )
+{
+  return _regs.halted && !_regs.unhalted;
+} /* end GBC_cpu_is_halted */
+
+
 void
 GBC_cpu_set_cgb_mode (
+        	      GBC_Machine   *m,
         	      const GBC_Bool enabled
         	      )
 {
@@ -1969,6 +3416,7 @@ GBC_cpu_set_cgb_mode (
 
 void
 GBC_cpu_speed_prepare (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       )
 {
@@ -1980,7 +3428,9 @@ GBC_cpu_speed_prepare (
 
 
 GBCu8
-GBC_cpu_speed_query (void)
+GBC_cpu_speed_query (
+                     GBC_Machine *m
+                     )
 {
   
   if ( !_cgb_mode ) return 0xFF;
@@ -1990,8 +3440,18 @@ GBC_cpu_speed_query (void)
 } /* end GBC_cpu_speed_query */
 
 
+void
+GBC_cpu_stop_run (
+        	  GBC_Machine *m
+        	  )
+{
+  _run.budget= 0;
+} /* end GBC_cpu_stop_run */
+
+
 void
 GBC_cpu_write_IE (
+        	  GBC_Machine *m,
         	  GBCu8 data
         	  )
 {
@@ -2004,6 +3464,7 @@ GBC_cpu_write_IE (
 
 void
 GBC_cpu_write_IF (
+        	  GBC_Machine *m,
         	  GBCu8 data    /* Dades */
         	  )
 {
@@ -2016,6 +3477,7 @@ GBC_cpu_write_IF (
 
 int
 GBC_cpu_save_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    )
 {
@@ -2031,6 +3493,7 @@ GBC_cpu_save_state (
 
 int
 GBC_cpu_load_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    )
 {
@@ -2038,7 +3501,36 @@ GBC_cpu_load_state (
   LOAD ( _regs );
   LOAD ( _cgb_mode );
   LOAD ( _speed );
+#ifdef CPU_BLOCKS
+  flush_blocks ( m );
+#endif
 
   return 0;
   
 } /* end GBC_cpu_load_state */
+
+#else /* CPU_TRACE */
+
+
+
+
+/**********************************/
+/* FUNCIONS PÚBLIQUES (AMB TRAÇA) */
+/**********************************/
+
+int
+GBC_cpu_run_trace (
+        	   GBC_Machine *m
+        	   )
+{
+  
+  /* Fora dels lots HALT sols consumix 4 cicles. */
+  _run.budget= _run.cc;
+  if ( _regs.IME && _regs.IAUX )
+    return interruption ( m );
+  _opcode= mem_read ( m, _regs.PC++ );
+  return _insts[_opcode] ( m );
+  
+} /* end GBC_cpu_run_trace */
+
+#endif /* CPU_TRACE */
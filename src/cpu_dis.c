@@ -29,6 +29,7 @@
 #include <stdlib.h>
 
 #include "GBC.h"
+#include "machine.h"
 
 
 
@@ -576,13 +577,14 @@ static const GBC_InstId _insts[256]=
 
 static GBCu16
 get_extra_byte (
+        	GBC_Machine   *m,
         	GBCu16         addr,
         	GBC_InstExtra *extra,
         	GBC_Inst      *inst
         	)
 {
   
-  inst->bytes[inst->nbytes++]= extra->byte= GBC_mem_read ( addr++ );
+  inst->bytes[inst->nbytes++]= extra->byte= GBC_mem_read ( m, addr++ );
   
   return addr;
   
@@ -591,13 +593,14 @@ get_extra_byte (
 
 static GBCu16
 get_extra_desp (
+                GBC_Machine   *m,
                 GBCu16         addr,
                 GBC_InstExtra *extra,
                 GBC_Inst      *inst
                 )
 {
   
-  inst->bytes[inst->nbytes]= GBC_mem_read ( addr++ );
+  inst->bytes[inst->nbytes]= GBC_mem_read ( m, addr++ );
   extra->desp= (GBCs8) (inst->bytes[inst->nbytes++]);
   
   return addr;
@@ -607,14 +610,15 @@ get_extra_desp (
 
 static GBCu16
 get_extra_addr_word (
+        	     GBC_Machine   *m,
         	     GBCu16         addr,
         	     GBC_InstExtra *extra,
         	     GBC_Inst      *inst
         	     )
 {
   
-  extra->addr_word= inst->bytes[inst->nbytes++]= GBC_mem_read ( addr++ );
-  inst->bytes[inst->nbytes]= GBC_mem_read ( addr++ );
+  extra->addr_word= inst->bytes[inst->nbytes++]= GBC_mem_read ( m, addr++ );
+  inst->bytes[inst->nbytes]= GBC_mem_read ( m, addr++ );
   extra->addr_word|= ((GBCu16) inst->bytes[inst->nbytes++])<<8;
   
   return addr;
@@ -624,13 +628,14 @@ get_extra_addr_word (
 
 static GBCu16
 get_extra_branch (
+        	  GBC_Machine   *m,
         	  GBCu16         addr,
         	  GBC_InstExtra *extra,
         	  GBC_Inst      *inst
         	  )
 {
   
-  inst->bytes[inst->nbytes]= GBC_mem_read ( addr++ );
+  inst->bytes[inst->nbytes]= GBC_mem_read ( m, addr++ );
   extra->branch.desp= (GBCs8) (inst->bytes[inst->nbytes++]);
   extra->branch.addr= addr + extra->branch.desp;
   
@@ -641,6 +646,7 @@ get_extra_branch (
 
 static GBCu16
 get_extra_op (
+              GBC_Machine      *m,
               GBCu16            addr,
               const GBC_OpType  op,
               GBC_InstExtra    *extra,
@@ -652,12 +658,12 @@ get_extra_op (
     {
     case GBC_pFF00n:
     case GBC_pBYTE:
-    case GBC_BYTE: return get_extra_byte ( addr, extra, inst );
+    case GBC_BYTE: return get_extra_byte ( m, addr, extra, inst );
     case GBC_DESP:
-    case GBC_SPdd: return get_extra_desp ( addr, extra, inst );
+    case GBC_SPdd: return get_extra_desp ( m, addr, extra, inst );
     case GBC_ADDR:
-    case GBC_WORD: return get_extra_addr_word ( addr, extra, inst );
-    case GBC_BRANCH: return get_extra_branch ( addr, extra, inst );
+    case GBC_WORD: return get_extra_addr_word ( m, addr, extra, inst );
+    case GBC_BRANCH: return get_extra_branch ( m, addr, extra, inst );
     default: break;
     }
   
@@ -668,19 +674,21 @@ get_extra_op (
 
 static GBCu16
 get_extra (
+           GBC_Machine *m,
            GBCu16    addr,
            GBC_Inst *inst
            )
 {
   
-  addr= get_extra_op ( addr, inst->id.op1, &(inst->e1), inst );
-  return get_extra_op ( addr, inst->id.op2, &(inst->e2), inst );
+  addr= get_extra_op ( m, addr, inst->id.op1, &(inst->e1), inst );
+  return get_extra_op ( m, addr, inst->id.op2, &(inst->e2), inst );
   
 } /* end get_extra */
 
 
 static GBCu16
 decode_cb (
+           GBC_Machine *m,
            GBCu16    addr,
            GBC_Inst *inst
            )
@@ -689,11 +697,11 @@ decode_cb (
   GBCu8 opcode;
   
   
-  opcode= inst->bytes[1]= GBC_mem_read ( addr++ );
+  opcode= inst->bytes[1]= GBC_mem_read ( m, addr++ );
   inst->nbytes= 2;
   inst->id= _insts_cb[opcode];
   
-  return get_extra ( addr, inst );
+  return get_extra ( m, addr, inst );
   
 } /* end decode_cb */
 
@@ -706,6 +714,7 @@ decode_cb (
 
 GBCu16
 GBC_cpu_decode (
+        	GBC_Machine *m,
         	GBCu16    addr,
         	GBC_Inst *inst
         	)
@@ -714,14 +723,14 @@ GBC_cpu_decode (
   GBCu8 opcode;
   
   
-  opcode= inst->bytes[0]= GBC_mem_read ( addr++ );
+  opcode= inst->bytes[0]= GBC_mem_read ( m, addr++ );
   switch ( opcode )
     {
-    case 0xcb: return decode_cb ( addr, inst );
+    case 0xcb: return decode_cb ( m, addr, inst );
     default:
       inst->nbytes= 1;
       inst->id= _insts[opcode];
-      return get_extra ( addr, inst );
+      return get_extra ( m, addr, inst );
     }
   
 } /* end GBC_cpu_decode */
@@ -0,0 +1,32 @@
+/*
+ * Copyright 2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  cpu_trace.c - Variant de la UCP per a 'GBC_trace'.
+ *
+ *  Compila 'cpu.c' una altra vegada definint CPU_TRACE. D'aquesta
+ *  manera les instruccions que executa 'GBC_loop' (i 'GBC_iter')
+ *  accedixen a la memòria sense passar pels punters de 'mem.c', i sols
+ *  les d'aquesta variant, que exporta únicament 'GBC_cpu_run_trace',
+ *  criden al callback de traça.
+ *
+ */
+
+
+#define CPU_TRACE
+#include "cpu.c"
@@ -26,6 +26,7 @@
 #include <stdlib.h>
 
 #include "GBC.h"
+#include "machine.h"
 
 
 
@@ -51,12 +52,10 @@
 /* ESTAT */
 /*********/
 
-/* Callbacks. */
-static GBC_CheckButtons *_check_buttons;
-static void *_udata;
-
-/* Selecci i bits ignorats. */
-static GBCu8 _sel;
+/* L'estat està en 'GBC_Machine' (veure 'machine.h'). */
+#define _check_buttons (m->joypad.check_buttons)
+#define _udata (m->joypad.udata)
+#define _sel (m->joypad.sel)
 
 
 
@@ -67,6 +66,7 @@ static GBCu8 _sel;
 
 void
 GBC_joypad_init (
+        	 GBC_Machine      *m,
         	 GBC_CheckButtons *check_buttons,
                  void             *udata
         	 )
@@ -74,13 +74,15 @@ GBC_joypad_init (
   
   _check_buttons= check_buttons;
   _udata= udata;
-  GBC_joypad_init_state ();
+  GBC_joypad_init_state ( m );
   
 } /* end GBC_joypad_init */
 
 
 void
-GBC_joypad_init_state (void)
+GBC_joypad_init_state (
+                       GBC_Machine *m
+                       )
 {
   _sel= 0;
 } /* end GBC_joypad_init_state */
@@ -88,6 +90,7 @@ GBC_joypad_init_state (void)
 
 void
 GBC_joypad_key_pressed (
+        		GBC_Machine *m,
         		GBC_Bool button_pressed,
         		GBC_Bool direction_pressed
         		)
@@ -95,13 +98,15 @@ GBC_joypad_key_pressed (
   
   if ( (button_pressed && _sel&BUTTON) ||
        (direction_pressed && _sel&DIRECTION) )
-    GBC_cpu_request_joypad_int ();
+    GBC_cpu_request_joypad_int ( m );
   
 } /* end GBC_joypad_key_presed */
 
 
 GBCu8
-GBC_joypad_read (void)
+GBC_joypad_read (
+                 GBC_Machine *m
+                 )
 {
   
   /* NOTA: No sé que fa quan els dos estan seleccionats. */
@@ -118,6 +123,7 @@ GBC_joypad_read (void)
 
 void
 GBC_joypad_write (
+        	  GBC_Machine *m,
         	  GBCu8 data
         	  )
 {
@@ -127,6 +133,7 @@ GBC_joypad_write (
 
 int
 GBC_joypad_save_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       )
 {
@@ -140,6 +147,7 @@ GBC_joypad_save_state (
 
 int
 GBC_joypad_load_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       )
 {
@@ -32,11 +32,15 @@
  */
 
 
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "GBC.h"
+#include "machine.h"
 
 
 
@@ -74,151 +78,69 @@
 #define CICLESPERFRAME 70224
 
 /* Grandària banc. */
-#define BANK_SIZE 8192
+#define BANK_SIZE GBC_VRAM_BANK_SIZE
 
 /* Grandària OAM. */
-#define OAM_SIZE 160
+#define OAM_SIZE GBC_OAM_SIZE
 
 
-/* MACROS DE 'render_line_bg_color'. */
+/* MACROS DE 'render_line_*'. */
 #define VFLIP 0x40
 #define HFLIP 0x20
 #define BGPRIOR 0x80
 
-#define GET_NEXT_NT_MONO_AUX        		\
-  addr= addr_row|addr_col;                      \
-  NT= _vram[0][addr]
-
-#define GET_NEXT_NT_MONO        		\
-  GET_NEXT_NT_MONO_AUX;        			\
-  if ( (++addr_col) == 32 ) addr_col= 0
-
-#define GET_NEXT_NT_MONO_WIN        		\
-  GET_NEXT_NT_MONO_AUX;        			\
-  ++addr_col
-
-#define GET_NEXT_NT_COLOR_AUX        		\
-  addr= addr_row|addr_col;                      \
-  NT= _vram[0][addr];        			\
-  ATTR= _vram[1][addr];        			\
-  tram= &(_vram[(ATTR&0x08)>>3][0])
-
-#define GET_NEXT_NT_COLOR        		\
-  GET_NEXT_NT_COLOR_AUX;        		\
-  if ( (++addr_col) == 32 ) addr_col= 0
-
-#define GET_NEXT_NT_COLOR_WIN        		\
-  GET_NEXT_NT_COLOR_AUX;        		\
-  ++addr_col
-
-#define CALC_ADDR_PAT_MONO_AUX        		\
-  addr_pat=        				\
-    _control.bgwin_tile_data ?        		\
-    (((GBCu16) NT)<<4) :        		\
-    (GBCu16) ((0x100+((GBCs8) NT))<<4);        	\
-  addr_pat|= sel_bp
-
-#define CALC_ADDR_PAT_MONO        		\
-  CALC_ADDR_PAT_MONO_AUX
-
-#define CALC_ADDR_PAT_MONO_WIN        		\
-  CALC_ADDR_PAT_MONO_AUX
-
-#define CALC_ADDR_PAT_COLOR_AUX        		\
-  addr_pat=        				\
-    _control.bgwin_tile_data ?        		\
-    (((GBCu16) NT)<<4) :        		\
-    (GBCu16) ((0x100+((GBCs8) NT))<<4);        	\
-  addr_pat|= (ATTR&VFLIP)?sel_bp_flip:sel_bp
-
-#define CALC_ADDR_PAT_COLOR        		\
-  CALC_ADDR_PAT_COLOR_AUX;        		\
-  sel_pal^= 1;        				\
-  pal[sel_pal]= &(_cpal.bg.v[ATTR&0x7][0])
-
-#define CALC_ADDR_PAT_COLOR_WIN        		\
-  CALC_ADDR_PAT_COLOR_AUX;        		\
-  pal= &(_cpal.bg.v[ATTR&0x7][0]);        	\
-  prio= ((ATTR&BGPRIOR)!=0)
-
-#define GET_NEXT_BP_COLOR        				   \
-  if ( ATTR&HFLIP )        					   \
-    {        							   \
-      bp0|= reverse_byte ( tram[addr_pat] );        		   \
-      bp1|= reverse_byte ( tram[addr_pat|1] );        		   \
-    }        							   \
-  else        							   \
-    {        							   \
-      bp0|= tram[addr_pat];        				   \
-      bp1|= tram[addr_pat|1];        				   \
-    }        							   \
-  bpal|= sel_pal ? 0xFF : 0x00;        				   \
-  bprio|= ATTR&BGPRIOR ? 0xFF : 0x00
-
-#define GET_NEXT_BP_MONO        				   \
-  bp0|= tram[addr_pat];        					   \
-  bp1|= tram[addr_pat|1]
-
-#define GET_NEXT_BP_COLOR_WIN        				   \
-  do {        							   \
-    if ( ATTR&HFLIP )        					   \
-      {        							   \
-        bp0= reverse_byte ( tram[addr_pat] );			   \
-        bp1= reverse_byte ( tram[addr_pat|1] );			   \
-      }        							   \
-    else        						   \
-      {        							   \
-        bp0= tram[addr_pat];					   \
-        bp1= tram[addr_pat|1];					   \
-      }        							   \
-  } while(0)
-
-#define GET_NEXT_BP_MONO_WIN        				   \
-  do {        							   \
-    bp0= tram[addr_pat];        				   \
-    bp1= tram[addr_pat|1];        				   \
-  } while(0)
-
-#define RENDER_LINE_BG_COLOR_INIT                                  \
-  sel_pal= 0;        						   \
-  GET_NEXT_NT_COLOR;        					   \
-  CALC_ADDR_PAT_COLOR;        					   \
-  if ( ATTR&HFLIP )        					   \
-    {        							   \
-      bp0= ((GBCu16) reverse_byte ( tram[addr_pat] ))<<8;           \
-      bp1= ((GBCu16) reverse_byte ( tram[addr_pat|1] ))<<8;           \
-    }        							   \
-  else        							   \
-    {        							   \
-      bp0= ((GBCu16) tram[addr_pat])<<8;        		   \
-      bp1= ((GBCu16) tram[addr_pat|1])<<8;        		   \
-    }        							   \
-  bpal= sel_pal ? 0xFF00 : 0x0000;        			   \
-  bprio= ATTR&BGPRIOR ? 0xFF00 : 0x0000
-
-#define RENDER_LINE_BG_MONO_INIT        			   \
-  GET_NEXT_NT_MONO;        					   \
-  CALC_ADDR_PAT_MONO;        					   \
-  bp0= ((GBCu16) tram[addr_pat])<<8;        			   \
-  bp1= ((GBCu16) tram[addr_pat|1])<<8
-
-
-
-
-/*********/
-/* TIPUS */
-/*********/
-
-typedef struct
-{
-  
-  int      v[8][4];
-  int      p; /* Paleta. */
-  int      c; /* Color. */
-  int      high; /* Posició. */
-  GBC_Bool auto_increment;
-  
-} cpal_t;
+/* Tile del fons o la finestra amb número NT. */
+#define BGWIN_TILE(NT)        						\
+  (_control.bgwin_tile_data ? (int) (NT) : 0x100+((GBCs8) (NT)))
+
+/* Entrades de les paletes en les línies renderitzades: [0,31] fons,
+   [32,63] sprites, més el blanc del LCD desactivat i el negre del LCD
+   parat. */
+#define SLOT_OB 32
+#define SLOT_WHITE 64
+#define SLOT_BLACK 65
+#define NSLOTS 66
+
+/* Tipus d'escriptura registrada en mode diferit. */
+#define DEFER_SCX 0
+#define DEFER_SCY 1
+#define DEFER_WX 2
+#define DEFER_WY 3
+#define DEFER_LCDC 4
+#define DEFER_MPAL 5 /* 'addr': 0 BG, 1 OB0, 2 OB1. */
+#define DEFER_CPAL 6 /* 'addr': entrada de la paleta. */
+#define DEFER_VRAM 7 /* 'addr': banc<<13 | adreça. */
+#define DEFER_OAM 8
+
+/* Estat del fil de renderitzat. */
+#define THREAD_IDLE 0
+#define THREAD_BUSY 1 /* Renderitzant un frame. */
+#define THREAD_DONE 2 /* Frame acabat però encara no lliurat. */
+#define THREAD_QUIT 3
+
+/* On està la imatge del frame actual en un estat guardat. */
+#define STATE_FB_NONE 0   /* No es va guardar (anell sense buffer). */
+#define STATE_FB_RENDER 1 /* En 'render.fb'. */
+#define STATE_FB_DATA 2   /* Just a continuació, en el format. */
+
+/* Invalida en la cache el tile que conté l'adreça ADDR del banc
+   seleccionat. */
+#define INVALIDATE_TILE(ADDR)        					\
+  if ( (ADDR) < 0x1800 )        					\
+    _tiles.valid[_cvram!=&(_vram[0][0])][(ADDR)>>4]= GBC_FALSE
+
+/* Adreça ADDR del banc seleccionat en el registre diferit. */
+#define VRAM_ADDR(ADDR) (((_cvram!=&(_vram[0][0]))<<13) | (ADDR))
+
+/* Accessos als índexs de les cues de l'anell. Sense GCC/Clang es
+   protegeixen amb el mutex de l'anell. */
+#ifdef __GNUC__
+#define LOAD_ACQ(M,P) __atomic_load_n ( (P), __ATOMIC_ACQUIRE )
+#define STORE_REL(M,P,V) __atomic_store_n ( (P), (V), __ATOMIC_RELEASE )
+#else
+#define LOAD_ACQ(M,P) load_locked ( (M), (P) )
+#define STORE_REL(M,P,V) store_locked ( (M), (P), (V) )
+#endif
 
 
 
@@ -227,142 +149,33 @@ typedef struct
 /* ESTAT */
 /*********/
 
-/* Mode. */
-static GBC_Bool _cgb_mode;
-static GBC_Bool _pal_lock;
-
-/* Callbacks. */
-static GBC_Warning *_warning;
-static GBC_UpdateScreen *_update_screen;
-static void *_udata;
-
-/* Registre de control. */
-static struct
-{
-  
-  GBCu8    data;               /* Valor del registre. */
-  GBC_Bool enabled;            /* Dispositiu activat. */
-  GBCu16   win_tile_map;       /* Adreça del mapa de tiles utilitzat
-        			  per la finestra. */
-  GBC_Bool b5;                 /* Bit5. */
-  GBC_Bool win_enabled;        /* Finestra activada. */
-  GBC_Bool bgwin_tile_data;    /* TRUE -> 8000-8FFF (Unsigned). FALSE
-        			  -> 8800-97FF (Signed). */
-  GBC_Bool bg_tile_map;        /* Adreça del mapa de tiles utilitzat
-        			  per al fons. */
-  GBC_Bool obj_size16;         /* A cert indica que els sprites són de
-        			  8x16. */
-  GBC_Bool obj_enabled;        /* Sprites actius. */
-  GBC_Bool bg_enabled;         /* Fons actiu. */
-  GBC_Bool obj_has_prio;       /* Els sprites sempre tenen prioritat
-        			  sobre el fons i la finestra. */
-  
-} _control;
-
-/* Registre d'estat. */
-static struct
-{
-  
-  GBCu8    hdata;           /* Conté la part que no varia del registre
-        		       ([7-3]). */
-  GBC_Bool intC_enabled;    /* Interrupció coincidència. */
-  GBC_Bool int2_enabled;    /* Interrupció mode 2. */
-  GBC_Bool int1_enabled;    /* Interrupció mode 1. */
-  GBC_Bool int0_enabled;    /* Interrupció mode 0. */
-  GBCu8    mode;            /* Mode actual. */
-  
-} _status;
-
-/* Timing. */
-static struct
-{
-  
-  int cc;           /* Cicles acumulats. */
-  int cctoVBInt;    /* Cicles per a la següent interrupció
-        	       VBlank. Coincideix amb la interrupció mode
-        	       1. */
-  int cctoCInt;     /* Cicles fins a la següent interrupció per
-        	       coincidència. */
-  int ccto2Int;     /* Cicles fins a la següent interrupció mode 2. */
-  int ccto0Int;     /* Cicles fins a la següent interrupció mode 0. */
-  int extracc;      /* Cicles extra. */
-  
-} _timing;
-
-/* Registres de posició. */
-static struct
-{
-  
-  GBCu8 SCY,SCX;
-  int LY,LX;
-  int LYC;
-  GBCu8 WY,WX;
-  
-} _pos;
-
-/* Memòria. */
-static GBCu8 _vram[2][BANK_SIZE];
-static GBCu8 *_cvram;
-static GBCu8 _vram_selected;
-
-/* OAM. */
-static GBCu8 _oam[OAM_SIZE];
-
-/* DMA. */
-static struct
-{
-  
-  GBCu16   src;
-  GBCu16   dst;
-  GBCu8    length;
-  GBC_Bool active;
-  
-} _dma;
-
-/* Paleta monocroma. */
-static struct
-{
-  
-  GBCu8 bg[4];
-  GBCu8 ob0[4];
-  GBCu8 ob1[4];
-  
-} _mpal;
-
-/* Paleta de colors. */
-static struct
-{
-  
-  cpal_t bg;
-  cpal_t ob;
-  
-} _cpal;
-
-/* Estat renderitzat. */
-static struct
-{
-  
-  int  fb[23040 /*160x144*/];    /* Frame buffer. */
-  int  lines;                    /* Número de línies reals
-        			    renderitzades. */
-  int *p;                        /* Apunta al següent píxel a
-        			    renderitzar. */
-  int  line_bg[160];             /* Línia amb el fons dibuixat. */
-  int  line_obj[160];            /* Línia amb els sprites. -1 indica
-        			    transparent. */
-  signed char prio_bg[160];      /* La prioritat segons el fons. 0 ->
-        			    El que diguen els sprites. 1 ->
-        			    Prioritat fons. -1 -> Color fons
-        			    transparent. */
-  signed char prio_obj[160];     /* La prioritat segons els sprites. 0
-        			    -> prioritat sprite. El valor sols
-        			    es fixa quan el color no és
-        			    transparent. */
-  
-} _render;
-
-/* Indica si està parat. */
-static GBC_Bool _stop;
+/* L'estat està en 'GBC_Machine' (veure 'machine.h'). */
+#define _cgb_mode (m->lcd.cgb_mode)
+#define _pal_lock (m->lcd.pal_lock)
+#define _warning (m->lcd.warning)
+#define _update_screen (m->lcd.update_screen)
+#define _udata (m->lcd.udata)
+#define _control (m->lcd.control)
+#define _status (m->lcd.status)
+#define _timing (m->lcd.timing)
+#define _pos (m->lcd.pos)
+#define _vram (m->lcd.vram)
+#define _cvram (m->lcd.cvram)
+#define _vram_selected (m->lcd.vram_selected)
+#define _oam (m->lcd.oam)
+#define _obj_lines (m->lcd.obj_lines)
+#define _dma (m->lcd.dma)
+#define _mpal (m->lcd.mpal)
+#define _cpal (m->lcd.cpal)
+#define _tiles (m->lcd.tiles)
+#define _kernels (m->lcd.kernels)
+#define _render (m->lcd.render)
+#define _out (m->lcd.out)
+#define _skip (m->lcd.skip)
+#define _ring (m->lcd.ring)
+#define _defer (m->lcd.defer)
+#define _thread (m->lcd.thread)
+#define _stop (m->lcd.stop)
 
 
 
@@ -373,7 +186,9 @@ static GBC_Bool _stop;
 
 
 static void
-update_cctoCInt (void)
+update_cctoCInt (
+                 GBC_Machine *m
+                 )
 {
   
   if ( _pos.LY < _pos.LYC )
@@ -384,169 +199,202 @@ update_cctoCInt (void)
 } /* end update_cctoCInt */
 
 
+/* Entrades de cadascuna de les paletes de color (8 del fons i 8 dels
+   sprites). */
+static const int _slots[16][4]=
+  {
+    {  0,  1,  2,  3 }, {  4,  5,  6,  7 }, {  8,  9, 10, 11 },
+    { 12, 13, 14, 15 }, { 16, 17, 18, 19 }, { 20, 21, 22, 23 },
+    { 24, 25, 26, 27 }, { 28, 29, 30, 31 }, { 32, 33, 34, 35 },
+    { 36, 37, 38, 39 }, { 40, 41, 42, 43 }, { 44, 45, 46, 47 },
+    { 48, 49, 50, 51 }, { 52, 53, 54, 55 }, { 56, 57, 58, 59 },
+    { 60, 61, 62, 63 }
+  };
+
+
+/* Descodifica el tile TILE del banc BANK en la cache. */
 static void
-vram_dma_hblank_block (void)
+decode_tile (
+             GBC_Machine *m,
+             const int    bank,
+             const int    tile
+             )
+{
+  
+  _kernels->expand ( &(_vram[bank][tile<<4]),
+        	     &(_tiles.pix[bank][tile][0][0]),
+        	     &(_tiles.pix[bank][tile][1][0]) );
+  _tiles.valid[bank][tile]= GBC_TRUE;
+  
+} /* end decode_tile */
+
+
+/* Torna els índexs de color dels 8 píxels de la fila ROW del tile
+   TILE del banc BANK. */
+static const GBCu8 *
+get_tile_row (
+              GBC_Machine    *m,
+              const int       bank,
+              const int       tile,
+              const int       row,
+              const GBC_Bool  hflip
+              )
 {
   
-  int i;
-  
+  if ( !_tiles.valid[bank][tile] ) decode_tile ( m, bank, tile );
   
-  if ( (_dma.src >= 0x0000 && _dma.src < 0x8000) ||
-       (_dma.src >= 0xA000 && _dma.src < 0xE000) )
-    for ( i= 0; i < 0x10; ++i, ++_dma.dst, ++_dma.src )
-      _cvram[_dma.dst]= GBC_mem_read ( _dma.src );
-  else { _dma.dst+= 0x10; _dma.src+= 10; }
+  return &(_tiles.pix[bank][tile][hflip?1:0][row<<3]);
   
-} /* vram_dma_hblank_block */
+} /* end get_tile_row */
 
 
-static GBCu8
-reverse_byte (
-              GBCu8 byte
+/* Dibuixa en la línia del fons els píxels PIX d'un tile que comença
+   en X, amb els colors COLS i la prioritat PRIO. */
+static void
+draw_bg_tile (
+              GBC_Machine       *m,
+              const GBCu8       *pix,
+              const int          x,
+              const int         *cols,
+              const signed char  prio
               )
 {
   
-  int i;
-  GBCu8 ret;
+  int j, end, color;
   
   
-  ret= 0;
-  for ( i= 0; i < 8; ++i )
+  /* Tile sencer. */
+  if ( x >= 0 && x <= 152 )
     {
-      ret<<= 1;
-      if ( byte&0x1 ) ret|= 0x1;
-      byte>>= 1;
+      _kernels->gather ( &(_render.line_bg[x]), pix, cols );
+      for ( j= 0; j < 8; ++j )
+        _render.prio_bg[x+j]= pix[j]==0 ? -1 : prio;
+      return;
     }
   
-  return ret;
+  /* Tile retallat per un costat. */
+  end= x>152 ? 160-x : 8;
+  for ( j= x<0 ? -x : 0; j < end; ++j )
+    {
+      color= pix[j];
+      _render.line_bg[x+j]= cols[color];
+      _render.prio_bg[x+j]= color==0 ? -1 : prio;
+    }
   
-} /* end reverse_byte */
+} /* end draw_bg_tile */
 
 
+/* Dibuixa en la línia dels sprites els píxels PIX d'un sprite que
+   ocupa [BEGIN,END[, amb els colors COLS i la prioritat PRIO. */
 static void
-render_line_bg_mono (void)
+draw_obj_tile (
+               GBC_Machine       *m,
+               const GBCu8       *pix,
+               const int          begin,
+               const int          end,
+               const int         *cols,
+               const signed char  prio
+               )
 {
   
-  int x, i, j, row, sel_bp, color;
-  const int *pal;
-  GBCu8 NT;
-  GBCu16 addr, addr_row, addr_col, addr_pat, desp0, desp1,
-    bp0, bp1;
-  const GBCu8 *tram;
+  int x, color;
+  
+  
+  for ( x= begin<0 ? 0 : begin; x < end; ++x )
+    {
+      color= pix[x-begin];
+      if ( color != 0 )
+        {
+          _render.line_obj[x]= cols[color];
+          _render.prio_obj[x]= prio;
+        }
+    }
   
+} /* end draw_obj_tile */
+
+
+static void
+render_line_bg_mono (
+                     GBC_Machine *m
+                     )
+{
+  
+  int x, i, row, cols[4];
+  GBCu16 addr_row, addr_col;
+  const GBCu8 *pix;
   
-  /* RAM tiles i paleta. */
-  tram= &(_vram[0][0]);
-  pal= &(_cpal.bg.v[0][0]);
   
   /* Açò no pot passar en mode color. */
   if ( !_control.bg_enabled)
     {
       for ( x= 0; x < 160; ++x )
         {
-          _render.line_bg[x]= pal[_mpal.bg[0]];
+          _render.line_bg[x]= _mpal.bg[0];
           _render.prio_bg[x]= -1;
         }
       return;
     }
   
+  /* Paleta. */
+  for ( i= 0; i < 4; ++i )
+    cols[i]= _mpal.bg[i];
+  
   /* Calcula fila (i adreça base) del 'map tile'. */
   row= _render.lines + _pos.SCY;
   if ( row >= 256 ) row-= 256;
   addr_row= _control.bg_tile_map | ((row&0xF8)<<2);
   
-  /* Selector de bitmap dins d'un patró. */
-  sel_bp= (row&0x7)<<1;
-  
-  /* Columna inicial. */
-  addr_col= (GBCu16) (_pos.SCX>>3);
-  
-  /* Desplaçaments. */
-  desp0= 15 - (_pos.SCX&0x7);
-  desp1= desp0 - 1;
-  
   /* Renderitza. */
-  RENDER_LINE_BG_MONO_INIT;
-  for ( x= i= 0; i < 20; ++i )
+  addr_col= (GBCu16) (_pos.SCX>>3);
+  for ( x= -(_pos.SCX&0x7); x < 160; x+= 8 )
     {
-      GET_NEXT_NT_MONO;
-      CALC_ADDR_PAT_MONO;
-      GET_NEXT_BP_MONO;
-      for ( j= 0; j < 8; ++j, ++x )
-        {
-          color= ((bp0>>desp0)&0x01) | ((bp1>>desp1)&0x02);
-          _render.line_bg[x]= pal[_mpal.bg[color]];
-          _render.prio_bg[x]= color==0 ? -1 : 0;
-          bp0<<= 1; bp1<<= 1;
-        }
+      pix= get_tile_row ( m, 0, BGWIN_TILE ( _vram[0][addr_row|addr_col] ),
+        		  row&0x7, GBC_FALSE );
+      draw_bg_tile ( m, pix, x, cols, 0 );
+      addr_col= (addr_col+1)&0x1F;
     }
   
 } /* end render_line_bg_mono */
 
 
 static void
-render_line_win_mono (void)
+render_line_win_mono (
+                      GBC_Machine *m
+                      )
 {
   
-  int x, i, row, sel_bp, color;
-  const int *pal;
-  GBCu8 NT, bp0, bp1;
-  GBCu16 addr, addr_row, addr_col, addr_pat;
-  const GBCu8 *tram;
+  int x, i, row, cols[4];
+  GBCu16 addr_row, addr_col;
+  const GBCu8 *pix;
   
   
   /* Si no està activa no fa res. */
   if ( !_control.win_enabled) return;
   
-  /* RAM tiles i paleta. */
-  tram= &(_vram[0][0]);
-  pal= &(_cpal.bg.v[0][0]);
+  /* Paleta. */
+  for ( i= 0; i < 4; ++i )
+    cols[i]= _mpal.bg[i];
   
   /* Calcula fila (i adreça base) del 'map tile'. */
   row= _render.lines - _pos.WY;
   if ( row < 0 ) return;
   addr_row= _control.win_tile_map | ((row&0xF8)<<2);
   
-  /* Selector de bitmap dins d'un patró. */
-  sel_bp= (row&0x7)<<1;
-  
-  /* Columna inicial. */
-  addr_col= 0x0000;
-  
-  /* Renderitza primer tile (Pot apareixer fora de la pantalla). */
-  x= _pos.WX-7;
-  GET_NEXT_NT_MONO_WIN;
-  CALC_ADDR_PAT_MONO_WIN;
-  GET_NEXT_BP_MONO_WIN;
-  for ( i= 0; x < 0; ++x, ++i ) { bp0<<= 1; bp1<<= 1; }
-  for ( ; i < 8 && x < 160; ++x, ++i )
-    {
-      color= ((bp0>>7)&0x01) | ((bp1>>6)&0x02);
-      _render.line_bg[x]= pal[_mpal.bg[color]];
-      _render.prio_bg[x]= color==0 ? -1 : 0;
-      bp0<<= 1; bp1<<= 1;
-    }
-  if ( x == 160 ) return;
-  
-  /* Renderitza resta. */
-  do {
-    GET_NEXT_NT_MONO_WIN;
-    CALC_ADDR_PAT_MONO_WIN;
-    GET_NEXT_BP_MONO_WIN;
-    for ( i= 0; i < 8 && x < 160; ++x, ++i )
-      {
-        color= ((bp0>>7)&0x01) | ((bp1>>6)&0x02);
-        _render.line_bg[x]= pal[_mpal.bg[color]];
-        _render.prio_bg[x]= color==0 ? -1 : 0;
-        bp0<<= 1; bp1<<= 1;
-      }
-  } while ( x < 160 );
+  /* Renderitza (el primer tile pot apareixer fora de la pantalla). */
+  for ( x= _pos.WX-7, addr_col= 0x0000; x < 160; x+= 8, ++addr_col )
+    {
+      pix= get_tile_row ( m, 0, BGWIN_TILE ( _vram[0][addr_row|addr_col] ),
+        		  row&0x7, GBC_FALSE );
+      draw_bg_tile ( m, pix, x, cols, 0 );
+    }
   
 } /* end render_line_win_mono */
 
 
 static void
-clear_line_obj (void)
+clear_line_obj (
+                GBC_Machine *m
+                )
 {
   
   int i;
@@ -558,8 +406,93 @@ clear_line_obj (void)
 } /* end clear_line_obj */
 
 
+/* Índex del bit a 1 de menor pes. MASK no pot ser 0. */
+static int
+lowest_bit (
+            GBCu64 mask
+            )
+{
+  
+#ifdef __GNUC__
+  return __builtin_ctzll ( mask );
+#else
+  int ret;
+  
+  
+  for ( ret= 0; (mask&1) == 0; ++ret )
+    mask>>= 1;
+  
+  return ret;
+#endif
+  
+} /* end lowest_bit */
+
+
+/* Afegeix (SET) o lleva l'objecte N de les línies on apareix. */
+static void
+update_obj_lines (
+                  GBC_Machine    *m,
+                  const int       n,
+                  const GBC_Bool  set
+                  )
+{
+  
+  int y, end;
+  GBCu64 bit;
+  
+  
+  bit= ((GBCu64) 1)<<n;
+  y= (int) _oam[n<<2] - 16;
+  end= y + (_control.obj_size16 ? 16 : 8);
+  if ( y < 0 ) y= 0;
+  if ( end > 144 ) end= 144;
+  if ( set )
+    for ( ; y < end; ++y )
+      _obj_lines[y]|= bit;
+  else
+    for ( ; y < end; ++y )
+      _obj_lines[y]&= ~bit;
+  
+} /* end update_obj_lines */
+
+
+static void
+build_obj_lines (
+        	 GBC_Machine *m
+        	 )
+{
+  
+  int n;
+  
+  
+  memset ( _obj_lines, 0, sizeof(_obj_lines) );
+  for ( n= 0; n < 40; ++n )
+    update_obj_lines ( m, n, GBC_TRUE );
+  
+} /* end build_obj_lines */
+
+
+/* Modifica la Y de l'objecte N. */
+static void
+set_obj_y (
+           GBC_Machine *m,
+           const int    n,
+           const GBCu8  y
+           )
+{
+  
+  if ( _oam[n<<2] == y ) return;
+  update_obj_lines ( m, n, GBC_FALSE );
+  _oam[n<<2]= y;
+  update_obj_lines ( m, n, GBC_TRUE );
+  
+} /* end set_obj_y */
+
+
 static void
-render_line_obj_mono (void)
+render_line_obj_mono (
+                      GBC_Machine *m
+                      )
 {
   
   /* NOTA: Com no es diu res en ninguna part de la documentació sobre
@@ -572,18 +505,18 @@ render_line_obj_mono (void)
     const GBCu8 *obj;
     int          row;
   } buffer[NMAX_SPRITES];
-  int n, N, row, max_row, x, begin, end, color;
-  const GBCu8 *p, *tram;
-  GBCu8 NT, ATTR, bp0, bp1, *mpal;
-  GBCu16 addr_pat;
+  int n, N, row, max_row, begin, end, i, cols[4];
+  GBCu64 mask;
+  const GBCu8 *p, *pix;
+  GBCu8 NT, ATTR;
+  const GBCu8 *mpal;
   const int *pal;
-  signed char prio;
   
   
   /* Si no està activat. */
   if ( !_control.obj_enabled )
     {
-      clear_line_obj ();
+      clear_line_obj ( m );
       return;
     }
   
@@ -592,76 +525,52 @@ render_line_obj_mono (void)
   /* ATENCIÓ!!!! Però de moment passe!!!!. */
   max_row= _control.obj_size16 ? 16 : 8;
   N= 0;
-  for ( n= 0, p= &(_oam[0]); n < 40; ++n, p+= 4 )
+  for ( mask= _obj_lines[_render.lines];
+        mask != 0 && N < NMAX_SPRITES;
+        mask&= mask-1 )
     {
-      row= _render.lines + 16 - *p;
-      if ( row >= 0 && row < max_row )
-        {
-          buffer[N].obj= p;
-          buffer[N].row= row;
-          if ( ++N == NMAX_SPRITES ) break;
-        }
+      p= &(_oam[lowest_bit ( mask )<<2]);
+      buffer[N].obj= p;
+      buffer[N].row= _render.lines + 16 - *p;
+      ++N;
     }
   
-  /* VRAM bank i paletes. */
-  tram= &(_vram[0][0]);
-  
   /* PINTA. */
-  clear_line_obj ();
+  clear_line_obj ( m );
   for ( n= N-1; n >= 0; --n )
     {
       
       p= buffer[n].obj;
       row= buffer[n].row;
       
-      /* NT, ATTR i tram. */
+      /* NT i ATTR. */
       NT= p[2];
       ATTR= p[3];
-      
-      /* Calcula addr_pat. */
-      if ( _control.obj_size16 ) NT&= 0xFE;
-      if ( ATTR&0x40 /* Y-FLIP */)
-        row= max_row - row - 1;
-      addr_pat= (((GBCu16) NT)<<4) | (row<<1);
-      
-      /* Prepara renderitzat. */
-      if ( ATTR&0x20 /* X-FLIP */ )
-        {
-          bp0= reverse_byte ( tram[addr_pat] );
-          bp1= reverse_byte ( tram[addr_pat|1] );
-        }
-      else
-        {
-          bp0= tram[addr_pat];
-          bp1= tram[addr_pat|1];
-        }
       end= p[1]; begin= end - 8;
       if ( end == 0 ) continue;
       end= MIN ( end, 160 );
+      
+      /* Fila del tile. */
+      if ( _control.obj_size16 ) NT&= 0xFE;
+      if ( ATTR&VFLIP ) row= max_row - row - 1;
+      pix= get_tile_row ( m, 0, NT + (row>>3), row&0x7, (ATTR&HFLIP)!=0 );
+      
+      /* Paleta. */
       if ( ATTR&0x10 )
         {
-          pal= &(_cpal.ob.v[1][0]);
+          pal= _slots[9];
           mpal= &(_mpal.ob1[0]);
         }
       else
         {
-          pal= &(_cpal.ob.v[0][0]);
+          pal= _slots[8];
           mpal= &(_mpal.ob0[0]);
         }
-      prio= (ATTR>>7);
+      for ( i= 0; i < 4; ++i )
+        cols[i]= pal[mpal[i]];
       
       /* Renderitza. */
-      for ( x= begin; x < 0; ++x ) { bp0<<= 1; bp1<<= 1; }
-      for ( ; x < end; ++x )
-        {
-          color= ((bp0>>7)&0x01) | ((bp1>>6)&0x02);
-          if ( color != 0 )
-            {
-              _render.line_obj[x]= pal[mpal[color]];
-              _render.prio_obj[x]= prio;
-            }
-          bp0<<= 1; bp1<<= 1;
-        }
+      draw_obj_tile ( m, pix, begin, end, cols, ATTR>>7 );
       
     }
   
@@ -669,15 +578,15 @@ render_line_obj_mono (void)
 
 
 static void
-render_line_bg_color (void)
+render_line_bg_color (
+                      GBC_Machine *m
+                      )
 {
   
-  int x, i, j, row, sel_bp, sel_bp_flip, sel_pal, color;
-  const int *pal[2];
-  GBCu8 NT, ATTR;
-  GBCu16 addr, addr_row, addr_col, addr_pat, desp0, desp1,
-    bp0, bp1, bpal, bprio;
-  const GBCu8 *tram;
+  int x, row;
+  GBCu8 ATTR;
+  GBCu16 addr, addr_row, addr_col;
+  const GBCu8 *pix;
   
   
   /* Açò no pot passar en mode color. */
@@ -688,47 +597,33 @@ render_line_bg_color (void)
   if ( row >= 256 ) row-= 256;
   addr_row= _control.bg_tile_map | ((row&0xF8)<<2);
   
-  /* Selector de bitmap dins d'un patró. */
-  sel_bp= (row&0x7)<<1;
-  sel_bp_flip= (7<<1)-sel_bp;
-  
-  /* Columna inicial. */
-  addr_col= (GBCu16) (_pos.SCX>>3);
-  
-  /* Desplaçaments. */
-  desp0= 15 - (_pos.SCX&0x7);
-  desp1= desp0 - 1;
-  
   /* Renderitza. */
-  RENDER_LINE_BG_COLOR_INIT;
-  for ( x= i= 0; i < 20; ++i )
+  addr_col= (GBCu16) (_pos.SCX>>3);
+  for ( x= -(_pos.SCX&0x7); x < 160; x+= 8 )
     {
-      GET_NEXT_NT_COLOR;
-      CALC_ADDR_PAT_COLOR;
-      GET_NEXT_BP_COLOR;
-      for ( j= 0; j < 8; ++j, ++x )
-        {
-          color= ((bp0>>desp0)&0x01) | ((bp1>>desp1)&0x02);
-          _render.line_bg[x]= pal[(bpal>>desp0)&0x1][color];
-          _render.prio_bg[x]= color==0 ? -1 : ((bprio>>desp0)&0x01);
-          bp0<<= 1; bp1<<= 1;
-          bpal<<= 1; bprio<<= 1;
-        }
+      addr= addr_row|addr_col;
+      ATTR= _vram[1][addr];
+      pix= get_tile_row ( m, (ATTR&0x08)>>3, BGWIN_TILE ( _vram[0][addr] ),
+        		  (ATTR&VFLIP) ? 7-(row&0x7) : row&0x7,
+        		  (ATTR&HFLIP)!=0 );
+      draw_bg_tile ( m, pix, x, _slots[ATTR&0x7],
+        	     (ATTR&BGPRIOR)!=0 );
+      addr_col= (addr_col+1)&0x1F;
     }
   
 } /* end render_line_bg_color */
 
 
 static void
-render_line_win_color (void)
+render_line_win_color (
+                       GBC_Machine *m
+                       )
 {
   
-  int x, i, row, sel_bp, sel_bp_flip, color;
-  const int *pal;
-  GBCu8 NT, ATTR, bp0, bp1;
-  GBCu16 addr, addr_row, addr_col, addr_pat;
-  const GBCu8 *tram;
-  signed char prio;
+  int x, row;
+  GBCu8 ATTR;
+  GBCu16 addr, addr_row, addr_col;
+  const GBCu8 *pix;
   
   
   /* Si no està activa no fa res. */
@@ -739,47 +634,25 @@ render_line_win_color (void)
   if ( row < 0 ) return;
   addr_row= _control.win_tile_map | ((row&0xF8)<<2);
   
-  /* Selector de bitmap dins d'un patró. */
-  sel_bp= (row&0x7)<<1;
-  sel_bp_flip= (7<<1)-sel_bp;
-  
-  /* Columna inicial. */
-  addr_col= 0x0000;
-  
-  /* Renderitza primer tile (Pot apareixer fora de la pantalla). */
-  x= _pos.WX-7;
-  GET_NEXT_NT_COLOR_WIN;
-  CALC_ADDR_PAT_COLOR_WIN;
-  GET_NEXT_BP_COLOR_WIN;
-  for ( i= 0; x < 0; ++x, ++i ) { bp0<<= 1; bp1<<= 1; }
-  for ( ; i < 8 && x < 160; ++x, ++i )
-    {
-      color= ((bp0>>7)&0x01) | ((bp1>>6)&0x02);
-      _render.line_bg[x]= pal[color];
-      _render.prio_bg[x]= color==0 ? -1 : prio;
-      bp0<<= 1; bp1<<= 1;
-    }
-  if ( x == 160 ) return;
-  
-  /* Renderitza resta. */
-  do {
-    GET_NEXT_NT_COLOR_WIN;
-    CALC_ADDR_PAT_COLOR_WIN;
-    GET_NEXT_BP_COLOR_WIN;
-    for ( i= 0; i < 8 && x < 160; ++x, ++i )
-      {
-        color= ((bp0>>7)&0x01) | ((bp1>>6)&0x02);
-        _render.line_bg[x]= pal[color];
-        _render.prio_bg[x]= color==0 ? -1 : prio;
-        bp0<<= 1; bp1<<= 1;
-      }
-  } while ( x < 160 );
+  /* Renderitza (el primer tile pot apareixer fora de la pantalla). */
+  for ( x= _pos.WX-7, addr_col= 0x0000; x < 160; x+= 8, ++addr_col )
+    {
+      addr= addr_row|addr_col;
+      ATTR= _vram[1][addr];
+      pix= get_tile_row ( m, (ATTR&0x08)>>3, BGWIN_TILE ( _vram[0][addr] ),
+        		  (ATTR&VFLIP) ? 7-(row&0x7) : row&0x7,
+        		  (ATTR&HFLIP)!=0 );
+      draw_bg_tile ( m, pix, x, _slots[ATTR&0x7],
+        	     (ATTR&BGPRIOR)!=0 );
+    }
   
 } /* end render_line_win_color */
 
 
 static void
-render_line_obj_color (void)
+render_line_obj_color (
+                       GBC_Machine *m
+                       )
 {
   
   /* NOTA: Com no es diu res en ninguna part de la documentació sobre
@@ -792,18 +665,16 @@ render_line_obj_color (void)
     const GBCu8 *obj;
     int          row;
   } buffer[NMAX_SPRITES];
-  int n, N, row, max_row, x, begin, end, color;
-  const GBCu8 *p, *tram;
-  GBCu8 NT, ATTR, bp0, bp1;
-  GBCu16 addr_pat;
-  const int *pal;
-  signed char prio;
+  int n, N, row, max_row, begin, end;
+  GBCu64 mask;
+  const GBCu8 *p, *pix;
+  GBCu8 NT, ATTR;
   
   
   /* Si no està activat. */
   if ( !_control.obj_enabled )
     {
-      clear_line_obj ();
+      clear_line_obj ( m );
       return;
     }
   
@@ -811,181 +682,1112 @@ render_line_obj_color (void)
   /* ATENCIÓ!!!! En mode B/N la prioritat no es basa en l'ordre. */
   max_row= _control.obj_size16 ? 16 : 8;
   N= 0;
-  for ( n= 0, p= &(_oam[0]); n < 40; ++n, p+= 4 )
+  for ( mask= _obj_lines[_render.lines];
+        mask != 0 && N < NMAX_SPRITES;
+        mask&= mask-1 )
     {
-      row= _render.lines + 16 - *p;
-      if ( row >= 0 && row < max_row )
-        {
-          buffer[N].obj= p;
-          buffer[N].row= row;
-          if ( ++N == NMAX_SPRITES ) break;
-        }
+      p= &(_oam[lowest_bit ( mask )<<2]);
+      buffer[N].obj= p;
+      buffer[N].row= _render.lines + 16 - *p;
+      ++N;
     }
   
   /* PINTA. */
-  clear_line_obj ();
+  clear_line_obj ( m );
   for ( n= N-1; n >= 0; --n )
     {
       
       p= buffer[n].obj;
       row= buffer[n].row;
       
-      /* NT, ATTR i tram. */
+      /* NT i ATTR. */
       NT= p[2];
       ATTR= p[3];
-      tram= &(_vram[(ATTR&0x08)>>3][0]);
-      
-      /* Calcula addr_pat. */
-      if ( _control.obj_size16 ) NT&= 0xFE;
-      if ( ATTR&0x40 /* Y-FLIP */)
-        row= max_row - row - 1;
-      addr_pat= (((GBCu16) NT)<<4) | (row<<1);
-      
-      /* Prepara renderitzat. */
-      if ( ATTR&0x20 /* X-FLIP */ )
-        {
-          bp0= reverse_byte ( tram[addr_pat] );
-          bp1= reverse_byte ( tram[addr_pat|1] );
-        }
-      else
-        {
-          bp0= tram[addr_pat];
-          bp1= tram[addr_pat|1];
-        }
       end= p[1]; begin= end - 8;
       if ( end == 0 ) continue;
       end= MIN ( end, 160 );
-      pal= &(_cpal.ob.v[ATTR&0x7][0]);
-      prio= (ATTR>>7);
+      
+      /* Fila del tile. */
+      if ( _control.obj_size16 ) NT&= 0xFE;
+      if ( ATTR&VFLIP ) row= max_row - row - 1;
+      pix= get_tile_row ( m, (ATTR&0x08)>>3, NT + (row>>3), row&0x7,
+        		  (ATTR&HFLIP)!=0 );
       
       /* Renderitza. */
-      for ( x= begin; x < 0; ++x ) { bp0<<= 1; bp1<<= 1; }
-      for ( ; x < end; ++x )
-        {
-          color= ((bp0>>7)&0x01) | ((bp1>>6)&0x02);
-          if ( color != 0 )
-            {
-              _render.line_obj[x]= pal[color];
-              _render.prio_obj[x]= prio;
-            }
-          bp0<<= 1; bp1<<= 1;
-        }
+      draw_obj_tile ( m, pix, begin, end, _slots[8|(ATTR&0x7)],
+        	      ATTR>>7 );
       
     }
   
 } /* end render_line_obj_color */
 
 
-static void
-render_line (void)
+/* Converteix un color BBBBBGGGGGRRRRR al format de la imatge, passant
+   per la taula de correcció si n'hi ha. */
+static GBCu32
+convert_color (
+               const GBC_FBFormat  format,
+               const GBCu32       *color_lut,
+               const int           color,
+               const int           slot
+               )
 {
   
-  int x, color_obj, bgprio;
+  GBCu8 bytes[4];
+  GBCu32 ret;
+  int r, g, b;
   
   
-  if ( !_control.enabled )
-    for ( x= 0; x < 160; ++x ) *(_render.p++)= 0x7FFF;
+  /* Components de 8 bits. */
+  if ( color_lut != NULL )
+    {
+      r= color_lut[color]&0xFF;
+      g= (color_lut[color]>>8)&0xFF;
+      b= (color_lut[color]>>16)&0xFF;
+    }
   else
     {
-      if ( _cgb_mode )
-        {
-          render_line_bg_color ();
-          render_line_win_color ();
-          render_line_obj_color ();
-        }
-      else
-        {
-          render_line_bg_mono ();
-          render_line_win_mono ();
-          render_line_obj_mono ();
-        }
-      for ( x= 0; x < 160; ++x )
+      r= ((color&0x1F)*255+15)/31;
+      g= (((color>>5)&0x1F)*255+15)/31;
+      b= (((color>>10)&0x1F)*255+15)/31;
+    }
+  switch ( format )
+    {
+    case GBC_FB_RGBA8888:
+    case GBC_FB_BGRA8888:
+      bytes[format==GBC_FB_RGBA8888 ? 0 : 2]= (GBCu8) r;
+      bytes[1]= (GBCu8) g;
+      bytes[format==GBC_FB_RGBA8888 ? 2 : 0]= (GBCu8) b;
+      bytes[3]= 0xFF;
+      memcpy ( &ret, bytes, 4 );
+      return ret;
+    case GBC_FB_RGB565:
+      return (GBCu32) (((r>>3)<<11) | ((g>>2)<<5) | (b>>3));
+    case GBC_FB_XRGB1555:
+      return (GBCu32) (((r>>3)<<10) | ((g>>3)<<5) | (b>>3));
+    case GBC_FB_INDEXED8: return (GBCu32) slot;
+    case GBC_FB_CGB15:
+    default: return (GBCu32) ((r>>3) | ((g>>3)<<5) | ((b>>3)<<10));
+    }
+  
+} /* end convert_color */
+
+
+/* Component de 8 bits a partir d'un valor entre 0 i 1. */
+static GBCu32
+to_8bit (
+         const double val
+         )
+{
+  return val<=0.0 ? 0 : (val>=1.0 ? 255 : (GBCu32) (val*255.0 + 0.5));
+} /* end to_8bit */
+
+
+/* Calcula la taula de correcció del perfil indicat. */
+static void
+build_color_lut (
+        	 GBCu32                    *lut,
+        	 const GBC_LCDColorProfile  profile,
+        	 const double               matrix[3][3]
+        	 )
+{
+  
+  int color, r, g, b, R, G, B;
+  double lr, lg, lb;
+  
+  
+  for ( color= 0; color < 32768; ++color )
+    {
+      r= color&0x1F; g= (color>>5)&0x1F; b= (color>>10)&0x1F;
+      switch ( profile )
         {
-          color_obj= _render.line_obj[x];
-          bgprio= _render.prio_bg[x];
-          *(_render.p++)=
-            color_obj != -1 && (bgprio == -1 ||
-        			_control.obj_has_prio ||
-        			(!bgprio && !_render.prio_obj[x])) ?
-            color_obj : _render.line_bg[x];
+          
+          /* Colors menys saturats i més foscos, com en la pantalla
+             de la GBC. */
+        case GBC_LCD_COLOR_CGB:
+          R= r*26 + g*4 + b*2;
+          G= g*24 + b*8;
+          B= r*6 + g*4 + b*22;
+          lut[color]= (GBCu32) ((R>960 ? 960 : R)>>2) |
+            ((GBCu32) ((G>960 ? 960 : G)>>2)<<8) |
+            ((GBCu32) ((B>960 ? 960 : B)>>2)<<16);
+          break;
+          
+          /* La pantalla de la GBA té una gamma de 4 i els canals es
+             mesclen. S'aplica una gamma de 2.2 a l'eixida. */
+        case GBC_LCD_COLOR_GBA:
+          lr= pow ( r/31.0, 4.0 );
+          lg= pow ( g/31.0, 4.0 );
+          lb= pow ( b/31.0, 4.0 );
+          lut[color]=
+            to_8bit ( pow ( (255*lr + 50*lg)/255.0, 1/2.2 )*
+        	      (255.0/280.0) ) |
+            (to_8bit ( pow ( (10*lr + 230*lg + 30*lb)/255.0, 1/2.2 )*
+        	       (255.0/280.0) )<<8) |
+            (to_8bit ( pow ( (50*lr + 10*lg + 220*lb)/255.0, 1/2.2 )*
+        	       (255.0/280.0) )<<16);
+          break;
+          
+        case GBC_LCD_COLOR_CUSTOM:
+        default:
+          lr= r/31.0; lg= g/31.0; lb= b/31.0;
+          lut[color]=
+            to_8bit ( matrix[0][0]*lr + matrix[0][1]*lg + matrix[0][2]*lb ) |
+            (to_8bit ( matrix[1][0]*lr + matrix[1][1]*lg +
+        	       matrix[1][2]*lb )<<8) |
+            (to_8bit ( matrix[2][0]*lr + matrix[2][1]*lg +
+        	       matrix[2][2]*lb )<<16);
         }
     }
-  ++_render.lines;
   
-} /* end render_line */
+} /* end build_color_lut */
 
 
+/* Actualitza el color de l'entrada SLOT en la taula de conversió. */
 static void
-render_lines (
-              const int lines
-              )
+update_lut (
+            GBC_Machine *m,
+            const int    slot
+            )
 {
   
-  int i;
+  int color;
   
   
-  for ( i= 0; i < lines; ++i )
-    render_line ();
+  if ( slot < SLOT_OB ) color= _cpal.bg.v[slot>>2][slot&0x3];
+  else if ( slot < SLOT_WHITE ) color= _cpal.ob.v[(slot>>2)&0x7][slot&0x3];
+  else color= slot==SLOT_WHITE ? 0x7FFF : 0x0000;
+  _out.lut[slot]= convert_color ( _out.format, _out.color_lut, color, slot );
+  _out.pal_changed= GBC_TRUE;
   
-} /* end render_lines */
+} /* end update_lut */
 
 
 static void
-run (
-     const int Yb,
-     const int Xb,
-     const int Ye,
-     const int Xe
-     )
+update_luts (
+             GBC_Machine *m
+             )
 {
   
-  int lines;
+  int i;
   
   
-  if ( Yb < 144 )
-    {
-      if ( Ye < 144 )
-        {
-          lines= Ye - Yb + (Xe>=CICLESTOM0) - (Xb>=CICLESTOM0);
-          render_lines ( lines );
-        }
-      else
-        {
-          lines= 144 - Yb - (Xb>=CICLESTOM0);
-          render_lines ( lines );
-        }
-    }
-  if ( _render.lines == 144 )
+  for ( i= 0; i < NSLOTS; ++i )
+    update_lut ( m, i );
+  
+} /* end update_luts */
+
+
+/* Grandària en bytes d'un píxel de la imatge. */
+static size_t
+pixel_size (
+            const GBC_FBFormat format
+            )
+{
+  
+  switch ( format )
     {
-      _update_screen ( _render.fb, _udata );
-      _render.p= &(_render.fb[0]);
-      _render.lines= 0;
+    case GBC_FB_RGBA8888:
+    case GBC_FB_BGRA8888: return 4;
+    case GBC_FB_RGB565:
+    case GBC_FB_XRGB1555: return 2;
+    case GBC_FB_INDEXED8: return 1;
+    case GBC_FB_CGB15:
+    default: return sizeof(int);
     }
   
-} /* end run */
+} /* end pixel_size */
 
 
-static void
-clock (void)
+/* Torna la imatge on es renderitza. Amb l'anell activat SLOT indica
+   el buffer. */
+static GBCu8 *
+get_fb (
+        GBC_Machine *m,
+        const int    slot
+        )
 {
   
-  int newY, newX;
+  if ( _ring.n > 0 ) return &(_ring.mem[slot*_ring.size]);
+  else if ( _out.format == GBC_FB_CGB15 ) return (GBCu8 *) &(_render.fb[0]);
+  else return (GBCu8 *) &(_out.fb);
   
+} /* end get_fb */
+
+
+/* Torna la imatge on s'està renderitzant el frame actual o NULL si
+   l'anell està activat i no es té cap buffer. */
+static GBCu8 *
+get_cur_fb (
+            GBC_Machine *m
+            )
+{
   
-  if ( _stop || !_control.enabled )
-    {
-      _timing.cc= 0;
-      return;
-    }
+  if ( _ring.n > 0 && _ring.cur == -1 ) return NULL;
+  else return get_fb ( m, _ring.cur );
   
-  /* Actualitza comptadors. */
-  _timing.ccto0Int-= _timing.cc;
-  if ( _timing.ccto0Int <= 0 && _dma.active )
-    {
-      _timing.cc+= 8;
+} /* end get_cur_fb */
+
+
+/* Escriu la línia composta en la imatge. */
+static void
+write_line (
+            GBC_Machine *m
+            )
+{
+  
+  int x;
+  size_t offset;
+  const int *line;
+  const GBCu32 *lut;
+  GBCu8 *dst;
+  const GBCu8 *old;
+  GBCu32 color, diff;
+  
+  
+  /* Al mateix temps que s'escriu es compara amb la línia de l'últim
+     frame lliurat. Sense anell és el que hi ha en la imatge. */
+  offset= _render.lines*160*pixel_size ( _out.format );
+  dst= get_fb ( m, _ring.cur ) + offset;
+  if ( _ring.n == 0 ) old= dst;
+  else if ( _ring.prev != -1 ) old= get_fb ( m, _ring.prev ) + offset;
+  else old= NULL;
+  line= &(_out.line[0]);
+  lut= &(_out.lut[0]);
+  diff= old==NULL;
+  if ( old == NULL ) old= dst;
+  switch ( _out.format )
+    {
+    case GBC_FB_RGBA8888:
+    case GBC_FB_BGRA8888:
+      for ( x= 0; x < 160; ++x )
+        {
+          color= lut[line[x]];
+          diff|= ((const GBCu32 *) old)[x]^color;
+          ((GBCu32 *) dst)[x]= color;
+        }
+      break;
+    case GBC_FB_RGB565:
+    case GBC_FB_XRGB1555:
+      for ( x= 0; x < 160; ++x )
+        {
+          color= lut[line[x]];
+          diff|= ((const GBCu16 *) old)[x]^color;
+          ((GBCu16 *) dst)[x]= (GBCu16) color;
+        }
+      break;
+    case GBC_FB_INDEXED8:
+      for ( x= 0; x < 160; ++x )
+        {
+          diff|= old[x]^(GBCu32) line[x];
+          dst[x]= (GBCu8) line[x];
+        }
+      break;
+    case GBC_FB_CGB15:
+    default:
+      for ( x= 0; x < 160; ++x )
+        {
+          color= lut[line[x]];
+          diff|= ((GBCu32) ((const int *) old)[x])^color;
+          ((int *) dst)[x]= (int) color;
+        }
+    }
+  if ( diff != 0 )
+    _out.dirty[_render.lines>>5]|= 1U<<(_render.lines&0x1F);
+  _render.p+= 160;
+  
+} /* end write_line */
+
+
+#ifndef __GNUC__
+static unsigned
+load_locked (
+             GBC_Machine    *m,
+             const unsigned *p
+             )
+{
+  
+  unsigned ret;
+  
+  
+  pthread_mutex_lock ( &(_ring.lock) );
+  ret= *p;
+  pthread_mutex_unlock ( &(_ring.lock) );
+  
+  return ret;
+  
+} /* end load_locked */
+
+
+static void
+store_locked (
+              GBC_Machine    *m,
+              unsigned       *p,
+              const unsigned  val
+              )
+{
+  
+  pthread_mutex_lock ( &(_ring.lock) );
+  *p= val;
+  pthread_mutex_unlock ( &(_ring.lock) );
+  
+} /* end store_locked */
+#endif
+
+
+/* Afegeix V a la cua. Sols la crida el productor. Torna GBC_FALSE si
+   està plena. */
+static GBC_Bool
+queue_push (
+            GBC_Machine *m,
+            spsc_t      *q,
+            const int    v
+            )
+{
+  
+  unsigned tail, next;
+  
+  
+  tail= q->tail;
+  next= (tail+1)%q->size;
+  if ( next == LOAD_ACQ ( m, &(q->head) ) ) return GBC_FALSE;
+  q->v[tail]= v;
+  STORE_REL ( m, &(q->tail), next );
+  
+  return GBC_TRUE;
+  
+} /* end queue_push */
+
+
+/* Trau el primer element de la cua. Sols la crida el consumidor. Torna
+   -1 si està buida. */
+static int
+queue_pop (
+           GBC_Machine *m,
+           spsc_t      *q
+           )
+{
+  
+  unsigned head;
+  int v;
+  
+  
+  head= q->head;
+  if ( head == LOAD_ACQ ( m, &(q->tail) ) ) return -1;
+  v= q->v[head];
+  STORE_REL ( m, &(q->head), (head+1)%q->size );
+  
+  return v;
+  
+} /* end queue_pop */
+
+
+/* Desperta als fils que esperen en l'anell. */
+static void
+ring_wakeup (
+             GBC_Machine *m
+             )
+{
+  
+  pthread_mutex_lock ( &(_ring.lock) );
+  pthread_cond_broadcast ( &(_ring.cond) );
+  pthread_mutex_unlock ( &(_ring.lock) );
+  
+} /* end ring_wakeup */
+
+
+/* Obté un buffer lliure per al següent frame. Torna GBC_FALSE si el
+   frame no s'ha de renderitzar. */
+static GBC_Bool
+ring_next_slot (
+                GBC_Machine *m
+                )
+{
+  
+  if ( (_ring.cur= queue_pop ( m, &(_ring.free) )) != -1 ) return GBC_TRUE;
+  if ( _ring.policy == GBC_FB_RING_DROP )
+    {
+      ++_ring.dropped;
+      return GBC_FALSE;
+    }
+  pthread_mutex_lock ( &(_ring.lock) );
+  while ( (_ring.cur= queue_pop ( m, &(_ring.free) )) == -1 )
+    pthread_cond_wait ( &(_ring.cond), &(_ring.lock) );
+  pthread_mutex_unlock ( &(_ring.lock) );
+  
+  return GBC_TRUE;
+  
+} /* end ring_next_slot */
+
+
+/* Publica el frame renderitzat en el buffer actual. */
+static void
+ring_publish (
+              GBC_Machine            *m,
+              const GBC_FrameChanges *changes
+              )
+{
+  
+  _ring.slots[_ring.cur].changes= *changes;
+  _ring.slots[_ring.cur].number= _ring.frames++;
+  queue_push ( m, &(_ring.ready), _ring.cur );
+  _ring.prev= _ring.cur;
+  _ring.cur= -1;
+  ring_wakeup ( m );
+  
+} /* end ring_publish */
+
+
+/* Allibera la memòria de l'anell. */
+static void
+ring_free (
+           GBC_Machine *m
+           )
+{
+  
+  if ( _ring.n == 0 ) return;
+  free ( _ring.mem );
+  free ( _ring.slots );
+  free ( _ring.ready.v );
+  free ( _ring.free.v );
+  pthread_cond_destroy ( &(_ring.cond) );
+  pthread_mutex_destroy ( &(_ring.lock) );
+  _ring.n= 0;
+  _ring.cur= _ring.prev= -1;
+  
+} /* end ring_free */
+
+
+/* Marca totes les línies com modificades. */
+static void
+set_all_dirty (
+               GBC_Machine *m
+               )
+{
+  
+  int i;
+  
+  
+  for ( i= 0; i < 4; ++i )
+    _out.dirty[i]= 0xFFFFFFFF;
+  _out.dirty[4]= 0x0000FFFF;
+  
+} /* end set_all_dirty */
+
+
+/* Passa la imatge al 'frontend' amb les línies que han canviat des de
+   l'últim frame lliurat. */
+static void
+deliver_frame (
+               GBC_Machine *m
+               )
+{
+  
+  GBC_FrameChanges changes;
+  int i;
+  
+  
+  /* En mode indexat un canvi de paleta canvia tots els colors encara
+     que els índexs siguen els mateixos. */
+  if ( _out.format == GBC_FB_INDEXED8 && _out.pal_changed )
+    set_all_dirty ( m );
+  changes.identical= GBC_TRUE;
+  for ( i= 0; i < 5; ++i )
+    {
+      changes.dirty[i]= _out.dirty[i];
+      if ( _out.dirty[i] != 0 ) changes.identical= GBC_FALSE;
+      _out.dirty[i]= 0;
+    }
+  _out.pal_changed= GBC_FALSE;
+  if ( _ring.n > 0 ) ring_publish ( m, &changes );
+  else _update_screen ( get_fb ( m, -1 ), &changes, _udata );
+  
+} /* end deliver_frame */
+
+
+static void
+render_line (
+             GBC_Machine *m
+             )
+{
+  
+  int x;
+  
+  
+  if ( !_control.enabled )
+    for ( x= 0; x < 160; ++x ) _out.line[x]= SLOT_WHITE;
+  else
+    {
+      if ( _cgb_mode )
+        {
+          render_line_bg_color ( m );
+          render_line_win_color ( m );
+          render_line_obj_color ( m );
+        }
+      else
+        {
+          render_line_bg_mono ( m );
+          render_line_win_mono ( m );
+          render_line_obj_mono ( m );
+        }
+      _kernels->blend ( _out.line, _render.line_bg, _render.line_obj,
+        		_render.prio_bg, _render.prio_obj,
+        		_control.obj_has_prio );
+    }
+  write_line ( m );
+  ++_render.lines;
+  
+} /* end render_line */
+
+
+/* Decideix si el següent frame es renderitza o es bota. */
+static void
+next_frame (
+            GBC_Machine *m
+            )
+{
+  
+  if ( _skip.n < 0 ) _skip.frame= GBC_TRUE;
+  else if ( _skip.count >= _skip.n )
+    {
+      _skip.count= 0;
+      _skip.frame= GBC_FALSE;
+    }
+  else
+    {
+      ++_skip.count;
+      _skip.frame= GBC_TRUE;
+    }
+  if ( !_skip.frame && _ring.n > 0 )
+    _skip.frame= !ring_next_slot ( m );
+  
+} /* end next_frame */
+
+
+static void
+render_lines (
+              GBC_Machine *m,
+              const int lines
+              )
+{
+  
+  int i;
+  
+  
+  /* En els frames que es boten sols s'avança la posició. */
+  if ( _skip.frame )
+    {
+      _render.lines+= lines;
+      _render.p+= lines*160;
+      return;
+    }
+  for ( i= 0; i < lines; ++i )
+    render_line ( m );
+  
+} /* end render_lines */
+
+
+/* Assigna els camps del registre de control excepte l'activació del
+   LCD. */
+static void
+set_control (
+             GBC_Machine *m,
+             const GBCu8  data
+             )
+{
+  
+  _control.data= data;
+  _control.win_tile_map= (data&0x40) ? 0x1C00 : 0x1800;
+  _control.b5= _control.win_enabled= ((data&0x20)!=0);
+  _control.bgwin_tile_data= ((data&0x10)!=0);
+  _control.bg_tile_map= (data&0x08) ? 0x1C00 : 0x1800;
+  if ( _control.obj_size16 != ((data&0x04)!=0) )
+    {
+      _control.obj_size16= ((data&0x04)!=0);
+      build_obj_lines ( m );
+    }
+  _control.obj_enabled= ((data&0x02)!=0);
+  if ( _cgb_mode ) _control.obj_has_prio= ((data&0x1)==0);
+  else
+    {
+      if ( data&0x01 ) _control.bg_enabled= GBC_TRUE;
+      else
+        {
+          _control.bg_enabled= GBC_FALSE;
+          _control.win_enabled= GBC_FALSE; /* Sobreescriu el bit 5. */
+        }
+    }
+  
+} /* end set_control */
+
+
+static void
+set_mpal (
+          const GBCu8 data,
+          GBCu8       pal[4]
+          )
+{
+  
+  pal[0]= data&0x3;
+  pal[1]= (data>>2)&0x3;
+  pal[2]= (data>>4)&0x3;
+  pal[3]= data>>6;
+  
+} /* end set_mpal */
+
+
+/* Aplica el valor VAL d'una escriptura registrada. */
+static void
+defer_apply (
+             GBC_Machine      *m,
+             const defer_op_t *op,
+             const GBCu16      val
+             )
+{
+  
+  int addr;
+  
+  
+  addr= op->addr;
+  switch ( op->type )
+    {
+    case DEFER_SCX: _pos.SCX= (GBCu8) val; break;
+    case DEFER_SCY: _pos.SCY= (GBCu8) val; break;
+    case DEFER_WX: _pos.WX= (GBCu8) val; break;
+    case DEFER_WY: _pos.WY= (GBCu8) val; break;
+    case DEFER_LCDC: set_control ( m, (GBCu8) val ); break;
+    case DEFER_MPAL:
+      set_mpal ( (GBCu8) val, addr==0 ? _mpal.bg :
+        	 (addr==1 ? _mpal.ob0 : _mpal.ob1) );
+      break;
+    case DEFER_CPAL:
+      if ( addr < SLOT_OB ) _cpal.bg.v[addr>>2][addr&0x3]= val;
+      else                  _cpal.ob.v[(addr>>2)&0x7][addr&0x3]= val;
+      update_lut ( m, addr );
+      break;
+    case DEFER_VRAM:
+      _vram[addr>>13][addr&0x1FFF]= (GBCu8) val;
+      if ( (addr&0x1FFF) < 0x1800 )
+        _tiles.valid[addr>>13][(addr&0x1FFF)>>4]= GBC_FALSE;
+      break;
+    case DEFER_OAM:
+      if ( (addr&0x3) == 0 ) set_obj_y ( m, addr>>2, (GBCu8) val );
+      else _oam[addr]= (GBCu8) val;
+      break;
+    }
+  
+} /* end defer_apply */
+
+
+/* Renderitza fins a la línia LINES (exclosa) aplicant les N
+   escriptures de LOG abans de la primera línia a la que afecten. Les
+   que queden s'apliquen al final. */
+static void
+replay_log (
+            GBC_Machine      *m,
+            const defer_op_t *log,
+            const int         n,
+            const int         lines
+            )
+{
+  
+  int i;
+  
+  
+  for ( i= 0; _render.lines < lines; )
+    {
+      for ( ; i < n && log[i].line <= _render.lines; ++i )
+        defer_apply ( m, &(log[i]), log[i].val );
+      render_lines ( m, 1 );
+    }
+  for ( ; i < n; ++i )
+    defer_apply ( m, &(log[i]), log[i].val );
+  
+} /* end replay_log */
+
+
+/* Renderitza les línies que el LCD ja ha recorregut. Si hi ha
+   escriptures registrades es desfan per tornar a l'estat de la
+   primera línia pendent i es tornen a aplicar línia a línia. */
+static void
+defer_flush (
+             GBC_Machine *m
+             )
+{
+  
+  int i;
+  GBC_Bool pal_changed;
+  
+  
+  if ( _defer.n == 0 )
+    {
+      render_lines ( m, _defer.lines - _render.lines );
+      return;
+    }
+  
+  /* Desfà. */
+  pal_changed= _out.pal_changed;
+  for ( i= _defer.n-1; i >= 0; --i )
+    defer_apply ( m, &(_defer.log[i]), _defer.log[i].old );
+  
+  /* Renderitza i torna a aplicar. */
+  replay_log ( m, _defer.log, _defer.n, _defer.lines );
+  _defer.n= 0;
+  
+  /* Les escriptures ja havien marcat el canvi de paleta. */
+  _out.pal_changed= pal_changed;
+  
+} /* end defer_flush */
+
+
+/* Fil de renderitzat. Renderitza sobre 'rm' el frame que li passa
+   'thread_end_frame'. */
+static void *
+thread_main (
+             void *arg
+             )
+{
+  
+  lcd_thread_t *t;
+  
+  
+  t= (lcd_thread_t *) arg;
+  pthread_mutex_lock ( &(t->lock) );
+  for (;;)
+    {
+      while ( t->state == THREAD_IDLE || t->state == THREAD_DONE )
+        pthread_cond_wait ( &(t->cond), &(t->lock) );
+      if ( t->state == THREAD_QUIT ) break;
+      pthread_mutex_unlock ( &(t->lock) );
+      t->rm->lcd.skip.frame= t->job_skip;
+      replay_log ( t->rm, t->log[t->cur^1], t->n[t->cur^1], 144 );
+      pthread_mutex_lock ( &(t->lock) );
+      t->state= THREAD_DONE;
+      pthread_cond_broadcast ( &(t->cond) );
+    }
+  pthread_mutex_unlock ( &(t->lock) );
+  
+  return NULL;
+  
+} /* end thread_main */
+
+
+/* Espera a que el fil acabe el frame que està renderitzant i el
+   lliura. En mode comprovació abans el compara amb el renderitzat en
+   línia. */
+static void
+thread_wait (
+             GBC_Machine *m
+             )
+{
+  
+  lcd_thread_t *t;
+  GBC_Machine *rm;
+  
+  
+  t= _thread;
+  rm= t->rm;
+  pthread_mutex_lock ( &(t->lock) );
+  while ( t->state == THREAD_BUSY )
+    pthread_cond_wait ( &(t->cond), &(t->lock) );
+  if ( t->state != THREAD_DONE )
+    {
+      pthread_mutex_unlock ( &(t->lock) );
+      return;
+    }
+  t->state= THREAD_IDLE;
+  pthread_mutex_unlock ( &(t->lock) );
+  if ( !t->job_skip )
+    {
+      if ( t->check &&
+           memcmp ( get_fb ( rm, -1 ), t->check_fb,
+        	    23040*pixel_size ( _out.format ) ) != 0 &&
+           t->mismatches++ == 0 )
+        _warning ( _udata, "el fil de renderitzat ha generat un frame"
+        	   " diferent al renderitzat en línia" );
+      deliver_frame ( rm );
+    }
+  rm->lcd.render.p= &(rm->lcd.render.fb[0]);
+  rm->lcd.render.lines= 0;
+  
+} /* end thread_wait */
+
+
+/* Passa al fil el frame actual, que el LCD acaba de recórrer, i
+   comença el següent. */
+static void
+thread_end_frame (
+        	  GBC_Machine *m
+        	  )
+{
+  
+  lcd_thread_t *t;
+  
+  
+  t= _thread;
+  thread_wait ( m );
+  if ( t->check && !_skip.frame )
+    {
+      memcpy ( t->check_fb, get_fb ( m, -1 ),
+               23040*pixel_size ( _out.format ) );
+      memset ( _out.dirty, 0, sizeof(_out.dirty) );
+      _out.pal_changed= GBC_FALSE;
+    }
+  t->job_skip= _skip.frame;
+  t->cur^= 1;
+  t->n[t->cur]= 0;
+  pthread_mutex_lock ( &(t->lock) );
+  t->state= THREAD_BUSY;
+  pthread_cond_broadcast ( &(t->cond) );
+  pthread_mutex_unlock ( &(t->lock) );
+  
+  _render.p= &(_render.fb[0]);
+  _render.lines= 0;
+  _defer.lines= 0;
+  next_frame ( m );
+  
+} /* end thread_end_frame */
+
+
+/* Espera al fil i renderitza en 'rm' la part del frame actual que ja
+   s'ha recorregut. Sense comprovació el resultat es copia en
+   l'estat. */
+static void
+thread_join (
+             GBC_Machine *m
+             )
+{
+  
+  lcd_thread_t *t;
+  GBC_Machine *rm;
+  
+  
+  t= _thread;
+  rm= t->rm;
+  thread_wait ( m );
+  if ( !t->check )
+    {
+      rm->lcd.skip.frame= _skip.frame;
+      replay_log ( rm, t->log[t->cur], t->n[t->cur], _defer.lines );
+      _render= rm->lcd.render;
+      _render.p= &(_render.fb[0]) + _render.lines*160;
+      _out= rm->lcd.out;
+    }
+  t->n[t->cur]= 0;
+  
+} /* end thread_join */
+
+
+/* Torna a copiar l'estat en 'rm' després de 'thread_join'. */
+static void
+thread_resume (
+               GBC_Machine *m
+               )
+{
+  
+  GBC_Machine *rm;
+  
+  
+  rm= _thread->rm;
+  rm->lcd= m->lcd;
+  rm->lcd.render.p= &(rm->lcd.render.fb[0]) + rm->lcd.render.lines*160;
+  rm->lcd.cvram= &(rm->lcd.vram[rm->lcd.vram_selected&0x1][0]);
+  
+} /* end thread_resume */
+
+
+static void
+thread_free (
+             GBC_Machine *m
+             )
+{
+  
+  lcd_thread_t *t;
+  
+  
+  if ( (t= _thread) == NULL ) return;
+  pthread_mutex_lock ( &(t->lock) );
+  t->state= THREAD_QUIT;
+  pthread_cond_broadcast ( &(t->cond) );
+  pthread_mutex_unlock ( &(t->lock) );
+  pthread_join ( t->thread, NULL );
+  pthread_cond_destroy ( &(t->cond) );
+  pthread_mutex_destroy ( &(t->lock) );
+  free ( t->rm );
+  free ( t->log[0] );
+  free ( t->log[1] );
+  free ( t->check_fb );
+  free ( t );
+  _thread= NULL;
+  
+} /* end thread_free */
+
+
+/* Deixa renderitzat tot el que el LCD ja ha recorregut, per a poder
+   modificar l'estat sense passar pel registre. Després s'ha de cridar
+   a 'render_resume'. */
+static void
+render_pause (
+              GBC_Machine *m
+              )
+{
+  
+  if ( _thread != NULL ) thread_join ( m );
+  if ( _thread == NULL || _thread->check ) defer_flush ( m );
+  
+} /* end render_pause */
+
+
+static void
+render_resume (
+               GBC_Machine *m
+               )
+{
+  
+  if ( _thread != NULL ) thread_resume ( m );
+  
+} /* end render_resume */
+
+
+/* Registra una escriptura que afecta al renderitzat. S'ha de cridar
+   abans de modificar l'estat. Sols cal registrar-la si hi ha línies
+   recorregudes que encara no s'han renderitzat. */
+static void
+defer_log (
+           GBC_Machine *m,
+           const int    type,
+           const int    addr,
+           const int    old,
+           const int    val
+           )
+{
+  
+  defer_op_t *op;
+  lcd_thread_t *t;
+  
+  
+  /* El fil de renderitzat necessita totes les escriptures. */
+  if ( (t= _thread) != NULL )
+    {
+      if ( t->n[t->cur] == GBC_LCD_THREAD_LOG_SIZE )
+        {
+          render_pause ( m );
+          render_resume ( m );
+        }
+      op= &(t->log[t->cur][t->n[t->cur]++]);
+      op->line= (GBCu8) _defer.lines;
+      op->type= (GBCu8) type;
+      op->addr= (GBCu16) addr;
+      op->old= (GBCu16) old;
+      op->val= (GBCu16) val;
+      if ( !t->check ) return;
+    }
+  
+  if ( _defer.lines == _render.lines || _skip.frame ) return;
+  if ( _defer.n == GBC_LCD_DEFER_LOG_SIZE )
+    {
+      defer_flush ( m );
+      return;
+    }
+  op= &(_defer.log[_defer.n++]);
+  op->line= (GBCu8) _defer.lines;
+  op->type= (GBCu8) type;
+  op->addr= (GBCu16) addr;
+  op->old= (GBCu16) old;
+  op->val= (GBCu16) val;
+  
+} /* end defer_log */
+
+
+static void
+vram_dma_hblank_block (
+                       GBC_Machine *m
+                       )
+{
+  
+  int i;
+  GBCu8 data;
+  
+  
+  if ( (_dma.src >= 0x0000 && _dma.src < 0x8000) ||
+       (_dma.src >= 0xA000 && _dma.src < 0xE000) )
+    {
+      INVALIDATE_TILE ( _dma.dst );
+      for ( i= 0; i < 0x10; ++i, ++_dma.dst, ++_dma.src )
+        {
+          data= GBC_mem_read ( m, _dma.src );
+          defer_log ( m, DEFER_VRAM, VRAM_ADDR ( _dma.dst ),
+        	      _cvram[_dma.dst], data );
+          _cvram[_dma.dst]= data;
+        }
+    }
+  else { _dma.dst+= 0x10; _dma.src+= 10; }
+  
+} /* vram_dma_hblank_block */
+
+
+static void
+run (
+     GBC_Machine *m,
+     const int Yb,
+     const int Xb,
+     const int Ye,
+     const int Xe
+     )
+{
+  
+  if ( Yb < 144 )
+    {
+      if ( Ye < 144 )
+        _defer.lines+= Ye - Yb + (Xe>=CICLESTOM0) - (Xb>=CICLESTOM0);
+      else
+        _defer.lines+= 144 - Yb - (Xb>=CICLESTOM0);
+      
+      /* En mode diferit sols es renderitza al final del frame, i amb
+         el fil de renderitzat sols per a comprovar-lo. */
+      if ( (_thread == NULL || _thread->check) &&
+           (!_defer.enabled || _defer.lines == 144) )
+        defer_flush ( m );
+    }
+  if ( _thread != NULL )
+    {
+      if ( _defer.lines == 144 ) thread_end_frame ( m );
+    }
+  else if ( _render.lines == 144 )
+    {
+      if ( !_skip.frame ) deliver_frame ( m );
+      _render.p= &(_render.fb[0]);
+      _render.lines= 0;
+      _defer.lines= 0;
+      next_frame ( m );
+    }
+  
+} /* end run */
+
+
+static void
+update_clock (
+       GBC_Machine *m
+       )
+{
+  
+  int newY, newX;
+  
+  
+  if ( _stop || !_control.enabled )
+    {
+      _timing.cc= 0;
+      return;
+    }
+  
+  /* Actualitza comptadors. */
+  _timing.ccto0Int-= _timing.cc;
+  if ( _timing.ccto0Int <= 0 && _dma.active )
+    {
+      _timing.cc+= 8;
       _timing.extracc+= 8;
       _dma.dst&= 0x1FFF;
-      vram_dma_hblank_block ();
+      vram_dma_hblank_block ( m );
       if ( --_dma.length == 0xFF )
         {
           _dma.length= 0x7F;
@@ -1003,11 +1805,11 @@ clock (void)
   _timing.cc= 0;
   while ( newY >= 154 )
     {
-      run ( _pos.LY, _pos.LX, 154, 0 );
+      run ( m, _pos.LY, _pos.LX, 154, 0 );
       newY-= 154;
       _pos.LY= _pos.LX= 0;
     }
-  run ( _pos.LY, _pos.LX, newY, newX );
+  run ( m, _pos.LY, _pos.LX, newY, newX );
   _pos.LY= newY;
   _pos.LX= newX;
   
@@ -1021,9 +1823,9 @@ clock (void)
      cas demana interrupció. */
   if ( _timing.cctoVBInt <= 0 )
     {
-      GBC_cpu_request_vblank_int ();
+      GBC_cpu_request_vblank_int ( m );
       if ( _status.int1_enabled )
-        GBC_cpu_request_lcdstat_int ();
+        GBC_cpu_request_lcdstat_int ( m );
       if ( newY < 144 )
         _timing.cctoVBInt= (144-newY)*CICLESPERLINE - newX;
       else
@@ -1032,13 +1834,13 @@ clock (void)
   if ( _timing.cctoCInt <= 0 )
     {
       if ( _status.intC_enabled && _pos.LYC < 154 )
-        GBC_cpu_request_lcdstat_int ();
-      update_cctoCInt ();
+        GBC_cpu_request_lcdstat_int ( m );
+      update_cctoCInt ( m );
     }
   if ( _timing.ccto2Int <= 0 )
     {
       if ( _status.int2_enabled )
-        GBC_cpu_request_lcdstat_int ();
+        GBC_cpu_request_lcdstat_int ( m );
       /* S'entra en el mode 2 al principi de cada línia que no és del
          VBLANK. Per tant si ja estic en la última línia visible o més
          allà, aleshores són els cicles que falten per a la línia
@@ -1051,7 +1853,7 @@ clock (void)
   if ( _timing.ccto0Int <= 0 )
     {
       if ( _status.int0_enabled )
-        GBC_cpu_request_lcdstat_int ();
+        GBC_cpu_request_lcdstat_int ( m );
       if ( newY < 143 || (newY == 143 && newX < CICLESTOM0) )
         _timing.ccto0Int=
           (newX<CICLESTOM0)?CICLESTOM0-newX:CICLESPERLINE+CICLESTOM0-newX;
@@ -1059,16 +1861,17 @@ clock (void)
         _timing.ccto0Int= (154-newY)*CICLESPERLINE+CICLESTOM0-newX;
     }
   
-} /* end clock */
+} /* end update_clock */
 
 
 static GBCu8
 mpal_get (
+          GBC_Machine *m,
           const GBCu8 pal[4]
           )
 {
   
-  clock ();
+  update_clock ( m );
   
   return pal[0] | (pal[1]<<2) | (pal[2]<<4) | (pal[3]<<6);
   
@@ -1077,17 +1880,18 @@ mpal_get (
 
 static void
 mpal_set (
+          GBC_Machine *m,
           const GBCu8 data,
           GBCu8       pal[4]
           )
 {
   
-  clock ();
-  pal[0]= data&0x3;
-  pal[1]= (data>>2)&0x3;
-  pal[2]= (data>>4)&0x3;
-  pal[3]= data>>6;
-  
+  update_clock ( m );
+  defer_log ( m, DEFER_MPAL,
+              pal==_mpal.bg ? 0 : (pal==_mpal.ob0 ? 1 : 2),
+              pal[0] | (pal[1]<<2) | (pal[2]<<4) | (pal[3]<<6), data );
+  set_mpal ( data, pal );
+  
 } /* end mpal_set */
 
 
@@ -1112,13 +1916,14 @@ init_cpal (
 
 static void
 cpal_index (
+            GBC_Machine *m,
             const GBCu8  data,
             cpal_t      *pal
             )
 {
   
   if ( !_cgb_mode && _pal_lock ) return;
-  clock ();
+  update_clock ( m );
   pal->auto_increment= ((data&0x80)!=0);
   pal->high= (data&0x1);
   pal->c= (data>>1)&0x3;
@@ -1129,23 +1934,25 @@ cpal_index (
 
 static void
 cpal_write_data (
+        	 GBC_Machine *m,
         	 const GBCu8  data,
         	 cpal_t      *pal
         	 )
 {
   
+  int slot, color;
+  
+  
   if ( !_cgb_mode && _pal_lock ) return;
-  clock ();
+  update_clock ( m );
   if ( pal->high )
-    {
-      pal->v[pal->p][pal->c]&= 0xFF;
-      pal->v[pal->p][pal->c]|= ((GBCu16) (data&0x7F))<<8;
-    }
+    color= (pal->v[pal->p][pal->c]&0xFF) | (((int) (data&0x7F))<<8);
   else
-    {
-      pal->v[pal->p][pal->c]&= 0x7F00;
-      pal->v[pal->p][pal->c]|= data;
-    }
+    color= (pal->v[pal->p][pal->c]&0x7F00) | data;
+  slot= (pal==&_cpal.ob ? SLOT_OB : 0) + pal->p*4 + pal->c;
+  defer_log ( m, DEFER_CPAL, slot, pal->v[pal->p][pal->c], color );
+  pal->v[pal->p][pal->c]= color;
+  update_lut ( m, slot );
   if ( pal->auto_increment )
     {
       if ( (pal->high^= 1) == 0 )
@@ -1161,12 +1968,13 @@ cpal_write_data (
 
 static GBCu8
 cpal_read_data (
+        	GBC_Machine  *m,
         	const cpal_t *pal
         	)
 {
   
   if ( !_cgb_mode && _pal_lock ) return 0xFF;
-  clock ();
+  update_clock ( m );
   /*if ( _status.mode == 3 ) return 0xFF;*/
   if ( pal->high ) return (GBCu8) ((pal->v[pal->p][pal->c]&0x7F00)>>8);
   else             return (GBCu8) (pal->v[pal->p][pal->c]&0xFF);
@@ -1175,7 +1983,9 @@ cpal_read_data (
 
 
 static void
-clear_cc_num_int (void)
+clear_cc_num_int (
+                  GBC_Machine *m
+                  )
 {
   
   _timing.cctoVBInt= 144*CICLESPERLINE;
@@ -1185,6 +1995,64 @@ clear_cc_num_int (void)
 } /* end clear_cc_num_int */
 
 
+/* Colors RGBA8888 de les entrades de les paletes per als visors de la
+   VRAM. */
+static void
+view_colors (
+             GBC_Machine *m,
+             GBCu32       cols[NSLOTS]
+             )
+{
+  
+  int slot, color;
+  
+  
+  for ( slot= 0; slot < NSLOTS; ++slot )
+    {
+      if ( slot < SLOT_OB ) color= _cpal.bg.v[slot>>2][slot&0x3];
+      else if ( slot < SLOT_WHITE )
+        color= _cpal.ob.v[(slot>>2)&0x7][slot&0x3];
+      else color= slot==SLOT_WHITE ? 0x7FFF : 0x0000;
+      cols[slot]= convert_color ( GBC_FB_RGBA8888, _out.color_lut,
+        			  color, slot );
+    }
+  
+} /* end view_colors */
+
+
+/* Dibuixa en DST el tile TILE del banc BANK amb els colors COLS i el
+   volteig indicat en ATTR. Si TRANSP és cert el color 0 es deixa
+   transparent. */
+static void
+view_tile (
+           GBC_Machine    *m,
+           GBCu8          *dst,
+           const int       pitch,
+           const int       bank,
+           const int       tile,
+           const GBCu32    cols[4],
+           const GBCu8     attr,
+           const GBC_Bool  transp
+           )
+{
+  
+  int row, x;
+  const GBCu8 *pix;
+  GBCu32 *p;
+  
+  
+  for ( row= 0; row < 8; ++row )
+    {
+      pix= get_tile_row ( m, bank, tile, (attr&VFLIP) ? 7-row : row,
+        		  (attr&HFLIP)!=0 );
+      p= (GBCu32 *) (dst + row*pitch);
+      for ( x= 0; x < 8; ++x )
+        p[x]= (transp && pix[x] == 0) ? 0 : cols[pix[x]];
+    }
+  
+} /* end view_tile */
+
+
 
 
 /**********************/
@@ -1193,6 +2061,7 @@ clear_cc_num_int (void)
 
 int
 GBC_lcd_clock (
+               GBC_Machine *m,
                const int cc
                )
 {
@@ -1206,7 +2075,7 @@ GBC_lcd_clock (
        (_timing.cc >= _timing.ccto0Int &&
         (_status.int0_enabled || _dma.active )) ||
        (_timing.cc >= _timing.ccto2Int && _status.int2_enabled) )
-    clock ();
+    update_clock ( m );
   ret= _timing.extracc;
   _timing.extracc= 0;
   
@@ -1216,7 +2085,9 @@ GBC_lcd_clock (
 
 
 GBCu8
-GBC_lcd_control_read (void)
+GBC_lcd_control_read (
+                      GBC_Machine *m
+                      )
 {
   return _control.data;
 } /* end GBC_lcd_control_read */
@@ -1224,6 +2095,7 @@ GBC_lcd_control_read (void)
 
 void
 GBC_lcd_control_write (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       )
 {
@@ -1231,10 +2103,12 @@ GBC_lcd_control_write (
   GBC_Bool aux;
   
   
-  clock ();
+  update_clock ( m );
   
-  _control.data= data;
+  /* Activar o desactivar el LCD reinicia el frame. */
   aux= _control.enabled;
+  if ( aux != ((data&0x80)!=0) ) render_pause ( m );
+  else defer_log ( m, DEFER_LCDC, 0, _control.data, data );
   _control.enabled= ((data&0x80)!=0);
   if ( aux != _control.enabled && !_control.enabled )
     {
@@ -1242,86 +2116,82 @@ GBC_lcd_control_write (
         _warning ( _udata, "El LCD s'ha desactivat fora del període V-Blank" );
       */
       _timing.cc= 0;
-      clear_cc_num_int ();
+      clear_cc_num_int ( m );
       _pos.LY= _pos.LX= 0;
-      update_cctoCInt ();
+      update_cctoCInt ( m );
       _render.p= &(_render.fb[0]);
       _render.lines= 0;
+      _defer.lines= 0;
       _status.mode= 0;
       /* ACÍ PUC GENERAR UNA PANTALLA EN NEGRE. */
     }
-  _control.win_tile_map= (data&0x40) ? 0x1C00 : 0x1800;
-  _control.b5= _control.win_enabled= ((data&0x20)!=0);
-  _control.bgwin_tile_data= ((data&0x10)!=0);
-  _control.bg_tile_map= (data&0x08) ? 0x1C00 : 0x1800;
-  _control.obj_size16= ((data&0x04)!=0);
-  _control.obj_enabled= ((data&0x02)!=0);
-  if ( _cgb_mode ) _control.obj_has_prio= ((data&0x1)==0);
-  else
-    {
-      if ( data&0x01 ) _control.bg_enabled= GBC_TRUE;
-      else
-        {
-          _control.bg_enabled= GBC_FALSE;
-          _control.win_enabled= GBC_FALSE; /* Sobreescriu el bit 5. */
-        }
-    }
+  set_control ( m, data );
+  if ( aux != _control.enabled ) render_resume ( m );
   
 } /* end GBC_lcd_control_write */
 
 
 void
 GBC_lcd_cpal_bg_index (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       )
 {
-  cpal_index ( data, &_cpal.bg );
+  cpal_index ( m, data, &_cpal.bg );
 } /* end GBC_lcd_cpal_bg_index */
 
 
 void
 GBC_lcd_cpal_ob_index (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       )
 {
-  cpal_index ( data, &_cpal.ob );
+  cpal_index ( m, data, &_cpal.ob );
 } /* end GBC_lcd_cpal_ob_index */
 
 
 GBCu8
-GBC_lcd_cpal_bg_read_data (void)
+GBC_lcd_cpal_bg_read_data (
+                           GBC_Machine *m
+                           )
 {
-  return cpal_read_data ( &_cpal.bg );
+  return cpal_read_data ( m, &_cpal.bg );
 } /* end GBC_lcd_cpal_bg_read_data */
 
 
 GBCu8
-GBC_lcd_cpal_ob_read_data (void)
+GBC_lcd_cpal_ob_read_data (
+                           GBC_Machine *m
+                           )
 {
-  return cpal_read_data ( &_cpal.ob );
+  return cpal_read_data ( m, &_cpal.ob );
 } /* end GBC_lcd_cpal_ob_read_data */
 
 
 void
 GBC_lcd_cpal_bg_write_data (
+        		    GBC_Machine *m,
         		    const GBCu8 data
         		    )
 {
-  cpal_write_data ( data, &_cpal.bg );
+  cpal_write_data ( m, data, &_cpal.bg );
 } /* end GBC_lcd_cpal_bg_write_data */
 
 
 void
 GBC_lcd_cpal_ob_write_data (
+        		    GBC_Machine *m,
         		    const GBCu8 data
         		    )
 {
-  cpal_write_data ( data, &_cpal.ob );
+  cpal_write_data ( m, data, &_cpal.ob );
 } /* end GBC_lcd_cpal_ob_write_data */
 
 
 void
 GBC_lcd_get_cpal (
+        	  GBC_Machine *m,
         	  int bg[8][4],
         	  int ob[8][4]
         	  )
@@ -1341,14 +2211,18 @@ GBC_lcd_get_cpal (
 
 
 const GBCu8 *
-GBC_lcd_get_vram (void)
+GBC_lcd_get_vram (
+                  GBC_Machine *m
+                  )
 {
   return &(_vram[0][0]);
 } /* end GBC_lcd_get_vram */
 
 
 GBCu8
-GBC_lcd_get_vram_bank (void)
+GBC_lcd_get_vram_bank (
+                       GBC_Machine *m
+                       )
 {
   
   if ( !_cgb_mode ) return 0xFF;
@@ -1359,7 +2233,9 @@ GBC_lcd_get_vram_bank (void)
 
 void
 GBC_lcd_init (
+              GBC_Machine      *m,
               GBC_UpdateScreen *update_screen,
+              GBC_FBFormat      format,
               GBC_Warning      *warning,
               void             *udata
               )
@@ -1368,16 +2244,29 @@ GBC_lcd_init (
   _update_screen= update_screen;
   _warning= warning;
   _udata= udata;
-  
-  GBC_lcd_init_state ();
+  _kernels= GBC_lcd_get_kernels ( GBC_LCD_SIMD_AUTO );
+  _out.format= format;
+  _skip.n= 0;
+  _skip.count= 0;
+  _skip.frame= GBC_FALSE;
+  _ring.n= 0;
+  _ring.cur= _ring.prev= -1;
+  _defer.enabled= GBC_FALSE;
+  _thread= NULL;
+  
+  GBC_lcd_init_state ( m );
   
 } /* end GBC_lcd_init */
 
 
 void
-GBC_lcd_init_state (void)
+GBC_lcd_init_state (
+                    GBC_Machine *m
+                    )
 {
   
+  if ( _thread != NULL ) thread_join ( m );
+  
   /* Mode. */
   _cgb_mode= GBC_TRUE;
   _pal_lock= GBC_TRUE;
@@ -1412,7 +2301,7 @@ GBC_lcd_init_state (void)
   
   /* Tming. */
   _timing.cc= 0;
-  clear_cc_num_int ();
+  clear_cc_num_int ( m );
   _timing.cctoCInt= 0;
   
   /* Registres de posició. */
@@ -1424,11 +2313,14 @@ GBC_lcd_init_state (void)
   
   /* Memòria. */
   memset ( _vram[0], 0, BANK_SIZE*2 );
+  memset ( _tiles.valid, 0, sizeof(_tiles.valid) );
   _cvram= &(_vram[0][0]);
+  GBC_mem_map_vram ( m, _cvram );
   _vram_selected= 0x00;
   
   /* OAM. */
   memset ( _oam, 0, OAM_SIZE );
+  build_obj_lines ( m );
   
   /* DMA. */
   _dma.src= 0x0000;
@@ -1444,26 +2336,37 @@ GBC_lcd_init_state (void)
   /* Paleta de color. */
   init_cpal ( &_cpal.bg );
   init_cpal ( &_cpal.ob );
+  update_luts ( m );
   
   /* Renderitzat. */
   memset ( _render.fb, 0, 23040*sizeof(int) );
+  memset ( &(_out.fb), 0, sizeof(_out.fb) );
+  set_all_dirty ( m );
   memset ( _render.line_bg, 0, 160*sizeof(int) );
   memset ( _render.line_obj, 0, 160*sizeof(int) );
   memset ( _render.prio_bg, 0, 160 );
   memset ( _render.prio_obj, 0, 160 );
   _render.p= &(_render.fb[0]);
   _render.lines= 0;
+  _defer.lines= 0;
+  _defer.n= 0;
   
   /* Estat parat. */
   _stop= GBC_FALSE;
   
+  render_resume ( m );
+  
 } /* end GBC_lcd_init_state */
 
 
 void
-GBC_lcd_init_gray_pal (void)
+GBC_lcd_init_gray_pal (
+                       GBC_Machine *m
+                       )
 {
   
+  render_pause ( m );
+  
   /* BG/WIN. */
   _cpal.bg.v[0][0]= 32767;
   _cpal.bg.v[0][1]= 21140;
@@ -1482,21 +2385,66 @@ GBC_lcd_init_gray_pal (void)
   _cpal.ob.v[1][2]= 10570;
   _cpal.ob.v[1][3]= 0;
   
+  update_luts ( m );
+  render_resume ( m );
+  
 } /* end GBC_lcd_init_gray_pal */
 
 
 GBCu8
-GBC_lcd_ly_read (void)
+GBC_lcd_ly_read (
+                 GBC_Machine *m
+                 )
 {
   
-  clock ();
+  update_clock ( m );
   return (GBCu8) ((GBCs8) _pos.LY);
   
 } /* end GBC_lcd_ly_read */
 
 
+void
+GBC_lcd_get_stable (
+        	    GBC_Machine  *m,
+        	    const GBCu16  addr,
+        	    int          *since,
+        	    int          *until
+        	    )
+{
+  
+  int begin, end;
+  
+  
+  update_clock ( m );
+  if ( _stop || !_control.enabled )
+    {
+      *since= *until= INT_MAX;
+      return;
+    }
+  
+  /* LY canvia al principi de cada línia. STAT a més canvia amb el
+     mode dins de les línies visibles. */
+  begin= 0; end= CICLESPERLINE;
+  if ( addr == 0xFF41 && _pos.LY < 144 )
+    {
+      if ( _pos.LX > CICLESTOM0 ) begin= CICLESTOM0+1;
+      else if ( _pos.LX > CICLESTOM3 )
+        {
+          begin= CICLESTOM3+1;
+          end= CICLESTOM0+1;
+        }
+      else end= CICLESTOM3+1;
+    }
+  *since= _pos.LX - begin;
+  *until= end - _pos.LX;
+  
+} /* end GBC_lcd_get_stable */
+
+
 GBCu8
-GBC_lcd_lyc_read (void)
+GBC_lcd_lyc_read (
+                  GBC_Machine *m
+                  )
 {
   return (GBCu8) ((GBCs8) _pos.LYC);
 } /* end GBC_lcd_lyc_read */
@@ -1504,88 +2452,130 @@ GBC_lcd_lyc_read (void)
 
 void
 GBC_lcd_lyc_write (
+        	   GBC_Machine *m,
         	   const GBCu8 data
         	   )
 {
   
-  clock ();
+  update_clock ( m );
   _pos.LYC= (int) data;
-  update_cctoCInt ();
+  update_cctoCInt ( m );
   
 } /* end GBC_lcd_lyc_write */
 
 
 GBCu8
-GBC_lcd_mpal_bg_get (void)
+GBC_lcd_mpal_bg_get (
+                     GBC_Machine *m
+                     )
 {
-  return mpal_get ( _mpal.bg );
+  return mpal_get ( m, _mpal.bg );
 } /* end GBC_lcd_mpal_bg_get */
 
 
 void
 GBC_lcd_mpal_bg_set (
+        	     GBC_Machine *m,
         	     const GBCu8 data
         	     )
 {
-  mpal_set ( data, _mpal.bg );
+  mpal_set ( m, data, _mpal.bg );
 } /* end GBC_lcd_mpal_bg_set */
 
 
 GBCu8
-GBC_lcd_mpal_ob0_get (void)
+GBC_lcd_mpal_ob0_get (
+                      GBC_Machine *m
+                      )
 {
-  return mpal_get ( _mpal.ob0 );
+  return mpal_get ( m, _mpal.ob0 );
 } /* end GBC_lcd_mpal_ob0_get */
 
 
 void
 GBC_lcd_mpal_ob0_set (
+        	      GBC_Machine *m,
         	      const GBCu8 data
         	      )
 {
-  mpal_set ( data, _mpal.ob0 );
+  mpal_set ( m, data, _mpal.ob0 );
 } /* end GBC_lcd_mpal_ob0_set */
 
 
 GBCu8
-GBC_lcd_mpal_ob1_get (void)
+GBC_lcd_mpal_ob1_get (
+                      GBC_Machine *m
+                      )
 {
-  return mpal_get ( _mpal.ob1 );
+  return mpal_get ( m, _mpal.ob1 );
 } /* end GBC_lcd_mpal_ob1_set */
 
 
 void
 GBC_lcd_mpal_ob1_set (
+        	      GBC_Machine *m,
         	      const GBCu8 data
         	      )
 {
-  mpal_set ( data, _mpal.ob1 );
+  mpal_set ( m, data, _mpal.ob1 );
 } /* end GBC_lcd_mpal_ob1_set */
 
 
+int
+GBC_lcd_next_event (
+        	    GBC_Machine *m
+        	    )
+{
+  
+  int cc;
+  
+  
+  /* Mateixes condicions que en 'GBC_lcd_clock'. */
+  cc= _timing.cctoVBInt;
+  if ( _status.intC_enabled && _timing.cctoCInt < cc )
+    cc= _timing.cctoCInt;
+  if ( (_status.int0_enabled || _dma.active) && _timing.ccto0Int < cc )
+    cc= _timing.ccto0Int;
+  if ( _status.int2_enabled && _timing.ccto2Int < cc )
+    cc= _timing.ccto2Int;
+  
+  return cc - _timing.cc;
+  
+} /* end GBC_lcd_next_event */
+
+
 void
 GBC_lcd_oam_dma (
+        	 GBC_Machine *m,
         	 const GBCu8 data
         	 )
 {
   
   GBCu16 addr, i;
+  GBCu8 val;
   
   
-  clock ();
+  update_clock ( m );
   for ( i= 0, addr= ((GBCu16)data)<<8; i < 0xA0; ++i, ++addr )
-    _oam[i]= GBC_mem_read ( addr );
+    {
+      val= GBC_mem_read ( m, addr );
+      if ( val == _oam[i] ) continue;
+      defer_log ( m, DEFER_OAM, i, _oam[i], val );
+      if ( (i&0x3) == 0 ) set_obj_y ( m, i>>2, val );
+      else _oam[i]= val;
+    }
   
 } /* end GBC_lcd_oam_dma */
 
 
 GBCu8
 GBC_lcd_oam_read (
+        	  GBC_Machine *m,
         	  const GBCu16 addr
         	  )
 {
   
-  clock ();
+  update_clock ( m );
   /*if ( _status.mode&0x2 ) return 0xFF;*/
   
   return _oam[addr];
@@ -1595,32 +2585,38 @@ GBC_lcd_oam_read (
 
 void
 GBC_lcd_oam_write (
+        	   GBC_Machine *m,
         	   const GBCu16 addr,
         	   const GBCu8  data
         	   )
 {
   
-  clock ();
+  update_clock ( m );
   /*if ( _status.mode&0x2 ) return;*/
-  _oam[addr]= data;
+  defer_log ( m, DEFER_OAM, addr, _oam[addr], data );
+  if ( (addr&0x3) == 0 ) set_obj_y ( m, addr>>2, data );
+  else _oam[addr]= data;
   
 } /* end GBC_lcd_oam_write */
 
 
 void
 GBC_lcd_pal_lock (
+        	  GBC_Machine *m,
         	  const GBCu8 data
         	  )
 {
   
-  clock ();
+  update_clock ( m );
   _pal_lock= ((data&0x1)==0);
   
 } /* end GBC_lcd_pal_lock */
 
 
 GBCu8
-GBC_lcd_scx_read (void)
+GBC_lcd_scx_read (
+                  GBC_Machine *m
+                  )
 {
   return _pos.SCX;
 } /* end GBC_lcd_scx_read */
@@ -1628,18 +2624,22 @@ GBC_lcd_scx_read (void)
 
 void
 GBC_lcd_scx_write (
+        	   GBC_Machine *m,
         	   const GBCu8 data
         	   )
 {
   
-  clock ();
+  update_clock ( m );
+  defer_log ( m, DEFER_SCX, 0, _pos.SCX, data );
   _pos.SCX= data;
   
 } /* end GBC_lcd_scx_write */
 
 
 GBCu8
-GBC_lcd_scy_read (void)
+GBC_lcd_scy_read (
+                  GBC_Machine *m
+                  )
 {
   return _pos.SCY;
 } /* end GBC_lcd_scy_read */
@@ -1647,11 +2647,13 @@ GBC_lcd_scy_read (void)
 
 void
 GBC_lcd_scy_write (
+        	   GBC_Machine *m,
         	   const GBCu8 data
         	   )
 {
   
-  clock ();
+  update_clock ( m );
+  defer_log ( m, DEFER_SCY, 0, _pos.SCY, data );
   _pos.SCY= data;
   
 } /* end GBC_lcd_scy_write */
@@ -1659,25 +2661,29 @@ GBC_lcd_scy_write (
 
 void
 GBC_lcd_select_vram_bank (
+        		  GBC_Machine *m,
         		  const GBCu8 data
         		  )
 {
   
   if ( !_cgb_mode ) return;
-  clock ();
+  update_clock ( m );
   _vram_selected= data;
   _cvram= &(_vram[_vram_selected&0x1][0]);
+  GBC_mem_map_vram ( m, _cvram );
   
 } /* end GBC_lcd_select_vram_bank */
 
 
 void
 GBC_lcd_set_cgb_mode (
+        	      GBC_Machine   *m,
         	      const GBC_Bool enabled
         	      )
 {
   
-  clock ();
+  update_clock ( m );
+  render_pause ( m );
   
   /* CGB -> DMG */
   if ( _cgb_mode && !enabled )
@@ -1697,15 +2703,284 @@ GBC_lcd_set_cgb_mode (
       _control.obj_has_prio= !_control.bg_enabled;
     }
   _cgb_mode= enabled;
+  render_resume ( m );
   
 } /* end GBC_lcd_set_cgb_mode */
 
 
+int
+GBC_lcd_set_color_profile (
+        		   GBC_Machine               *m,
+        		   const GBC_LCDColorProfile  profile,
+        		   const double               matrix[3][3]
+        		   )
+{
+  
+  GBCu32 *lut;
+  
+  
+  /* Nova taula. */
+  if ( profile == GBC_LCD_COLOR_RAW ) lut= NULL;
+  else
+    {
+      if ( profile == GBC_LCD_COLOR_CUSTOM && matrix == NULL ) return -1;
+      lut= (GBCu32 *) malloc ( sizeof(GBCu32)*32768 );
+      if ( lut == NULL ) return -1;
+      build_color_lut ( lut, profile, matrix );
+    }
+  
+  /* Els colors nous s'apliquen a partir de la posició actual. */
+  if ( _out.color_lut != NULL || lut != NULL )
+    {
+      update_clock ( m );
+      render_pause ( m );
+      free ( _out.color_lut );
+      _out.color_lut= lut;
+      update_luts ( m );
+      render_resume ( m );
+    }
+  
+  return 0;
+  
+} /* end GBC_lcd_set_color_profile */
+
+
+void
+GBC_lcd_set_deferred (
+        	      GBC_Machine    *m,
+        	      const GBC_Bool  enabled
+        	      )
+{
+  
+  update_clock ( m );
+  render_pause ( m );
+  _defer.enabled= enabled;
+  render_resume ( m );
+  
+} /* end GBC_lcd_set_deferred */
+
+
+void
+GBC_lcd_set_frameskip (
+        	       GBC_Machine *m,
+        	       const int    n
+        	       )
+{
+  
+  update_clock ( m );
+  render_pause ( m );
+  _skip.n= n;
+  _skip.count= 0;
+  
+  /* El frame actual acaba com va començar, excepte si es desactiva el
+     vídeo, que es deixa de renderitzar la resta del frame. */
+  if ( n < 0 ) _skip.frame= GBC_TRUE;
+  render_resume ( m );
+  
+} /* end GBC_lcd_set_frameskip */
+
+
+int
+GBC_lcd_set_ring (
+        	  GBC_Machine            *m,
+        	  const int               n,
+        	  const GBC_FBRingPolicy  policy
+        	  )
+{
+  
+  int i;
+  
+  
+  if ( n <= 0 && _ring.n == 0 ) return 0;
+  if ( _thread != NULL ) return -1;
+  update_clock ( m );
+  defer_flush ( m );
+  ring_free ( m );
+  
+  /* El frame en curs no es publica. */
+  _skip.frame= GBC_TRUE;
+  if ( n <= 0 ) return 0;
+  
+  /* Reserva. */
+  _ring.size= 23040*pixel_size ( _out.format );
+  _ring.mem= (GBCu8 *) malloc ( _ring.size*n );
+  _ring.slots= (ring_slot_t *) malloc ( sizeof(ring_slot_t)*n );
+  _ring.ready.v= (int *) malloc ( sizeof(int)*(n+1) );
+  _ring.free.v= (int *) malloc ( sizeof(int)*(n+1) );
+  if ( _ring.mem == NULL || _ring.slots == NULL ||
+       _ring.ready.v == NULL || _ring.free.v == NULL )
+    {
+      free ( _ring.mem );
+      free ( _ring.slots );
+      free ( _ring.ready.v );
+      free ( _ring.free.v );
+      return -1;
+    }
+  pthread_mutex_init ( &(_ring.lock), NULL );
+  pthread_cond_init ( &(_ring.cond), NULL );
+  
+  /* Inicialitza. */
+  _ring.n= n;
+  _ring.policy= policy;
+  _ring.cur= _ring.prev= -1;
+  _ring.frames= 0;
+  _ring.dropped= 0;
+  _ring.ready.size= _ring.free.size= (unsigned) (n+1);
+  _ring.ready.head= _ring.ready.tail= 0;
+  _ring.free.head= _ring.free.tail= 0;
+  for ( i= 0; i < n; ++i )
+    queue_push ( m, &(_ring.free), i );
+  
+  return 0;
+  
+} /* end GBC_lcd_set_ring */
+
+
+GBC_Bool
+GBC_lcd_ring_acquire (
+        	      GBC_Machine     *m,
+        	      GBC_FBRingFrame *frame,
+        	      const GBC_Bool   wait
+        	      )
+{
+  
+  int slot;
+  
+  
+  if ( (slot= queue_pop ( m, &(_ring.ready) )) == -1 )
+    {
+      if ( !wait ) return GBC_FALSE;
+      pthread_mutex_lock ( &(_ring.lock) );
+      while ( (slot= queue_pop ( m, &(_ring.ready) )) == -1 )
+        pthread_cond_wait ( &(_ring.cond), &(_ring.lock) );
+      pthread_mutex_unlock ( &(_ring.lock) );
+    }
+  frame->fb= get_fb ( m, slot );
+  frame->changes= _ring.slots[slot].changes;
+  frame->number= _ring.slots[slot].number;
+  frame->slot= slot;
+  
+  return GBC_TRUE;
+  
+} /* end GBC_lcd_ring_acquire */
+
+
+void
+GBC_lcd_ring_release (
+        	      GBC_Machine           *m,
+        	      const GBC_FBRingFrame *frame
+        	      )
+{
+  
+  queue_push ( m, &(_ring.free), frame->slot );
+  ring_wakeup ( m );
+  
+} /* end GBC_lcd_ring_release */
+
+
+GBCu64
+GBC_lcd_ring_get_dropped (
+        		  GBC_Machine *m
+        		  )
+{
+  return _ring.dropped;
+} /* end GBC_lcd_ring_get_dropped */
+
+
+int
+GBC_lcd_set_render_mode (
+        		 GBC_Machine             *m,
+        		 const GBC_LCDRenderMode  mode
+        		 )
+{
+  
+  lcd_thread_t *t;
+  
+  
+  if ( _thread == NULL && mode == GBC_LCD_RENDER_INLINE ) return 0;
+  if ( _ring.n > 0 ) return -1;
+  update_clock ( m );
+  render_pause ( m );
+  thread_free ( m );
+  if ( mode == GBC_LCD_RENDER_INLINE ) return 0;
+  
+  /* Reserva. */
+  t= (lcd_thread_t *) calloc ( 1, sizeof(lcd_thread_t) );
+  if ( t == NULL ) return -1;
+  t->check= (mode == GBC_LCD_RENDER_THREAD_CHECK);
+  t->rm= (GBC_Machine *) calloc ( 1, sizeof(GBC_Machine) );
+  t->log[0]= (defer_op_t *) malloc ( sizeof(defer_op_t)*
+        			     GBC_LCD_THREAD_LOG_SIZE );
+  t->log[1]= (defer_op_t *) malloc ( sizeof(defer_op_t)*
+        			     GBC_LCD_THREAD_LOG_SIZE );
+  if ( t->check )
+    t->check_fb= (GBCu8 *) malloc ( 23040*pixel_size ( _out.format ) );
+  if ( t->rm == NULL || t->log[0] == NULL || t->log[1] == NULL ||
+       (t->check && t->check_fb == NULL) )
+    goto error;
+  
+  /* Fil. */
+  t->state= THREAD_IDLE;
+  pthread_mutex_init ( &(t->lock), NULL );
+  pthread_cond_init ( &(t->cond), NULL );
+  if ( pthread_create ( &(t->thread), NULL, thread_main, t ) != 0 )
+    {
+      pthread_cond_destroy ( &(t->cond) );
+      pthread_mutex_destroy ( &(t->lock) );
+      goto error;
+    }
+  _thread= t;
+  render_resume ( m );
+  
+  return 0;
+  
+ error:
+  free ( t->rm );
+  free ( t->log[0] );
+  free ( t->log[1] );
+  free ( t->check_fb );
+  free ( t );
+  return -1;
+  
+} /* end GBC_lcd_set_render_mode */
+
+
+GBCu64
+GBC_lcd_get_render_mismatches (
+        		       GBC_Machine *m
+        		       )
+{
+  return _thread!=NULL ? _thread->mismatches : 0;
+} /* end GBC_lcd_get_render_mismatches */
+
+
+int
+GBC_lcd_set_simd (
+        	  GBC_Machine       *m,
+        	  const GBC_LCDSimd  simd
+        	  )
+{
+  
+  const GBC_LCDKernels *kernels;
+  
+  
+  if ( (kernels= GBC_lcd_get_kernels ( simd )) == NULL ) return -1;
+  render_pause ( m );
+  _kernels= kernels;
+  render_resume ( m );
+  
+  return 0;
+  
+} /* end GBC_lcd_set_simd */
+
+
 GBCu8
-GBC_lcd_status_read (void)
+GBC_lcd_status_read (
+                     GBC_Machine *m
+                     )
 {
   
-  clock ();
+  update_clock ( m );
   
   return _status.hdata | ((_pos.LY==_pos.LYC) ? CFLAG : 0x00) | _status.mode;
   
@@ -1714,11 +2989,12 @@ GBC_lcd_status_read (void)
 
 void
 GBC_lcd_status_write (
+        	      GBC_Machine *m,
         	      const GBCu8 data
         	      )
 {
   
-  clock ();
+  update_clock ( m );
   
   _status.hdata= data&0xF8;
   _status.intC_enabled= ((data&0x40)!=0);
@@ -1731,30 +3007,202 @@ GBC_lcd_status_write (
 
 void
 GBC_lcd_stop (
+              GBC_Machine   *m,
               const GBC_Bool state
               )
 {
   
-  /* Processa els clocks pendents i para. Si ja estava parat clock()
+  int x, lines;
+  
+  
+  /* Processa els clocks pendents i para. Si ja estava parat update_clock ( m )
      buidarà els cicles acumulats en aquest periode. */
-  clock ();
+  update_clock ( m );
+  render_pause ( m );
   _stop= state;
-  if ( state )
+  if ( state && _skip.n >= 0 && (_ring.n == 0 || _ring.cur != -1) )
     {
-      memset ( _render.fb, 0, 160*144*sizeof(int) );
-      _update_screen ( _render.fb, _udata );
+      lines= _render.lines;
+      for ( x= 0; x < 160; ++x ) _out.line[x]= SLOT_BLACK;
+      _render.p= &(_render.fb[0]);
+      for ( _render.lines= 0; _render.lines < 144; ++_render.lines )
+        write_line ( m );
+      deliver_frame ( m );
+      _render.p= &(_render.fb[0]) + lines*160;
+      _render.lines= lines;
+      /* La resta del frame actual ja no té buffer. */
+      if ( _ring.n > 0 ) _skip.frame= GBC_TRUE;
     }
+  render_resume ( m );
   
 } /* end GBC_lcd_stop */
 
 
+int
+GBC_lcd_view_map (
+        	  GBC_Machine *m,
+        	  const int    map,
+        	  GBCu8       *dst,
+        	  const int    pitch
+        	  )
+{
+  
+  GBCu32 all[NSLOTS], cols[4];
+  GBCu16 addr;
+  GBCu8 NT, ATTR;
+  int row, col, i;
+  
+  
+  if ( map != 0 && map != 1 ) return -1;
+  view_colors ( m, all );
+  addr= map ? 0x1C00 : 0x1800;
+  for ( row= 0; row < 32; ++row )
+    for ( col= 0; col < 32; ++col, ++addr )
+      {
+        NT= _vram[0][addr];
+        ATTR= _cgb_mode ? _vram[1][addr] : 0x00;
+        for ( i= 0; i < 4; ++i )
+          cols[i]= all[_cgb_mode ? _slots[ATTR&0x7][i] : _mpal.bg[i]];
+        view_tile ( m, dst + row*8*pitch + col*8*4, pitch,
+        	    (ATTR&0x08)>>3, BGWIN_TILE ( NT ), cols, ATTR, GBC_FALSE );
+      }
+  
+  return 0;
+  
+} /* end GBC_lcd_view_map */
+
+
+void
+GBC_lcd_view_oam (
+        	  GBC_Machine *m,
+        	  GBCu8       *dst,
+        	  const int    pitch
+        	  )
+{
+  
+  GBCu32 all[NSLOTS], cols[4];
+  GBCu8 NT, ATTR, *cell;
+  const GBCu8 *p, *mpal;
+  const int *pal;
+  int n, i, row;
+  
+  
+  view_colors ( m, all );
+  for ( n= 0; n < 40; ++n )
+    {
+      p= &(_oam[n<<2]);
+      NT= p[2];
+      ATTR= p[3];
+      if ( _cgb_mode )
+        {
+          pal= _slots[8|(ATTR&0x7)];
+          for ( i= 0; i < 4; ++i ) cols[i]= all[pal[i]];
+        }
+      else
+        {
+          pal= _slots[(ATTR&0x10) ? 9 : 8];
+          mpal= (ATTR&0x10) ? &(_mpal.ob1[0]) : &(_mpal.ob0[0]);
+          for ( i= 0; i < 4; ++i ) cols[i]= all[pal[mpal[i]]];
+          ATTR&= ~0x08;
+        }
+      
+      /* Els sprites de 8x16 es dibuixen sencers, amb el volteig
+         vertical aplicat als dos tiles. */
+      cell= dst + (n>>3)*16*pitch + (n&0x7)*8*4;
+      if ( _control.obj_size16 )
+        {
+          NT&= 0xFE;
+          view_tile ( m, cell, pitch, (ATTR&0x08)>>3,
+        	      (ATTR&VFLIP) ? NT|1 : NT, cols, ATTR, GBC_TRUE );
+          view_tile ( m, cell + 8*pitch, pitch, (ATTR&0x08)>>3,
+        	      (ATTR&VFLIP) ? NT : NT|1, cols, ATTR, GBC_TRUE );
+        }
+      else
+        {
+          view_tile ( m, cell, pitch, (ATTR&0x08)>>3, NT, cols, ATTR,
+        	      GBC_TRUE );
+          for ( row= 8; row < 16; ++row )
+            memset ( cell + row*pitch, 0, 8*4 );
+        }
+    }
+  
+} /* end GBC_lcd_view_oam */
+
+
+void
+GBC_lcd_view_palettes (
+        	       GBC_Machine *m,
+        	       GBCu8       *dst,
+        	       const int    pitch
+        	       )
+{
+  
+  GBCu32 all[NSLOTS], *p;
+  int slot, y, x;
+  
+  
+  view_colors ( m, all );
+  for ( y= 0; y < GBC_LCD_VIEW_PALETTES_HEIGHT; ++y )
+    {
+      p= (GBCu32 *) (dst + y*pitch);
+      for ( x= 0; x < GBC_LCD_VIEW_PALETTES_WIDTH; ++x )
+        {
+          slot= (x>>5)*SLOT_OB + (y>>3)*4 + ((x>>3)&0x3);
+          p[x]= all[slot];
+        }
+    }
+  
+} /* end GBC_lcd_view_palettes */
+
+
+int
+GBC_lcd_view_tiles (
+        	    GBC_Machine *m,
+        	    const int    bank,
+        	    const int    pal,
+        	    GBCu8       *dst,
+        	    const int    pitch
+        	    )
+{
+  
+  static const int gray[4]= { 32767, 21140, 10570, 0 };
+  
+  GBCu32 all[NSLOTS], cols[4];
+  int tile, i;
+  
+  
+  if ( bank < 0 || bank > 1 || pal > 15 ) return -1;
+  
+  /* Colors. */
+  if ( pal < 0 )
+    for ( i= 0; i < 4; ++i )
+      cols[i]= convert_color ( GBC_FB_RGBA8888, _out.color_lut,
+        		       gray[i], 0 );
+  else
+    {
+      view_colors ( m, all );
+      for ( i= 0; i < 4; ++i )
+        cols[i]= all[_slots[pal][i]];
+    }
+  
+  /* 16 tiles per fila. */
+  for ( tile= 0; tile < 384; ++tile )
+    view_tile ( m, dst + (tile>>4)*8*pitch + (tile&0xF)*8*4, pitch,
+        	bank, tile, cols, 0x00, GBC_FALSE );
+  
+  return 0;
+  
+} /* end GBC_lcd_view_tiles */
+
+
 void
 GBC_lcd_vram_dma_dst_high (
+        		   GBC_Machine *m,
         		   const GBCu8 data
         		   )
 {
   if ( !_cgb_mode ) return;
-  clock ();
+  update_clock ( m );
   _dma.dst&= 0xFF;
   _dma.dst|= ((GBCu16) (data&0x1F))<<8;
   
@@ -1763,12 +3211,13 @@ GBC_lcd_vram_dma_dst_high (
 
 void
 GBC_lcd_vram_dma_dst_low (
+        		  GBC_Machine *m,
         		  const GBCu8 data
         		  )
 {
   
   if ( !_cgb_mode ) return;
-  clock ();
+  update_clock ( m );
   _dma.dst&= 0xFF00;
   _dma.dst|= data&0xF0;
   
@@ -1777,6 +3226,7 @@ GBC_lcd_vram_dma_dst_low (
 
 void
 GBC_lcd_vram_dma_init (
+        	       GBC_Machine *m,
         	       const GBCu8 data
         	       )
 {
@@ -1785,7 +3235,7 @@ GBC_lcd_vram_dma_init (
   
   
   if ( !_cgb_mode ) return;
-  clock ();
+  update_clock ( m );
   
   /* NOTA: Açò no està del tot clar. */
   /* Si hi ha una transferència activa sols es pot desactivar. */
@@ -1806,11 +3256,11 @@ GBC_lcd_vram_dma_init (
           _dma.dst&= 0x1FFF;
           for ( ; _dma.length != 0xFF; --_dma.length )
             {
-              vram_dma_hblank_block ();
+              vram_dma_hblank_block ( m );
               _dma.dst&= 0x1FFF;
             }
           _dma.length= 0x7F;
-          clock ();
+          update_clock ( m );
         }
     }
   
@@ -1819,11 +3269,12 @@ GBC_lcd_vram_dma_init (
 
 void
 GBC_lcd_vram_dma_src_high (
+        		   GBC_Machine *m,
         		   const GBCu8 data
         		   )
 {
   if ( !_cgb_mode ) return;
-  clock ();
+  update_clock ( m );
   _dma.src&= 0xFF;
   _dma.src|= ((GBCu16) data)<<8;
   
@@ -1832,12 +3283,13 @@ GBC_lcd_vram_dma_src_high (
 
 void
 GBC_lcd_vram_dma_src_low (
+        		  GBC_Machine *m,
         		  const GBCu8 data
         		  )
 {
   
   if ( !_cgb_mode ) return;
-  clock ();
+  update_clock ( m );
   _dma.src&= 0xFF00;
   _dma.src|= data&0xF0;
   
@@ -1845,11 +3297,13 @@ GBC_lcd_vram_dma_src_low (
 
 
 GBCu8
-GBC_lcd_vram_dma_status (void)
+GBC_lcd_vram_dma_status (
+                         GBC_Machine *m
+                         )
 {
   
   if ( !_cgb_mode ) return 0xFF;
-  clock ();
+  update_clock ( m );
   
   return _dma.length | (_dma.active ? 0x00 : 0x80);
   
@@ -1858,11 +3312,12 @@ GBC_lcd_vram_dma_status (void)
 
 GBCu8
 GBC_lcd_vram_read (
+        	   GBC_Machine *m,
         	   const GBCu16 addr
         	   )
 {
   
-  clock ();
+  update_clock ( m );
   /*if ( _status.mode == 3 ) return 0xFF;*/
   
   return _cvram[addr];
@@ -1872,20 +3327,25 @@ GBC_lcd_vram_read (
 
 void
 GBC_lcd_vram_write (
+        	    GBC_Machine *m,
         	    const GBCu16 addr,
         	    const GBCu8  data
         	    )
 {
   
-  clock ();
+  update_clock ( m );
   /*if ( _status.mode == 3 ) return;*/
+  defer_log ( m, DEFER_VRAM, VRAM_ADDR ( addr ), _cvram[addr], data );
   _cvram[addr]= data;
+  INVALIDATE_TILE ( addr );
   
 } /* end GBC_lcd_vram_write */
 
 
 GBCu8
-GBC_lcd_wx_read (void)
+GBC_lcd_wx_read (
+                 GBC_Machine *m
+                 )
 {
   return _pos.WX;
 } /* end GBC_lcd_wx_read */
@@ -1893,18 +3353,22 @@ GBC_lcd_wx_read (void)
 
 void
 GBC_lcd_wx_write (
+        	  GBC_Machine *m,
         	  const GBCu8 data
         	  )
 {
   
-  clock ();
+  update_clock ( m );
+  defer_log ( m, DEFER_WX, 0, _pos.WX, data );
   _pos.WX= data;
   
 } /* end GBC_lcd_wx_write */
 
 
 GBCu8
-GBC_lcd_wy_read (void)
+GBC_lcd_wy_read (
+                 GBC_Machine *m
+                 )
 {
   return _pos.WY;
 } /* end GBC_lcd_wy_read */
@@ -1912,11 +3376,13 @@ GBC_lcd_wy_read (void)
 
 void
 GBC_lcd_wy_write (
+        	  GBC_Machine *m,
         	  const GBCu8 data
         	  )
 {
   
-  clock ();
+  update_clock ( m );
+  defer_log ( m, DEFER_WY, 0, _pos.WY, data );
   _pos.WY= data;
   
 } /* end GBC_lcd_wy_write */
@@ -1924,14 +3390,19 @@ GBC_lcd_wy_write (
 
 int
 GBC_lcd_save_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    )
 {
 
-  int *aux;
+  int *aux, where;
   size_t ret;
+  GBCu8 *fb;
   
   
+  /* Sols cal que l'estat estiga al dia. */
+  render_pause ( m );
+  render_resume ( m );
   SAVE ( _cgb_mode );
   SAVE ( _pal_lock );
   SAVE ( _control );
@@ -1950,6 +3421,17 @@ GBC_lcd_save_state (
   ret= fwrite ( &_render, sizeof(_render), 1, f );
   _render.p= aux;
   if ( ret != 1 ) return -1;
+  /* Imatge on s'està renderitzant, amb les línies ja dibuixades del
+     frame actual. */
+  fb= get_cur_fb ( m );
+  if ( fb == NULL ) where= STATE_FB_NONE;
+  else if ( fb == (GBCu8 *) &(_render.fb[0]) ) where= STATE_FB_RENDER;
+  else where= STATE_FB_DATA;
+  SAVE ( _out.format );
+  SAVE ( where );
+  if ( where == STATE_FB_DATA &&
+       fwrite ( fb, 160*144*pixel_size ( _out.format ), 1, f ) != 1 )
+    return -1;
   SAVE ( _stop );
 
   return 0;
@@ -1959,13 +3441,18 @@ GBC_lcd_save_state (
 
 int
 GBC_lcd_load_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    )
 {
 
-  int i, j;
+  int i, j, where;
+  GBC_FBFormat format;
+  size_t size;
+  GBCu8 *fb;
 
   
+  render_pause ( m );
   LOAD ( _cgb_mode );
   LOAD ( _pal_lock );
   LOAD ( _control );
@@ -1977,8 +3464,10 @@ GBC_lcd_load_state (
   CHECK ( _pos.LY >= 0 && _pos.LY < 154 );
   CHECK ( _pos.LX >= 0 && _pos.LX < CICLESPERLINE );
   LOAD ( _vram );
+  memset ( _tiles.valid, 0, sizeof(_tiles.valid) );
   LOAD ( _vram_selected );
   _cvram= &(_vram[_vram_selected&0x1][0]);
+  GBC_mem_map_vram ( m, _cvram );
   LOAD ( _oam );
   LOAD ( _dma );
   CHECK ( (_dma.src&0xFFF0) == _dma.src );
@@ -2003,6 +3492,8 @@ GBC_lcd_load_state (
   CHECK ( _cpal.ob.p >= 0 && _cpal.ob.p < 8 );
   CHECK ( _cpal.ob.c >= 0 && _cpal.ob.c < 4 );
   CHECK ( _cpal.ob.high == 0 || _cpal.ob.high == 1 );
+  update_luts ( m );
+  set_all_dirty ( m );
 
   /* En render es fa un tractament especial del punter.  */
   LOAD ( _render );
@@ -2015,7 +3506,40 @@ GBC_lcd_load_state (
     if ( _render.fb[i] < 0 || _render.fb[i] > 32767 )
       return -1;
   
+  /* Imatge. Si no es pot recuperar les línies ja dibuixades es
+     deixen en negre. */
+  LOAD ( format );
+  CHECK ( format >= GBC_FB_CGB15 && format <= GBC_FB_INDEXED8 );
+  LOAD ( where );
+  CHECK ( where >= STATE_FB_NONE && where <= STATE_FB_DATA );
+  fb= get_cur_fb ( m );
+  size= 160*144*pixel_size ( format );
+  if ( where == STATE_FB_DATA && fb != NULL && format == _out.format )
+    {
+      if ( fread ( fb, size, 1, f ) != 1 ) return -1;
+    }
+  else
+    {
+      if ( where == STATE_FB_DATA &&
+           fseek ( f, (long) size, SEEK_CUR ) != 0 )
+        return -1;
+      if ( fb != NULL )
+        {
+          if ( where == STATE_FB_RENDER && _out.format == GBC_FB_CGB15 )
+            {
+              if ( fb != (GBCu8 *) &(_render.fb[0]) )
+        	memcpy ( fb, _render.fb, sizeof(_render.fb) );
+            }
+          else memset ( fb, 0,
+        		_render.lines*160*pixel_size ( _out.format ) );
+        }
+    }
+  
   LOAD ( _stop );
+  build_obj_lines ( m );
+  _defer.lines= _render.lines;
+  _defer.n= 0;
+  render_resume ( m );
   
   return 0;
   
@@ -0,0 +1,425 @@
+/*
+ * Copyright 2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  lcd_simd.c - Funcions vectorials (SSE2/AVX2) del renderitzat de la
+ *               pantalla, amb una versió escalar per a la resta de
+ *               processadors.
+ *
+ *  El joc de funcions es tria en temps d'execució amb CPUID. Totes les
+ *  versions han de produir exactament el mateix resultat que la
+ *  versió escalar.
+ *
+ */
+
+
+/* Les versions vectorials es compilen sols per a x86-64 amb GCC o
+ * Clang, que permeten compilar funcions AVX2 sense canviar les opcions
+ * de la resta del fitxer. Es desactiven definint GBC_LCD_NO_SIMD. */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(GBC_LCD_NO_SIMD)
+#define LCD_SIMD
+#endif
+
+#include <stddef.h>
+#include <string.h>
+#ifdef LCD_SIMD
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "GBC.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#ifdef LCD_SIMD
+#define AVX2 __attribute__ ((target ("avx2")))
+#endif
+
+
+
+
+/***********/
+/* ESCALAR */
+/***********/
+
+static void
+expand_scalar (
+               const GBCu8 planes[16],
+               GBCu8       pix[64],
+               GBCu8       pix_flip[64]
+               )
+{
+
+  int row, j;
+  GBCu8 color;
+
+
+  for ( row= 0; row < 8; ++row, planes+= 2, pix+= 8, pix_flip+= 8 )
+    for ( j= 0; j < 8; ++j )
+      {
+        color= (GBCu8) (((planes[0]>>(7-j))&0x01) |
+        		(((planes[1]>>(7-j))<<1)&0x02));
+        pix[j]= color;
+        pix_flip[7-j]= color;
+      }
+
+} /* end expand_scalar */
+
+
+static void
+gather_scalar (
+               int         dst[8],
+               const GBCu8 pix[8],
+               const int   pal[4]
+               )
+{
+
+  int j;
+
+
+  for ( j= 0; j < 8; ++j )
+    dst[j]= pal[pix[j]];
+
+} /* end gather_scalar */
+
+
+static void
+blend_scalar (
+              int               dst[160],
+              const int         bg[160],
+              const int         obj[160],
+              const signed char prio_bg[160],
+              const signed char prio_obj[160],
+              const GBC_Bool    obj_has_prio
+              )
+{
+
+  int x;
+
+
+  for ( x= 0; x < 160; ++x )
+    dst[x]=
+      obj[x] != -1 && (prio_bg[x] == -1 || obj_has_prio ||
+        	       (!prio_bg[x] && !prio_obj[x])) ?
+      obj[x] : bg[x];
+
+} /* end blend_scalar */
+
+
+
+
+/********/
+/* SSE2 */
+/********/
+
+#ifdef LCD_SIMD
+
+/* Torna 16 bytes a 0xFF on el píxel de l'sprite té prioritat (sense
+   mirar si és transparent). */
+static __m128i
+obj_mask_sse2 (
+               const signed char *prio_bg,
+               const signed char *prio_obj,
+               const __m128i      has_prio
+               )
+{
+
+  __m128i pbg, pobj, zero;
+
+
+  zero= _mm_setzero_si128 ();
+  pbg= _mm_loadu_si128 ( (const __m128i *) prio_bg );
+  pobj= _mm_loadu_si128 ( (const __m128i *) prio_obj );
+
+  return _mm_or_si128 ( _mm_or_si128 ( _mm_cmpeq_epi8 ( pbg,
+        						 _mm_set1_epi8 ( -1 ) ),
+        			       has_prio ),
+        		_mm_and_si128 ( _mm_cmpeq_epi8 ( pbg, zero ),
+        				_mm_cmpeq_epi8 ( pobj, zero ) ) );
+
+} /* end obj_mask_sse2 */
+
+
+static void
+expand_sse2 (
+             const GBCu8 planes[16],
+             GBCu8       pix[64],
+             GBCu8       pix_flip[64]
+             )
+{
+
+  int row;
+  __m128i bits, bits_flip, lo, hi, one, two;
+
+
+  /* Cada iteració processa dues files: cada byte dels plans es
+     replica 8 vegades i es compara amb el bit del píxel. */
+  bits= _mm_setr_epi8 ( (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        		(char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 );
+  bits_flip= _mm_setr_epi8 ( 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+        		     (char) 0x80,
+        		     0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+        		     (char) 0x80 );
+  one= _mm_set1_epi8 ( 1 );
+  two= _mm_set1_epi8 ( 2 );
+  for ( row= 0; row < 8; row+= 2, planes+= 4 )
+    {
+      lo= _mm_set_epi64x ( 0x0101010101010101LL*planes[2],
+        		   0x0101010101010101LL*planes[0] );
+      hi= _mm_set_epi64x ( 0x0101010101010101LL*planes[3],
+        		   0x0101010101010101LL*planes[1] );
+      _mm_storeu_si128
+        ( (__m128i *) &(pix[row<<3]),
+          _mm_or_si128
+          ( _mm_and_si128 ( _mm_cmpeq_epi8 ( _mm_and_si128 ( lo, bits ),
+        				     bits ), one ),
+            _mm_and_si128 ( _mm_cmpeq_epi8 ( _mm_and_si128 ( hi, bits ),
+        				     bits ), two ) ) );
+      _mm_storeu_si128
+        ( (__m128i *) &(pix_flip[row<<3]),
+          _mm_or_si128
+          ( _mm_and_si128 ( _mm_cmpeq_epi8 ( _mm_and_si128 ( lo, bits_flip ),
+        				     bits_flip ), one ),
+            _mm_and_si128 ( _mm_cmpeq_epi8 ( _mm_and_si128 ( hi, bits_flip ),
+        				     bits_flip ), two ) ) );
+    }
+
+} /* end expand_sse2 */
+
+
+static void
+gather_sse2 (
+             int         dst[8],
+             const GBCu8 pix[8],
+             const int   pal[4]
+             )
+{
+
+  int i, j;
+  __m128i idx, res;
+
+
+  /* SSE2 no té permutacions variables: se selecciona cada entrada de
+     la paleta amb una comparació. */
+  for ( i= 0; i < 8; i+= 4 )
+    {
+      idx= _mm_setr_epi32 ( pix[i], pix[i+1], pix[i+2], pix[i+3] );
+      res= _mm_setzero_si128 ();
+      for ( j= 0; j < 4; ++j )
+        res= _mm_or_si128 ( res,
+        		    _mm_and_si128 ( _mm_cmpeq_epi32
+        				    ( idx, _mm_set1_epi32 ( j ) ),
+        				    _mm_set1_epi32 ( pal[j] ) ) );
+      _mm_storeu_si128 ( (__m128i *) &(dst[i]), res );
+    }
+
+} /* end gather_sse2 */
+
+
+static void
+blend_sse2 (
+            int               dst[160],
+            const int         bg[160],
+            const int         obj[160],
+            const signed char prio_bg[160],
+            const signed char prio_obj[160],
+            const GBC_Bool    obj_has_prio
+            )
+{
+
+  int x, i;
+  __m128i has_prio, mask8, mask16, mask32, vobj, vbg, none;
+
+
+  has_prio= _mm_set1_epi8 ( obj_has_prio ? -1 : 0 );
+  none= _mm_set1_epi32 ( -1 );
+  for ( x= 0; x < 160; x+= 16 )
+    {
+      mask8= obj_mask_sse2 ( &(prio_bg[x]), &(prio_obj[x]), has_prio );
+      for ( i= 0; i < 16; i+= 4 )
+        {
+          /* Estén la màscara de bytes a paraules de 32 bits. */
+          mask16= i < 8 ?
+            _mm_unpacklo_epi8 ( mask8, mask8 ) :
+            _mm_unpackhi_epi8 ( mask8, mask8 );
+          mask32= (i&4) == 0 ?
+            _mm_unpacklo_epi16 ( mask16, mask16 ) :
+            _mm_unpackhi_epi16 ( mask16, mask16 );
+          vobj= _mm_loadu_si128 ( (const __m128i *) &(obj[x+i]) );
+          vbg= _mm_loadu_si128 ( (const __m128i *) &(bg[x+i]) );
+          mask32= _mm_andnot_si128 ( _mm_cmpeq_epi32 ( vobj, none ),
+        			     mask32 );
+          _mm_storeu_si128 ( (__m128i *) &(dst[x+i]),
+        		     _mm_or_si128 ( _mm_and_si128 ( mask32, vobj ),
+        				    _mm_andnot_si128 ( mask32, vbg ) ) );
+        }
+    }
+
+} /* end blend_sse2 */
+
+
+
+
+/********/
+/* AVX2 */
+/********/
+
+static AVX2 void
+gather_avx2 (
+             int         dst[8],
+             const GBCu8 pix[8],
+             const int   pal[4]
+             )
+{
+
+  __m256i idx, vpal;
+
+
+  idx= _mm256_cvtepu8_epi32 ( _mm_loadl_epi64 ( (const __m128i *) pix ) );
+  vpal= _mm256_castsi128_si256 ( _mm_loadu_si128 ( (const __m128i *) pal ) );
+  _mm256_storeu_si256 ( (__m256i *) dst,
+        		_mm256_permutevar8x32_epi32 ( vpal, idx ) );
+
+} /* end gather_avx2 */
+
+
+static AVX2 void
+blend_avx2 (
+            int               dst[160],
+            const int         bg[160],
+            const int         obj[160],
+            const signed char prio_bg[160],
+            const signed char prio_obj[160],
+            const GBC_Bool    obj_has_prio
+            )
+{
+
+  int x, i;
+  __m128i has_prio, mask8;
+  __m256i mask32, vobj, vbg, none;
+
+
+  has_prio= _mm_set1_epi8 ( obj_has_prio ? -1 : 0 );
+  none= _mm256_set1_epi32 ( -1 );
+  for ( x= 0; x < 160; x+= 16 )
+    {
+      mask8= obj_mask_sse2 ( &(prio_bg[x]), &(prio_obj[x]), has_prio );
+      for ( i= 0; i < 16; i+= 8 )
+        {
+          mask32= _mm256_cvtepi8_epi32 ( i == 0 ? mask8 :
+        				 _mm_srli_si128 ( mask8, 8 ) );
+          vobj= _mm256_loadu_si256 ( (const __m256i *) &(obj[x+i]) );
+          vbg= _mm256_loadu_si256 ( (const __m256i *) &(bg[x+i]) );
+          mask32= _mm256_andnot_si256 ( _mm256_cmpeq_epi32 ( vobj, none ),
+        				mask32 );
+          _mm256_storeu_si256 ( (__m256i *) &(dst[x+i]),
+        			_mm256_blendv_epi8 ( vbg, vobj, mask32 ) );
+        }
+    }
+
+} /* end blend_avx2 */
+
+
+/* Comprova amb CPUID que la UCP i el sistema operatiu suporten
+   AVX2. */
+static GBC_Bool
+cpu_has_avx2 (void)
+{
+
+  unsigned int eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+
+
+  if ( !__get_cpuid ( 1, &eax, &ebx, &ecx, &edx ) ) return GBC_FALSE;
+  /* OSXSAVE i AVX. */
+  if ( (ecx&(1<<27)) == 0 || (ecx&(1<<28)) == 0 ) return GBC_FALSE;
+  /* El sistema operatiu desa els registres XMM i YMM. */
+  __asm__ ( "xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0) );
+  if ( (xcr0_lo&0x6) != 0x6 ) return GBC_FALSE;
+  if ( __get_cpuid_max ( 0, NULL ) < 7 ) return GBC_FALSE;
+  __cpuid_count ( 7, 0, eax, ebx, ecx, edx );
+
+  return (ebx&(1<<5)) != 0;
+
+} /* end cpu_has_avx2 */
+
+#endif /* LCD_SIMD */
+
+
+
+
+/********/
+/* JOCS */
+/********/
+
+static const GBC_LCDKernels _scalar=
+  {
+    GBC_LCD_SIMD_SCALAR, "scalar",
+    expand_scalar, gather_scalar, blend_scalar
+  };
+
+#ifdef LCD_SIMD
+static const GBC_LCDKernels _sse2=
+  {
+    GBC_LCD_SIMD_SSE2, "sse2",
+    expand_sse2, gather_sse2, blend_sse2
+  };
+
+/* L'expansió de plans sols es fa quan es modifica un tile, per això
+   AVX2 reutilitza la versió SSE2. */
+static const GBC_LCDKernels _avx2=
+  {
+    GBC_LCD_SIMD_AVX2, "avx2",
+    expand_sse2, gather_avx2, blend_avx2
+  };
+#endif
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+const GBC_LCDKernels *
+GBC_lcd_get_kernels (
+        	     const GBC_LCDSimd simd
+        	     )
+{
+
+  switch ( simd )
+    {
+    case GBC_LCD_SIMD_AUTO:
+#ifdef LCD_SIMD
+      return cpu_has_avx2 () ? &_avx2 : &_sse2;
+#else
+      return &_scalar;
+#endif
+    case GBC_LCD_SIMD_SCALAR: return &_scalar;
+#ifdef LCD_SIMD
+    case GBC_LCD_SIMD_SSE2: return &_sse2;
+    case GBC_LCD_SIMD_AVX2: return cpu_has_avx2 () ? &_avx2 : NULL;
+#endif
+    default: return NULL;
+    }
+
+} /* end GBC_lcd_get_kernels */
@@ -0,0 +1,978 @@
+/*
+ * Copyright 2011-2013,2015,2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  machine.h - Definició interna de 'GBC_Machine'.
+ *
+ *  NOTA: Aquest fitxer no forma part de la interfície pública. Sols
+ *  l'inclouen els mòduls del simulador.
+ *  NOTA: Cada mòdul accedix al seu estat mitjançant macros que
+ *  suposen que hi ha una variable 'm' amb la màquina. L'estat es
+ *  desa amb 'fwrite' camp a camp, per tant no s'ha de modificar la
+ *  disposició dels camps sense tindre en compte els fitxers d'estat.
+ *
+ */
+
+#ifndef __MACHINE_H__
+#define __MACHINE_H__
+
+#include <pthread.h>
+#include <time.h>
+
+#include "GBC.h"
+
+
+
+
+/*************/
+/* CONSTANTS */
+/*************/
+
+/* Grandària d'un banc de VRAM. */
+#define GBC_VRAM_BANK_SIZE 8192
+
+/* Grandària OAM. */
+#define GBC_OAM_SIZE 160
+
+/* Escriptures que es poden registrar en un frame en mode diferit. */
+#define GBC_LCD_DEFER_LOG_SIZE 4096
+
+/* Escriptures que es poden registrar en un frame per al fil de
+   renderitzat. */
+#define GBC_LCD_THREAD_LOG_SIZE 16384
+
+/* Grandària d'una pàgina de la RAM interna. */
+#define GBC_WRAM_PAGE_SIZE 4096
+
+/* Grandària HRAM. */
+#define GBC_HRAM_SIZE 127
+
+/* RAM estàtica dels cartutxos. */
+#define GBC_MAPPER_RAM_BANK_SIZE 8192
+#define GBC_MAPPER_RAM_NBANKS 16
+
+/* Cache de blocs de la UCP: número de blocs (potència de 2) i número
+ * màxim d'instruccions per bloc. */
+#define GBC_CPU_NBLOCKS 1024
+#define GBC_CPU_BLOCK_SIZE 16
+
+/* Bytes de memòria executable per al codi generat pel compilador
+ * dinàmic de la UCP. */
+#define GBC_CPU_JIT_SIZE (1024*1024)
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+/* MAIN - Events del planificador. */
+typedef enum
+  {
+    GBC_EV_LCD= 0,      /* VBlank, STAT i blocs de HDMA. */
+    GBC_EV_TIMER,       /* Desbordament del temporitzador. */
+    GBC_EV_APU,         /* Búfer de so ple. */
+    GBC_EV_CHECK,       /* Crida a CHECKSIGNALS. */
+    GBC_EV_NUM
+  } GBC_Event;
+
+/* LCD - Paleta de colors. */
+typedef struct
+{
+
+  int      v[8][4];
+  int      p; /* Paleta. */
+  int      c; /* Color. */
+  int      high; /* Posició. */
+  GBC_Bool auto_increment;
+
+} cpal_t;
+
+/* Cua circular d'índexs amb un únic productor i un únic consumidor
+   (veure 'lcd.c'). */
+typedef struct
+{
+
+  int      *v;
+  unsigned  size;
+  unsigned  head;       /* Següent a llegir. Sols l'escriu el
+        		   consumidor. */
+  unsigned  tail;       /* Següent a escriure. Sols l'escriu el
+        		   productor. */
+
+} spsc_t;
+
+/* Informació d'un buffer de l'anell. */
+typedef struct
+{
+
+  GBC_FrameChanges changes;
+  GBCu64           number;
+
+} ring_slot_t;
+
+/* Escriptura registrada en mode diferit. */
+typedef struct
+{
+
+  GBCu8  line;       /* Primera línia a la que afecta. */
+  GBCu8  type;
+  GBCu16 addr;
+  GBCu16 old;        /* Valor anterior. */
+  GBCu16 val;        /* Valor nou. */
+
+} defer_op_t;
+
+/* Fil de renderitzat. El fil renderitza un frame per darrere sobre la
+   seua pròpia còpia de l'estat del LCD ('rm'), aplicant les
+   escriptures que registra el fil de la simulació. */
+typedef struct
+{
+
+  GBC_Machine     *rm;           /* Sols s'utilitza 'rm->lcd'. */
+  pthread_t        thread;
+  pthread_mutex_t  lock;
+  pthread_cond_t   cond;
+  int              state;
+  GBC_Bool         check;        /* Renderitza també en línia i compara. */
+  defer_op_t      *log[2];       /* Un per al frame actual i l'altre per
+        			    al que renderitza el fil. */
+  int              n[2];
+  int              cur;          /* Registre del frame actual. */
+  GBC_Bool         job_skip;     /* El frame del fil no es dibuixa. */
+  GBCu8           *check_fb;     /* Frame renderitzat en línia. */
+  GBCu64           mismatches;
+
+} lcd_thread_t;
+
+
+/* CPU - Instrucció descodificada d'un bloc. */
+typedef struct
+{
+
+  int   (*exec) (GBC_Machine *m);  /* Implementació. */
+  GBCu8   opcode;
+  GBCu8   ops[2];                  /* Operands ja llegits. */
+  GBCu8   nbytes;
+  GBCu8   check;                   /* Accedix a memòria o canvia IME. */
+
+} cpu_inst_t;
+
+
+/* CPU - Bloc bàsic descodificat. */
+typedef struct
+{
+
+  GBC_Bool   valid;
+  int        bank;         /* Banc de la regió on està el codi. */
+  GBCu16     addr;         /* Adreça de la primera instrucció. */
+  GBCu16     size;         /* Bytes. */
+  int        cc;           /* Cicles de totes les instruccions menys
+        		      l'última, o -1 si encara no es coneixen. */
+  int        n;            /* Número d'instruccions. */
+  cpu_inst_t v[GBC_CPU_BLOCK_SIZE];
+  GBCu16     idle;         /* Registre que consulta si és un bucle
+        		      d'espera, o 0. */
+  int        hits;         /* Execucions abans de compilar-lo. */
+  void     (*native) (GBC_Machine *m); /* Codi natiu o NULL. */
+
+} cpu_block_t;
+
+
+/* MAPPER - MBC1. */
+typedef struct
+{
+
+  GBC_Bool     ram_2KB;
+  GBCu8       *ram[4];
+  GBCu16       nbanks_ram;
+  GBCu8       *cram;          /* Bank actual. */
+  GBC_Bool     ram_enabled;
+  GBCu8        rom_num;
+  const GBCu8 *rom0;
+  const GBCu8 *rom1;
+  GBCu8        low;
+  GBCu8        high;
+  GBC_Bool     mode0;
+
+} mbc1_t;
+
+
+/* MAPPER - MBC2. */
+typedef struct
+{
+
+  GBCu8        *ram;
+  GBC_Bool     ram_enabled;
+  GBCu8        rom_num;
+  const GBCu8 *rom0;
+  const GBCu8 *rom1;
+
+} mbc2_t;
+
+
+typedef struct
+{
+
+  int      ss;
+  int      mm;
+  int      hh;
+  int      dd;
+  GBC_Bool carry;
+
+} mbc3_time_t;
+
+
+/* MAPPER - MBC3. */
+typedef struct
+{
+
+  GBCu8       *ram[4];
+  GBCu8       *cram;
+  GBC_Bool     ram_enabled;
+  enum {
+    MBC3_MODE_RAM,
+    MBC3_MODE_NONE,
+    MBC3_MODE_RTC_S,
+    MBC3_MODE_RTC_M,
+    MBC3_MODE_RTC_H,
+    MBC3_MODE_RTC_DL,
+    MBC3_MODE_RTC_DH
+  }            ram_mode;
+  GBCu16       rom_num;
+  const GBCu8 *rom0;
+  const GBCu8 *rom1;
+  mbc3_time_t  counters;
+  mbc3_time_t  latch;
+  GBC_Bool     latch_flag;
+  clock_t      cc;
+  clock_t      remaincc;
+  GBC_Bool     timer_enabled;
+
+} mbc3_t;
+
+
+/* MAPPER - MBC5. */
+typedef struct
+{
+
+  GBCu8       *ram[4];
+  GBCu16       nbanks_ram;
+  GBCu8       *cram;          /* Bank actual. */
+  GBC_Bool     ram_enabled;
+  GBCu16       rom_num;
+  const GBCu8 *rom0;
+  const GBCu8 *rom1;
+  GBC_Bool     rumble;
+  int          cc;
+  int          rumble_level;    /* Últim nivell actiu. */
+  int          rumble_state;
+  int          rumble_nframes;
+
+} mbc5_t;
+
+
+
+
+/***********/
+/* MÀQUINA */
+/***********/
+
+struct GBC_Machine
+{
+
+  /* MAIN. */
+  struct
+  {
+
+    const GBC_Rom    *rom;                 /* Rom. */
+    GBC_Bool          use_fake_bios;       /* Inidica si hi ha bios. */
+    GBC_Bool          stop;                /* Senyals. */
+    GBC_CheckSignals *check;               /* Frontend. */
+    GBC_Warning      *warning;
+    void             *udata;
+    int               speed;               /* Velocitat (1 - Doble
+        				      velocitat). */
+    GBC_CPUStep      *cpu_step;            /* Callback per a la
+        				      UCP. */
+    int               cc;                  /* Cicles des de l'última
+        				      crida a 'check'. */
+
+    /* Planificador. Els instants són cicles (a velocitat normal)
+       des de 'GBC_init'. */
+    struct
+    {
+      GBCu64 now;                          /* Principi de la
+        				      instrucció actual. */
+      GBCu64 synced;                       /* Instant fins al qual
+        				      estan actualitzats els
+        				      dispositius. */
+      GBCu64 ev[GBC_EV_NUM];               /* Instant de cada
+        				      event. */
+      GBCu64 next;                         /* Event més pròxim. */
+      int    cpu_cc;                       /* Cicles de
+        				      'GBC_cpu_run_cycles' ja
+        				      comptats en NOW. */
+    }                 sched;
+
+  } main;
+
+  /* CPU. */
+  struct
+  {
+
+    /* L'acumulador tenen més bits dels que neecessita. */
+    struct
+    {
+
+      GBCu16 SP;
+      GBCu16 PC;
+      GBCu16 A;
+      GBCu8  F, F2;
+      GBCu8  B;
+      GBCu8  C;
+      GBCu8  D;
+      GBCu8  E;
+      GBCu8  H;
+      GBCu8  L;
+      GBCu8  IE, IF, IAUX;
+      GBC_Bool IME;
+      GBC_Bool halted;
+      GBC_Bool unhalted;
+
+    }            regs;
+
+    /* Opcode de la instrucció que s'està executant. */
+    GBCu8        opcode;
+    GBCu8        opcode2;
+
+    /* Informació de l'usuari. */
+    GBC_Warning *warning;
+    void        *udata;
+
+    /* Mode. */
+    int          cgb_mode;
+
+    /* Velocitat. */
+    struct
+    {
+
+      GBCu8    current;
+      GBC_Bool prepare;
+
+    }            speed;
+
+    /* Execució per lots ('GBC_cpu_run_cycles'). */
+    struct
+    {
+
+      int budget;                /* Cicles a executar. */
+      int cc;                    /* Cicles executats abans de la
+        			    instrucció actual. */
+
+    }            run;
+
+    /* Cache de blocs bàsics. */
+    struct
+    {
+
+      const GBCu8 *ops;          /* Operands de la instrucció actual,
+        			    NULL fora dels blocs. */
+      cpu_block_t  v[GBC_CPU_NBLOCKS];
+
+    }            blocks;
+
+    /* Bucles d'espera. */
+    struct
+    {
+
+      GBC_Bool enabled;
+      GBCu64   skipped;          /* Cicles botats. */
+
+    }            idle;
+
+    /* Compilador dinàmic. */
+    struct
+    {
+
+      GBC_JitMode       mode;
+      GBCu8            *code;    /* Memòria per al codi o NULL. */
+      size_t            used;
+      size_t            page;    /* Grandària de pàgina. */
+      GBC_JitBlockHook *hook;
+      void             *hook_udata;
+
+    }            jit;
+
+  } cpu;
+
+  /* MEM. */
+  struct
+  {
+
+    /* BIOS. */
+    const GBCu8   *bios;
+    GBC_Bool       bios_mapped;
+
+    /* RAM. */
+    GBCu8          ram[8][GBC_WRAM_PAGE_SIZE];
+    GBCu8         *ram0;
+    GBCu8         *ram1;
+    GBCu8          svbk;
+
+    /* HRAM. */
+    GBCu8          hram[GBC_HRAM_SIZE];
+
+    /* Nombre de blocs de la UCP que contenen cada byte de RAM. */
+    GBCu8          ram_code[8][GBC_WRAM_PAGE_SIZE];
+    GBCu8          hram_code[GBC_HRAM_SIZE];
+
+    /* Taula de pàgines de 256 bytes per als accessos directes (NULL
+       vol dir que s'ha de passar per 'read' o 'write'). 'cpage'
+       apunta a les marques de codi de les pàgines de 'wpage'. */
+    const GBCu8   *rom0;
+    const GBCu8   *rom1;
+    const GBCu8   *vram;
+    const GBCu8   *rpage[256];
+    GBCu8         *wpage[256];
+    const GBCu8   *cpage[256];
+
+    /* Accessos als ports d'E/S no implementats. */
+    GBCu32         io_reads[128];
+    GBCu32         io_writes[128];
+
+    /* Funcions per a llegir. */
+    GBCu8        (*read) (GBC_Machine *m,const GBCu16 addr);
+    void         (*write) (GBC_Machine *m,const GBCu16 addr,const GBCu8 data);
+
+    /* Callbacks. */
+    GBC_Warning   *warning;
+    GBC_MemAccess *mem_access;
+    void          *udata;
+
+  } mem;
+
+  /* MAPPER. */
+  struct
+  {
+
+    /* Callbacks. */
+    GBC_MapperChanged  *mapper_changed;
+    GBC_UpdateRumble   *update_rumble;
+    GBC_GetExternalRAM *get_external_ram;
+    void               *udata;
+
+    /* RAM que no estàtica. */
+    GBCu8               ram[GBC_MAPPER_RAM_NBANKS][GBC_MAPPER_RAM_BANK_SIZE];
+
+    /* L'estat. */
+    struct
+    {
+
+      const GBC_Rom *rom;      /* ROM */
+      GBC_Mapper     mapper;
+      union
+      {
+        mbc1_t mbc1;
+        mbc2_t mbc2;
+        mbc3_t mbc3;
+        mbc5_t mbc5;
+      }              s;
+
+    }                   state;
+
+    /* Funcions del mapper actual. */
+    void  (*clock) (GBC_Machine *m,const int cc);
+    int   (*get_bank1) (GBC_Machine *m);
+    GBCu8 (*read) (GBC_Machine *m,const GBCu16 addr);
+    GBCu8 (*read_ram) (GBC_Machine *m,const GBCu16 addr);
+    void  (*write) (GBC_Machine *m,const GBCu16 addr,const GBCu8 data);
+    void  (*write_ram) (GBC_Machine *m,const GBCu16 addr,const GBCu8 data);
+
+  } mapper;
+
+  /* TIMERS. */
+  struct
+  {
+
+    /* Divisor a 16384 Hz (Cada 256 cicles rellotge). */
+    struct
+    {
+
+      GBCu8 reg;
+      int   cc;
+
+    } divider;
+
+    /* Temporitzador. */
+    struct
+    {
+
+      GBCu8    control;
+      GBCu8    counter;
+      GBCu8    modulo;
+      GBC_Bool enabled;
+      int      cc;
+      int      freq;
+
+    } timer;
+
+  } timers;
+
+  /* JOYPAD. */
+  struct
+  {
+
+    /* Callbacks. */
+    GBC_CheckButtons *check_buttons;
+    void             *udata;
+
+    /* Selecci i bits ignorats. */
+    GBCu8             sel;
+
+  } joypad;
+
+  /* LCD. */
+  struct
+  {
+
+    /* Mode. */
+    GBC_Bool          cgb_mode;
+    GBC_Bool          pal_lock;
+
+    /* Callbacks. */
+    GBC_Warning      *warning;
+    GBC_UpdateScreen *update_screen;
+    void             *udata;
+
+    /* Registre de control. */
+    struct
+    {
+
+      GBCu8    data;               /* Valor del registre. */
+      GBC_Bool enabled;            /* Dispositiu activat. */
+      GBCu16   win_tile_map;       /* Adreça del mapa de tiles utilitzat
+        			      per la finestra. */
+      GBC_Bool b5;                 /* Bit5. */
+      GBC_Bool win_enabled;        /* Finestra activada. */
+      GBC_Bool bgwin_tile_data;    /* TRUE -> 8000-8FFF (Unsigned). FALSE
+        			      -> 8800-97FF (Signed). */
+      GBC_Bool bg_tile_map;        /* Adreça del mapa de tiles utilitzat
+        			      per al fons. */
+      GBC_Bool obj_size16;         /* A cert indica que els sprites són
+        			      de 8x16. */
+      GBC_Bool obj_enabled;        /* Sprites actius. */
+      GBC_Bool bg_enabled;         /* Fons actiu. */
+      GBC_Bool obj_has_prio;       /* Els sprites sempre tenen prioritat
+        			      sobre el fons i la finestra. */
+
+    }                 control;
+
+    /* Registre d'estat. */
+    struct
+    {
+
+      GBCu8    hdata;           /* Conté la part que no varia del
+        			   registre ([7-3]). */
+      GBC_Bool intC_enabled;    /* Interrupció coincidència. */
+      GBC_Bool int2_enabled;    /* Interrupció mode 2. */
+      GBC_Bool int1_enabled;    /* Interrupció mode 1. */
+      GBC_Bool int0_enabled;    /* Interrupció mode 0. */
+      GBCu8    mode;            /* Mode actual. */
+
+    }                 status;
+
+    /* Timing. */
+    struct
+    {
+
+      int cc;           /* Cicles acumulats. */
+      int cctoVBInt;    /* Cicles per a la següent interrupció
+        		   VBlank. Coincideix amb la interrupció mode
+        		   1. */
+      int cctoCInt;     /* Cicles fins a la següent interrupció per
+        		   coincidència. */
+      int ccto2Int;     /* Cicles fins a la següent interrupció mode
+        		   2. */
+      int ccto0Int;     /* Cicles fins a la següent interrupció mode
+        		   0. */
+      int extracc;      /* Cicles extra. */
+
+    }                 timing;
+
+    /* Registres de posició. */
+    struct
+    {
+
+      GBCu8 SCY,SCX;
+      int LY,LX;
+      int LYC;
+      GBCu8 WY,WX;
+
+    }                 pos;
+
+    /* Memòria. */
+    GBCu8             vram[2][GBC_VRAM_BANK_SIZE];
+    GBCu8            *cvram;
+    GBCu8             vram_selected;
+
+    /* Cache dels tiles descodificats (índex de color per píxel, sense
+       i amb volteig horitzontal). */
+    struct
+    {
+
+      GBCu8    pix[2][384][2][64];
+      GBC_Bool valid[2][384];
+
+    }                 tiles;
+
+    /* Funcions vectorials del renderitzat. */
+    const GBC_LCDKernels *kernels;
+
+    /* OAM. */
+    GBCu8             oam[GBC_OAM_SIZE];
+
+    /* Objectes candidats de cada línia (un bit per objecte de l'OAM,
+       en ordre). S'actualitza quan canvia la Y d'un objecte o la
+       grandària dels sprites. */
+    GBCu64            obj_lines[144];
+
+    /* DMA. */
+    struct
+    {
+
+      GBCu16   src;
+      GBCu16   dst;
+      GBCu8    length;
+      GBC_Bool active;
+
+    }                 dma;
+
+    /* Paleta monocroma. */
+    struct
+    {
+
+      GBCu8 bg[4];
+      GBCu8 ob0[4];
+      GBCu8 ob1[4];
+
+    }                 mpal;
+
+    /* Paleta de colors. */
+    struct
+    {
+
+      cpal_t bg;
+      cpal_t ob;
+
+    }                 cpal;
+
+    /* Estat renderitzat. */
+    struct
+    {
+
+      int  fb[23040 /*160x144*/];    /* Frame buffer. */
+      int  lines;                    /* Número de línies reals
+        				renderitzades. */
+      int *p;                        /* Apunta al següent píxel a
+        				renderitzar. */
+      int  line_bg[160];             /* Línia amb el fons dibuixat. */
+      int  line_obj[160];            /* Línia amb els sprites. -1
+        				indica transparent. */
+      signed char prio_bg[160];      /* La prioritat segons el fons. 0
+        				-> El que diguen els sprites. 1
+        				-> Prioritat fons. -1 -> Color
+        				fons transparent. */
+      signed char prio_obj[160];     /* La prioritat segons els
+        				sprites. 0 -> prioritat
+        				sprite. El valor sols es fixa
+        				quan el color no és
+        				transparent. */
+
+    }                 render;
+
+    /* Imatge en el format del 'frontend'. Amb GBC_FB_CGB15 s'utilitza
+       directament 'render.fb'. */
+    struct
+    {
+
+      GBC_FBFormat format;
+      GBCu32       lut[66];          /* Color de cada entrada de les
+        				    paletes en el format. */
+      int          line[160];        /* Línia composta (entrades de
+        				    les paletes). */
+      GBCu32       dirty[5];         /* Línies modificades des de
+        				    l'últim frame lliurat. */
+      GBC_Bool     pal_changed;      /* La taula ha canviat des de
+        				    l'últim frame lliurat. */
+      GBCu32      *color_lut;        /* Color corregit (R | G<<8 |
+        				    B<<16) de cada color
+        				    BBBBBGGGGGRRRRR. NULL -> sense
+        				    correcció. */
+      union
+      {
+        GBCu32 u32[23040];
+        GBCu16 u16[23040];
+        GBCu8  u8[23040];
+      }            fb;
+
+    }                 out;
+
+    /* Frames que no es renderitzen. */
+    struct
+    {
+
+      int      n;                    /* Frames botats per cada frame
+        				renderitzat. Negatiu -> cap. */
+      int      count;                /* Frames botats des de l'últim
+        				renderitzat. */
+      GBC_Bool frame;                /* El frame actual es bota. */
+
+    }                 skip;
+
+    /* Anell de buffers on es publiquen els frames. */
+    struct
+    {
+
+      int               n;           /* Buffers (0 -> desactivat). */
+      GBC_FBRingPolicy  policy;
+      size_t            size;        /* Bytes de cada buffer. */
+      GBCu8            *mem;
+      ring_slot_t      *slots;
+      int               cur;         /* On es renderitza (-1 cap). */
+      int               prev;        /* Últim publicat (-1 cap). */
+      GBCu64            frames;      /* Frames publicats. */
+      GBCu64            dropped;     /* Frames perduts. */
+      spsc_t            ready;       /* Frames publicats. */
+      spsc_t            free;        /* Buffers alliberats. */
+      pthread_mutex_t   lock;        /* Sols per a esperar. */
+      pthread_cond_t    cond;
+
+    }                 ring;
+
+    /* Renderitzat diferit. */
+    struct
+    {
+
+      GBC_Bool   enabled;
+      int        lines;       /* Línies que ha recorregut el LCD. */
+      int        n;           /* Escriptures registrades. */
+      defer_op_t log[GBC_LCD_DEFER_LOG_SIZE];
+
+    }                 defer;
+
+    /* Fil de renderitzat (NULL si no s'utilitza). */
+    lcd_thread_t     *thread;
+
+    /* Indica si està parat. */
+    GBC_Bool          stop;
+
+  } lcd;
+
+  /* APU. */
+  struct
+  {
+
+    /* Estat provisional pera VIN. */
+    GBCu8          vin;
+
+    /* Patrons duty amb grunalaritat 12. */
+    char           duty_pat[4][96];
+
+    /* Canal 1. */
+    struct
+    {
+
+      GBC_Bool enabled;
+
+      /* Programmable timer. */
+      GBCu16   pt_freq;
+      GBCu16   pt_counter;
+
+      /* Master Channel Control Switch. */
+      GBC_Bool mccswitch;
+
+      /* Length counter. */
+      int      lc_aux_div;    /* Divisor auxiliar. */
+      GBCu8    lc_counter;
+      GBC_Bool lc_enabled;
+
+      /* Sweep Unit. */
+      int      sw_aux_div;    /* Dividix lc_aux_div */
+      GBC_Bool sw_enabled;
+      GBCu16   sw_freq;
+      GBCu8    sw_time;
+      GBCu8    sw_counter;
+      GBC_Bool sw_increase;
+      GBCu8    sw_shift;
+      GBC_Bool sw_neg_used;
+
+      /* Duty Cicle. */
+      GBCu8    dc_wave_pattern;
+      int      dc_pos;
+      char     dc_out;
+
+      /* Volumne Envelope. */
+      int      ve_aux_div;    /* Divisor auxiliar que utilitza amb
+        			 sw_aux_div. */
+      GBCu8    ve_vol_reg;
+      GBCu8    ve_vol;
+      GBC_Bool ve_increase_reg;
+      GBC_Bool ve_increase;
+      GBCu8    ve_step;
+      GBCu8    ve_counter;
+
+    }              ch1;
+
+    /* Canal 2. */
+    struct
+    {
+
+      GBC_Bool enabled;
+
+      /* Programmable timer. */
+      GBCu16   pt_freq;
+      GBCu16   pt_counter;
+
+      /* Master Channel Control Switch. */
+      GBC_Bool mccswitch;
+
+      /* Length counter. */
+      int      lc_aux_div;    /* Divisor auxiliar. */
+      GBCu8    lc_counter;
+      GBC_Bool lc_enabled;
+
+      /* Duty Cicle. */
+      GBCu8    dc_wave_pattern;
+      int      dc_pos;
+      char     dc_out;
+
+      /* Volumne Envelope. */
+      int      ve_aux_div;    /* Divisor auxiliar que utilitza amb
+        			 lc_aux_div. */
+      GBCu8    ve_vol_reg;
+      GBCu8    ve_vol;
+      GBC_Bool ve_increase_reg;
+      GBC_Bool ve_increase;
+      GBCu8    ve_step;
+      GBCu8    ve_counter;
+
+    }              ch2;
+
+    /* Canal 3. */
+    struct
+    {
+
+      GBC_Bool enabled;
+
+      /* Programmable timer. */
+      GBCu16   pt_freq;
+      GBCu16   pt_counter;
+
+      /* Master Channel Control Switch. */
+      GBC_Bool mccswitch;
+
+      /* Length counter. */
+      int      lc_aux_div;    /* Divisor auxiliar. */
+      GBCu16   lc_counter;
+      GBC_Bool lc_enabled;
+
+      /* Wave Pattern RAM. */
+      char     ram[32];
+
+      /* Wave Pattern Playback / Shifter Unit. */
+      int      su_pos;
+      int      su_val;
+
+    }              ch3;
+
+    /* Canal 4. */
+    struct
+    {
+
+      GBC_Bool enabled;
+
+      /* Configurable timer. */
+      GBCu16   ct_3bcounter;   /* 2*524288 / (2*r) / 2^(s+1) */
+      int      ct_16bcounter;
+      GBCu8    ct_ratio;
+      GBCu8    ct_scfreq;
+
+      /* Master Channel Control Switch. */
+      GBC_Bool mccswitch;
+
+      /* Length counter. */
+      int      lc_aux_div;    /* Divisor auxiliar. */
+      GBCu8    lc_counter;
+      GBC_Bool lc_enabled;
+
+      /* Volumne Envelope. */
+      int      ve_aux_div;    /* Divisor auxiliar que utilitza amb
+        			 lc_aux_div. */
+      GBCu8    ve_vol_reg;
+      GBCu8    ve_vol;
+      GBC_Bool ve_increase_reg;
+      GBC_Bool ve_increase;
+      GBCu8    ve_step;
+      GBCu8    ve_counter;
+
+      /* PseudoRandom Number Generator. */
+      GBCu16   pr_prng;
+      char     pr_out;
+      GBC_Bool pr_mode15b;
+
+    }              ch4;
+
+    /* Indica que el so està activat o no. */
+    GBC_Bool       sound_on;
+    GBC_Bool       stop;
+
+    /* Buffers per a cada canal. Açò es abans de convertir al valor
+       real. */
+    GBCu8          buffer[4][GBC_APU_BUFFER_SIZE];
+
+    /* Comptadors i cicles per processar. */
+    struct
+    {
+
+      int pos;          /* Següent sample a generar, on 0 és el
+        		   primer. */
+      int cc;           /* Cicles de UCP acumulats. */
+      int cctoFrame;    /* Cicles que falten per a plenar el
+        		   buffer. */
+
+    }              timing;
+
+    /* Buffers d'eixida. */
+    double         left[GBC_APU_BUFFER_SIZE];
+    double         right[GBC_APU_BUFFER_SIZE];
+
+    /* Màscares dels canals. */
+    int            left_mask;
+    int            right_mask;
+
+    /* Callback. */
+    GBC_PlaySound *play_sound;
+    void          *udata;
+
+  } apu;
+
+};
+
+#endif /* __MACHINE_H__ */
@@ -22,11 +22,13 @@
  */
 
 
+#include <limits.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "GBC.h"
+#include "machine.h"
 
 
 
@@ -42,6 +44,12 @@ static const int CCTOCHECK= 42000;
 
 static const char GBCSTATE[]= "GBCSTATE\n";
 
+/* Instant d'un event que no es produirà mai. */
+#define NEVER (~((GBCu64) 0))
+
+/* Màxim de cicles que s'executen sense sincronitzar (un frame). */
+#define MAX_BUDGET 70224
+
 
 
 
@@ -49,37 +57,150 @@ static const char GBCSTATE[]= "GBCSTATE\n";
 /* ESTAT */
 /*********/
 
-/* Rom. */
-static const GBC_Rom *_rom;
+/* L'estat està en 'GBC_Machine' (veure 'machine.h'). */
+#define _rom (m->main.rom)
+#define _use_fake_bios (m->main.use_fake_bios)
+#define _stop (m->main.stop)
+#define _check (m->main.check)
+#define _warning (m->main.warning)
+#define _udata (m->main.udata)
+#define _speed (m->main.speed)
+#define _cpu_step (m->main.cpu_step)
+#define _CC (m->main.cc)
+#define _sched (m->main.sched)
+
 
-/* Inidica si hi ha bios. */
-static GBC_Bool _use_fake_bios;
 
-/* Senyals. */
-static GBC_Bool _stop;
-static GBC_Bool _button_pressed;
-static GBC_Bool _direction_pressed;
 
-/* Frontend. */
-static GBC_CheckSignals *_check;
-static GBC_Warning *_warning;
-static void *_udata;
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
 
-/* Velocitat (1 - Doble velocitat). */
-static int _speed;
+/* Posa al dia tots els dispositius amb els cicles executats des de
+ * l'última sincronització. Els dispositius sols processen de veritat
+ * els cicles quan arriben al seu event, la resta del temps sols els
+ * acumulen, per tant el resultat és el mateix que si s'actualitzaren
+ * després de cada instrucció.
+ */
+static void
+sync (
+      GBC_Machine *m
+      )
+{
+  
+  int cc, extra;
+  
+  
+  cc= (int) (_sched.now - _sched.synced);
+  _sched.synced= _sched.now; /* Per si 'GBC_lcd_clock' accedix a
+        			memòria. */
+  extra= GBC_lcd_clock ( m, cc );
+  cc+= extra;
+  _sched.now+= extra;
+  _sched.synced= _sched.now;
+  GBC_apu_clock ( m, cc );
+  GBC_mapper_clock ( m, cc );
+  GBC_timers_clock ( m, cc<<_speed );
+  _CC+= cc;
+  
+} /* end sync */
 
-/* Callback per a la UCP. */
-static GBC_CPUStep *_cpu_step;
 
+static GBCu64
+event_time (
+            GBC_Machine *m,
+            const int    cc
+            )
+{
+  return cc<=0 ? _sched.synced : _sched.synced+cc;
+} /* end event_time */
 
 
+/* Recalcula l'instant de tots els events. S'ha de cridar després de
+ * 'sync'.
+ */
+static void
+update_events (
+               GBC_Machine *m
+               )
+{
+  
+  int cc, i;
+  
+  
+  _sched.ev[GBC_EV_LCD]= event_time ( m, GBC_lcd_next_event ( m ) );
+  cc= GBC_timers_next_event ( m );
+  _sched.ev[GBC_EV_TIMER]= cc < 0 ? NEVER :
+    event_time ( m, (cc+(1<<_speed)-1)>>_speed );
+  /* Mentre la UCP està parada no cal parar en els events de l'APU,
+     que no demana interrupcions. Es sincronitzarà en el següent. */
+  _sched.ev[GBC_EV_APU]= GBC_cpu_is_halted ( m ) ? NEVER :
+    event_time ( m, GBC_apu_next_event ( m ) );
+  _sched.ev[GBC_EV_CHECK]= _check!=NULL ?
+    event_time ( m, CCTOCHECK-_CC ) : NEVER;
+  _sched.next= _sched.ev[0];
+  for ( i= 1; i < GBC_EV_NUM; ++i )
+    if ( _sched.ev[i] < _sched.next )
+      _sched.next= _sched.ev[i];
+  
+} /* end update_events */
+
+
+/* Executa instruccions fins arribar al pròxim event i actualitza els
+ * dispositius. Torna els cicles executats.
+ */
+static int
+run_to_next_event (
+        	   GBC_Machine *m
+        	   )
+{
+  
+  GBCu64 begin;
+  int budget, cc;
+  
+  
+  /* Els cicles de la UCP van al doble de velocitat en mode doble. Com
+     les instruccions sempre tarden un número parell de cicles, és
+     equivalent a convertir-los un a un. */
+  begin= _sched.now;
+  if ( _sched.next <= _sched.now ) budget= 0;
+  else if ( _sched.next-_sched.now > MAX_BUDGET ) budget= MAX_BUDGET<<_speed;
+  else budget= ((int) (_sched.next-_sched.now))<<_speed;
+  _sched.cpu_cc= 0;
+  cc= GBC_cpu_run_cycles ( m, budget );
+  _sched.now+= (cc-_sched.cpu_cc)>>_speed;
+  _sched.cpu_cc= cc;
+  sync ( m );
+  
+  return (int) (_sched.now - begin);
+  
+} /* end run_to_next_event */
+
+
+static void
+check_signals (
+               GBC_Machine *m,
+               GBC_Bool    *stop
+               )
+{
+  
+  GBC_Bool button_pressed, direction_pressed;
+  
+  
+  if ( _CC < CCTOCHECK ) return;
+  _CC-= CCTOCHECK;
+  if ( _check == NULL ) return;
+  button_pressed= direction_pressed= GBC_FALSE;
+  _check ( stop, &button_pressed, &direction_pressed, _udata );
+  GBC_joypad_key_pressed ( m, button_pressed, direction_pressed );
+  
+} /* end check_signals */
 
-/*********************/
-/* FUNCIONS PRIVADES */
-/*********************/
 
 static void
-fake_bios (void)
+fake_bios (
+           GBC_Machine *m
+           )
 {
   
   GBC_Bool cgb_mode;
@@ -87,26 +208,26 @@ fake_bios (void)
   
   /* CGB MODE. */
   cgb_mode= ((_rom->banks[0][0x143]&0x80)!=0);
-  GBC_cpu_set_cgb_mode ( cgb_mode );
-  GBC_lcd_set_cgb_mode ( cgb_mode );
-  if ( !cgb_mode ) GBC_lcd_init_gray_pal ();
+  GBC_cpu_set_cgb_mode ( m, cgb_mode );
+  GBC_lcd_set_cgb_mode ( m, cgb_mode );
+  if ( !cgb_mode ) GBC_lcd_init_gray_pal ( m );
   
   /* Power Up Sequence. */
-  GBC_cpu_power_up ();
-  GBC_apu_power_up ();
-  GBC_mem_write ( 0xFF05, 0x00 );
-  GBC_mem_write ( 0xFF06, 0x00 );
-  GBC_mem_write ( 0xFF07, 0x00 );
-  GBC_mem_write ( 0xFF40, 0x91 );
-  GBC_mem_write ( 0xFF42, 0x00 );
-  GBC_mem_write ( 0xFF43, 0x00 );
-  GBC_mem_write ( 0xFF45, 0x00 );
-  GBC_mem_write ( 0xFF47, 0xFC );
-  GBC_mem_write ( 0xFF48, 0xFF );
-  GBC_mem_write ( 0xFF49, 0xFF );
-  GBC_mem_write ( 0xFF4A, 0x00 );
-  GBC_mem_write ( 0xFF4B, 0x00 );
-  GBC_mem_write ( 0xFFFF, 0x00 );
+  GBC_cpu_power_up ( m );
+  GBC_apu_power_up ( m );
+  GBC_mem_write ( m, 0xFF05, 0x00 );
+  GBC_mem_write ( m, 0xFF06, 0x00 );
+  GBC_mem_write ( m, 0xFF07, 0x00 );
+  GBC_mem_write ( m, 0xFF40, 0x91 );
+  GBC_mem_write ( m, 0xFF42, 0x00 );
+  GBC_mem_write ( m, 0xFF43, 0x00 );
+  GBC_mem_write ( m, 0xFF45, 0x00 );
+  GBC_mem_write ( m, 0xFF47, 0xFC );
+  GBC_mem_write ( m, 0xFF48, 0xFF );
+  GBC_mem_write ( m, 0xFF49, 0xFF );
+  GBC_mem_write ( m, 0xFF4A, 0x00 );
+  GBC_mem_write ( m, 0xFF4B, 0x00 );
+  GBC_mem_write ( m, 0xFFFF, 0x00 );
       
 } /* end fake_bios */
 
@@ -118,14 +239,79 @@ fake_bios (void)
 /**********************/
 
 void
-GBC_main_switch_speed (void)
+GBC_main_resched (
+                  GBC_Machine *m
+                  )
 {
+  GBC_cpu_stop_run ( m );
+} /* end GBC_main_resched */
+
+
+void
+GBC_main_switch_speed (
+                       GBC_Machine *m
+                       )
+{
+  
+  /* Els cicles pendents s'han de processar amb la velocitat
+     anterior. */
+  GBC_main_sync ( m );
   _speed^= 1;
+  GBC_main_resched ( m );
+  
 } /* end GBC_main_switch_speed */
 
 
+void
+GBC_main_sync (
+               GBC_Machine *m
+               )
+{
+  
+  int cc;
+  
+  
+  /* Cicles executats per 'GBC_cpu_run_cycles' encara no comptats. */
+  cc= GBC_cpu_get_run_cycles ( m );
+  _sched.now+= (cc-_sched.cpu_cc)>>_speed;
+  _sched.cpu_cc= cc;
+  if ( _sched.now != _sched.synced ) sync ( m );
+  
+} /* end GBC_main_sync */
+
+
+void
+GBC_main_get_stable (
+        	     GBC_Machine  *m,
+        	     const GBCu16  addr,
+        	     int          *since,
+        	     int          *until
+        	     )
+{
+  
+  GBC_main_sync ( m );
+  switch ( addr )
+    {
+    case 0xFF04:
+    case 0xFF05:
+      GBC_timers_get_stable ( m, addr, since, until );
+      break;
+    case 0xFF41:
+    case 0xFF44:
+      GBC_lcd_get_stable ( m, addr, since, until );
+      /* Cicles del LCD a cicles de UCP. */
+      if ( *since != INT_MAX ) { *since<<= _speed; *until<<= _speed; }
+      break;
+    default: /* IF sols canvia en els events. */
+      *since= *until= INT_MAX;
+    }
+  
+} /* end GBC_main_get_stable */
+
+
 GBC_Error
 GBC_init (
+          GBC_Machine        *m,
           const GBCu8         bios[0x900],
           const GBC_Rom      *rom,
           const GBC_Frontend *frontend,
@@ -137,6 +323,10 @@ GBC_init (
   
   
   _speed= 0;
+  _CC= 0;
+  _sched.now= _sched.synced= 0;
+  _sched.next= NEVER;
+  _sched.cpu_cc= GBC_cpu_get_run_cycles ( m );
   _check= frontend->check;
   _warning= frontend->warning;
   _udata= udata;
@@ -145,24 +335,26 @@ GBC_init (
   _rom= rom;
   _use_fake_bios= (bios==NULL);
   
-  err= GBC_mapper_init ( rom, bios==NULL,
+  err= GBC_mapper_init ( m, rom, bios==NULL,
         		 frontend->get_external_ram,
         		 frontend->update_rumble,
         		 frontend->trace!=NULL?
         		 frontend->trace->mapper_changed:NULL,
         		 udata );
   if ( err != GBC_NOERROR ) return err;
-  GBC_mem_init ( bios,
+  GBC_mem_init ( m, bios, frontend->warning,
         	 frontend->trace!=NULL?
         	 frontend->trace->mem_access:NULL,
         	 udata );
-  GBC_cpu_init ( frontend->warning, udata );
-  GBC_lcd_init ( frontend->update_screen, frontend->warning, udata );
-  GBC_timers_init ();
-  GBC_joypad_init ( frontend->check_buttons, udata );
-  GBC_apu_init ( frontend->play_sound, udata );
+  GBC_cpu_init ( m, frontend->warning, udata );
+  GBC_lcd_init ( m, frontend->update_screen, frontend->fb_format,
+        	 frontend->warning, udata );
+  GBC_timers_init ( m );
+  GBC_joypad_init ( m, frontend->check_buttons, udata );
+  GBC_apu_init ( m, frontend->play_sound, udata );
   
-  if ( _use_fake_bios ) fake_bios ();
+  if ( _use_fake_bios ) fake_bios ( m );
+  update_events ( m );
   
   return GBC_NOERROR;
   
@@ -171,28 +363,17 @@ GBC_init (
 
 int
 GBC_iter (
+          GBC_Machine *m,
           GBC_Bool *stop
           )
 {
 
-  static int CC= 0;
   int cc;
-  GBC_Bool button_pressed, direction_pressed;
   
   
-  cc= (GBC_cpu_run ()>>_speed);
-  cc+= GBC_lcd_clock ( cc );
-  GBC_apu_clock ( cc );
-  GBC_mapper_clock ( cc );
-  GBC_timers_clock ( cc<<_speed );
-  CC+= cc;
-  if ( CC >= CCTOCHECK && _check != NULL )
-    {
-      CC-= CCTOCHECK;
-      button_pressed= direction_pressed= GBC_FALSE;
-      _check ( stop, &button_pressed, &direction_pressed, _udata );
-      GBC_joypad_key_pressed ( button_pressed, direction_pressed );
-    }
+  cc= run_to_next_event ( m );
+  check_signals ( m, stop );
+  update_events ( m );
   
   return cc;
   
@@ -201,24 +382,26 @@ GBC_iter (
 
 void
 GBC_key_pressed (
+        	 GBC_Machine *m,
         	 GBC_Bool button_pressed,
         	 GBC_Bool direction_pressed
         	 )
 {
-  GBC_joypad_key_pressed ( button_pressed, direction_pressed );
+  GBC_joypad_key_pressed ( m, button_pressed, direction_pressed );
 } /* end GBC_key_pressed */
 
 
 int
 GBC_load_state (
+        	GBC_Machine *m,
         	FILE *f
         	)
 {
 
-  static char buf[sizeof(GBCSTATE)];
+  char buf[sizeof(GBCSTATE)];
   
   
-  _stop= _button_pressed= _direction_pressed= GBC_FALSE;
+  _stop= GBC_FALSE;
   
   /* GBCSTATE. */
   if ( fread ( buf, sizeof(GBCSTATE)-1, 1, f ) != 1 ) goto error;
@@ -230,13 +413,15 @@ GBC_load_state (
   if ( _speed != 0 && _speed != 1 ) goto error;
   
   /* Carrega. */
-  if ( GBC_mapper_load_state ( f ) != 0 ) goto error;
-  if ( GBC_mem_load_state ( f ) != 0 ) goto error;
-  if ( GBC_cpu_load_state ( f ) != 0 ) goto error;
-  if ( GBC_apu_load_state ( f ) != 0 ) goto error;
-  if ( GBC_lcd_load_state ( f ) != 0 ) goto error;
-  if ( GBC_joypad_load_state ( f ) != 0 ) goto error;
-  if ( GBC_timers_load_state ( f ) != 0 ) goto error;
+  if ( GBC_mapper_load_state ( m, f ) != 0 ) goto error;
+  if ( GBC_mem_load_state ( m, f ) != 0 ) goto error;
+  if ( GBC_cpu_load_state ( m, f ) != 0 ) goto error;
+  if ( GBC_apu_load_state ( m, f ) != 0 ) goto error;
+  if ( GBC_lcd_load_state ( m, f ) != 0 ) goto error;
+  if ( GBC_joypad_load_state ( m, f ) != 0 ) goto error;
+  if ( GBC_timers_load_state ( m, f ) != 0 ) goto error;
+  _sched.synced= _sched.now;
+  update_events ( m );
   
   return 0;
   
@@ -244,79 +429,87 @@ GBC_load_state (
   _warning ( _udata,
              "error al carregar l'estat del simulador des d'un fitxer" );
   _speed= 0;
-  GBC_mapper_init_state (); /* Ací no pot tornar error. */
-  GBC_mem_init_state ();
-  GBC_cpu_init_state ();
-  GBC_apu_init_state ();
-  GBC_lcd_init_state ();
-  GBC_joypad_init_state ();
-  GBC_timers_init ();
-  if ( _use_fake_bios ) fake_bios ();
+  GBC_mapper_init_state ( m ); /* Ací no pot tornar error. */
+  GBC_mem_init_state ( m );
+  GBC_cpu_init_state ( m );
+  GBC_apu_init_state ( m );
+  GBC_lcd_init_state ( m );
+  GBC_joypad_init_state ( m );
+  GBC_timers_init ( m );
+  if ( _use_fake_bios ) fake_bios ( m );
+  _sched.synced= _sched.now;
+  update_events ( m );
   return -1;
   
 } /* end GBC_load_state */
 
 
 void
-GBC_loop (void)
+GBC_loop (
+          GBC_Machine *m
+          )
 {
   
-  int cc, CC;
-  
-  
-  _stop= _button_pressed= _direction_pressed= GBC_FALSE;
-  if ( _check == NULL )
-    {
-      while ( !_stop )
-        {
-          cc= (GBC_cpu_run ()>>_speed);
-          cc+= GBC_lcd_clock ( cc );
-          GBC_apu_clock ( cc );
-          GBC_mapper_clock ( cc );
-          GBC_timers_clock ( cc<<_speed );
-        }
-    }
-  else
+  _stop= GBC_FALSE;
+  _CC= 0;
+  update_events ( m );
+  while ( !_stop )
     {
-      CC= 0;
-      for (;;)
-        {
-          cc= (GBC_cpu_run ()>>_speed);
-          cc+= GBC_lcd_clock ( cc );
-          GBC_apu_clock ( cc );
-          GBC_mapper_clock ( cc );
-          GBC_timers_clock ( cc<<_speed );
-          CC+= cc;
-          if ( CC >= CCTOCHECK )
-            {
-              CC-= CCTOCHECK;
-              _check ( &_stop, &_button_pressed, &_direction_pressed, _udata );
-              GBC_joypad_key_pressed ( _button_pressed, _direction_pressed );
-              _button_pressed= _direction_pressed= GBC_FALSE;
-              if ( _stop ) break;
-            }
-        }
+      run_to_next_event ( m );
+      check_signals ( m, &_stop );
+      update_events ( m );
     }
   _stop= GBC_FALSE;
   
 } /* end GBC_loop */
 
 
+void
+GBC_machine_free (
+        	  GBC_Machine *m
+        	  )
+{
+  
+  if ( m == NULL ) return;
+  GBC_cpu_set_jit ( m, GBC_JIT_OFF );
+  GBC_lcd_set_render_mode ( m, GBC_LCD_RENDER_INLINE );
+  GBC_lcd_set_ring ( m, 0, GBC_FB_RING_DROP );
+  GBC_lcd_set_color_profile ( m, GBC_LCD_COLOR_RAW, NULL );
+  free ( m );
+  
+} /* end GBC_machine_free */
+
+
+GBC_Machine *
+GBC_machine_new (void)
+{
+  
+  GBC_Machine *m;
+  
+  
+  m= (GBC_Machine *) calloc ( 1, sizeof(GBC_Machine) );
+  
+  return m;
+  
+} /* end GBC_machine_new */
+
+
 int
 GBC_save_state (
+        	GBC_Machine *m,
         	FILE *f
         	)
 {
 
   if ( fwrite ( GBCSTATE, sizeof(GBCSTATE)-1, 1, f ) != 1 ) return -1;
   if ( fwrite ( &_speed, sizeof(_speed), 1, f ) != 1 ) return -1;
-  if ( GBC_mapper_save_state ( f ) != 0 ) return -1;
-  if ( GBC_mem_save_state ( f ) != 0 ) return -1;
-  if ( GBC_cpu_save_state ( f ) != 0 ) return -1;
-  if ( GBC_apu_save_state ( f ) != 0 ) return -1;
-  if ( GBC_lcd_save_state ( f ) != 0 ) return -1;
-  if ( GBC_joypad_save_state ( f ) != 0 ) return -1;
-  if ( GBC_timers_save_state ( f ) != 0 ) return -1;
+  if ( GBC_mapper_save_state ( m, f ) != 0 ) return -1;
+  if ( GBC_mem_save_state ( m, f ) != 0 ) return -1;
+  if ( GBC_cpu_save_state ( m, f ) != 0 ) return -1;
+  if ( GBC_apu_save_state ( m, f ) != 0 ) return -1;
+  if ( GBC_lcd_save_state ( m, f ) != 0 ) return -1;
+  if ( GBC_joypad_save_state ( m, f ) != 0 ) return -1;
+  if ( GBC_timers_save_state ( m, f ) != 0 ) return -1;
   
   return 0;
   
@@ -324,34 +517,40 @@ GBC_save_state (
 
 
 void
-GBC_stop (void)
+GBC_stop (
+          GBC_Machine *m
+          )
 {
+  
   _stop= GBC_TRUE;
+  GBC_main_resched ( m );
+  
 } /* end GBC_stop */
 
 
 int
-GBC_trace (void)
+GBC_trace (
+           GBC_Machine *m
+           )
 {
   
-  int cc;
+  GBCu64 begin;
   GBCu16 addr;
   GBC_Step step;
   
   
   if ( _cpu_step != NULL )
     {
-      addr= GBC_cpu_decode_next_step ( &step );
+      addr= GBC_cpu_decode_next_step ( m, &step );
       _cpu_step ( &step, addr, _udata );
     }
-  GBC_mem_set_mode_trace ( GBC_TRUE );
-  cc= (GBC_cpu_run ()>>_speed);
-  cc+= GBC_lcd_clock ( cc );
-  GBC_apu_clock ( cc );
-  GBC_mapper_clock ( cc );
-  GBC_timers_clock ( cc<<_speed );
-  GBC_mem_set_mode_trace ( GBC_FALSE );
-  
-  return cc;
+  GBC_mem_set_mode_trace ( m, GBC_TRUE );
+  begin= _sched.now;
+  _sched.now+= GBC_cpu_run_trace ( m )>>_speed;
+  sync ( m );
+  update_events ( m );
+  GBC_mem_set_mode_trace ( m, GBC_FALSE );
+  
+  return (int) (_sched.now - begin);
   
 } /* end GBC_trace */
@@ -38,6 +38,7 @@
 #include <time.h>
 
 #include "GBC.h"
+#include "machine.h"
 
 
 
@@ -56,8 +57,12 @@
   if ( !(COND) ) return -1;
 
 
-#define RAM_BANK_SIZE 8192
-#define RAM_NBANKS 16
+#define RAM_BANK_SIZE GBC_MAPPER_RAM_BANK_SIZE
+#define RAM_NBANKS GBC_MAPPER_RAM_NBANKS
+
+/* Informa a la memòria dels bancs de ROM mapejats. */
+#define MAP_ROM(MBC)        					\
+  GBC_mem_map_rom ( m, _state.s.MBC.rom0, _state.s.MBC.rom1 )
 
 #define RBL_MIN_CICLES 60000
 #define RBL_MAX_CICLES 80000
@@ -66,133 +71,22 @@
 
 
 /*********/
-/* TIPUS */
+/* ESTAT */
 /*********/
 
-/* MBC1. */
-typedef struct
-{
-  
-  GBC_Bool     ram_2KB;
-  GBCu8       *ram[4];
-  GBCu16       nbanks_ram;
-  GBCu8       *cram;          /* Bank actual. */
-  GBC_Bool     ram_enabled;
-  GBCu8        rom_num;
-  const GBCu8 *rom0;
-  const GBCu8 *rom1;
-  GBCu8        low;
-  GBCu8        high;
-  GBC_Bool     mode0;
-  
-} mbc1_t;
-
-
-// MBC2.
-typedef struct
-{
-  
-  GBCu8        *ram;
-  GBC_Bool     ram_enabled;
-  GBCu8        rom_num;
-  const GBCu8 *rom0;
-  const GBCu8 *rom1;
-  
-} mbc2_t;
-
-
-typedef struct
-{
-  
-  int      ss;
-  int      mm;
-  int      hh;
-  int      dd;
-  GBC_Bool carry;
-  
-} mbc3_time_t;
-
-
-/* MBC3. */
-typedef struct
-{
-  
-  GBCu8       *ram[4];
-  GBCu8       *cram;
-  GBC_Bool     ram_enabled;
-  enum {
-    MBC3_MODE_RAM,
-    MBC3_MODE_NONE,
-    MBC3_MODE_RTC_S,
-    MBC3_MODE_RTC_M,
-    MBC3_MODE_RTC_H,
-    MBC3_MODE_RTC_DL,
-    MBC3_MODE_RTC_DH
-  }            ram_mode;
-  GBCu16       rom_num;
-  const GBCu8 *rom0;
-  const GBCu8 *rom1;
-  mbc3_time_t  counters;
-  mbc3_time_t  latch;
-  GBC_Bool     latch_flag;
-  clock_t      cc;
-  clock_t      remaincc;
-  GBC_Bool     timer_enabled;
-  
-} mbc3_t;
-
-
-/* MBC5. */
-typedef struct
-{
-  
-  GBCu8       *ram[4];
-  GBCu16       nbanks_ram;
-  GBCu8       *cram;          /* Bank actual. */
-  GBC_Bool     ram_enabled;
-  GBCu16       rom_num;
-  const GBCu8 *rom0;
-  const GBCu8 *rom1;
-  GBC_Bool     rumble;
-  int          cc;
-  int          rumble_level;    /* Últim nivell actiu. */
-  int          rumble_state;
-  int          rumble_nframes;
-  
-} mbc5_t;
-
-
-
-
-/****************/
-/* ESTAT PRIVAT */
-/****************/
-
-/* Callbacks. */
-static GBC_MapperChanged *_mapper_changed;
-static GBC_UpdateRumble *_update_rumble;
-static GBC_GetExternalRAM *_get_external_ram;
-static void *_udata;
-
-/* RAM que no estàtica. */
-static GBCu8 _ram[RAM_NBANKS][RAM_BANK_SIZE];
-
-
-/* L'estat. */
-struct
-{
-  
-  const GBC_Rom *rom;      /* ROM */
-  GBC_Mapper     mapper;
-  union
-  {
-    mbc1_t mbc1;
-    mbc2_t mbc2;
-    mbc3_t mbc3;
-    mbc5_t mbc5;
-  }              s;
-  
-} _state;
+/* L'estat està en 'GBC_Machine' (veure 'machine.h'). */
+#define _mapper_changed (m->mapper.mapper_changed)
+#define _update_rumble (m->mapper.update_rumble)
+#define _get_external_ram (m->mapper.get_external_ram)
+#define _udata (m->mapper.udata)
+#define _ram (m->mapper.ram)
+#define _state (m->mapper.state)
+#define _clock (m->mapper.clock)
+#define _get_bank1 (m->mapper.get_bank1)
+#define _read (m->mapper.read)
+#define _read_ram (m->mapper.read_ram)
+#define _write (m->mapper.write)
+#define _write_ram (m->mapper.write_ram)
 
 
 
@@ -203,6 +97,7 @@ struct
 
 static GBCu8
 read_ram_empty (
+        	GBC_Machine *m,
         	const GBCu16 addr
         	)
 {
@@ -212,6 +107,7 @@ read_ram_empty (
 
 static void
 write_ram_empty (
+        	 GBC_Machine *m,
         	 const GBCu16 addr,
         	 const GBCu8  data
         	 )
@@ -221,6 +117,7 @@ write_ram_empty (
 
 static void
 mapper_clock_empty (
+        	    GBC_Machine *m,
         	    const int cc
         	    )
 {
@@ -228,7 +125,9 @@ mapper_clock_empty (
 
 
 static void
-init_static_ram (void)
+init_static_ram (
+                 GBC_Machine *m
+                 )
 {
   memset ( &(_ram[0][0]), 0, RAM_NBANKS*RAM_BANK_SIZE );
 } /* end init_static_ram */
@@ -242,6 +141,7 @@ init_static_ram (void)
 
 static GBCu8
 read_rom (
+          GBC_Machine *m,
           const GBCu16 addr
           )
 {
@@ -254,6 +154,7 @@ read_rom (
 
 static void
 write_rom (
+           GBC_Machine *m,
            const GBCu16 addr,
            const GBCu8  data
            )
@@ -262,25 +163,30 @@ write_rom (
 
 
 static int
-get_bank1_rom (void)
+get_bank1_rom (
+               GBC_Machine *m
+               )
 {
   return 1;
 } /* end get_bank1_rom */
 
 
 static GBC_Error
-rom_init (void)
+rom_init (
+          GBC_Machine *m
+          )
 {
   
   if ( _state.rom->nbanks != 2  )
     return GBC_WRONGROMSIZE;
   
-  GBC_mapper_read_ram= read_ram_empty;
-  GBC_mapper_write_ram= write_ram_empty;
-  GBC_mapper_read= read_rom;
-  GBC_mapper_write= write_rom;
-  GBC_mapper_get_bank1= get_bank1_rom;
-  GBC_mapper_clock= mapper_clock_empty;
+  _read_ram= read_ram_empty;
+  _write_ram= write_ram_empty;
+  _read= read_rom;
+  _write= write_rom;
+  GBC_mem_map_rom ( m, _state.rom->banks[0], _state.rom->banks[1] );
+  _get_bank1= get_bank1_rom;
+  _clock= mapper_clock_empty;
   
   return GBC_NOERROR;
   
@@ -294,7 +200,9 @@ rom_init (void)
 /********/
 
 static void
-mbc1_update_banks (void)
+mbc1_update_banks (
+                   GBC_Machine *m
+                   )
 {
   
   GBCu8 ram_num;
@@ -317,6 +225,7 @@ mbc1_update_banks (void)
   if ( _state.s.mbc1.rom_num == 0x0 ) _state.s.mbc1.rom_num= 0x1;
   _state.s.mbc1.rom1=
     &(_state.rom->banks[_state.s.mbc1.rom_num%_state.rom->nbanks][0]);
+  MAP_ROM ( mbc1 );
   if ( _state.s.mbc1.nbanks_ram > 0 )
     _state.s.mbc1.cram= _state.s.mbc1.ram[ram_num%_state.s.mbc1.nbanks_ram];
   
@@ -324,7 +233,9 @@ mbc1_update_banks (void)
 
 
 static int
-get_bank1_mbc1 (void)
+get_bank1_mbc1 (
+                GBC_Machine *m
+                )
 {
   return _state.s.mbc1.rom_num;
 } /* end get_bank1_mbc1 */
@@ -332,6 +243,7 @@ get_bank1_mbc1 (void)
 
 static GBCu8
 read_ram_mbc1 (
+               GBC_Machine *m,
                const GBCu16 addr
                )
 {
@@ -346,6 +258,7 @@ read_ram_mbc1 (
 
 static void
 write_ram_mbc1 (
+                GBC_Machine *m,
                 const GBCu16 addr,
                 const GBCu8  data
                 )
@@ -360,6 +273,7 @@ write_ram_mbc1 (
 
 static GBCu8
 read_mbc1 (
+           GBC_Machine *m,
            const GBCu16 addr
            )
 {
@@ -372,6 +286,7 @@ read_mbc1 (
 
 static void
 write_mbc1 (
+            GBC_Machine *m,
             const GBCu16 addr,
             const GBCu8  data
             )
@@ -385,21 +300,21 @@ write_mbc1 (
   else if ( addr < 0x4000 )
     {
       _state.s.mbc1.low= data&0x1F;
-      mbc1_update_banks ();
+      mbc1_update_banks ( m );
     }
   
   /* RAM Bank Number or Upper Bits of ROM Bank Number. */
   else if ( addr < 0x6000 )
     {
       _state.s.mbc1.high= data&0x3;
-      mbc1_update_banks ();
+      mbc1_update_banks ( m );
     }
   
   /* ROM/RAM Mode Select. */
   else if ( addr < 0x8000 )
     {
       _state.s.mbc1.mode0= ((data&0x1)==0);
-      mbc1_update_banks ();
+      mbc1_update_banks ( m );
     }
   
 } /* end write_mbc1 */
@@ -407,12 +322,13 @@ write_mbc1 (
 
 static void
 write_mbc1_trace (
+                  GBC_Machine *m,
                   const GBCu16 addr,
                   const GBCu8  data
                   )
 {
   
-  write_mbc1 ( addr, data );
+  write_mbc1 ( m, addr, data );
   if ( addr >= 0x2000 && addr < 0x8000 )
     _mapper_changed ( _udata );
   
@@ -420,7 +336,9 @@ write_mbc1_trace (
 
 
 static void
-mbc1_init_ram (void)
+mbc1_init_ram (
+               GBC_Machine *m
+               )
 {
 
   int i;
@@ -429,7 +347,7 @@ mbc1_init_ram (void)
   
   if ( _state.mapper == GBC_MBC1_RAM )
     {
-      init_static_ram ();
+      init_static_ram ( m );
       mem= &(_ram[0][0]);
     }
   else mem= _get_external_ram ( _state.s.mbc1.ram_2KB ? 0x800 :
@@ -442,7 +360,9 @@ mbc1_init_ram (void)
 
 
 static GBC_Error
-mbc1_init (void)
+mbc1_init (
+           GBC_Machine *m
+           )
 {
   
   int ram_size;
@@ -451,8 +371,8 @@ mbc1_init (void)
   /* Fixa la memòria RAM */
   if ( _state.mapper == GBC_MBC1 )
     {
-      GBC_mapper_read_ram= read_ram_empty;
-      GBC_mapper_write_ram= write_ram_empty;
+      _read_ram= read_ram_empty;
+      _write_ram= write_ram_empty;
     }
   else
     {
@@ -469,9 +389,9 @@ mbc1_init (void)
           _state.s.mbc1.nbanks_ram= ram_size>>3;
           _state.s.mbc1.ram_2KB= GBC_FALSE;
         }
-      mbc1_init_ram ();
-      GBC_mapper_read_ram= read_ram_mbc1;
-      GBC_mapper_write_ram= write_ram_mbc1;
+      mbc1_init_ram ( m );
+      _read_ram= read_ram_mbc1;
+      _write_ram= write_ram_mbc1;
       _state.s.mbc1.cram= _state.s.mbc1.ram[0];
       _state.s.mbc1.ram_enabled= GBC_FALSE;
     }
@@ -479,15 +399,16 @@ mbc1_init (void)
   /* Fixa la ROM. */
   if ( _state.rom->nbanks < 2 || _state.rom->nbanks > 128 )
     return GBC_WRONGROMSIZE;
-  GBC_mapper_read= read_mbc1;
-  GBC_mapper_write= _mapper_changed==NULL ? write_mbc1 : write_mbc1_trace;
+  _read= read_mbc1;
+  _write= _mapper_changed==NULL ? write_mbc1 : write_mbc1_trace;
   _state.s.mbc1.rom_num= 1;
   _state.s.mbc1.rom0= &(_state.rom->banks[0][0]);
   _state.s.mbc1.rom1= &(_state.rom->banks[1][0]);
+  MAP_ROM ( mbc1 );
   _state.s.mbc1.mode0= GBC_TRUE;
   
-  GBC_mapper_get_bank1= get_bank1_mbc1;
-  GBC_mapper_clock= mapper_clock_empty;
+  _get_bank1= get_bank1_mbc1;
+  _clock= mapper_clock_empty;
   
   return GBC_NOERROR;
   
@@ -496,6 +417,7 @@ mbc1_init (void)
 
 static int
 mbc1_save_state (
+        	 GBC_Machine *m,
         	 FILE *f
         	 )
 {
@@ -535,6 +457,7 @@ mbc1_save_state (
 
 static int
 mbc1_load_state (
+        	 GBC_Machine *m,
         	 FILE *f
         	 )
 {
@@ -556,7 +479,7 @@ mbc1_load_state (
           CHECK ( _state.s.mbc1.nbanks_ram == (ram_size>>3) );
           CHECK ( _state.s.mbc1.ram_2KB == GBC_FALSE );
         }
-      mbc1_init_ram ();
+      mbc1_init_ram ( m );
       for ( i= 0; i < _state.s.mbc1.nbanks_ram; ++i )
         if ( fread ( _state.s.mbc1.ram[i], RAM_BANK_SIZE, 1, f ) != 1 )
           return -1;
@@ -568,6 +491,7 @@ mbc1_load_state (
   _state.s.mbc1.rom0= &(_state.rom->banks[0][0]);
   _state.s.mbc1.rom1=
     &(_state.rom->banks[_state.s.mbc1.rom_num%_state.rom->nbanks][0]);
+  MAP_ROM ( mbc1 );
   
   return 0;
   
@@ -581,7 +505,9 @@ mbc1_load_state (
 /********/
 
 static int
-get_bank1_mbc2 (void)
+get_bank1_mbc2 (
+                GBC_Machine *m
+                )
 {
   return _state.s.mbc2.rom_num;
 } // end get_bank1_mbc2
@@ -590,6 +516,7 @@ get_bank1_mbc2 (void)
 // NOTA!!! La RAM són bytes de 4 bits.
 static GBCu8
 read_ram_mbc2 (
+               GBC_Machine *m,
                const GBCu16 addr
                )
 {
@@ -604,6 +531,7 @@ read_ram_mbc2 (
 
 static void
 write_ram_mbc2 (
+                GBC_Machine *m,
                 const GBCu16 addr,
                 const GBCu8  data
                 )
@@ -618,6 +546,7 @@ write_ram_mbc2 (
 
 static GBCu8
 read_mbc2 (
+           GBC_Machine *m,
            const GBCu16 addr
            )
 {
@@ -630,6 +559,7 @@ read_mbc2 (
 
 static void
 write_mbc2 (
+            GBC_Machine *m,
             const GBCu16 addr,
             const GBCu8  data
             )
@@ -650,6 +580,7 @@ write_mbc2 (
           _state.s.mbc2.rom_num= data&0xF;
           _state.s.mbc2.rom1=
             &(_state.rom->banks[_state.s.mbc2.rom_num%_state.rom->nbanks][0]);
+          MAP_ROM ( mbc2 );
         }
     }
   
@@ -658,12 +589,13 @@ write_mbc2 (
 
 static void
 write_mbc2_trace (
+                  GBC_Machine *m,
                   const GBCu16 addr,
                   const GBCu8  data
                   )
 {
   
-  write_mbc2 ( addr, data );
+  write_mbc2 ( m, addr, data );
   if ( addr >= 0x2000 && addr < 0x8000 )
     _mapper_changed ( _udata );
   
@@ -671,7 +603,9 @@ write_mbc2_trace (
 
 
 static void
-mbc2_init_ram (void)
+mbc2_init_ram (
+               GBC_Machine *m
+               )
 {
 
   GBCu8 *mem;
@@ -679,7 +613,7 @@ mbc2_init_ram (void)
   
   if ( _state.mapper == GBC_MBC2 )
     {
-      init_static_ram ();
+      init_static_ram ( m );
       mem= &(_ram[0][0]);
     }
   else mem= _get_external_ram ( 512, _udata );
@@ -689,26 +623,29 @@ mbc2_init_ram (void)
 
 
 static GBC_Error
-mbc2_init (void)
+mbc2_init (
+           GBC_Machine *m
+           )
 {
   
   // Inicialitza ram (en realitat no és ram)
-  mbc2_init_ram ();
-  GBC_mapper_read_ram= read_ram_mbc2;
-  GBC_mapper_write_ram= write_ram_mbc2;
+  mbc2_init_ram ( m );
+  _read_ram= read_ram_mbc2;
+  _write_ram= write_ram_mbc2;
   _state.s.mbc2.ram_enabled= GBC_FALSE;
   
   // Fixa la ROM.
   if ( _state.rom->nbanks < 2 || _state.rom->nbanks > 16 )
     return GBC_WRONGROMSIZE;
-  GBC_mapper_read= read_mbc2;
-  GBC_mapper_write= _mapper_changed==NULL ? write_mbc2 : write_mbc2_trace;
+  _read= read_mbc2;
+  _write= _mapper_changed==NULL ? write_mbc2 : write_mbc2_trace;
   _state.s.mbc2.rom_num= 1;
   _state.s.mbc2.rom0= &(_state.rom->banks[0][0]);
   _state.s.mbc2.rom1= &(_state.rom->banks[1][0]);
+  MAP_ROM ( mbc2 );
   
-  GBC_mapper_get_bank1= get_bank1_mbc2;
-  GBC_mapper_clock= mapper_clock_empty;
+  _get_bank1= get_bank1_mbc2;
+  _clock= mapper_clock_empty;
   
   return GBC_NOERROR;
   
@@ -717,6 +654,7 @@ mbc2_init (void)
 
 static int
 mbc2_save_state (
+        	 GBC_Machine *m,
         	 FILE *f
         	 )
 {
@@ -732,18 +670,20 @@ mbc2_save_state (
 
 static int
 mbc2_load_state (
+        	 GBC_Machine *m,
         	 FILE *f
         	 )
 {
 
   LOAD ( _state.s.mbc2 );
-  mbc2_init_ram ();
+  mbc2_init_ram ( m );
   if ( fread ( _state.s.mbc2.ram, 512, 1, f ) != 1 )
     return -1;
   CHECK ( _state.s.mbc2.rom_num >= 0 );
   _state.s.mbc2.rom0= &(_state.rom->banks[0][0]);
   _state.s.mbc2.rom1=
     &(_state.rom->banks[_state.s.mbc2.rom_num%_state.rom->nbanks][0]);
+  MAP_ROM ( mbc2 );
   
   return 0;
   
@@ -757,7 +697,9 @@ mbc2_load_state (
 /********/
 
 static void
-mbc3_update_counters (void)
+mbc3_update_counters (
+                      GBC_Machine *m
+                      )
 {
   
   clock_t aux, cc;
@@ -791,7 +733,9 @@ mbc3_update_counters (void)
 
 
 static int
-get_bank1_mbc3 (void)
+get_bank1_mbc3 (
+                GBC_Machine *m
+                )
 {
   return _state.s.mbc3.rom_num;
 } /* end get_bank1_mbc3 */
@@ -799,6 +743,7 @@ get_bank1_mbc3 (void)
 
 static GBCu8
 read_mbc3 (
+           GBC_Machine *m,
            const GBCu16 addr
            )
 {
@@ -811,6 +756,7 @@ read_mbc3 (
 
 static void
 write_mbc3 (
+            GBC_Machine *m,
             const GBCu16 addr,
             const GBCu8  data
             )
@@ -829,6 +775,7 @@ write_mbc3 (
       _state.s.mbc3.rom_num= data&0x7F;
       _state.s.mbc3.rom1=
         &(_state.rom->banks[_state.s.mbc3.rom_num%_state.rom->nbanks][0]);
+      MAP_ROM ( mbc3 );
     }
   
   /* REG2 (RAM bank i counters) */
@@ -861,7 +808,7 @@ write_mbc3 (
       aux= ((data&0x1)==0x1);
       if ( aux && !_state.s.mbc3.latch_flag )
         {
-          mbc3_update_counters ();
+          mbc3_update_counters ( m );
           _state.s.mbc3.latch= _state.s.mbc3.counters;
         }
       _state.s.mbc3.latch_flag= aux;
@@ -872,12 +819,13 @@ write_mbc3 (
 
 static void
 write_mbc3_trace (
+        	  GBC_Machine *m,
         	  const GBCu16 addr,
         	  const GBCu8  data
         	  )
 {
   
-  write_mbc3 ( addr, data );
+  write_mbc3 ( m, addr, data );
   if ( addr >= 0x2000 && addr < 0x4000 )
     _mapper_changed ( _udata );
   
@@ -886,6 +834,7 @@ write_mbc3_trace (
 
 static GBCu8
 read_ram_mbc3 (
+               GBC_Machine *m,
                const GBCu16 addr
                )
 {
@@ -911,6 +860,7 @@ read_ram_mbc3 (
 
 static void
 write_ram_mbc3 (
+        	GBC_Machine *m,
         	const GBCu16 addr,
         	const GBCu8  data
         	)
@@ -945,7 +895,7 @@ write_ram_mbc3 (
               _state.s.mbc3.cc= clock ();
               _state.s.mbc3.remaincc= 0;
             }
-          else mbc3_update_counters (); /* Abans de parar actualitza. */
+          else mbc3_update_counters ( m ); /* Abans de parar actualitza. */
         }
       _state.s.mbc3.timer_enabled= aux;
       _state.s.mbc3.counters.dd&= 0xFF;
@@ -959,7 +909,9 @@ write_ram_mbc3 (
 
 
 static void
-mbc3_init_ram (void)
+mbc3_init_ram (
+               GBC_Machine *m
+               )
 {
 
   int i;
@@ -968,7 +920,7 @@ mbc3_init_ram (void)
 
   if ( _state.mapper == GBC_MBC3_RAM )
     {
-      init_static_ram ();
+      init_static_ram ( m );
       mem= &(_ram[0][0]);
     }
   else mem= _get_external_ram ( 4*RAM_BANK_SIZE, _udata );
@@ -979,7 +931,9 @@ mbc3_init_ram (void)
 
 
 static GBC_Error
-mbc3_init (void)
+mbc3_init (
+           GBC_Machine *m
+           )
 {
   
   int ram_size;
@@ -988,18 +942,18 @@ mbc3_init (void)
   /* Fixa la memòria RAM */
   if ( _state.mapper == GBC_MBC3 || _state.mapper == GBC_MBC3_TIMER_BATTERY )
     {
-      GBC_mapper_read_ram= read_ram_empty;
-      GBC_mapper_write_ram= write_ram_empty;
+      _read_ram= read_ram_empty;
+      _write_ram= write_ram_empty;
     }
   else
     {
       ram_size= GBC_rom_get_ram_size ( _state.rom );
       if ( ram_size != 32 )
         return GBC_WRONGRAMSIZE;
-      mbc3_init_ram ();
+      mbc3_init_ram ( m );
       _state.s.mbc3.ram_mode= MBC3_MODE_RAM;
-      GBC_mapper_read_ram= read_ram_mbc3;
-      GBC_mapper_write_ram= write_ram_mbc3;
+      _read_ram= read_ram_mbc3;
+      _write_ram= write_ram_mbc3;
       _state.s.mbc3.cram= _state.s.mbc3.ram[0];
       _state.s.mbc3.ram_enabled= GBC_FALSE;
     }
@@ -1007,14 +961,15 @@ mbc3_init (void)
   /* Fixa la ROM. */
   if ( _state.rom->nbanks < 4 || _state.rom->nbanks > 128 )
     return GBC_WRONGROMSIZE;
-  GBC_mapper_read= read_mbc3;
-  GBC_mapper_write= _mapper_changed==NULL ? write_mbc3 : write_mbc3_trace;
+  _read= read_mbc3;
+  _write= _mapper_changed==NULL ? write_mbc3 : write_mbc3_trace;
   _state.s.mbc3.rom_num= 1;
   _state.s.mbc3.rom0= &(_state.rom->banks[0][0]);
   _state.s.mbc3.rom1= &(_state.rom->banks[1][0]);
+  MAP_ROM ( mbc3 );
   
-  GBC_mapper_get_bank1= get_bank1_mbc3;
-  GBC_mapper_clock= mapper_clock_empty;
+  _get_bank1= get_bank1_mbc3;
+  _clock= mapper_clock_empty;
   
   /* Temporitzador. */
   _state.s.mbc3.latch_flag= GBC_FALSE;
@@ -1039,6 +994,7 @@ mbc3_init (void)
 
 static int
 mbc3_save_state (
+        	 GBC_Machine *m,
         	 FILE *f
         	 )
 {
@@ -1078,6 +1034,7 @@ mbc3_save_state (
 
 static int
 mbc3_load_state (
+        	 GBC_Machine *m,
         	 FILE *f
         	 )
 {
@@ -1088,7 +1045,7 @@ mbc3_load_state (
   LOAD ( _state.s.mbc3 );
   if ( _state.mapper != GBC_MBC3 && _state.mapper != GBC_MBC3_TIMER_BATTERY )
     {
-      mbc3_init_ram ();
+      mbc3_init_ram ( m );
       for ( i= 0; i < 4; ++i )
         if ( fread ( _state.s.mbc3.ram[i], RAM_BANK_SIZE, 1, f ) != 1 )
           return -1;
@@ -1100,6 +1057,7 @@ mbc3_load_state (
   _state.s.mbc3.rom0= &(_state.rom->banks[0][0]);
   _state.s.mbc3.rom1=
     &(_state.rom->banks[_state.s.mbc3.rom_num%_state.rom->nbanks][0]);
+  MAP_ROM ( mbc3 );
   CHECK ( _state.s.mbc3.cc >= 0 );
   CHECK ( _state.s.mbc3.remaincc >= 0 );
   
@@ -1115,7 +1073,9 @@ mbc3_load_state (
 /********/
 
 static int
-get_bank1_mbc5 (void)
+get_bank1_mbc5 (
+                GBC_Machine *m
+                )
 {
   return _state.s.mbc5.rom_num;
 } /* end get_bank1_mbc5 */
@@ -1123,6 +1083,7 @@ get_bank1_mbc5 (void)
 
 static GBCu8
 read_ram_mbc5 (
+               GBC_Machine *m,
                const GBCu16 addr
                )
 {
@@ -1135,6 +1096,7 @@ read_ram_mbc5 (
 
 static void
 write_ram_mbc5 (
+        	GBC_Machine *m,
         	const GBCu16 addr,
         	const GBCu8  data
         	)
@@ -1148,6 +1110,7 @@ write_ram_mbc5 (
 
 static GBCu8
 read_mbc5 (
+           GBC_Machine *m,
            const GBCu16 addr
            )
 {
@@ -1160,6 +1123,7 @@ read_mbc5 (
 
 static void
 write_mbc5 (
+            GBC_Machine *m,
             const GBCu16 addr,
             const GBCu8  data
             )
@@ -1176,6 +1140,7 @@ write_mbc5 (
       _state.s.mbc5.rom_num|= data;
       _state.s.mbc5.rom1=
         &(_state.rom->banks[_state.s.mbc5.rom_num%_state.rom->nbanks][0]);
+      MAP_ROM ( mbc5 );
     }
   
   /* ROMB1. */
@@ -1185,6 +1150,7 @@ write_mbc5 (
       _state.s.mbc5.rom_num|= ((GBCu16) (data&0x1))<<8;
       _state.s.mbc5.rom1=
         &(_state.rom->banks[_state.s.mbc5.rom_num%_state.rom->nbanks][0]);
+      MAP_ROM ( mbc5 );
     }
   
   /* RAMB */
@@ -1212,12 +1178,13 @@ write_mbc5 (
 
 static void
 write_mbc5_trace (
+        	  GBC_Machine *m,
         	  const GBCu16 addr,
         	  const GBCu8  data
         	  )
 {
   
-  write_mbc5 ( addr, data );
+  write_mbc5 ( m, addr, data );
   if ( addr >= 0x2000 && addr < 0x4000 )
     _mapper_changed ( _udata );
   
@@ -1226,6 +1193,7 @@ write_mbc5_trace (
 
 static void
 mbc5_mapper_clock (
+        	   GBC_Machine *m,
         	   const int cc
         	   )
 {
@@ -1242,7 +1210,9 @@ mbc5_mapper_clock (
 
 
 static void
-mbc5_init_ram (void)
+mbc5_init_ram (
+               GBC_Machine *m
+               )
 {
 
   int i;
@@ -1252,7 +1222,7 @@ mbc5_init_ram (void)
   if ( _state.mapper == GBC_MBC5_RAM ||
        _state.mapper == GBC_MBC5_RUMBLE_RAM )
     {
-      init_static_ram ();
+      init_static_ram ( m );
       mem= &(_ram[0][0]);
     }
   else mem= _get_external_ram ( _state.s.mbc5.nbanks_ram*RAM_BANK_SIZE,
@@ -1264,7 +1234,9 @@ mbc5_init_ram (void)
 
 
 static GBC_Error
-mbc5_init (void)
+mbc5_init (
+           GBC_Machine *m
+           )
 {
   
   int ram_size;
@@ -1273,8 +1245,8 @@ mbc5_init (void)
   /* Fixa la memòria RAM */
   if ( _state.mapper == GBC_MBC5 || _state.mapper == GBC_MBC5_RUMBLE )
     {
-      GBC_mapper_read_ram= read_ram_empty;
-      GBC_mapper_write_ram= write_ram_empty;
+      _read_ram= read_ram_empty;
+      _write_ram= write_ram_empty;
     }
   else
     {
@@ -1282,9 +1254,9 @@ mbc5_init (void)
       if ( ram_size < 8 || ram_size > 32 )
         return GBC_WRONGRAMSIZE;
       _state.s.mbc5.nbanks_ram= ram_size>>3;
-      mbc5_init_ram ();
-      GBC_mapper_read_ram= read_ram_mbc5;
-      GBC_mapper_write_ram= write_ram_mbc5;
+      mbc5_init_ram ( m );
+      _read_ram= read_ram_mbc5;
+      _write_ram= write_ram_mbc5;
       _state.s.mbc5.cram= _state.s.mbc5.ram[0];
       _state.s.mbc5.ram_enabled= GBC_FALSE;
     }
@@ -1292,13 +1264,14 @@ mbc5_init (void)
   /* Fixa la ROM. */
   if ( _state.rom->nbanks < 2 || _state.rom->nbanks > 512 )
     return GBC_WRONGROMSIZE;
-  GBC_mapper_read= read_mbc5;
-  GBC_mapper_write= _mapper_changed==NULL ? write_mbc5 : write_mbc5_trace;
+  _read= read_mbc5;
+  _write= _mapper_changed==NULL ? write_mbc5 : write_mbc5_trace;
   _state.s.mbc5.rom_num= 1;
   _state.s.mbc5.rom0= &(_state.rom->banks[0][0]);
   _state.s.mbc5.rom1= &(_state.rom->banks[1][0]);
+  MAP_ROM ( mbc5 );
   
-  GBC_mapper_get_bank1= get_bank1_mbc5;
+  _get_bank1= get_bank1_mbc5;
   
   /* Rumble. */
   _state.s.mbc5.rumble=
@@ -1308,12 +1281,12 @@ mbc5_init (void)
   if ( _state.s.mbc5.rumble )
     {
       _state.s.mbc5.cc= 0;
-      GBC_mapper_clock= mbc5_mapper_clock;
+      _clock= mbc5_mapper_clock;
       _state.s.mbc5.rumble_state= 0;
       _state.s.mbc5.rumble_level= 0;
       _state.s.mbc5.rumble_nframes= 0;
     }
-  else GBC_mapper_clock= mapper_clock_empty;
+  else _clock= mapper_clock_empty;
   
   return GBC_NOERROR;
   
@@ -1322,6 +1295,7 @@ mbc5_init (void)
 
 static int
 mbc5_save_state (
+        	 GBC_Machine *m,
         	 FILE *f
         	 )
 {
@@ -1361,6 +1335,7 @@ mbc5_save_state (
 
 static int
 mbc5_load_state (
+        	 GBC_Machine *m,
         	 FILE *f
         	 )
 {
@@ -1373,7 +1348,7 @@ mbc5_load_state (
     {
       ram_size= GBC_rom_get_ram_size ( _state.rom );
       CHECK ( _state.s.mbc5.nbanks_ram == (ram_size>>3) );
-      mbc5_init_ram ();
+      mbc5_init_ram ( m );
       for ( i= 0; i < _state.s.mbc5.nbanks_ram; ++i )
         if ( fread ( _state.s.mbc5.ram[i], RAM_BANK_SIZE, 1, f ) != 1 )
           return -1;
@@ -1385,6 +1360,7 @@ mbc5_load_state (
   _state.s.mbc5.rom0= &(_state.rom->banks[0][0]);
   _state.s.mbc5.rom1=
     &(_state.rom->banks[_state.s.mbc5.rom_num%_state.rom->nbanks][0]);
+  MAP_ROM ( mbc5 );
   if ( _state.s.mbc5.rumble )
     {
       CHECK ( _state.s.mbc5.cc >= 0 );
@@ -1397,26 +1373,32 @@ mbc5_load_state (
 
 
 
-/****************/
-/* ESTAT PÚBLIC */
-/****************/
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
 
-void (*GBC_mapper_clock) (const int);
-int (*GBC_mapper_get_bank1) (void);
-GBCu8 (*GBC_mapper_read) (const GBCu16);
-GBCu8 (*GBC_mapper_read_ram) (const GBCu16);
-void (*GBC_mapper_write) (const GBCu16,const GBCu8);
-void (*GBC_mapper_write_ram) (const GBCu16,const GBCu8);
+void
+GBC_mapper_clock (
+        	  GBC_Machine *m,
+        	  const int    cc
+        	  )
+{
+  _clock ( m, cc );
+} /* end GBC_mapper_clock */
 
 
+int
+GBC_mapper_get_bank1 (
+        	      GBC_Machine *m
+        	      )
+{
+  return _get_bank1 ( m );
+} /* end GBC_mapper_get_bank1 */
 
 
-/**********************/
-/* FUNCIONS PÚBLIQUES */
-/**********************/
-
 GBC_Error
 GBC_mapper_init (
+        	 GBC_Machine        *m,
         	 const GBC_Rom      *rom,
         	 const GBC_Bool      check_rom,
         	 GBC_GetExternalRAM *get_external_ram,
@@ -1440,13 +1422,15 @@ GBC_mapper_init (
         return GBC_WRONGCHKS;
     }
 
-  return GBC_mapper_init_state ();
+  return GBC_mapper_init_state ( m );
   
 } /* end GBC_mapper_init */
 
 
 GBC_Error
-GBC_mapper_init_state (void)
+GBC_mapper_init_state (
+                       GBC_Machine *m
+                       )
 {
   
   _state.mapper= GBC_rom_get_mapper ( _state.rom );
@@ -1457,20 +1441,20 @@ GBC_mapper_init_state (void)
       
       // ROM.
     case GBC_ROM:
-      return rom_init ();
+      return rom_init ( m );
       break;
       
       // MBC1.
     case GBC_MBC1:
     case GBC_MBC1_RAM:
     case GBC_MBC1_RAM_BATTERY:
-      return mbc1_init ();
+      return mbc1_init ( m );
       break;
 
       // MBC2.
     case GBC_MBC2:
     case GBC_MBC2_BATTERY:
-      return mbc2_init ();
+      return mbc2_init ( m );
       break;
       
       // MBC3.
@@ -1479,7 +1463,7 @@ GBC_mapper_init_state (void)
     case GBC_MBC3:
     case GBC_MBC3_RAM:
     case GBC_MBC3_RAM_BATTERY:
-      return mbc3_init ();
+      return mbc3_init ( m );
       break;
       
       // MBC5.
@@ -1489,7 +1473,7 @@ GBC_mapper_init_state (void)
     case GBC_MBC5_RUMBLE:
     case GBC_MBC5_RUMBLE_RAM:
     case GBC_MBC5_RUMBLE_RAM_BATTERY:
-      return mbc5_init ();
+      return mbc5_init ( m );
       break;
       
     default: 
@@ -1506,6 +1490,7 @@ GBC_mapper_init_state (void)
 
 int
 GBC_mapper_save_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       )
 {
@@ -1522,14 +1507,14 @@ GBC_mapper_save_state (
     case GBC_MBC1:
     case GBC_MBC1_RAM:
     case GBC_MBC1_RAM_BATTERY:
-      ret= mbc1_save_state ( f );
+      ret= mbc1_save_state ( m, f );
       if ( ret != 0 ) return ret;
       break;
 
       // MBC2.
     case GBC_MBC2:
     case GBC_MBC2_BATTERY:
-      ret= mbc2_save_state ( f );
+      ret= mbc2_save_state ( m, f );
       if ( ret != 0 ) return ret;
       break;
       
@@ -1539,7 +1524,7 @@ GBC_mapper_save_state (
     case GBC_MBC3:
     case GBC_MBC3_RAM:
     case GBC_MBC3_RAM_BATTERY:
-      ret= mbc3_save_state ( f );
+      ret= mbc3_save_state ( m, f );
       if ( ret != 0 ) return ret;
       break;
       
@@ -1550,7 +1535,7 @@ GBC_mapper_save_state (
     case GBC_MBC5_RUMBLE:
     case GBC_MBC5_RUMBLE_RAM:
     case GBC_MBC5_RUMBLE_RAM_BATTERY:
-      ret= mbc5_save_state ( f );
+      ret= mbc5_save_state ( m, f );
       if ( ret != 0 ) return ret;
       break;
       
@@ -1566,6 +1551,7 @@ GBC_mapper_save_state (
 
 int
 GBC_mapper_load_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       )
 {
@@ -1586,14 +1572,14 @@ GBC_mapper_load_state (
     case GBC_MBC1:
     case GBC_MBC1_RAM:
     case GBC_MBC1_RAM_BATTERY:
-      ret= mbc1_load_state ( f );
+      ret= mbc1_load_state ( m, f );
       if ( ret != 0 ) return ret;
       break;
 
       // MBC2.
     case GBC_MBC2:
     case GBC_MBC2_BATTERY:
-      ret= mbc2_load_state ( f );
+      ret= mbc2_load_state ( m, f );
       if ( ret != 0 ) return ret;
       break;
       
@@ -1603,7 +1589,7 @@ GBC_mapper_load_state (
     case GBC_MBC3:
     case GBC_MBC3_RAM:
     case GBC_MBC3_RAM_BATTERY:
-      ret= mbc3_load_state ( f );
+      ret= mbc3_load_state ( m, f );
       if ( ret != 0 ) return ret;
       break;
       
@@ -1614,7 +1600,7 @@ GBC_mapper_load_state (
     case GBC_MBC5_RUMBLE:
     case GBC_MBC5_RUMBLE_RAM:
     case GBC_MBC5_RUMBLE_RAM_BATTERY:
-      ret= mbc5_load_state ( f );
+      ret= mbc5_load_state ( m, f );
       if ( ret != 0 ) return ret;
       break;
       
@@ -1626,3 +1612,45 @@ GBC_mapper_load_state (
   return 0;
   
 } // end GBC_mapper_load_state
+
+
+GBCu8
+GBC_mapper_read (
+        	 GBC_Machine  *m,
+        	 const GBCu16  addr
+        	 )
+{
+  return _read ( m, addr );
+} /* end GBC_mapper_read */
+
+
+GBCu8
+GBC_mapper_read_ram (
+        	     GBC_Machine  *m,
+        	     const GBCu16  addr
+        	     )
+{
+  return _read_ram ( m, addr );
+} /* end GBC_mapper_read_ram */
+
+
+void
+GBC_mapper_write (
+        	  GBC_Machine  *m,
+        	  const GBCu16  addr,
+        	  const GBCu8   data
+        	  )
+{
+  _write ( m, addr, data );
+} /* end GBC_mapper_write */
+
+
+void
+GBC_mapper_write_ram (
+        	      GBC_Machine  *m,
+        	      const GBCu16  addr,
+        	      const GBCu8   data
+        	      )
+{
+  _write_ram ( m, addr, data );
+} /* end GBC_mapper_write_ram */
@@ -27,6 +27,7 @@
 #include <string.h>
 
 #include "GBC.h"
+#include "machine.h"
 
 
 
@@ -45,9 +46,9 @@
   if ( !(COND) ) return -1;
 
 
-#define RAM_PAGE_SIZE 4096
+#define RAM_PAGE_SIZE GBC_WRAM_PAGE_SIZE
 
-#define HRAM_SIZE 127
+#define HRAM_SIZE GBC_HRAM_SIZE
 
 
 
@@ -56,57 +57,542 @@
 /* ESTAT */
 /*********/
 
-/* BIOS. */
-static const GBCu8 *_bios;
-static GBC_Bool _bios_mapped;
+/* L'estat està en 'GBC_Machine' (veure 'machine.h'). */
+#define _bios (m->mem.bios)
+#define _bios_mapped (m->mem.bios_mapped)
+#define _ram (m->mem.ram)
+#define _ram0 (m->mem.ram0)
+#define _ram1 (m->mem.ram1)
+#define _svbk (m->mem.svbk)
+#define _hram (m->mem.hram)
+#define _ram_code (m->mem.ram_code)
+#define _hram_code (m->mem.hram_code)
+#define _mem_read (m->mem.read)
+#define _mem_write (m->mem.write)
+#define _mem_access (m->mem.mem_access)
+#define _udata (m->mem.udata)
+#define _rom0 (m->mem.rom0)
+#define _rom1 (m->mem.rom1)
+#define _vram (m->mem.vram)
+#define _rpage (m->mem.rpage)
+#define _wpage (m->mem.wpage)
+#define _cpage (m->mem.cpage)
+#define _io_reads (m->mem.io_reads)
+#define _io_writes (m->mem.io_writes)
+#define _warning (m->mem.warning)
 
-/* RAM. */
-static GBCu8 _ram[8][RAM_PAGE_SIZE];
-static GBCu8 *_ram0;
-static GBCu8 *_ram1;
-static GBCu8 _svbk;
 
-/* HRAM. */
-static GBCu8 _hram[HRAM_SIZE];
 
-/* Funcions per a llegir. */
-static GBCu8 (*_mem_read) (const GBCu16 addr);
-static void (*_mem_write) (const GBCu16 addr,const GBCu8 data);
 
-/* Callback. */
-static GBC_MemAccess *_mem_access;
-static void *_udata;
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
 
+/* Torna la pàgina de RAM mapejada en 0xD000. */
+static int
+ram1_page (
+           GBC_Machine *m
+           )
+{
+  return (int) ((_ram1-&(_ram[0][0]))/RAM_PAGE_SIZE);
+} /* end ram1_page */
 
 
+/* Torna els comptadors de blocs de la UCP a partir de ADDR. BANK és
+   la pàgina de RAM per a 0xD000-0xDFFF. */
+static GBCu8 *
+code_marks (
+            GBC_Machine  *m,
+            const GBCu16  addr,
+            const int     bank
+            )
+{
+  
+  if ( addr >= 0xFF80 ) return &(_hram_code[addr&0x7F]);
+  else if ( addr&0x1000 ) return &(_ram_code[bank][addr&0xFFF]);
+  else return &(_ram_code[0][addr&0xFFF]);
+  
+} /* end code_marks */
+
+
+/* Mapeja en la taula de pàgines les pàgines [BEGIN,END[ a partir de
+   P. */
+static void
+map_pages (
+           GBC_Machine *m,
+           const int    begin,
+           const int    end,
+           const GBCu8 *p
+           )
+{
+  
+  int i;
+  
+  
+  for ( i= begin; i < end; ++i, p+= 0x100 )
+    _rpage[i]= p;
+  
+} /* end map_pages */
+
+
+/* Torna a calcular la taula de pàgines. Sols es mapegen les regions
+   que es poden llegir sense efectes laterals: ROM, VRAM, WRAM i el
+   seu eco. */
+static void
+update_map (
+            GBC_Machine *m
+            )
+{
+  
+  int i;
+  
+  
+  memset ( _rpage, 0, sizeof(_rpage) );
+  memset ( _wpage, 0, sizeof(_wpage) );
+  memset ( _cpage, 0, sizeof(_cpage) );
+  
+  /* ROM. La BIOS es llig amb la funció. */
+  if ( _rom0 != NULL )
+    {
+      i= _bios_mapped ? 0x09 : 0x00;
+      map_pages ( m, i, 0x40, _rom0 + i*0x100 );
+      map_pages ( m, 0x40, 0x80, _rom1 );
+    }
+  
+  /* VRAM. Les escriptures necessiten posar al dia el LCD. */
+  if ( _vram != NULL ) map_pages ( m, 0x80, 0xA0, _vram );
+  
+  /* WRAM i eco. */
+  map_pages ( m, 0xC0, 0xD0, _ram0 );
+  map_pages ( m, 0xD0, 0xE0, _ram1 );
+  map_pages ( m, 0xE0, 0xF0, _ram0 );
+  map_pages ( m, 0xF0, 0xFE, _ram1 );
+  for ( i= 0xC0; i < 0xFE; ++i )
+    {
+      _wpage[i]= (GBCu8 *) _rpage[i];
+      _cpage[i]= &(_ram_code[(i&0x10) ? ram1_page ( m ) : 0][(i&0xF)<<8]);
+    }
+  
+} /* end update_map */
+
+
+/***************/
+/* PORTS D'E/S */
+/***************/
+
+/* Registres sense funció en el dispositiu. */
+static GBCu8 read_ff (GBC_Machine *m) { return 0xFF; }
+static void write_none (GBC_Machine *m, GBCu8 data) {}
+
+
+/* Wave Pattern RAM. */
+#define WAVE_RAM(POS)        						\
+  static GBCu8 wave_read_ ## POS (GBC_Machine *m)        		\
+  { return GBC_apu_ch3_ram_read ( m, POS ); }        			\
+  static void wave_write_ ## POS (GBC_Machine *m, GBCu8 data)        	\
+  { GBC_apu_ch3_ram_write ( m, data, POS ); }
+
+WAVE_RAM ( 0 )
+WAVE_RAM ( 1 )
+WAVE_RAM ( 2 )
+WAVE_RAM ( 3 )
+WAVE_RAM ( 4 )
+WAVE_RAM ( 5 )
+WAVE_RAM ( 6 )
+WAVE_RAM ( 7 )
+WAVE_RAM ( 8 )
+WAVE_RAM ( 9 )
+WAVE_RAM ( 10 )
+WAVE_RAM ( 11 )
+WAVE_RAM ( 12 )
+WAVE_RAM ( 13 )
+WAVE_RAM ( 14 )
+WAVE_RAM ( 15 )
+
+
+/* LCDMODE. */
+static void
+lcdmode_write (
+               GBC_Machine *m,
+               GBCu8        data
+               )
+{
+  
+  GBC_cpu_set_cgb_mode ( m, (data&0x80)!=0 );
+  GBC_lcd_set_cgb_mode ( m, (data&0x80)!=0 );
+  
+} /* end lcdmode_write */
+
+
+/* BLCK. */
+static void
+blck_write (
+            GBC_Machine *m,
+            GBCu8        data
+            )
+{
+  
+  if ( data == 0x11 )
+    {
+      _bios_mapped= GBC_FALSE;
+      update_map ( m );
+    }
+  
+} /* end blck_write */
+
+
+/* SVBK. */
+static GBCu8
+svbk_read (
+           GBC_Machine *m
+           )
+{
+  return _svbk;
+} /* end svbk_read */
+
+
+static void
+svbk_write (
+            GBC_Machine *m,
+            GBCu8        data
+            )
+{
+  
+  int aux;
+  
+  
+  /* Mirant el codi de la BIOS he aplegat a la conclusió de que
+     aquesta opció sempre té que estar activa. */
+  _svbk= data;
+  aux= data&0x7;
+  if ( aux == 0 ) aux= 1;
+  _ram1= &(_ram[aux][0]);
+  update_map ( m );
+  
+} /* end svbk_write */
+
+
+/* Funcions per a llegir i escriure en els ports 0xFF00-0xFF7F. NULL
+   vol dir que el port no està implementat. */
+static GBCu8 (*const _io_read[128]) (GBC_Machine *)=
+{
+  /* 0x00 */ GBC_joypad_read,
+  /* 0x01 */ NULL,
+  /* 0x02 */ NULL,
+  /* 0x03 */ NULL,
+  /* 0x04 */ GBC_timers_divider_read,
+  /* 0x05 */ GBC_timers_timer_counter_read,
+  /* 0x06 */ GBC_timers_timer_modulo_read,
+  /* 0x07 */ GBC_timers_timer_control_read,
+  /* 0x08 */ NULL,
+  /* 0x09 */ NULL,
+  /* 0x0a */ NULL,
+  /* 0x0b */ NULL,
+  /* 0x0c */ NULL,
+  /* 0x0d */ NULL,
+  /* 0x0e */ NULL,
+  /* 0x0f */ GBC_cpu_read_IF,
+  /* 0x10 */ GBC_apu_ch1_sweep_read,
+  /* 0x11 */ GBC_apu_ch1_get_wave_pattern_duty,
+  /* 0x12 */ GBC_apu_ch1_volume_envelope_read,
+  /* 0x13 */ read_ff,
+  /* 0x14 */ GBC_apu_ch1_get_lc_status,
+  /* 0x15 */ read_ff,
+  /* 0x16 */ GBC_apu_ch2_get_wave_pattern_duty,
+  /* 0x17 */ GBC_apu_ch2_volume_envelope_read,
+  /* 0x18 */ read_ff,
+  /* 0x19 */ GBC_apu_ch2_get_lc_status,
+  /* 0x1a */ GBC_apu_ch3_sound_on_off_read,
+  /* 0x1b */ read_ff,
+  /* 0x1c */ GBC_apu_ch3_output_level_read,
+  /* 0x1d */ read_ff,
+  /* 0x1e */ GBC_apu_ch3_get_lc_status,
+  /* 0x1f */ read_ff,
+  /* 0x20 */ read_ff,
+  /* 0x21 */ GBC_apu_ch4_volume_envelope_read,
+  /* 0x22 */ GBC_apu_ch4_polynomial_counter_read,
+  /* 0x23 */ GBC_apu_ch4_get_lc_status,
+  /* 0x24 */ GBC_apu_vin_read,
+  /* 0x25 */ GBC_apu_select_out_read,
+  /* 0x26 */ GBC_apu_get_status,
+  /* 0x27 */ NULL,
+  /* 0x28 */ NULL,
+  /* 0x29 */ NULL,
+  /* 0x2a */ NULL,
+  /* 0x2b */ NULL,
+  /* 0x2c */ NULL,
+  /* 0x2d */ NULL,
+  /* 0x2e */ NULL,
+  /* 0x2f */ NULL,
+  /* 0x30 */ wave_read_0,
+  /* 0x31 */ wave_read_1,
+  /* 0x32 */ wave_read_2,
+  /* 0x33 */ wave_read_3,
+  /* 0x34 */ wave_read_4,
+  /* 0x35 */ wave_read_5,
+  /* 0x36 */ wave_read_6,
+  /* 0x37 */ wave_read_7,
+  /* 0x38 */ wave_read_8,
+  /* 0x39 */ wave_read_9,
+  /* 0x3a */ wave_read_10,
+  /* 0x3b */ wave_read_11,
+  /* 0x3c */ wave_read_12,
+  /* 0x3d */ wave_read_13,
+  /* 0x3e */ wave_read_14,
+  /* 0x3f */ wave_read_15,
+  /* 0x40 */ GBC_lcd_control_read,
+  /* 0x41 */ GBC_lcd_status_read,
+  /* 0x42 */ GBC_lcd_scy_read,
+  /* 0x43 */ GBC_lcd_scx_read,
+  /* 0x44 */ GBC_lcd_ly_read,
+  /* 0x45 */ GBC_lcd_lyc_read,
+  /* 0x46 */ NULL,
+  /* 0x47 */ GBC_lcd_mpal_bg_get,
+  /* 0x48 */ GBC_lcd_mpal_ob0_get,
+  /* 0x49 */ GBC_lcd_mpal_ob1_get,
+  /* 0x4a */ GBC_lcd_wy_read,
+  /* 0x4b */ GBC_lcd_wx_read,
+  /* 0x4c */ NULL,
+  /* 0x4d */ GBC_cpu_speed_query,
+  /* 0x4e */ NULL,
+  /* 0x4f */ GBC_lcd_get_vram_bank,
+  /* 0x50 */ NULL,
+  /* 0x51 */ NULL,
+  /* 0x52 */ NULL,
+  /* 0x53 */ NULL,
+  /* 0x54 */ NULL,
+  /* 0x55 */ GBC_lcd_vram_dma_status,
+  /* 0x56 */ NULL,
+  /* 0x57 */ NULL,
+  /* 0x58 */ NULL,
+  /* 0x59 */ NULL,
+  /* 0x5a */ NULL,
+  /* 0x5b */ NULL,
+  /* 0x5c */ NULL,
+  /* 0x5d */ NULL,
+  /* 0x5e */ NULL,
+  /* 0x5f */ NULL,
+  /* 0x60 */ NULL,
+  /* 0x61 */ NULL,
+  /* 0x62 */ NULL,
+  /* 0x63 */ NULL,
+  /* 0x64 */ NULL,
+  /* 0x65 */ NULL,
+  /* 0x66 */ NULL,
+  /* 0x67 */ NULL,
+  /* 0x68 */ NULL,
+  /* 0x69 */ GBC_lcd_cpal_bg_read_data,
+  /* 0x6a */ NULL,
+  /* 0x6b */ GBC_lcd_cpal_ob_read_data,
+  /* 0x6c */ NULL,
+  /* 0x6d */ NULL,
+  /* 0x6e */ NULL,
+  /* 0x6f */ NULL,
+  /* 0x70 */ svbk_read,
+  /* 0x71 */ NULL,
+  /* 0x72 */ NULL,
+  /* 0x73 */ NULL,
+  /* 0x74 */ NULL,
+  /* 0x75 */ NULL,
+  /* 0x76 */ NULL,
+  /* 0x77 */ NULL,
+  /* 0x78 */ NULL,
+  /* 0x79 */ NULL,
+  /* 0x7a */ NULL,
+  /* 0x7b */ NULL,
+  /* 0x7c */ NULL,
+  /* 0x7d */ NULL,
+  /* 0x7e */ NULL,
+  /* 0x7f */ NULL
+};
+
+static void (*const _io_write[128]) (GBC_Machine *,GBCu8)=
+{
+  /* 0x00 */ GBC_joypad_write,
+  /* 0x01 */ NULL,
+  /* 0x02 */ NULL,
+  /* 0x03 */ NULL,
+  /* 0x04 */ GBC_timers_divider_write,
+  /* 0x05 */ GBC_timers_timer_counter_write,
+  /* 0x06 */ GBC_timers_timer_modulo_write,
+  /* 0x07 */ GBC_timers_timer_control_write,
+  /* 0x08 */ NULL,
+  /* 0x09 */ NULL,
+  /* 0x0a */ NULL,
+  /* 0x0b */ NULL,
+  /* 0x0c */ NULL,
+  /* 0x0d */ NULL,
+  /* 0x0e */ NULL,
+  /* 0x0f */ GBC_cpu_write_IF,
+  /* 0x10 */ GBC_apu_ch1_sweep_write,
+  /* 0x11 */ GBC_apu_ch1_set_length_wave_pattern_dutty,
+  /* 0x12 */ GBC_apu_ch1_volume_envelope_write,
+  /* 0x13 */ GBC_apu_ch1_freq_lo,
+  /* 0x14 */ GBC_apu_ch1_freq_hi,
+  /* 0x15 */ write_none,
+  /* 0x16 */ GBC_apu_ch2_set_length_wave_pattern_dutty,
+  /* 0x17 */ GBC_apu_ch2_volume_envelope_write,
+  /* 0x18 */ GBC_apu_ch2_freq_lo,
+  /* 0x19 */ GBC_apu_ch2_freq_hi,
+  /* 0x1a */ GBC_apu_ch3_sound_on_off_write,
+  /* 0x1b */ GBC_apu_ch3_set_length,
+  /* 0x1c */ GBC_apu_ch3_output_level_write,
+  /* 0x1d */ GBC_apu_ch3_freq_lo,
+  /* 0x1e */ GBC_apu_ch3_freq_hi,
+  /* 0x1f */ write_none,
+  /* 0x20 */ GBC_apu_ch4_set_length,
+  /* 0x21 */ GBC_apu_ch4_volume_envelope_write,
+  /* 0x22 */ GBC_apu_ch4_polynomial_counter_write,
+  /* 0x23 */ GBC_apu_ch4_init,
+  /* 0x24 */ GBC_apu_vin_write,
+  /* 0x25 */ GBC_apu_select_out_write,
+  /* 0x26 */ GBC_apu_turn_on,
+  /* 0x27 */ NULL,
+  /* 0x28 */ NULL,
+  /* 0x29 */ NULL,
+  /* 0x2a */ NULL,
+  /* 0x2b */ NULL,
+  /* 0x2c */ NULL,
+  /* 0x2d */ NULL,
+  /* 0x2e */ NULL,
+  /* 0x2f */ NULL,
+  /* 0x30 */ wave_write_0,
+  /* 0x31 */ wave_write_1,
+  /* 0x32 */ wave_write_2,
+  /* 0x33 */ wave_write_3,
+  /* 0x34 */ wave_write_4,
+  /* 0x35 */ wave_write_5,
+  /* 0x36 */ wave_write_6,
+  /* 0x37 */ wave_write_7,
+  /* 0x38 */ wave_write_8,
+  /* 0x39 */ wave_write_9,
+  /* 0x3a */ wave_write_10,
+  /* 0x3b */ wave_write_11,
+  /* 0x3c */ wave_write_12,
+  /* 0x3d */ wave_write_13,
+  /* 0x3e */ wave_write_14,
+  /* 0x3f */ wave_write_15,
+  /* 0x40 */ GBC_lcd_control_write,
+  /* 0x41 */ GBC_lcd_status_write,
+  /* 0x42 */ GBC_lcd_scy_write,
+  /* 0x43 */ GBC_lcd_scx_write,
+  /* 0x44 */ NULL,
+  /* 0x45 */ GBC_lcd_lyc_write,
+  /* 0x46 */ GBC_lcd_oam_dma,
+  /* 0x47 */ GBC_lcd_mpal_bg_set,
+  /* 0x48 */ GBC_lcd_mpal_ob0_set,
+  /* 0x49 */ GBC_lcd_mpal_ob1_set,
+  /* 0x4a */ GBC_lcd_wy_write,
+  /* 0x4b */ GBC_lcd_wx_write,
+  /* 0x4c */ lcdmode_write,
+  /* 0x4d */ GBC_cpu_speed_prepare,
+  /* 0x4e */ NULL,
+  /* 0x4f */ GBC_lcd_select_vram_bank,
+  /* 0x50 */ blck_write,
+  /* 0x51 */ GBC_lcd_vram_dma_src_high,
+  /* 0x52 */ GBC_lcd_vram_dma_src_low,
+  /* 0x53 */ GBC_lcd_vram_dma_dst_high,
+  /* 0x54 */ GBC_lcd_vram_dma_dst_low,
+  /* 0x55 */ GBC_lcd_vram_dma_init,
+  /* 0x56 */ NULL,
+  /* 0x57 */ NULL,
+  /* 0x58 */ NULL,
+  /* 0x59 */ NULL,
+  /* 0x5a */ NULL,
+  /* 0x5b */ NULL,
+  /* 0x5c */ NULL,
+  /* 0x5d */ NULL,
+  /* 0x5e */ NULL,
+  /* 0x5f */ NULL,
+  /* 0x60 */ NULL,
+  /* 0x61 */ NULL,
+  /* 0x62 */ NULL,
+  /* 0x63 */ NULL,
+  /* 0x64 */ NULL,
+  /* 0x65 */ NULL,
+  /* 0x66 */ NULL,
+  /* 0x67 */ NULL,
+  /* 0x68 */ GBC_lcd_cpal_bg_index,
+  /* 0x69 */ GBC_lcd_cpal_bg_write_data,
+  /* 0x6a */ GBC_lcd_cpal_ob_index,
+  /* 0x6b */ GBC_lcd_cpal_ob_write_data,
+  /* 0x6c */ GBC_lcd_pal_lock,
+  /* 0x6d */ NULL,
+  /* 0x6e */ NULL,
+  /* 0x6f */ NULL,
+  /* 0x70 */ svbk_write,
+  /* 0x71 */ NULL,
+  /* 0x72 */ NULL,
+  /* 0x73 */ NULL,
+  /* 0x74 */ NULL,
+  /* 0x75 */ NULL,
+  /* 0x76 */ NULL,
+  /* 0x77 */ NULL,
+  /* 0x78 */ NULL,
+  /* 0x79 */ NULL,
+  /* 0x7a */ NULL,
+  /* 0x7b */ NULL,
+  /* 0x7c */ NULL,
+  /* 0x7d */ NULL,
+  /* 0x7e */ NULL,
+  /* 0x7f */ NULL
+};
+
+
+/* Compta un accés al port no implementat ADDR i avisa la primera
+   vegada. */
+static void
+io_unmapped (
+             GBC_Machine    *m,
+             const GBCu16    addr,
+             const GBC_Bool  write
+             )
+{
+  
+  GBCu32 *count;
+  
+  
+  count= write ? &(_io_writes[addr&0x7F]) : &(_io_reads[addr&0x7F]);
+  if ( ++(*count) == 1 && _warning != NULL )
+    _warning ( _udata, "el port d'E/S 'FF%02X' no està implementat (%s)",
+               addr&0x7F, write ? "escriptura" : "lectura" );
+  
+} /* end io_unmapped */
 
-/*********************/
-/* FUNCIONS PRIVADES */
-/*********************/
 
-#include <stdio.h>
 static GBCu8
 mem_read (
+          GBC_Machine *m,
           const GBCu16 addr
           )
 {
   
+  const GBCu8 *p;
+  
+  
+  /* Accés directe. */
+  if ( (p= _rpage[addr>>8]) != NULL ) return p[addr&0xFF];
+  
   /* ROM+BIOS. */
   if ( addr < 0x900 )
     {
       if ( _bios_mapped && (addr < 0x100 || addr >= 0x200) )
         return _bios[addr];
-      else return GBC_mapper_read ( addr );
+      else return GBC_mapper_read ( m, addr );
     }
   
   /* ROM. */
-  else if ( addr < 0x8000 ) return GBC_mapper_read ( addr );
+  else if ( addr < 0x8000 ) return GBC_mapper_read ( m, addr );
   
   /* VRAM. */
-  else if ( addr < 0xA000 ) return GBC_lcd_vram_read ( addr&0x1FFF );
+  else if ( addr < 0xA000 )
+    {
+      GBC_main_sync ( m );
+      return GBC_lcd_vram_read ( m, addr&0x1FFF );
+    }
   
   /* External RAM. */
-  else if ( addr < 0xC000 ) return GBC_mapper_read_ram ( addr&0x1FFF );
+  else if ( addr < 0xC000 ) return GBC_mapper_read_ram ( m, addr&0x1FFF );
   
   /* RAM. */
   else if ( addr < 0xFE00 )
@@ -116,191 +602,37 @@ mem_read (
     }
   
   /* OAM. */
-  else if ( addr < 0xFEA0 ) return GBC_lcd_oam_read ( addr&0xFF );
+  else if ( addr < 0xFEA0 )
+    {
+      GBC_main_sync ( m );
+      return GBC_lcd_oam_read ( m, addr&0xFF );
+    }
   
   /* Not usable. */
   else if ( addr < 0xFF00 ) return 0x00;
   
-  /* I/O Ports. */
+  /* I/O Ports. Els dispositius han d'estar al dia abans de llegir
+     els seus registres. */
   else if ( addr < 0xFF80 )
     {
-      switch ( addr&0xFF )
-        {
-          
-        case 0x00: /* JOYP. */
-          return GBC_joypad_read ();
-          
-        case 0x04: /* DIV. */
-          return GBC_timers_divider_read ();
-          
-        case 0x05: /* TIMA. */
-          return GBC_timers_timer_counter_read ();
-          
-        case 0x06: /* TMA. */
-          return GBC_timers_timer_modulo_read ();
-          
-        case 0x07: /* TAC. */
-          return GBC_timers_timer_control_read ();
-          
-        case 0x0F: /* Interrupt Flag. */
-          return GBC_cpu_read_IF ();
-        
-        case 0x10: /* NR10. */
-          return GBC_apu_ch1_sweep_read ();
-          
-        case 0x11: /* NR11. */
-          return GBC_apu_ch1_get_wave_pattern_duty ();
-          
-        case 0x12: /* NR12. */
-          return GBC_apu_ch1_volume_envelope_read ();
-        
-        case 0x13: /* NR13. */
-          return 0xFF;
-          
-        case 0x14: /* NR14. */
-          return GBC_apu_ch1_get_lc_status ();
-        
-        case 0x15: /* NR20. */
-          return 0xFF;
-          
-        case 0x16: /* NR21. */
-          return GBC_apu_ch2_get_wave_pattern_duty ();
-          
-        case 0x17: /* NR22. */
-          return GBC_apu_ch2_volume_envelope_read ();
-          
-        case 0x18: /* NR23. */
-          return 0xFF;
-          
-        case 0x19: /* NR24. */
-          return GBC_apu_ch2_get_lc_status ();
-        
-        case 0x1A: /* NR30. */
-          return GBC_apu_ch3_sound_on_off_read ();
-        
-        case 0x1B: /* NR31. */
-          return 0xFF;
-          
-        case 0x1C: /* NR32. */  
-          return GBC_apu_ch3_output_level_read ();
-          
-        case 0x1D: /* NR33. */
-          return 0xFF;
-          
-        case 0x1E: /* NR34. */  
-          return GBC_apu_ch3_get_lc_status ();
-          
-        case 0x1F: /* NR40. */
-          return 0xFF;
-          
-        case 0x20: /* NR41. */
-          return 0xFF;
-          
-        case 0x21: /* NR42. */
-          return GBC_apu_ch4_volume_envelope_read ();
-          
-        case 0x22: /* NR43. */
-          return GBC_apu_ch4_polynomial_counter_read ();
-        
-        case 0x23: /* NR44. */
-          return GBC_apu_ch4_get_lc_status ();
-          
-        case 0x24: /* NR50. */
-          return GBC_apu_vin_read ();
-          
-        case 0x25: /* NR51. */
-          return GBC_apu_select_out_read ();
-          
-        case 0x26: /* NR52. */
-          return GBC_apu_get_status ();
-          
-          /* Wave Pattern RAM. */
-        case 0x30: return GBC_apu_ch3_ram_read ( 0 );
-        case 0x31: return GBC_apu_ch3_ram_read ( 1 );
-        case 0x32: return GBC_apu_ch3_ram_read ( 2 );
-        case 0x33: return GBC_apu_ch3_ram_read ( 3 );
-        case 0x34: return GBC_apu_ch3_ram_read ( 4 );
-        case 0x35: return GBC_apu_ch3_ram_read ( 5 );
-        case 0x36: return GBC_apu_ch3_ram_read ( 6 );
-        case 0x37: return GBC_apu_ch3_ram_read ( 7 );
-        case 0x38: return GBC_apu_ch3_ram_read ( 8 );
-        case 0x39: return GBC_apu_ch3_ram_read ( 9 );
-        case 0x3A: return GBC_apu_ch3_ram_read ( 10 );
-        case 0x3B: return GBC_apu_ch3_ram_read ( 11 );
-        case 0x3C: return GBC_apu_ch3_ram_read ( 12 );
-        case 0x3D: return GBC_apu_ch3_ram_read ( 13 );
-        case 0x3E: return GBC_apu_ch3_ram_read ( 14 );
-        case 0x3F: return GBC_apu_ch3_ram_read ( 15 );
-          
-        case 0x40: /* LCDC. */
-          return GBC_lcd_control_read ();
-          
-        case 0x41: /* STAT. */
-          return GBC_lcd_status_read ();
-          
-        case 0x42: /* SCY. */
-          return GBC_lcd_scy_read ();
-          
-        case 0x43: /* SCX. */
-          return GBC_lcd_scx_read ();
-          
-        case 0x44: /* LY. */
-          return GBC_lcd_ly_read ();
-          
-        case 0x45: /* LYC. */
-          return GBC_lcd_lyc_read ();
-          
-        case 0x47: /* BGP. */
-          return GBC_lcd_mpal_bg_get ();
-          
-        case 0x48: /* OBP0. */
-          return GBC_lcd_mpal_ob0_get ();
-          
-        case 0x49: /* OBP1. */
-          return GBC_lcd_mpal_ob1_get ();
-          
-        case 0x4A: /* WY. */
-          return GBC_lcd_wy_read ();
-          
-        case 0x4B: /* WX. */
-          return GBC_lcd_wx_read ();
-          
-        case 0x4D: /* KEY1. */
-          return GBC_cpu_speed_query ();
-          
-        case 0x4F: /* VBK. */
-          return GBC_lcd_get_vram_bank ();
-          
-        case 0x55: /* HDMA5. */
-          return GBC_lcd_vram_dma_status ();
-          
-        case 0x69: /* BGPD. */
-          return GBC_lcd_cpal_bg_read_data ();
-          
-        case 0x6B: /* OBPD. */
-          return GBC_lcd_cpal_ob_read_data ();
-          
-        case 0x70: /* SVBK. */
-          return _svbk;
-          
-        default:
-          printf ( "Read I/O port FF%02x\n", addr&0xFF );
-          return 0xFF;
-          
-        }
+      GBC_main_sync ( m );
+      if ( _io_read[addr&0x7F] != NULL ) return _io_read[addr&0x7F] ( m );
+      io_unmapped ( m, addr, GBC_FALSE );
+      return 0xFF;
     }
   
   /* HRAM. */
   else if ( addr < 0xFFFF ) return _hram[addr&0x7F];
   
   /* Interrupt Enable Register. */
-  else return GBC_cpu_read_IE ();
+  else return GBC_cpu_read_IE ( m );
   
 } /* end mem_read */
 
 
 static GBCu8
 mem_read_trace (
+        	GBC_Machine *m,
         	const GBCu16 addr
         	)
 {
@@ -308,7 +640,7 @@ mem_read_trace (
   GBCu8 data;
   
   
-  data= mem_read ( addr );
+  data= mem_read ( m, addr );
   _mem_access ( GBC_READ, addr, data, _udata );
   
   return data;
@@ -318,307 +650,90 @@ mem_read_trace (
 
 static void
 mem_write (
+           GBC_Machine *m,
            const GBCu16 addr,
            const GBCu8  data
            )
 {
   
   int aux;
+  GBCu8 *p;
   
   
+  /* Accés directe. */
+  if ( (p= _wpage[addr>>8]) != NULL && !_cpage[addr>>8][addr&0xFF] )
+    {
+      p[addr&0xFF]= data;
+      return;
+    }
+  
   /* ROM. */
-  if ( addr < 0x8000 ) GBC_mapper_write ( addr, data );
+  if ( addr < 0x8000 )
+    {
+      GBC_main_sync ( m );
+      GBC_mapper_write ( m, addr, data );
+    }
   
   /* VRAM. */
-  else if ( addr < 0xA000 ) GBC_lcd_vram_write ( addr&0x1FFF, data );
+  else if ( addr < 0xA000 )
+    {
+      GBC_main_sync ( m );
+      GBC_lcd_vram_write ( m, addr&0x1FFF, data );
+    }
   
   /* External RAM. */
-  else if ( addr < 0xC000 ) GBC_mapper_write_ram ( addr&0x1FFF, data );
+  else if ( addr < 0xC000 ) GBC_mapper_write_ram ( m, addr&0x1FFF, data );
   
   /* RAM. */
   else if ( addr < 0xFE00 )
     {
-      if ( addr&0x1000 ) _ram1[addr&0xFFF]= data;
-      else               _ram0[addr&0xFFF]= data;
+      aux= (addr&0x1000) ? ram1_page ( m ) : 0;
+      _ram[aux][addr&0xFFF]= data;
+      if ( _ram_code[aux][addr&0xFFF] )
+        GBC_cpu_code_written ( m, 0xC000|(addr&0x1FFF), aux );
     }
   
   /* OAM. */
-  else if ( addr < 0xFEA0 ) GBC_lcd_oam_write ( addr&0xFF, data );
+  else if ( addr < 0xFEA0 )
+    {
+      GBC_main_sync ( m );
+      GBC_lcd_oam_write ( m, addr&0xFF, data );
+    }
   
   /* Not usable. */
   else if ( addr < 0xFF00 ) return;
   
-  /* I/O Ports. */
+  /* I/O Ports. Una escriptura pot canviar el moment dels events. */
   else if ( addr < 0xFF80 )
     {
-      switch ( addr&0xFF )
-        {
-          
-        case 0x00: /* JOYP. */
-          GBC_joypad_write ( data );
-          break;
-          
-        case 0x04: /* DIV. */
-          GBC_timers_divider_write ( data );
-          break;
-          
-        case 0x05: /* TIMA. */
-          GBC_timers_timer_counter_write ( data );
-          break;
-          
-        case 0x06: /* TMA. */
-          GBC_timers_timer_modulo_write ( data );
-          break;
-          
-        case 0x07: /* TAC. */
-          GBC_timers_timer_control_write ( data );
-          break;
-          
-        case 0x0F: /* Interrupt Flag. */
-          GBC_cpu_write_IF ( data );
-          break;
-        
-        case 0x10: /* NR10. */
-          GBC_apu_ch1_sweep_write ( data );
-          break;
-        
-        case 0x11: /* NR11. */
-          GBC_apu_ch1_set_length_wave_pattern_dutty ( data );
-          break;
-          
-        case 0x12: /* NR12. */
-          GBC_apu_ch1_volume_envelope_write ( data );
-          break;
-          
-        case 0x13: /* NR13. */
-          GBC_apu_ch1_freq_lo ( data );
-          break;
-          
-        case 0x14: /* NR14. */
-          GBC_apu_ch1_freq_hi ( data );
-          break;
-          
-        case 0x15: /* NR20. */
-          break;
-          
-        case 0x16: /* NR21. */
-          GBC_apu_ch2_set_length_wave_pattern_dutty ( data );
-          break;
-          
-        case 0x17: /* NR22. */
-          GBC_apu_ch2_volume_envelope_write ( data );
-          break;
-          
-        case 0x18: /* NR23. */
-          GBC_apu_ch2_freq_lo ( data );
-          break;
-          
-        case 0x19: /* NR24. */
-          GBC_apu_ch2_freq_hi ( data );
-          break;
-         
-        case 0x1A: /* NR30. */
-          GBC_apu_ch3_sound_on_off_write ( data );
-          break;
-          
-        case 0x1B: /* NR31. */ 
-          GBC_apu_ch3_set_length ( data );
-          break;
-          
-        case 0x1C: /* NR32. */
-          GBC_apu_ch3_output_level_write ( data );
-          break;
-          
-        case 0x1D: /* NR33. */
-          GBC_apu_ch3_freq_lo ( data );
-          break;
-          
-        case 0x1E: /* NR34. */
-          GBC_apu_ch3_freq_hi ( data );
-          break;
-          
-        case 0x1F: /* NR40. */
-          break;
-          
-        case 0x20: /* NR41. */
-          GBC_apu_ch4_set_length ( data );
-          break;
-          
-        case 0x21: /* NR42. */
-          GBC_apu_ch4_volume_envelope_write ( data );
-          break;
-          
-        case 0x22: /* NR43. */
-          GBC_apu_ch4_polynomial_counter_write ( data );
-          break;
-         
-        case 0x23: /* NR44. */
-          GBC_apu_ch4_init ( data );
-          break;
-          
-        case 0x24: /* NR50. */
-          GBC_apu_vin_write ( data );
-          break;
-          
-        case 0x25: /* NR51. */	  
-          GBC_apu_select_out_write ( data );
-          break;
-          
-        case 0x26: /* NR52. */
-          GBC_apu_turn_on ( data );
-          break;
-          
-          /* Wave Pattern RAM. */
-        case 0x30: GBC_apu_ch3_ram_write ( data, 0 ); break;
-        case 0x31: GBC_apu_ch3_ram_write ( data, 1 ); break;
-        case 0x32: GBC_apu_ch3_ram_write ( data, 2 ); break;
-        case 0x33: GBC_apu_ch3_ram_write ( data, 3 ); break;
-        case 0x34: GBC_apu_ch3_ram_write ( data, 4 ); break;
-        case 0x35: GBC_apu_ch3_ram_write ( data, 5 ); break;
-        case 0x36: GBC_apu_ch3_ram_write ( data, 6 ); break;
-        case 0x37: GBC_apu_ch3_ram_write ( data, 7 ); break;
-        case 0x38: GBC_apu_ch3_ram_write ( data, 8 ); break;
-        case 0x39: GBC_apu_ch3_ram_write ( data, 9 ); break;
-        case 0x3A: GBC_apu_ch3_ram_write ( data, 10 ); break;
-        case 0x3B: GBC_apu_ch3_ram_write ( data, 11 ); break;
-        case 0x3C: GBC_apu_ch3_ram_write ( data, 12 ); break;
-        case 0x3D: GBC_apu_ch3_ram_write ( data, 13 ); break;
-        case 0x3E: GBC_apu_ch3_ram_write ( data, 14 ); break;
-        case 0x3F: GBC_apu_ch3_ram_write ( data, 15 ); break;
-          
-        case 0x40: /* LCDC. */
-          GBC_lcd_control_write ( data );
-          break;
-          
-        case 0x41: /* STAT. */
-          GBC_lcd_status_write ( data );
-          break;
-          
-        case 0x42: /* SCY. */
-          GBC_lcd_scy_write ( data );
-          break;
-          
-        case 0x43: /* SCX. */
-          GBC_lcd_scx_write ( data );
-          break;
-          
-        case 0x45: /* LYC. */
-          GBC_lcd_lyc_write ( data );
-          break;
-          
-        case 0x46: /* DMA. */
-          GBC_lcd_oam_dma ( data );
-          break;
-          
-        case 0x47: /* BGP. */
-          GBC_lcd_mpal_bg_set ( data );
-          break;
-          
-        case 0x48: /* OBP0. */
-          GBC_lcd_mpal_ob0_set ( data );
-          break;
-          
-        case 0x49: /* OBP1. */
-          GBC_lcd_mpal_ob1_set ( data );
-          break;
-          
-        case 0x4A: /* WY. */
-          GBC_lcd_wy_write ( data );
-          break;
-          
-        case 0x4B: /* WX. */
-          GBC_lcd_wx_write ( data );
-          break;
-          
-        case 0x4C: /* LCDMODE */
-          GBC_cpu_set_cgb_mode ( (data&0x80)!=0 );
-          GBC_lcd_set_cgb_mode ( (data&0x80)!=0 );
-          break;
-          
-        case 0x4D: /* KEY1. */
-          GBC_cpu_speed_prepare ( data );
-          break;
-          
-        case 0x4F: /* VBK. */
-          GBC_lcd_select_vram_bank ( data );
-          break;
-        
-        case 0x50: /* BLCK */
-          if ( data == 0x11 ) _bios_mapped= GBC_FALSE;
-          break;
-          
-        case 0x51: /* HDMA1. */
-          GBC_lcd_vram_dma_src_high ( data );
-          break;
-          
-        case 0x52: /* HDMA2. */
-          GBC_lcd_vram_dma_src_low ( data );
-          break;
-          
-        case 0x53: /* HDMA3. */
-          GBC_lcd_vram_dma_dst_high ( data );
-          break;
-          
-        case 0x54: /* HDMA4. */
-          GBC_lcd_vram_dma_dst_low ( data );
-          break;
-          
-        case 0x55: /* HDMA5. */
-          GBC_lcd_vram_dma_init ( data );
-          break;
-          
-        case 0x68: /* BGPI. */
-          GBC_lcd_cpal_bg_index ( data );
-          break;
-          
-        case 0x69: /* BGPD. */
-          GBC_lcd_cpal_bg_write_data ( data );
-          break;
-          
-        case 0x6A: /* OBPI. */
-          GBC_lcd_cpal_ob_index ( data );
-          break;
-          
-        case 0x6B: /* OBPD. */
-          GBC_lcd_cpal_ob_write_data ( data );
-          break;
-          
-        case 0x6C: /* PAL_LOCK */
-          GBC_lcd_pal_lock ( data );
-          break;
-          
-        case 0x70: /* SVBK. */
-          /* Mirant el codi de la BIOS he aplegat a la conclusió de
-             que aquesta opció sempre té que estar activa. */
-          _svbk= data;
-          aux= data&0x7;
-          if ( aux == 0 ) aux= 1;
-          _ram1= &(_ram[aux][0]);
-          break;
-          
-        default:
-          printf ( "Write I/O port FF%02x\n", addr&0xFF );
-          
-        }
+      GBC_main_sync ( m );
+      GBC_main_resched ( m );
+      if ( _io_write[addr&0x7F] != NULL ) _io_write[addr&0x7F] ( m, data );
+      else io_unmapped ( m, addr, GBC_TRUE );
     }
   
   /* HRAM. */
-  else if ( addr < 0xFFFF ) _hram[addr&0x7F]= data;
+  else if ( addr < 0xFFFF )
+    {
+      _hram[addr&0x7F]= data;
+      if ( _hram_code[addr&0x7F] ) GBC_cpu_code_written ( m, addr, 0 );
+    }
   
   /* Interrupt Enable Register. */
-  else GBC_cpu_write_IE ( data );
+  else GBC_cpu_write_IE ( m, data );
   
 } /* end mem_write */
 
 
 static void
 mem_write_trace (
+        	 GBC_Machine *m,
         	 const GBCu16 addr,
         	 const GBCu8  data
         	 )
 {
   
-  mem_write ( addr, data );
+  mem_write ( m, addr, data );
   _mem_access ( GBC_WRITE, addr, data, _udata );
   
 } /* end mem_write_trace */
@@ -632,17 +747,22 @@ mem_write_trace (
 
 void
 GBC_mem_init (
+              GBC_Machine    *m,
               const GBCu8     bios[0x900],
+              GBC_Warning    *warning,
               GBC_MemAccess  *mem_access,
               void           *udata
               )
 {
   
+  _warning= warning;
+  memset ( _io_reads, 0, sizeof(_io_reads) );
+  memset ( _io_writes, 0, sizeof(_io_writes) );
   _mem_access= mem_access;
   _udata= udata;
   _bios= bios;
 
-  GBC_mem_init_state ();
+  GBC_mem_init_state ( m );
   
   /* Funcions. */
   _mem_read= mem_read;
@@ -652,7 +772,9 @@ GBC_mem_init (
 
 
 void
-GBC_mem_init_state (void)
+GBC_mem_init_state (
+                    GBC_Machine *m
+                    )
 {
   
   _bios_mapped= (_bios!=NULL);
@@ -666,27 +788,148 @@ GBC_mem_init_state (void)
   /* HRAM. */
   memset ( _hram, 0, HRAM_SIZE );
   
+  /* Codi. */
+  memset ( _ram_code, 0, sizeof(_ram_code) );
+  memset ( _hram_code, 0, sizeof(_hram_code) );
+  
+  update_map ( m );
+  
 } /* end GBC_mem_init_state */
 
 
+int
+GBC_mem_get_code_bank (
+        	       GBC_Machine  *m,
+        	       const GBCu16  addr
+        	       )
+{
+  
+  if ( addr < 0x4000 )
+    return (_bios_mapped && addr < 0x900) ? -1 : 0;
+  else if ( addr < 0x8000 ) return GBC_mapper_get_bank1 ( m );
+  else if ( addr < 0xC000 ) return -1;
+  else if ( addr < 0xD000 ) return 0;
+  else if ( addr < 0xE000 ) return ram1_page ( m );
+  else if ( addr >= 0xFF80 && addr < 0xFFFF ) return 0;
+  else return -1;
+  
+} /* end GBC_mem_get_code_bank */
+
+
+void
+GBC_mem_get_io_unmapped (
+        		 GBC_Machine *m,
+        		 GBCu32       reads[128],
+        		 GBCu32       writes[128]
+        		 )
+{
+  
+  memcpy ( reads, _io_reads, sizeof(_io_reads) );
+  memcpy ( writes, _io_writes, sizeof(_io_writes) );
+  
+} /* end GBC_mem_get_io_unmapped */
+
+
 GBC_Bool
-GBC_mem_is_bios_mapped (void)
+GBC_mem_is_bios_mapped (
+                        GBC_Machine *m
+                        )
 {
   return _bios_mapped;
 } /* end GBC_mem_is_bios_mapped */
 
 
+void
+GBC_mem_mark_code (
+        	   GBC_Machine  *m,
+        	   const GBCu16  addr,
+        	   const int     bank,
+        	   const int     nbytes
+        	   )
+{
+  
+  GBCu8 *p;
+  int i;
+  
+  
+  p= code_marks ( m, addr, bank );
+  for ( i= 0; i < nbytes; ++i )
+    if ( p[i] != 0xFF ) ++p[i];
+  
+} /* end GBC_mem_mark_code */
+
+
+void
+GBC_mem_unmark_code (
+        	     GBC_Machine  *m,
+        	     const GBCu16  addr,
+        	     const int     bank,
+        	     const int     nbytes
+        	     )
+{
+  
+  GBCu8 *p;
+  int i;
+  
+  
+  p= code_marks ( m, addr, bank );
+  for ( i= 0; i < nbytes; ++i )
+    if ( p[i] != 0 && p[i] != 0xFF ) --p[i];
+  
+} /* end GBC_mem_unmark_code */
+
+
+void
+GBC_mem_map_rom (
+        	 GBC_Machine *m,
+        	 const GBCu8 *rom0,
+        	 const GBCu8 *rom1
+        	 )
+{
+  
+  _rom0= rom0;
+  _rom1= rom1;
+  update_map ( m );
+  
+} /* end GBC_mem_map_rom */
+
+
+void
+GBC_mem_map_vram (
+        	  GBC_Machine *m,
+        	  const GBCu8 *vram
+        	  )
+{
+  
+  _vram= vram;
+  update_map ( m );
+  
+} /* end GBC_mem_map_vram */
+
+
 GBCu8
 GBC_mem_read (
+              GBC_Machine *m,
               const GBCu16 addr
               )
 {
-  return _mem_read ( addr );
+  return _mem_read ( m, addr );
 } /* end GBC_mem_read */
 
 
+GBCu8
+GBC_mem_read_plain (
+        	    GBC_Machine  *m,
+        	    const GBCu16  addr
+        	    )
+{
+  return mem_read ( m, addr );
+} /* end GBC_mem_read_plain */
+
+
 void
 GBC_mem_set_mode_trace (
+        		GBC_Machine   *m,
         		const GBC_Bool val
         		)
 {
@@ -708,16 +951,29 @@ GBC_mem_set_mode_trace (
 
 void
 GBC_mem_write (
+               GBC_Machine *m,
                const GBCu16 addr,
                const GBCu8  data
                )
 {
-  _mem_write ( addr, data );
+  _mem_write ( m, addr, data );
 } /* end GBC_mem_write */
 
 
+void
+GBC_mem_write_plain (
+        	     GBC_Machine  *m,
+        	     const GBCu16  addr,
+        	     const GBCu8   data
+        	     )
+{
+  mem_write ( m, addr, data );
+} /* end GBC_mem_write_plain */
+
+
 int
 GBC_mem_save_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    )
 {
@@ -746,6 +1002,7 @@ GBC_mem_save_state (
 
 int
 GBC_mem_load_state (
+        	    GBC_Machine *m,
         	    FILE *f
         	    )
 {
@@ -762,6 +1019,9 @@ GBC_mem_load_state (
   _ram1= &(_ram[p][0]);
   LOAD ( _svbk );
   LOAD ( _hram );
+  memset ( _ram_code, 0, sizeof(_ram_code) );
+  memset ( _hram_code, 0, sizeof(_hram_code) );
+  update_map ( m );
 
   return 0;
   
@@ -22,10 +22,12 @@
  */
 
 
+#include <limits.h>
 #include <stddef.h>
 #include <stdlib.h>
 
 #include "GBC.h"
+#include "machine.h"
 
 
 
@@ -50,27 +52,9 @@
 /* ESTAT */
 /*********/
 
-/* Divisor a 16384 Hz (Cada 256 cicles rellotge). */
-static struct
-{
-  
-  GBCu8 reg;
-  int   cc;
-  
-} _divider;
-
-/* Temporitzador. */
-static struct
-{
-  
-  GBCu8    control;
-  GBCu8    counter;
-  GBCu8    modulo;
-  GBC_Bool enabled;
-  int      cc;
-  int      freq;
-  
-} _timer;
+/* L'estat està en 'GBC_Machine' (veure 'machine.h'). */
+#define _divider (m->timers.divider)
+#define _timer (m->timers.timer)
 
 
 
@@ -81,16 +65,15 @@ static struct
 
 void
 GBC_timers_clock (
+        	  GBC_Machine *m,
         	  const int cc
         	  )
 {
   
-  /* Divider. */
-  if ( (_divider.cc+= cc) >= 256 )
-    {
-      _divider.cc-= 256;
-      ++_divider.reg;
-    }
+  /* Divider. Pot rebre molts cicles de colp (veure 'GBC_main_sync'). */
+  _divider.cc+= cc;
+  _divider.reg+= (GBCu8) (_divider.cc/256);
+  _divider.cc%= 256;
   
   /* Timer. */
   if ( _timer.enabled )
@@ -102,7 +85,7 @@ GBC_timers_clock (
           if ( ++_timer.counter == 0x00 )
             {
               _timer.counter= _timer.modulo;
-              GBC_cpu_request_timer_int ();
+              GBC_cpu_request_timer_int ( m );
             }
         }
     }
@@ -111,7 +94,9 @@ GBC_timers_clock (
 
 
 GBCu8
-GBC_timers_divider_read (void)
+GBC_timers_divider_read (
+                         GBC_Machine *m
+                         )
 {
   return _divider.reg;
 } /* end GBC_timers_divider_read */
@@ -119,6 +104,7 @@ GBC_timers_divider_read (void)
 
 void
 GBC_timers_divider_write (
+        		  GBC_Machine *m,
         		  GBCu8 data
         		  )
 {
@@ -127,7 +113,9 @@ GBC_timers_divider_write (
 
 
 void
-GBC_timers_init (void)
+GBC_timers_init (
+                 GBC_Machine *m
+                 )
 {
   
   /* Divisor. */
@@ -145,8 +133,48 @@ GBC_timers_init (void)
 } /* end GBC_timers_init */
 
 
+int
+GBC_timers_next_event (
+        	       GBC_Machine *m
+        	       )
+{
+  
+  if ( !_timer.enabled ) return -1;
+  
+  return (0x100-_timer.counter)*_timer.freq - _timer.cc;
+  
+} /* end GBC_timers_next_event */
+
+
+void
+GBC_timers_get_stable (
+        	       GBC_Machine  *m,
+        	       const GBCu16  addr,
+        	       int          *since,
+        	       int          *until
+        	       )
+{
+  
+  if ( addr == 0xFF04 )
+    {
+      *since= _divider.cc;
+      *until= 256 - _divider.cc;
+    }
+  else if ( !_timer.enabled )
+    *since= *until= INT_MAX;
+  else
+    {
+      *since= _timer.cc;
+      *until= _timer.freq - _timer.cc;
+    }
+  
+} /* end GBC_timers_get_stable */
+
+
 GBCu8
-GBC_timers_timer_control_read (void)
+GBC_timers_timer_control_read (
+                               GBC_Machine *m
+                               )
 {
   return _timer.control;
 } /* end GBC_timers_timer_control_read */
@@ -154,6 +182,7 @@ GBC_timers_timer_control_read (void)
 
 void
 GBC_timers_timer_control_write (
+        			GBC_Machine *m,
         			GBCu8 data
         			)
 {
@@ -173,7 +202,9 @@ GBC_timers_timer_control_write (
 
 
 GBCu8
-GBC_timers_timer_counter_read (void)
+GBC_timers_timer_counter_read (
+                               GBC_Machine *m
+                               )
 {
   return _timer.counter;
 } /* end GBC_timers_timer_counter_read */
@@ -181,6 +212,7 @@ GBC_timers_timer_counter_read (void)
 
 void
 GBC_timers_timer_counter_write (
+        			GBC_Machine *m,
         			GBCu8 data
         			)
 {
@@ -189,7 +221,9 @@ GBC_timers_timer_counter_write (
 
 
 GBCu8
-GBC_timers_timer_modulo_read (void)
+GBC_timers_timer_modulo_read (
+                              GBC_Machine *m
+                              )
 {
   return _timer.modulo;
 } /* end GBC_timers_timer_modulo_read */
@@ -197,6 +231,7 @@ GBC_timers_timer_modulo_read (void)
 
 void
 GBC_timers_timer_modulo_write (
+        		       GBC_Machine *m,
         		       GBCu8 data
         		       )
 {
@@ -206,6 +241,7 @@ GBC_timers_timer_modulo_write (
 
 int
 GBC_timers_save_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       )
 {
@@ -220,6 +256,7 @@ GBC_timers_save_state (
 
 int
 GBC_timers_load_state (
+        	       GBC_Machine *m,
         	       FILE *f
         	       )
 {
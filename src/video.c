@@ -0,0 +1,616 @@
+/*
+ * Copyright 2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  video.c - Escalat i postprocés de la imatge que genera el LCD.
+ *
+ *  Totes les funcions treballen amb imatges en els formats de
+ *  'GBC_FBFormat' i escriuen en buffers del 'frontend'. Les parts més
+ *  costoses tenen versió SSE2 en x86-64.
+ *
+ */
+
+
+/* SSE2 sempre està disponible en x86-64. Es desactiva, com en
+ * 'lcd_simd.c', definint GBC_LCD_NO_SIMD. */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(GBC_LCD_NO_SIMD)
+#define VIDEO_SIMD
+#endif
+
+#include <stddef.h>
+#include <string.h>
+#ifdef VIDEO_SIMD
+#include <emmintrin.h>
+#endif
+
+#include "GBC.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define WIDTH GBC_VIDEO_WIDTH
+#define HEIGHT GBC_VIDEO_HEIGHT
+
+/* Màscares per a operar amb tots els canals d'un píxel de 15/16 bits
+ * a la vegada. El píxel es replica en la part alta i es deixen 5 bits
+ * lliures damunt de cada canal, per tant els pesos han d'estar entre 0
+ * i 32. */
+#define MASK_565 0x07E0F81FU
+#define MASK_555 0x03E07C1FU
+
+/* Scale2x i Scale3x. Es defineixen per a cada grandària de píxel.
+ * A B C
+ * D E F
+ * G H I
+ */
+#define SCALEX_FUNCS(SUFFIX,TYPE)        				\
+  static void        							\
+  scale2x_ ## SUFFIX (        						\
+        	      const void *src,        				\
+        	      GBCu8      *dst,        				\
+        	      const int   pitch        				\
+        	      )        						\
+  {        								\
+    const TYPE *s, *up, *down;        					\
+    TYPE *d0, *d1, B, D, E, F, H;        				\
+    int x, y;        							\
+    s= (const TYPE *) src;        					\
+    for ( y= 0; y < HEIGHT; ++y, s+= WIDTH )        			\
+      {        								\
+        up= y > 0 ? s-WIDTH : s;        				\
+        down= y < HEIGHT-1 ? s+WIDTH : s;        			\
+        d0= (TYPE *) (dst + (2*y)*pitch);        			\
+        d1= (TYPE *) (dst + (2*y+1)*pitch);        			\
+        for ( x= 0; x < WIDTH; ++x )        				\
+          {        							\
+            E= s[x]; B= up[x]; H= down[x];        			\
+            D= x > 0 ? s[x-1] : E;        				\
+            F= x < WIDTH-1 ? s[x+1] : E;        			\
+            if ( B != H && D != F )        				\
+              {        							\
+        	d0[2*x]= D == B ? D : E;        			\
+        	d0[2*x+1]= B == F ? F : E;        			\
+        	d1[2*x]= D == H ? D : E;        			\
+        	d1[2*x+1]= H == F ? F : E;        			\
+              }        							\
+            else d0[2*x]= d0[2*x+1]= d1[2*x]= d1[2*x+1]= E;        	\
+          }        							\
+      }        								\
+  }        								\
+          								\
+  static void        							\
+  scale3x_ ## SUFFIX (        						\
+        	      const void *src,        				\
+        	      GBCu8      *dst,        				\
+        	      const int   pitch        				\
+        	      )        						\
+  {        								\
+    const TYPE *s, *up, *down;        					\
+    TYPE *d0, *d1, *d2, A, B, C, D, E, F, G, H, I;        		\
+    int x, y, l, r;        						\
+    s= (const TYPE *) src;        					\
+    for ( y= 0; y < HEIGHT; ++y, s+= WIDTH )        			\
+      {        								\
+        up= y > 0 ? s-WIDTH : s;        				\
+        down= y < HEIGHT-1 ? s+WIDTH : s;        			\
+        d0= (TYPE *) (dst + (3*y)*pitch);        			\
+        d1= (TYPE *) (dst + (3*y+1)*pitch);        			\
+        d2= (TYPE *) (dst + (3*y+2)*pitch);        			\
+        for ( x= 0; x < WIDTH; ++x, d0+= 3, d1+= 3, d2+= 3 )        	\
+          {        							\
+            l= x > 0 ? x-1 : x;        					\
+            r= x < WIDTH-1 ? x+1 : x;        				\
+            A= up[l]; B= up[x]; C= up[r];        			\
+            D= s[l]; E= s[x]; F= s[r];        				\
+            G= down[l]; H= down[x]; I= down[r];        			\
+            if ( B != H && D != F )        				\
+              {        							\
+        	d0[0]= D == B ? D : E;        				\
+        	d0[1]= (D == B && E != C) || (B == F && E != A) ? B : E; \
+        	d0[2]= B == F ? F : E;        				\
+        	d1[0]= (D == B && E != G) || (D == H && E != A) ? D : E; \
+        	d1[1]= E;        					\
+        	d1[2]= (B == F && E != I) || (H == F && E != C) ? F : E; \
+        	d2[0]= D == H ? D : E;        				\
+        	d2[1]= (D == H && E != I) || (H == F && E != G) ? H : E; \
+        	d2[2]= H == F ? F : E;        				\
+              }        							\
+            else d0[0]= d0[1]= d0[2]= d1[0]= d1[1]= d1[2]=        	\
+        	   d2[0]= d2[1]= d2[2]= E;        			\
+          }        							\
+      }        								\
+  }
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static int
+pixel_size (
+            const GBC_FBFormat format
+            )
+{
+
+  switch ( format )
+    {
+    case GBC_FB_RGBA8888:
+    case GBC_FB_BGRA8888: return 4;
+    case GBC_FB_RGB565:
+    case GBC_FB_XRGB1555: return 2;
+    case GBC_FB_INDEXED8: return 1;
+    case GBC_FB_CGB15:
+    default: return (int) sizeof(int);
+    }
+
+} /* end pixel_size */
+
+
+/* Màscara dels canals d'un format de 15/16 bits. */
+static GBCu32
+mask16 (
+        const GBC_FBFormat format
+        )
+{
+  return format==GBC_FB_RGB565 ? MASK_565 : MASK_555;
+} /* end mask16 */
+
+
+/* Replica horitzontalment per FACTOR una fila de 160 píxels. */
+static void
+scale_row (
+           const GBCu8 *src,
+           GBCu8       *dst,
+           const int    size,
+           const int    factor
+           )
+{
+
+  int x, i;
+
+
+#ifdef VIDEO_SIMD
+  __m128i v;
+
+  if ( factor == 2 )
+    {
+      for ( x= 0; x < WIDTH*size; x+= 16, src+= 16, dst+= 32 )
+        {
+          v= _mm_loadu_si128 ( (const __m128i *) src );
+          switch ( size )
+            {
+            case 4:
+              _mm_storeu_si128 ( (__m128i *) dst,
+				 _mm_unpacklo_epi32 ( v, v ) );
+              _mm_storeu_si128 ( (__m128i *) (dst+16),
+        			 _mm_unpackhi_epi32 ( v, v ) );
+              break;
+            case 2:
+              _mm_storeu_si128 ( (__m128i *) dst,
+				 _mm_unpacklo_epi16 ( v, v ) );
+              _mm_storeu_si128 ( (__m128i *) (dst+16),
+        			 _mm_unpackhi_epi16 ( v, v ) );
+              break;
+            default:
+              _mm_storeu_si128 ( (__m128i *) dst,
+				 _mm_unpacklo_epi8 ( v, v ) );
+              _mm_storeu_si128 ( (__m128i *) (dst+16),
+        			 _mm_unpackhi_epi8 ( v, v ) );
+            }
+        }
+      return;
+    }
+  if ( factor == 4 && size == 4 )
+    {
+      for ( x= 0; x < WIDTH; x+= 4, src+= 16, dst+= 64 )
+        {
+          v= _mm_loadu_si128 ( (const __m128i *) src );
+          _mm_storeu_si128 ( (__m128i *) dst, _mm_shuffle_epi32 ( v, 0x00 ) );
+          _mm_storeu_si128 ( (__m128i *) (dst+16),
+        		     _mm_shuffle_epi32 ( v, 0x55 ) );
+          _mm_storeu_si128 ( (__m128i *) (dst+32),
+        		     _mm_shuffle_epi32 ( v, 0xAA ) );
+          _mm_storeu_si128 ( (__m128i *) (dst+48),
+        		     _mm_shuffle_epi32 ( v, 0xFF ) );
+        }
+      return;
+    }
+#endif
+
+  switch ( size )
+    {
+    case 4:
+      for ( x= 0; x < WIDTH; ++x )
+        for ( i= 0; i < factor; ++i )
+          ((GBCu32 *) dst)[x*factor+i]= ((const GBCu32 *) src)[x];
+      break;
+    case 2:
+      for ( x= 0; x < WIDTH; ++x )
+        for ( i= 0; i < factor; ++i )
+          ((GBCu16 *) dst)[x*factor+i]= ((const GBCu16 *) src)[x];
+      break;
+    default:
+      for ( x= 0; x < WIDTH; ++x )
+        for ( i= 0; i < factor; ++i )
+          dst[x*factor+i]= src[x];
+    }
+
+} /* end scale_row */
+
+
+SCALEX_FUNCS(8,GBCu8)
+SCALEX_FUNCS(16,GBCu16)
+SCALEX_FUNCS(32,GBCu32)
+
+
+/* Multiplica per MUL/256 els canals de N píxels de 32 bits, deixant
+   l'alfa. */
+static void
+darken32 (
+          GBCu32      *p,
+          const int    n,
+          const int    mul,
+          const GBCu32 alpha
+          )
+{
+
+  int i;
+  GBCu32 v;
+
+
+#ifdef VIDEO_SIMD
+  __m128i zero, m, a, lo, hi;
+
+  zero= _mm_setzero_si128 ();
+  m= _mm_set1_epi16 ( (short) mul );
+  a= _mm_set1_epi32 ( (int) alpha );
+  for ( i= 0; i+4 <= n; i+= 4 )
+    {
+      lo= _mm_loadu_si128 ( (const __m128i *) &(p[i]) );
+      hi= _mm_unpackhi_epi8 ( lo, zero );
+      lo= _mm_unpacklo_epi8 ( lo, zero );
+      lo= _mm_srli_epi16 ( _mm_mullo_epi16 ( lo, m ), 8 );
+      hi= _mm_srli_epi16 ( _mm_mullo_epi16 ( hi, m ), 8 );
+      _mm_storeu_si128 ( (__m128i *) &(p[i]),
+        		 _mm_or_si128 ( _mm_packus_epi16 ( lo, hi ), a ) );
+    }
+#else
+  i= 0;
+#endif
+  for ( ; i < n; ++i )
+    {
+      v= p[i];
+      p[i]= ((((v&0x00FF00FFU)*(GBCu32) mul)>>8)&0x00FF00FFU) |
+        ((((v&0x0000FF00U)*(GBCu32) mul)>>8)&0x0000FF00U) | alpha;
+    }
+
+} /* end darken32 */
+
+
+/* Com 'darken32' per a formats de 15/16 bits. MUL entre 0 i 32. */
+static void
+darken16 (
+          GBCu8        *p,
+          const int     size,
+          const int     n,
+          const int     mul,
+          const GBCu32  mask
+          )
+{
+
+  int i;
+  GBCu32 v;
+
+
+  for ( i= 0; i < n; ++i )
+    {
+      v= size==2 ? ((GBCu16 *) p)[i] : (GBCu32) ((int *) p)[i];
+      v= (v | (v<<16))&mask;
+      v= ((v*(GBCu32) mul)>>5)&mask;
+      v= (v | (v>>16))&0xFFFF;
+      if ( size == 2 ) ((GBCu16 *) p)[i]= (GBCu16) v;
+      else             ((int *) p)[i]= (int) v;
+    }
+
+} /* end darken16 */
+
+
+/* Components RGB de 8 bits d'un color BBBBBGGGGGRRRRR amb la
+   correcció de color de la pantalla de la GBC. */
+static void
+correct_color (
+               const int  color,
+               int        rgb[3]
+               )
+{
+
+  int r, g, b, R, G, B;
+
+
+  r= color&0x1F; g= (color>>5)&0x1F; b= (color>>10)&0x1F;
+  R= r*26 + g*4 + b*2;
+  G= g*24 + b*8;
+  B= r*6 + g*4 + b*22;
+  rgb[0]= (R>960 ? 960 : R)>>2;
+  rgb[1]= (G>960 ? 960 : G)>>2;
+  rgb[2]= (B>960 ? 960 : B)>>2;
+
+} /* end correct_color */
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+int
+GBC_video_color_correct (
+        		 const int          *src,
+        		 void               *dst,
+        		 const GBC_FBFormat  format
+        		 )
+{
+
+  int i, rgb[3];
+  GBCu8 *p;
+
+
+  if ( format == GBC_FB_INDEXED8 ) return -1;
+  p= (GBCu8 *) dst;
+  for ( i= 0; i < WIDTH*HEIGHT; ++i )
+    {
+      correct_color ( src[i], rgb );
+      switch ( format )
+        {
+        case GBC_FB_RGBA8888:
+        case GBC_FB_BGRA8888:
+          p[format==GBC_FB_RGBA8888 ? 0 : 2]= (GBCu8) rgb[0];
+          p[1]= (GBCu8) rgb[1];
+          p[format==GBC_FB_RGBA8888 ? 2 : 0]= (GBCu8) rgb[2];
+          p[3]= 0xFF;
+          p+= 4;
+          break;
+        case GBC_FB_RGB565:
+          *((GBCu16 *) p)= (GBCu16) (((rgb[0]>>3)<<11) | ((rgb[1]>>2)<<5) |
+        			     (rgb[2]>>3));
+          p+= 2;
+          break;
+        case GBC_FB_XRGB1555:
+          *((GBCu16 *) p)= (GBCu16) (((rgb[0]>>3)<<10) | ((rgb[1]>>3)<<5) |
+        			     (rgb[2]>>3));
+          p+= 2;
+          break;
+        case GBC_FB_CGB15:
+        default:
+          *((int *) p)= (rgb[0]>>3) | ((rgb[1]>>3)<<5) | ((rgb[2]>>3)<<10);
+          p+= sizeof(int);
+        }
+    }
+
+  return 0;
+
+} /* end GBC_video_color_correct */
+
+
+int
+GBC_video_ghosting (
+        	    void               *frame,
+        	    void               *prev,
+        	    const GBC_FBFormat  format,
+        	    const int           weight
+        	    )
+{
+
+  int i, n, w;
+  GBCu32 *f32, *p32, a, b, mask, alpha;
+  GBCu8 bytes[4];
+
+
+  if ( format == GBC_FB_INDEXED8 || weight < 0 || weight > 256 ) return -1;
+  n= WIDTH*HEIGHT;
+  if ( pixel_size ( format ) == 4 && format != GBC_FB_CGB15 )
+    {
+      f32= (GBCu32 *) frame;
+      p32= (GBCu32 *) prev;
+      memset ( bytes, 0, 4 ); bytes[3]= 0xFF;
+      memcpy ( &alpha, bytes, 4 );
+      i= 0;
+#ifdef VIDEO_SIMD
+      {
+        __m128i zero, wa, wb, va, ca, cb, lo, hi;
+
+        zero= _mm_setzero_si128 ();
+        wa= _mm_set1_epi16 ( (short) (256-weight) );
+        wb= _mm_set1_epi16 ( (short) weight );
+        va= _mm_set1_epi32 ( (int) alpha );
+        for ( ; i+4 <= n; i+= 4 )
+          {
+            ca= _mm_loadu_si128 ( (const __m128i *) &(f32[i]) );
+            cb= _mm_loadu_si128 ( (const __m128i *) &(p32[i]) );
+            lo= _mm_add_epi16
+              ( _mm_mullo_epi16 ( _mm_unpacklo_epi8 ( ca, zero ), wa ),
+        	_mm_mullo_epi16 ( _mm_unpacklo_epi8 ( cb, zero ), wb ) );
+            hi= _mm_add_epi16
+              ( _mm_mullo_epi16 ( _mm_unpackhi_epi8 ( ca, zero ), wa ),
+        	_mm_mullo_epi16 ( _mm_unpackhi_epi8 ( cb, zero ), wb ) );
+            ca= _mm_or_si128 ( _mm_and_si128 ( ca, va ),
+        		       _mm_andnot_si128 ( va, _mm_packus_epi16
+        					  ( _mm_srli_epi16 ( lo, 8 ),
+        					    _mm_srli_epi16 ( hi, 8 ) ) ) );
+            _mm_storeu_si128 ( (__m128i *) &(f32[i]), ca );
+            _mm_storeu_si128 ( (__m128i *) &(p32[i]), ca );
+          }
+      }
+#endif
+      for ( ; i < n; ++i )
+        {
+          a= f32[i]; b= p32[i];
+          a= ((((a&0x00FF00FFU)*(GBCu32) (256-weight) +
+        	(b&0x00FF00FFU)*(GBCu32) weight)>>8)&0x00FF00FFU) |
+            ((((a&0x0000FF00U)*(GBCu32) (256-weight) +
+               (b&0x0000FF00U)*(GBCu32) weight)>>8)&0x0000FF00U) |
+            (a&alpha);
+          f32[i]= p32[i]= a;
+        }
+    }
+  else
+    {
+      mask= mask16 ( format );
+      w= weight>>3;
+      for ( i= 0; i < n; ++i )
+        {
+          if ( format == GBC_FB_CGB15 )
+            { a= (GBCu32) ((int *) frame)[i]; b= (GBCu32) ((int *) prev)[i]; }
+          else
+            { a= ((GBCu16 *) frame)[i]; b= ((GBCu16 *) prev)[i]; }
+          a= (a | (a<<16))&mask;
+          b= (b | (b<<16))&mask;
+          a= ((a*(GBCu32) (32-w) + b*(GBCu32) w)>>5)&mask;
+          a= (a | (a>>16))&0xFFFF;
+          if ( format == GBC_FB_CGB15 )
+            ((int *) frame)[i]= ((int *) prev)[i]= (int) a;
+          else
+            ((GBCu16 *) frame)[i]= ((GBCu16 *) prev)[i]= (GBCu16) a;
+        }
+    }
+
+  return 0;
+
+} /* end GBC_video_ghosting */
+
+
+int
+GBC_video_lcd_grid (
+        	    void               *buf,
+        	    const GBC_FBFormat  format,
+        	    const int           pitch,
+        	    const int           factor,
+        	    const int           level
+        	    )
+{
+
+  GBCu8 *row, bytes[4];
+  GBCu32 alpha;
+  int size, y, x, mul;
+
+
+  if ( format == GBC_FB_INDEXED8 || factor < 2 || factor > 8 ||
+       level < 0 || level > 256 )
+    return -1;
+
+  /* L'última fila i l'última columna de cada píxel escalat. */
+  size= pixel_size ( format );
+  mul= 256-level;
+  memset ( bytes, 0, 4 ); bytes[3]= 0xFF;
+  memcpy ( &alpha, bytes, 4 );
+  for ( y= 0; y < HEIGHT*factor; ++y )
+    {
+      row= (GBCu8 *) buf + y*pitch;
+      if ( y%factor == factor-1 )
+        {
+          if ( size == 4 && format != GBC_FB_CGB15 )
+            darken32 ( (GBCu32 *) row, WIDTH*factor, mul, alpha );
+          else
+            darken16 ( row, size, WIDTH*factor, mul>>3, mask16 ( format ) );
+        }
+      else
+        for ( x= factor-1; x < WIDTH*factor; x+= factor )
+          {
+            if ( size == 4 && format != GBC_FB_CGB15 )
+              darken32 ( ((GBCu32 *) row) + x, 1, mul, alpha );
+            else
+              darken16 ( row + x*size, size, 1, mul>>3, mask16 ( format ) );
+          }
+    }
+
+  return 0;
+
+} /* end GBC_video_lcd_grid */
+
+
+int
+GBC_video_scale (
+        	 const void         *src,
+        	 const GBC_FBFormat  format,
+        	 void               *dst,
+        	 const int           pitch,
+        	 const int           factor
+        	 )
+{
+
+  const GBCu8 *s;
+  GBCu8 *d;
+  int size, y, i, row_bytes;
+
+
+  if ( factor < 1 || factor > 8 ) return -1;
+  size= pixel_size ( format );
+  row_bytes= WIDTH*factor*size;
+  s= (const GBCu8 *) src;
+  d= (GBCu8 *) dst;
+  for ( y= 0; y < HEIGHT; ++y, s+= WIDTH*size )
+    {
+      scale_row ( s, d, size, factor );
+      for ( i= 1; i < factor; ++i )
+        memcpy ( d + i*pitch, d, row_bytes );
+      d+= factor*pitch;
+    }
+
+  return 0;
+
+} /* end GBC_video_scale */
+
+
+int
+GBC_video_scalex (
+        	  const void         *src,
+        	  const GBC_FBFormat  format,
+        	  void               *dst,
+        	  const int           pitch,
+        	  const int           factor
+        	  )
+{
+
+  int size;
+
+
+  if ( factor != 2 && factor != 3 ) return -1;
+  size= pixel_size ( format );
+  if ( factor == 2 )
+    {
+      if ( size == 4 )      scale2x_32 ( src, (GBCu8 *) dst, pitch );
+      else if ( size == 2 ) scale2x_16 ( src, (GBCu8 *) dst, pitch );
+      else                  scale2x_8 ( src, (GBCu8 *) dst, pitch );
+    }
+  else
+    {
+      if ( size == 4 )      scale3x_32 ( src, (GBCu8 *) dst, pitch );
+      else if ( size == 2 ) scale3x_16 ( src, (GBCu8 *) dst, pitch );
+      else                  scale3x_8 ( src, (GBCu8 *) dst, pitch );
+    }
+
+  return 0;
+
+} /* end GBC_video_scalex */
@@ -0,0 +1,310 @@
+/*
+ * Copyright 2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  gbc-batch.c - Executa una llista de treballs en paral·lel.
+ *
+ *  Ús: gbc-batch [-j N] FITXER
+ *
+ *  Cada línia no buida de FITXER descriu un treball:
+ *
+ *    ROM FRAMES [GUIÓ]
+ *
+ *  on GUIÓ és un guió d'entrada (veure 'GBC_batch_read_input'). Per
+ *  cada treball s'escriu una línia amb la ROM, els frames executats,
+ *  el hash de l'últim frame, el hash del so i el temps emprat.
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "GBC.h"
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+typedef struct
+{
+
+  char           *name;
+  GBC_Rom         rom;
+  GBC_BatchInput *input;
+
+} entry_t;
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static void
+usage (
+       const char *prog
+       )
+{
+  fprintf ( stderr, "Usage: %s [-j N] JOBFILE\n", prog );
+} /* end usage */
+
+
+static int
+load_rom (
+          const char *fname,
+          GBC_Rom    *rom
+          )
+{
+
+  FILE *f;
+  long size;
+
+
+  rom->banks= NULL;
+  if ( (f= fopen ( fname, "rb" )) == NULL ) return -1;
+  if ( fseek ( f, 0, SEEK_END ) != 0 ||
+       (size= ftell ( f )) == -1 ||
+       size == 0 || size%GBC_BANK_SIZE != 0 ||
+       fseek ( f, 0, SEEK_SET ) != 0 )
+    goto error;
+  rom->nbanks= size/GBC_BANK_SIZE;
+  if ( GBC_rom_alloc ( *rom ) == NULL ) goto error;
+  if ( fread ( rom->banks, size, 1, f ) != 1 ) goto error;
+  fclose ( f );
+
+  return 0;
+
+ error:
+  GBC_rom_free ( *rom );
+  rom->banks= NULL;
+  fclose ( f );
+  return -1;
+
+} /* end load_rom */
+
+
+static int
+load_input (
+            const char      *fname,
+            GBC_BatchInput **input,
+            int             *ninput
+            )
+{
+
+  FILE *f;
+  int ret;
+
+
+  if ( (f= fopen ( fname, "r" )) == NULL ) return -1;
+  ret= GBC_batch_read_input ( f, input, ninput );
+  fclose ( f );
+
+  return ret;
+
+} /* end load_input */
+
+
+static void
+free_entries (
+              entry_t   *entries,
+              const int  n
+              )
+{
+
+  int i;
+
+
+  for ( i= 0; i < n; ++i )
+    {
+      free ( entries[i].name );
+      GBC_rom_free ( entries[i].rom );
+      if ( entries[i].input != NULL ) free ( entries[i].input );
+    }
+  if ( entries != NULL ) free ( entries );
+
+} /* end free_entries */
+
+
+/* Torna el número de treballs o -1 en cas d'error. */
+static int
+load_jobs (
+           const char    *fname,
+           GBC_BatchJob **jobs,
+           entry_t      **entries
+           )
+{
+
+  FILE *f;
+  char line[1024], rom[1024], script[1024];
+  int n, size, frames, nf, i;
+  GBC_BatchJob *j;
+  entry_t *e;
+
+
+  if ( (f= fopen ( fname, "r" )) == NULL )
+    {
+      fprintf ( stderr, "Cannot open '%s'\n", fname );
+      return -1;
+    }
+  *jobs= NULL; *entries= NULL; n= size= 0;
+  while ( fgets ( line, sizeof(line), f ) != NULL )
+    {
+      nf= sscanf ( line, "%1023s %d %1023s", rom, &frames, script );
+      if ( nf <= 0 || rom[0] == '#' ) continue;
+      if ( nf < 2 || frames <= 0 )
+        {
+          fprintf ( stderr, "Wrong job: %s", line );
+          goto error;
+        }
+      if ( n == size )
+        {
+          size= size ? size*2 : 16;
+          j= (GBC_BatchJob *) realloc ( *jobs, sizeof(GBC_BatchJob)*size );
+          if ( j == NULL ) goto error;
+          *jobs= j;
+          e= (entry_t *) realloc ( *entries, sizeof(entry_t)*size );
+          if ( e == NULL ) goto error;
+          *entries= e;
+        }
+      j= &((*jobs)[n]);
+      e= &((*entries)[n]);
+      memset ( j, 0, sizeof(*j) );
+      e->input= NULL;
+      e->rom.banks= NULL;
+      e->name= (char *) malloc ( strlen ( rom ) + 1 );
+      if ( e->name == NULL ) goto error;
+      strcpy ( e->name, rom );
+      ++n;
+      if ( load_rom ( rom, &(e->rom) ) != 0 )
+        {
+          fprintf ( stderr, "Cannot load ROM '%s'\n", rom );
+          goto error;
+        }
+      if ( nf == 3 &&
+           load_input ( script, &(e->input), &(j->ninput) ) != 0 )
+        {
+          fprintf ( stderr, "Cannot load input script '%s'\n", script );
+          goto error;
+        }
+      j->bios= NULL;
+      j->frames= frames;
+    }
+  fclose ( f );
+
+  /* Les entrades es poden haver mogut en créixer el vector. */
+  for ( i= 0; i < n; ++i )
+    {
+      (*jobs)[i].rom= &((*entries)[i].rom);
+      (*jobs)[i].input= (*entries)[i].input;
+    }
+
+  return n;
+
+ error:
+  fclose ( f );
+  free_entries ( *entries, n );
+  if ( *jobs != NULL ) free ( *jobs );
+  return -1;
+
+} /* end load_jobs */
+
+
+
+
+/********************/
+/* FUNCIÓ PRINCIPAL */
+/********************/
+
+int
+main (
+      int   argc,
+      char *argv[]
+      )
+{
+
+  GBC_BatchJob *jobs;
+  entry_t *entries;
+  int nthreads, njobs, i, ret;
+  const char *jobfile;
+  double total;
+
+
+  /* Arguments. */
+  nthreads= 0;
+  if ( argc == 4 && !strcmp ( argv[1], "-j" ) )
+    {
+      nthreads= atoi ( argv[2] );
+      jobfile= argv[3];
+    }
+  else if ( argc == 2 ) jobfile= argv[1];
+  else
+    {
+      usage ( argv[0] );
+      return EXIT_FAILURE;
+    }
+
+  /* Carrega i executa. */
+  ret= EXIT_FAILURE;
+  njobs= load_jobs ( jobfile, &jobs, &entries );
+  if ( njobs == -1 ) return EXIT_FAILURE;
+  if ( GBC_batch_run ( jobs, njobs, nthreads ) != 0 )
+    {
+      fprintf ( stderr, "Cannot run jobs\n" );
+      goto end;
+    }
+
+  /* Resultats. */
+  total= 0.0;
+  ret= EXIT_SUCCESS;
+  for ( i= 0; i < njobs; ++i )
+    {
+      if ( jobs[i].err == GBC_ETIMEOUT )
+        {
+          printf ( "%s TIMEOUT %d\n", entries[i].name,
+        	   jobs[i].frames_done );
+          total+= jobs[i].wall_time;
+          ret= EXIT_FAILURE;
+          continue;
+        }
+      if ( jobs[i].err != GBC_NOERROR )
+        {
+          printf ( "%s ERROR %d\n", entries[i].name, (int) jobs[i].err );
+          ret= EXIT_FAILURE;
+          continue;
+        }
+      printf ( "%s %d %08x %08x %.3f\n", entries[i].name,
+               jobs[i].frames_done, (unsigned) jobs[i].fb_hash,
+               (unsigned) jobs[i].audio_hash, jobs[i].wall_time );
+      total+= jobs[i].wall_time;
+    }
+  fprintf ( stderr, "%d jobs, %.3f s accumulated\n", njobs, total );
+
+ end:
+  free_entries ( entries, njobs );
+  if ( jobs != NULL ) free ( jobs );
+
+  return ret;
+
+} /* end main */
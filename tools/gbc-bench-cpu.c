@@ -0,0 +1,337 @@
+/*
+ * Copyright 2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  gbc-bench-cpu.c - Mesura el rendiment del nucli de la UCP.
+ *
+ *  Ús: gbc-bench-cpu [-J] [FRAMES]
+ *
+ *  Executa l'equivalent a FRAMES frames (per defecte 3000) d'una ROM
+ *  sintètica que apaga la pantalla i el so i sols fa càlculs en un
+ *  bucle (ALU, prefix 0xCB, pila, crides i accessos a WRAM). Mostra
+ *  els frames per segon i un hash de la WRAM. Es compila una vegada
+ *  per nucli (veure 'CMakeLists.txt') perquè els resultats es puguen
+ *  comparar. Amb -J s'activa el compilador dinàmic.
+ *
+ */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "GBC.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+
+#define DEFAULT_FRAMES 3000
+
+/* Cicles de UCP d'un frame. */
+#define FRAME_CC 70224
+
+#ifndef GBC_BENCH_CORE
+#define GBC_BENCH_CORE "default"
+#endif
+
+
+
+
+/*********/
+/* ESTAT */
+/*********/
+
+static GBCu8 *_eram;
+
+
+
+
+/************/
+/* FRONTEND */
+/************/
+
+static void
+warning (
+         void       *udata,
+         const char *format,
+         ...
+         )
+{
+} /* end warning */
+
+
+static GBCu8 *
+get_external_ram (
+        	  const size_t  nbytes,
+        	  void         *udata
+        	  )
+{
+
+  if ( _eram != NULL ) free ( _eram );
+  _eram= (GBCu8 *) calloc ( nbytes, 1 );
+
+  return _eram;
+
+} /* end get_external_ram */
+
+
+static void
+update_screen (
+               const void             *fb,
+               const GBC_FrameChanges *changes,
+               void                   *udata
+               )
+{
+} /* end update_screen */
+
+
+static int
+check_buttons (
+               void *udata
+               )
+{
+  return 0;
+} /* end check_buttons */
+
+
+static void
+play_sound (
+            const double  left[GBC_APU_BUFFER_SIZE],
+            const double  right[GBC_APU_BUFFER_SIZE],
+            void         *udata
+            )
+{
+} /* end play_sound */
+
+
+static void
+update_rumble (
+               const int  level,
+               void      *udata
+               )
+{
+} /* end update_rumble */
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static double
+get_time (void)
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+} /* end get_time */
+
+
+/* Construeix una ROM de 32K (sense mapper) amb el programa de prova. */
+static void
+build_rom (
+           GBCu8 *rom
+           )
+{
+
+  static const GBCu8 logo[48]=
+    {
+      0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B,
+      0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+      0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E,
+      0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+      0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC,
+      0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+    };
+
+  /* Programa a partir de 0x150. */
+  static const GBCu8 prog[]=
+    {
+      0xF3,             /* 0150 di */
+      0x31, 0xFE, 0xFF, /* 0151 ld sp,FFFE */
+      0xAF,             /* 0154 xor a */
+      0xE0, 0x40,       /* 0155 ldh (40),a ; LCD apagat. */
+      0xE0, 0x26,       /* 0157 ldh (26),a ; So apagat. */
+      0x21, 0x00, 0xC0, /* 0159 ld hl,C000 */
+      0x06, 0x20,       /* 015C ld b,20 */
+      0x2A,             /* 015E ld a,(hl+) */
+      0x81,             /* 015F add a,c */
+      0x4F,             /* 0160 ld c,a */
+      0xAA,             /* 0161 xor d */
+      0x07,             /* 0162 rlca */
+      0x57,             /* 0163 ld d,a */
+      0xCB, 0x33,       /* 0164 swap e */
+      0xCB, 0x5F,       /* 0166 bit 3,a */
+      0xCB, 0x3A,       /* 0168 srl d */
+      0x13,             /* 016A inc de */
+      0xC5,             /* 016B push bc */
+      0xC1,             /* 016C pop bc */
+      0xCD, 0x76, 0x01, /* 016D call 0176 */
+      0x05,             /* 0170 dec b */
+      0x20, 0xEB,       /* 0171 jr nz,015E */
+      0xC3, 0x59, 0x01, /* 0173 jp 0159 */
+      0x77,             /* 0176 ld (hl),a */
+      0xE6, 0x7F,       /* 0177 and 7F */
+      0xC9              /* 0179 ret */
+    };
+
+  int i;
+  GBCu8 chk;
+
+
+  memset ( rom, 0, 2*GBC_BANK_SIZE );
+  rom[0x100]= 0x00; /* nop */
+  rom[0x101]= 0xC3; rom[0x102]= 0x50; rom[0x103]= 0x01; /* jp 0150 */
+  memcpy ( &(rom[0x104]), logo, sizeof(logo) );
+  memcpy ( &(rom[0x134]), "CPUBENCH", 8 );
+  rom[0x147]= 0x00; /* ROM ONLY */
+  rom[0x148]= 0x00; /* 32K */
+  rom[0x149]= 0x00; /* Sense RAM */
+  for ( chk= 0, i= 0x134; i < 0x14D; ++i )
+    chk= chk - rom[i] - 1;
+  rom[0x14D]= chk;
+  memcpy ( &(rom[0x150]), prog, sizeof(prog) );
+
+} /* end build_rom */
+
+
+
+
+/********************/
+/* FUNCIÓ PRINCIPAL */
+/********************/
+
+int
+main (
+      int   argc,
+      char *argv[]
+      )
+{
+
+  static const GBC_Frontend frontend=
+    {
+      warning,
+      get_external_ram,
+      update_screen,
+      NULL,
+      check_buttons,
+      play_sound,
+      update_rumble,
+      NULL,
+      GBC_FB_CGB15
+    };
+
+  GBC_Machine *m;
+  GBC_Rom rom;
+  GBC_Error err;
+  GBC_Bool stop, jit;
+  GBCu32 hash;
+  double t0, t, cc, target_cc;
+  int target, ret, i, arg;
+
+
+  /* Arguments. */
+  arg= 1;
+  jit= GBC_FALSE;
+  if ( argc > 1 && !strcmp ( argv[1], "-J" ) )
+    {
+      jit= GBC_TRUE;
+      arg= 2;
+    }
+  target= argc-arg == 1 ? atoi ( argv[arg] ) : DEFAULT_FRAMES;
+  if ( argc-arg > 1 || target <= 0 )
+    {
+      fprintf ( stderr, "Usage: %s [-J] [FRAMES]\n", argv[0] );
+      return EXIT_FAILURE;
+    }
+
+  /* Prepara. */
+  rom.nbanks= 2;
+  if ( GBC_rom_alloc ( rom ) == NULL )
+    {
+      fprintf ( stderr, "Cannot allocate ROM\n" );
+      return EXIT_FAILURE;
+    }
+  build_rom ( rom.banks[0] );
+  if ( (m= GBC_machine_new ()) == NULL )
+    {
+      fprintf ( stderr, "Cannot allocate machine\n" );
+      GBC_rom_free ( rom );
+      return EXIT_FAILURE;
+    }
+
+  /* Executa. */
+  ret= EXIT_FAILURE;
+  _eram= NULL;
+  err= GBC_init ( m, NULL, &rom, &frontend, NULL );
+  if ( err != GBC_NOERROR )
+    {
+      fprintf ( stderr, "Cannot initialize simulator: error %d\n",
+        	(int) err );
+      goto end;
+    }
+  if ( jit && GBC_cpu_set_jit ( m, GBC_JIT_ON ) != 0 )
+    {
+      fprintf ( stderr, "Cannot enable the dynamic recompiler\n" );
+      goto end;
+    }
+  stop= GBC_FALSE;
+  cc= 0.0;
+  target_cc= (double) target*FRAME_CC;
+  t0= get_time ();
+  while ( cc < target_cc )
+    cc+= GBC_iter ( m, &stop );
+  t= get_time () - t0;
+
+  /* El contingut final de la WRAM ha de ser el mateix amb tots els
+     nuclis. */
+  hash= FNV_OFFSET;
+  for ( i= 0; i < 0x100; ++i )
+    hash= (hash^GBC_mem_read ( m, 0xC000+i ))*FNV_PRIME;
+  printf ( "core: %s%s\n", GBC_BENCH_CORE, jit ? "+jit" : "" );
+  printf ( "frames: %d\n", target );
+  printf ( "time: %.3f s\n", t );
+  printf ( "fps: %.1f\n", t > 0.0 ? target/t : 0.0 );
+  printf ( "wram_hash: %08x\n", (unsigned) hash );
+  ret= EXIT_SUCCESS;
+
+ end:
+  GBC_machine_free ( m );
+  GBC_rom_free ( rom );
+  if ( _eram != NULL ) free ( _eram );
+
+  return ret;
+
+} /* end main */
@@ -0,0 +1,260 @@
+/*
+ * Copyright 2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  gbc-bench-lcd.c - Mesura el rendiment dels jocs de funcions
+ *                    vectorials del renderitzat.
+ *
+ *  Ús: gbc-bench-lcd [FRAMES]
+ *
+ *  Renderitza FRAMES frames (per defecte 20000) de línies sintètiques
+ *  amb cada joc de funcions suportat per la UCP: expandeix els plans
+ *  de bits dels tiles, converteix els índexs en colors i combina el
+ *  fons amb els sprites. Mostra els frames per segon de cada joc i
+ *  comprova que el resultat és el mateix que el de la versió escalar.
+ *
+ */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "GBC.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+
+#define DEFAULT_FRAMES 20000
+
+/* Línies sintètiques diferents. */
+#define NLINES 64
+
+/* Tiles sintètics diferents. */
+#define NTILES 384
+
+
+
+
+/*********/
+/* ESTAT */
+/*********/
+
+static GBCu8 _planes[NTILES][16];
+static struct
+{
+  int         bg[160];
+  int         obj[160];
+  signed char prio_bg[160];
+  signed char prio_obj[160];
+  GBC_Bool    obj_has_prio;
+} _lines[NLINES];
+static int _pal[8][4];
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static double
+get_time (void)
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+} /* end get_time */
+
+
+/* Generador congruencial per a que les dades siguen reproduïbles. */
+static GBCu32
+next_rand (
+           GBCu32 *state
+           )
+{
+
+  *state= *state*1103515245U + 12345U;
+
+  return *state>>8;
+
+} /* end next_rand */
+
+
+static void
+build_data (void)
+{
+
+  GBCu32 state;
+  int i, j;
+
+
+  state= 1;
+  for ( i= 0; i < NTILES; ++i )
+    for ( j= 0; j < 16; ++j )
+      _planes[i][j]= (GBCu8) next_rand ( &state );
+  for ( i= 0; i < 8; ++i )
+    for ( j= 0; j < 4; ++j )
+      _pal[i][j]= (int) (next_rand ( &state )&0x7FFF);
+  for ( i= 0; i < NLINES; ++i )
+    {
+      for ( j= 0; j < 160; ++j )
+        {
+          _lines[i].bg[j]= (int) (next_rand ( &state )&0x7FFF);
+          _lines[i].obj[j]= (next_rand ( &state )&3) == 0 ?
+            (int) (next_rand ( &state )&0x7FFF) : -1;
+          _lines[i].prio_bg[j]= (signed char) (next_rand ( &state )%3) - 1;
+          _lines[i].prio_obj[j]= (signed char) (next_rand ( &state )&1);
+        }
+      _lines[i].obj_has_prio= (i&7) == 0;
+    }
+
+} /* end build_data */
+
+
+/* Renderitza FRAMES frames i torna un hash del resultat. */
+static GBCu32
+run (
+     const GBC_LCDKernels *k,
+     const int             frames
+     )
+{
+
+  static GBCu8 tiles[NTILES][2][64];
+  static int fb[144][160];
+  static int bg[160];
+
+  GBCu32 hash;
+  int f, y, x, t, n;
+  const GBCu8 *pix;
+
+
+  for ( t= 0; t < NTILES; ++t )
+    k->expand ( _planes[t], tiles[t][0], tiles[t][1] );
+  hash= FNV_OFFSET;
+  for ( f= 0; f < frames; ++f )
+    {
+
+      /* Com si s'hagueren modificat tots els tiles una vegada cada 16
+         frames. */
+      for ( t= (f&15)*(NTILES/16), n= 0; n < NTILES/16; ++t, ++n )
+        k->expand ( _planes[t], tiles[t][0], tiles[t][1] );
+
+      for ( y= 0; y < 144; ++y )
+        {
+          n= (f+y)%NLINES;
+          for ( x= 0; x < 160; x+= 8 )
+            {
+              t= (f*7 + y*3 + x)%NTILES;
+              pix= &(tiles[t][(x>>3)&1][(y&7)<<3]);
+              k->gather ( &(bg[x]), pix, _pal[(y+x)&7] );
+            }
+          for ( x= 0; x < 160; ++x )
+            bg[x]^= _lines[n].bg[x];
+          k->blend ( fb[y], bg, _lines[n].obj,
+        	     _lines[n].prio_bg, _lines[n].prio_obj,
+        	     _lines[n].obj_has_prio );
+        }
+
+      /* Hash de l'última línia de cada frame. */
+      for ( x= 0; x < 160; ++x )
+        hash= (hash^(GBCu32) fb[143][x])*FNV_PRIME;
+
+    }
+
+  return hash;
+
+} /* end run */
+
+
+
+
+/********************/
+/* FUNCIÓ PRINCIPAL */
+/********************/
+
+int
+main (
+      int   argc,
+      char *argv[]
+      )
+{
+
+  static const GBC_LCDSimd ids[]=
+    {
+      GBC_LCD_SIMD_SCALAR,
+      GBC_LCD_SIMD_SSE2,
+      GBC_LCD_SIMD_AVX2
+    };
+  static const char *names[]= { "scalar", "sse2", "avx2" };
+
+  const GBC_LCDKernels *k;
+  GBCu32 hash, ref;
+  double t0, t;
+  int target, ret, i;
+
+
+  /* Arguments. */
+  target= argc == 2 ? atoi ( argv[1] ) : DEFAULT_FRAMES;
+  if ( argc > 2 || target <= 0 )
+    {
+      fprintf ( stderr, "Usage: %s [FRAMES]\n", argv[0] );
+      return EXIT_FAILURE;
+    }
+
+  /* Executa. */
+  build_data ();
+  ret= EXIT_SUCCESS;
+  ref= 0;
+  printf ( "auto: %s\n", GBC_lcd_get_kernels ( GBC_LCD_SIMD_AUTO )->name );
+  for ( i= 0; i < (int) (sizeof(ids)/sizeof(ids[0])); ++i )
+    {
+      if ( (k= GBC_lcd_get_kernels ( ids[i] )) == NULL )
+        {
+          printf ( "%-8s not supported\n", names[i] );
+          continue;
+        }
+      t0= get_time ();
+      hash= run ( k, target );
+      t= get_time () - t0;
+      if ( i == 0 ) ref= hash;
+      printf ( "%-8s frames: %d  time: %.3f s  fps: %.1f  hash: %08x%s\n",
+               k->name, target, t, t > 0.0 ? target/t : 0.0,
+               (unsigned) hash, hash == ref ? "" : "  MISMATCH" );
+      if ( hash != ref ) ret= EXIT_FAILURE;
+    }
+
+  return ret;
+
+} /* end main */
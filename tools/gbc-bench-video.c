@@ -0,0 +1,259 @@
+/*
+ * Copyright 2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  gbc-bench-video.c - Mesura el rendiment de les funcions d'escalat
+ *                      i postprocés.
+ *
+ *  Ús: gbc-bench-video [FRAMES]
+ *
+ *  Aplica cada operació del mòdul 'GBC_video_*' FRAMES vegades (per
+ *  defecte 5000) a una imatge sintètica en els formats RGBA8888 i
+ *  RGB565. Mostra els frames per segon de cada operació i un hash del
+ *  resultat.
+ *
+ */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "GBC.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+
+#define DEFAULT_FRAMES 5000
+
+#define W GBC_VIDEO_WIDTH
+#define H GBC_VIDEO_HEIGHT
+
+/* Factor d'escalat màxim. */
+#define MAX_FACTOR 8
+
+/* Operacions. */
+enum
+  {
+    OP_SCALE2= 0,
+    OP_SCALE3,
+    OP_SCALE4,
+    OP_SCALE8,
+    OP_SCALE2X,
+    OP_SCALE3X,
+    OP_GRID,
+    OP_GHOSTING,
+    OP_COLOR,
+    OP_NUM
+  };
+
+
+
+
+/*********/
+/* ESTAT */
+/*********/
+
+static const char *_op_names[OP_NUM]=
+  {
+    "scale x2", "scale x3", "scale x4", "scale x8", "scale2x", "scale3x",
+    "grid x4", "ghosting", "color"
+  };
+static const int _op_factors[OP_NUM]= { 2, 3, 4, 8, 2, 3, 4, 1, 1 };
+
+static int _src15[W*H];
+static GBCu32 _src32[W*H];
+static GBCu16 _src16[W*H];
+static GBCu8 _dst[W*MAX_FACTOR*H*MAX_FACTOR*4];
+static GBCu8 _frame[W*H*4];
+static GBCu8 _prev[W*H*4];
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static double
+get_time (void)
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+} /* end get_time */
+
+
+/* Generador congruencial per a que les dades siguen reproduïbles. */
+static GBCu32
+next_rand (
+           GBCu32 *state
+           )
+{
+
+  *state= *state*1103515245U + 12345U;
+
+  return *state>>8;
+
+} /* end next_rand */
+
+
+/* Imatge amb blocs de colors (com els tiles) i un poc de soroll, per
+   a que Scale2x/3x troben vores. */
+static void
+build_data (void)
+{
+
+  GBCu32 state, pal[16];
+  int i, x, y, c;
+
+
+  state= 1;
+  for ( i= 0; i < 16; ++i )
+    pal[i]= next_rand ( &state )&0x7FFF;
+  for ( y= 0; y < H; ++y )
+    for ( x= 0; x < W; ++x )
+      {
+        c= ((x>>3)*5 + (y>>3)*3 + ((x^y)&4 ? 1 : 0))&15;
+        if ( (next_rand ( &state )&15) == 0 ) c= (c+7)&15;
+        _src15[y*W+x]= (int) pal[c];
+      }
+  GBC_video_color_correct ( _src15, _src32, GBC_FB_RGBA8888 );
+  GBC_video_color_correct ( _src15, _src16, GBC_FB_RGB565 );
+
+} /* end build_data */
+
+
+/* Aplica l'operació OP FRAMES vegades i torna un hash del resultat. */
+static GBCu32
+run (
+     const int          op,
+     const GBC_FBFormat format,
+     const int          frames
+     )
+{
+
+  const void *src;
+  GBCu32 hash;
+  int f, size, factor, pitch, i, n;
+
+
+  size= format==GBC_FB_RGB565 ? 2 : 4;
+  src= format==GBC_FB_RGB565 ? (const void *) _src16 : (const void *) _src32;
+  memset ( _prev, 0, W*H*size );
+  factor= _op_factors[op];
+  pitch= W*factor*size;
+  for ( f= 0; f < frames; ++f )
+    switch ( op )
+      {
+      case OP_SCALE2:
+      case OP_SCALE3:
+      case OP_SCALE4:
+      case OP_SCALE8:
+        GBC_video_scale ( src, format, _dst, pitch, factor );
+        break;
+      case OP_SCALE2X:
+      case OP_SCALE3X:
+        GBC_video_scalex ( src, format, _dst, pitch, factor );
+        break;
+      case OP_GRID:
+        GBC_video_scale ( src, format, _dst, pitch, factor );
+        GBC_video_lcd_grid ( _dst, format, pitch, factor, 64 );
+        break;
+      case OP_GHOSTING:
+        memcpy ( _frame, src, W*H*size );
+        GBC_video_ghosting ( _frame, _prev, format, 128 );
+        break;
+      case OP_COLOR:
+      default:
+        GBC_video_color_correct ( _src15, _dst, format );
+      }
+
+  /* Hash del resultat. */
+  n= op == OP_GHOSTING ? W*H*size : W*factor*H*factor*size;
+  hash= FNV_OFFSET;
+  for ( i= 0; i < n; ++i )
+    hash= (hash^(op == OP_GHOSTING ? _frame[i] : _dst[i]))*FNV_PRIME;
+
+  return hash;
+
+} /* end run */
+
+
+
+
+/********************/
+/* FUNCIÓ PRINCIPAL */
+/********************/
+
+int
+main (
+      int   argc,
+      char *argv[]
+      )
+{
+
+  static const GBC_FBFormat formats[]= { GBC_FB_RGBA8888, GBC_FB_RGB565 };
+  static const char *names[]= { "rgba8888", "rgb565" };
+
+  GBCu32 hash;
+  double t0, t;
+  int target, i, op;
+
+
+  /* Arguments. */
+  target= argc == 2 ? atoi ( argv[1] ) : DEFAULT_FRAMES;
+  if ( argc > 2 || target <= 0 )
+    {
+      fprintf ( stderr, "Usage: %s [FRAMES]\n", argv[0] );
+      return EXIT_FAILURE;
+    }
+
+  /* Executa. */
+  build_data ();
+  for ( i= 0; i < (int) (sizeof(formats)/sizeof(formats[0])); ++i )
+    for ( op= 0; op < OP_NUM; ++op )
+      {
+        t0= get_time ();
+        hash= run ( op, formats[i], target );
+        t= get_time () - t0;
+        printf ( "%-8s %-8s frames: %d  time: %.3f s  fps: %.1f  "
+        	 "hash: %08x\n",
+        	 names[i], _op_names[op], target, t,
+        	 t > 0.0 ? target/t : 0.0, (unsigned) hash );
+      }
+
+  return EXIT_SUCCESS;
+
+} /* end main */
@@ -0,0 +1,501 @@
+/*
+ * Copyright 2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  gbc-jit-diff.c - Compara el compilador dinàmic amb l'intèrpret.
+ *
+ *  Ús: gbc-jit-diff [-b BIOS] ROM [FRAMES]
+ *
+ *  Executa la ROM en dos màquines a la vegada, una amb GBC_JIT_ON i
+ *  l'altra amb GBC_JIT_SHADOW. Les dos tradueixen els mateixos
+ *  blocs, però la segona els executa amb l'intèrpret. Després de
+ *  cada iteració es comparen els registres que han deixat tots els
+ *  blocs traduïts i s'atura en la primera diferència. Si la ROM no
+ *  completa els frames en GBC_BATCH_FRAME_CC cicles per frame (per
+ *  exemple perquè apaga el LCD) s'atura i falla.
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "GBC.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+
+#define DEFAULT_FRAMES 600
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+/* Estat després d'un bloc traduït. */
+typedef struct
+{
+
+  GBCu16      addr;
+  int         bank;
+  GBC_CPURegs regs;
+
+} block_t;
+
+/* Una de les dos màquines. */
+typedef struct
+{
+
+  const char  *name;
+  GBC_Machine *m;
+  GBCu8       *eram;
+  int          frames;
+  GBCu32       fb_hash;
+  block_t     *log;
+  int          n;
+  int          size;
+  GBC_Bool     nomem;
+
+} side_t;
+
+
+
+
+/************/
+/* FRONTEND */
+/************/
+
+static void
+warning (
+         void       *udata,
+         const char *format,
+         ...
+         )
+{
+} /* end warning */
+
+
+static GBCu8 *
+get_external_ram (
+        	  const size_t  nbytes,
+        	  void         *udata
+        	  )
+{
+
+  side_t *s;
+
+
+  s= (side_t *) udata;
+  if ( s->eram != NULL ) free ( s->eram );
+  s->eram= (GBCu8 *) calloc ( nbytes, 1 );
+
+  return s->eram;
+
+} /* end get_external_ram */
+
+
+static void
+update_screen (
+               const void             *fb,
+               const GBC_FrameChanges *changes,
+               void                   *udata
+               )
+{
+
+  side_t *s;
+  const int *pix;
+  int i;
+
+
+  pix= (const int *) fb;
+  s= (side_t *) udata;
+  ++s->frames;
+  s->fb_hash= FNV_OFFSET;
+  for ( i= 0; i < 23040; ++i )
+    {
+      s->fb_hash= (s->fb_hash^((GBCu8) pix[i]))*FNV_PRIME;
+      s->fb_hash= (s->fb_hash^((GBCu8) (pix[i]>>8)))*FNV_PRIME;
+    }
+
+} /* end update_screen */
+
+
+static int
+check_buttons (
+               void *udata
+               )
+{
+  return 0;
+} /* end check_buttons */
+
+
+static void
+play_sound (
+            const double  left[GBC_APU_BUFFER_SIZE],
+            const double  right[GBC_APU_BUFFER_SIZE],
+            void         *udata
+            )
+{
+} /* end play_sound */
+
+
+static void
+update_rumble (
+               const int  level,
+               void      *udata
+               )
+{
+} /* end update_rumble */
+
+
+static void
+block_done (
+            const GBCu16       addr,
+            const int          bank,
+            const GBC_CPURegs *regs,
+            void              *udata
+            )
+{
+
+  side_t *s;
+  block_t *b;
+  int size;
+
+
+  s= (side_t *) udata;
+  if ( s->n == s->size )
+    {
+      size= s->size ? s->size*2 : 1024;
+      b= (block_t *) realloc ( s->log, sizeof(block_t)*size );
+      if ( b == NULL )
+        {
+          s->nomem= GBC_TRUE;
+          return;
+        }
+      s->log= b;
+      s->size= size;
+    }
+  b= &(s->log[s->n++]);
+  b->addr= addr;
+  b->bank= bank;
+  b->regs= *regs;
+
+} /* end block_done */
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static void
+usage (
+       const char *prog
+       )
+{
+  fprintf ( stderr, "Usage: %s [-b BIOS] ROM [FRAMES]\n", prog );
+} /* end usage */
+
+
+static int
+load_file (
+           const char *fname,
+           void       *dst,
+           const long  size
+           )
+{
+
+  FILE *f;
+  int ret;
+
+
+  if ( (f= fopen ( fname, "rb" )) == NULL ) return -1;
+  ret= fread ( dst, size, 1, f ) == 1 ? 0 : -1;
+  fclose ( f );
+
+  return ret;
+
+} /* end load_file */
+
+
+static int
+load_rom (
+          const char *fname,
+          GBC_Rom    *rom
+          )
+{
+
+  FILE *f;
+  long size;
+
+
+  rom->banks= NULL;
+  if ( (f= fopen ( fname, "rb" )) == NULL ) return -1;
+  if ( fseek ( f, 0, SEEK_END ) != 0 || (size= ftell ( f )) == -1 )
+    {
+      fclose ( f );
+      return -1;
+    }
+  fclose ( f );
+  if ( size == 0 || size%GBC_BANK_SIZE != 0 ) return -1;
+  rom->nbanks= size/GBC_BANK_SIZE;
+  if ( GBC_rom_alloc ( *rom ) == NULL ) return -1;
+  if ( load_file ( fname, rom->banks, size ) != 0 )
+    {
+      GBC_rom_free ( *rom );
+      rom->banks= NULL;
+      return -1;
+    }
+
+  return 0;
+
+} /* end load_rom */
+
+
+static void
+print_block (
+             const side_t  *s,
+             const block_t *b
+             )
+{
+
+  const GBC_CPURegs *r;
+
+
+  r= &(b->regs);
+  fprintf ( stderr, "  %-6s %02X:%04X  PC=%04X SP=%04X A=%02X F=%02X"
+            " B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X"
+            " IE=%02X IF=%02X IME=%d cc=%d\n",
+            s->name, b->bank, b->addr, r->PC, r->SP, r->A, r->F,
+            r->B, r->C, r->D, r->E, r->H, r->L,
+            r->IE, r->IF, (int) r->IME, r->cc );
+
+} /* end print_block */
+
+
+static GBC_Bool
+same_block (
+            const block_t *a,
+            const block_t *b
+            )
+{
+  return
+    a->addr == b->addr && a->bank == b->bank &&
+    a->regs.PC == b->regs.PC && a->regs.SP == b->regs.SP &&
+    a->regs.A == b->regs.A && a->regs.F == b->regs.F &&
+    a->regs.B == b->regs.B && a->regs.C == b->regs.C &&
+    a->regs.D == b->regs.D && a->regs.E == b->regs.E &&
+    a->regs.H == b->regs.H && a->regs.L == b->regs.L &&
+    a->regs.IE == b->regs.IE && a->regs.IF == b->regs.IF &&
+    a->regs.IME == b->regs.IME && a->regs.cc == b->regs.cc;
+} /* end same_block */
+
+
+/* Compara els blocs executats en l'última iteració i buida els
+   registres. Torna 0 si són iguals. */
+static int
+compare (
+         side_t *jit,
+         side_t *ref,
+         long   *nblocks
+         )
+{
+
+  int i;
+
+
+  if ( jit->nomem || ref->nomem )
+    {
+      fprintf ( stderr, "Cannot allocate block log\n" );
+      return -1;
+    }
+  for ( i= 0; i < jit->n && i < ref->n; ++i )
+    if ( !same_block ( &(jit->log[i]), &(ref->log[i]) ) )
+      {
+        fprintf ( stderr, "Mismatch after block %ld:\n", *nblocks+i );
+        print_block ( jit, &(jit->log[i]) );
+        print_block ( ref, &(ref->log[i]) );
+        return -1;
+      }
+  if ( jit->n != ref->n )
+    {
+      fprintf ( stderr, "Mismatch after block %ld: %d vs %d blocks\n",
+        	*nblocks+i, jit->n, ref->n );
+      return -1;
+    }
+  *nblocks+= jit->n;
+  jit->n= ref->n= 0;
+
+  return 0;
+
+} /* end compare */
+
+
+
+
+/********************/
+/* FUNCIÓ PRINCIPAL */
+/********************/
+
+int
+main (
+      int   argc,
+      char *argv[]
+      )
+{
+
+  static const GBC_Frontend frontend=
+    {
+      warning,
+      get_external_ram,
+      update_screen,
+      NULL,
+      check_buttons,
+      play_sound,
+      update_rumble,
+      NULL,
+      GBC_FB_CGB15
+    };
+
+  static GBCu8 bios[0x900];
+
+  side_t sides[2], *s;
+  GBC_Rom rom;
+  GBC_Error err;
+  GBC_Bool stop;
+  const char *bios_fname;
+  long nblocks;
+  int arg, ret, target, i;
+  GBCu64 cc, max_cc;
+
+
+  /* Arguments. */
+  arg= 1;
+  bios_fname= NULL;
+  if ( argc > 2 && !strcmp ( argv[1], "-b" ) )
+    {
+      bios_fname= argv[2];
+      arg= 3;
+    }
+  if ( argc-arg < 1 || argc-arg > 2 )
+    {
+      usage ( argv[0] );
+      return EXIT_FAILURE;
+    }
+  target= argc-arg == 2 ? atoi ( argv[arg+1] ) : DEFAULT_FRAMES;
+  if ( target <= 0 )
+    {
+      usage ( argv[0] );
+      return EXIT_FAILURE;
+    }
+  if ( !GBC_cpu_jit_available () )
+    {
+      fprintf ( stderr, "The dynamic recompiler is not available\n" );
+      return EXIT_FAILURE;
+    }
+
+  /* Carrega. */
+  if ( bios_fname != NULL && load_file ( bios_fname, bios, 0x900 ) != 0 )
+    {
+      fprintf ( stderr, "Cannot load BIOS '%s'\n", bios_fname );
+      return EXIT_FAILURE;
+    }
+  if ( load_rom ( argv[arg], &rom ) != 0 )
+    {
+      fprintf ( stderr, "Cannot load ROM '%s'\n", argv[arg] );
+      return EXIT_FAILURE;
+    }
+  memset ( sides, 0, sizeof(sides) );
+  sides[0].name= "jit";
+  sides[1].name= "interp";
+  ret= EXIT_FAILURE;
+  for ( i= 0; i < 2; ++i )
+    {
+      s= &(sides[i]);
+      if ( (s->m= GBC_machine_new ()) == NULL )
+        {
+          fprintf ( stderr, "Cannot allocate machine\n" );
+          goto end;
+        }
+      err= GBC_init ( s->m, bios_fname!=NULL ? bios : NULL, &rom,
+        	      &frontend, s );
+      if ( err != GBC_NOERROR )
+        {
+          fprintf ( stderr, "Cannot initialize simulator: error %d\n",
+        	    (int) err );
+          goto end;
+        }
+      if ( GBC_cpu_set_jit ( s->m,
+        		     i == 0 ? GBC_JIT_ON : GBC_JIT_SHADOW ) != 0 )
+        {
+          fprintf ( stderr, "Cannot enable the dynamic recompiler\n" );
+          goto end;
+        }
+      GBC_cpu_set_jit_hook ( s->m, block_done, s );
+    }
+
+  /* Executa les dos màquines pas a pas. */
+  stop= GBC_FALSE;
+  nblocks= 0;
+  cc= 0;
+  max_cc= ((GBCu64) target)*GBC_BATCH_FRAME_CC;
+  while ( sides[0].frames < target && !stop && cc < max_cc )
+    {
+      cc+= (GBCu64) GBC_iter ( sides[0].m, &stop );
+      GBC_iter ( sides[1].m, &stop );
+      if ( compare ( &(sides[0]), &(sides[1]), &nblocks ) != 0 ) goto end;
+    }
+  if ( sides[0].frames < target )
+    {
+      fprintf ( stderr, "Stopped after %d frames (%llu cycles)\n",
+        	sides[0].frames, (unsigned long long) cc );
+      goto end;
+    }
+  printf ( "frames: %d\n", sides[0].frames );
+  printf ( "blocks: %ld\n", nblocks );
+  printf ( "fb_hash: %08x %08x\n",
+           (unsigned) sides[0].fb_hash, (unsigned) sides[1].fb_hash );
+  if ( sides[0].frames == sides[1].frames &&
+       sides[0].fb_hash == sides[1].fb_hash )
+    ret= EXIT_SUCCESS;
+  else fprintf ( stderr, "Frames differ\n" );
+
+ end:
+  for ( i= 0; i < 2; ++i )
+    {
+      GBC_machine_free ( sides[i].m );
+      if ( sides[i].eram != NULL ) free ( sides[i].eram );
+      if ( sides[i].log != NULL ) free ( sides[i].log );
+    }
+  GBC_rom_free ( rom );
+
+  return ret;
+
+} /* end main */
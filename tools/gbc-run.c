@@ -0,0 +1,422 @@
+/*
+ * Copyright 2022 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/GBC.
+ *
+ * adriagipas/GBC is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/GBC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/GBC.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  gbc-run.c - Executa una ROM sense interfície.
+ *
+ *  Ús: gbc-run [-b BIOS] [-J] [-I] [-S N] [-D] [-T|-C] ROM [FRAMES]
+ *
+ *  Executa FRAMES frames (per defecte 600) amb tots els callbacks del
+ *  'frontend' buits i mostra els frames emulats per segon i un hash
+ *  (FNV-1a) de l'últim frame. Serveix per a mesurar el rendiment del
+ *  simulador sense cap dependència. Amb -J s'activa el compilador
+ *  dinàmic i amb -I es desactiva el bot dels bucles d'espera. Amb -S
+ *  sols es renderitza un de cada N+1 frames (el hash és el de l'últim
+ *  frame renderitzat) i amb -D el renderitzat és diferit. Amb -T es
+ *  renderitza en un fil a part i amb -C a més es comprova que el
+ *  resultat és el mateix que en línia. També mostra quants frames
+ *  eren idèntics a l'anterior. Si la ROM no completa els frames en
+ *  GBC_BATCH_FRAME_CC cicles per frame (per exemple perquè apaga el
+ *  LCD) s'atura i falla.
+ *
+ */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "GBC.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+
+#define DEFAULT_FRAMES 600
+
+
+
+
+/*********/
+/* ESTAT */
+/*********/
+
+static int _frames;
+static int _target;
+static int _frameskip;
+static int _identical;
+static GBCu32 _fb_hash;
+static GBCu8 *_eram;
+
+
+
+
+/************/
+/* FRONTEND */
+/************/
+
+static void
+warning (
+         void       *udata,
+         const char *format,
+         ...
+         )
+{
+} /* end warning */
+
+
+static GBCu8 *
+get_external_ram (
+        	  const size_t  nbytes,
+        	  void         *udata
+        	  )
+{
+
+  if ( _eram != NULL ) free ( _eram );
+  _eram= (GBCu8 *) calloc ( nbytes, 1 );
+
+  return _eram;
+
+} /* end get_external_ram */
+
+
+static void
+update_screen (
+               const void             *fb,
+               const GBC_FrameChanges *changes,
+               void                   *udata
+               )
+{
+
+  const int *pix;
+  int i, prev;
+
+
+  pix= (const int *) fb;
+  if ( changes->identical ) ++_identical;
+  prev= _frames;
+  _frames+= _frameskip+1;
+  if ( prev < _target && _frames >= _target )
+    {
+      _fb_hash= FNV_OFFSET;
+      for ( i= 0; i < 23040; ++i )
+        {
+          _fb_hash= (_fb_hash^((GBCu8) pix[i]))*FNV_PRIME;
+          _fb_hash= (_fb_hash^((GBCu8) (pix[i]>>8)))*FNV_PRIME;
+        }
+    }
+
+} /* end update_screen */
+
+
+static int
+check_buttons (
+               void *udata
+               )
+{
+  return 0;
+} /* end check_buttons */
+
+
+static void
+play_sound (
+            const double  left[GBC_APU_BUFFER_SIZE],
+            const double  right[GBC_APU_BUFFER_SIZE],
+            void         *udata
+            )
+{
+} /* end play_sound */
+
+
+static void
+update_rumble (
+               const int  level,
+               void      *udata
+               )
+{
+} /* end update_rumble */
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static void
+usage (
+       const char *prog
+       )
+{
+  fprintf ( stderr,
+            "Usage: %s [-b BIOS] [-J] [-I] [-S N] [-D] [-T|-C] ROM [FRAMES]\n",
+            prog );
+} /* end usage */
+
+
+static double
+get_time (void)
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+} /* end get_time */
+
+
+static int
+load_file (
+           const char *fname,
+           void       *dst,
+           const long  size
+           )
+{
+
+  FILE *f;
+  int ret;
+
+
+  if ( (f= fopen ( fname, "rb" )) == NULL ) return -1;
+  ret= fread ( dst, size, 1, f ) == 1 ? 0 : -1;
+  fclose ( f );
+
+  return ret;
+
+} /* end load_file */
+
+
+static int
+load_rom (
+          const char *fname,
+          GBC_Rom    *rom
+          )
+{
+
+  FILE *f;
+  long size;
+
+
+  rom->banks= NULL;
+  if ( (f= fopen ( fname, "rb" )) == NULL ) return -1;
+  if ( fseek ( f, 0, SEEK_END ) != 0 || (size= ftell ( f )) == -1 )
+    {
+      fclose ( f );
+      return -1;
+    }
+  fclose ( f );
+  if ( size == 0 || size%GBC_BANK_SIZE != 0 ) return -1;
+  rom->nbanks= size/GBC_BANK_SIZE;
+  if ( GBC_rom_alloc ( *rom ) == NULL ) return -1;
+  if ( load_file ( fname, rom->banks, size ) != 0 )
+    {
+      GBC_rom_free ( *rom );
+      rom->banks= NULL;
+      return -1;
+    }
+
+  return 0;
+
+} /* end load_rom */
+
+
+
+
+/********************/
+/* FUNCIÓ PRINCIPAL */
+/********************/
+
+int
+main (
+      int   argc,
+      char *argv[]
+      )
+{
+
+  static const GBC_Frontend frontend=
+    {
+      warning,
+      get_external_ram,
+      update_screen,
+      NULL,
+      check_buttons,
+      play_sound,
+      update_rumble,
+      NULL,
+      GBC_FB_CGB15
+    };
+
+  static GBCu8 bios[0x900];
+
+  GBC_Machine *m;
+  GBC_Rom rom;
+  GBC_Error err;
+  GBC_Bool stop, jit, idle, deferred;
+  GBC_LCDRenderMode render_mode;
+  const char *bios_fname;
+  double t0, t;
+  int arg, ret, i;
+  GBCu64 cc, max_cc;
+  GBCu32 reads[128], writes[128];
+  unsigned long unmapped;
+
+
+  /* Arguments. */
+  arg= 1;
+  bios_fname= NULL;
+  jit= GBC_FALSE;
+  idle= GBC_TRUE;
+  deferred= GBC_FALSE;
+  render_mode= GBC_LCD_RENDER_INLINE;
+  _frameskip= 0;
+  if ( argc > arg+1 && !strcmp ( argv[arg], "-b" ) )
+    {
+      bios_fname= argv[arg+1];
+      arg+= 2;
+    }
+  if ( argc > arg && !strcmp ( argv[arg], "-J" ) )
+    {
+      jit= GBC_TRUE;
+      ++arg;
+    }
+  if ( argc > arg && !strcmp ( argv[arg], "-I" ) )
+    {
+      idle= GBC_FALSE;
+      ++arg;
+    }
+  if ( argc > arg+1 && !strcmp ( argv[arg], "-S" ) )
+    {
+      _frameskip= atoi ( argv[arg+1] );
+      arg+= 2;
+    }
+  if ( argc > arg && !strcmp ( argv[arg], "-D" ) )
+    {
+      deferred= GBC_TRUE;
+      ++arg;
+    }
+  if ( argc > arg && !strcmp ( argv[arg], "-T" ) )
+    {
+      render_mode= GBC_LCD_RENDER_THREAD;
+      ++arg;
+    }
+  else if ( argc > arg && !strcmp ( argv[arg], "-C" ) )
+    {
+      render_mode= GBC_LCD_RENDER_THREAD_CHECK;
+      ++arg;
+    }
+  if ( argc-arg < 1 || argc-arg > 2 )
+    {
+      usage ( argv[0] );
+      return EXIT_FAILURE;
+    }
+  _target= argc-arg == 2 ? atoi ( argv[arg+1] ) : DEFAULT_FRAMES;
+  if ( _target <= 0 || _frameskip < 0 )
+    {
+      usage ( argv[0] );
+      return EXIT_FAILURE;
+    }
+
+  /* Carrega. */
+  if ( bios_fname != NULL && load_file ( bios_fname, bios, 0x900 ) != 0 )
+    {
+      fprintf ( stderr, "Cannot load BIOS '%s'\n", bios_fname );
+      return EXIT_FAILURE;
+    }
+  if ( load_rom ( argv[arg], &rom ) != 0 )
+    {
+      fprintf ( stderr, "Cannot load ROM '%s'\n", argv[arg] );
+      return EXIT_FAILURE;
+    }
+  if ( (m= GBC_machine_new ()) == NULL )
+    {
+      fprintf ( stderr, "Cannot allocate machine\n" );
+      GBC_rom_free ( rom );
+      return EXIT_FAILURE;
+    }
+
+  /* Executa. */
+  ret= EXIT_FAILURE;
+  _frames= 0;
+  _identical= 0;
+  _eram= NULL;
+  err= GBC_init ( m, bios_fname!=NULL ? bios : NULL, &rom, &frontend, NULL );
+  if ( err != GBC_NOERROR )
+    {
+      fprintf ( stderr, "Cannot initialize simulator: error %d\n",
+        	(int) err );
+      goto end;
+    }
+  if ( jit && GBC_cpu_set_jit ( m, GBC_JIT_ON ) != 0 )
+    {
+      fprintf ( stderr, "Cannot enable the dynamic recompiler\n" );
+      goto end;
+    }
+  GBC_cpu_set_idle_skip ( m, idle );
+  GBC_lcd_set_frameskip ( m, _frameskip );
+  GBC_lcd_set_deferred ( m, deferred );
+  if ( GBC_lcd_set_render_mode ( m, render_mode ) != 0 )
+    {
+      fprintf ( stderr, "Cannot start the render thread\n" );
+      goto end;
+    }
+  stop= GBC_FALSE;
+  cc= 0;
+  max_cc= ((GBCu64) _target)*GBC_BATCH_FRAME_CC;
+  t0= get_time ();
+  while ( _frames < _target && !stop && cc < max_cc )
+    cc+= (GBCu64) GBC_iter ( m, &stop );
+  t= get_time () - t0;
+  if ( _frames < _target )
+    fprintf ( stderr, "Stopped after %d frames (%llu cycles)\n",
+        	_frames, (unsigned long long) cc );
+  printf ( "frames: %d\n", _frames );
+  printf ( "time: %.3f s\n", t );
+  printf ( "fps: %.1f\n", t > 0.0 ? _frames/t : 0.0 );
+  printf ( "fb_hash: %08x\n", (unsigned) _fb_hash );
+  printf ( "identical_frames: %d\n", _identical );
+  if ( render_mode == GBC_LCD_RENDER_THREAD_CHECK )
+    printf ( "render_mismatches: %llu\n",
+             (unsigned long long) GBC_lcd_get_render_mismatches ( m ) );
+  printf ( "idle_skipped: %llu\n", GBC_cpu_get_idle_skipped ( m ) );
+  GBC_mem_get_io_unmapped ( m, reads, writes );
+  for ( unmapped= 0, i= 0; i < 128; ++i )
+    unmapped+= (unsigned long) reads[i] + writes[i];
+  printf ( "io_unmapped: %lu\n", unmapped );
+  ret= _frames >= _target ? EXIT_SUCCESS : EXIT_FAILURE;
+
+ end:
+  GBC_machine_free ( m );
+  GBC_rom_free ( rom );
+  if ( _eram != NULL ) free ( _eram );
+
+  return ret;
+
+} /* end main */